@@ -0,0 +1,189 @@
+#include <stdlib.h>
+
+#include <corrosion/core.h>
+#include <corrosion/maths.h>
+#include <corrosion/thread.h>
+#include <corrosion/timer.h>
+
+#include "bench.h"
+
+/* Churns the allocator the way the engine does: Each thread keeps a set of
+ * live blocks and over and over frees a random one and allocates a block
+ * of random size in its place. The same sequence of sizes is run against
+ * malloc and against core_alloc, on one thread and on several.
+ *
+ * core_alloc is the pool allocator in release builds, unless the library
+ * was built with cr_no_pool_alloc, and the tracking allocator in debug
+ * builds, so only release numbers are worth comparing. */
+
+#define churn_slots    4096
+#define churn_min_size 8
+#define churn_max_size 508
+
+struct churn {
+	bool use_malloc;
+	u64 ops;
+	u64 seed;
+
+	void** slots;
+};
+
+static u64 next_random(u64* state) {
+	u64 x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+/* Leaves the last blocks allocated, so that the pool's occupancy can be
+ * looked at; See free_churn. */
+static void run_churn(struct churn* churn) {
+	u64 state = churn->seed;
+
+	for (u64 i = 0; i < churn->ops; i++) {
+		u64 r = next_random(&state);
+
+		usize slot = (usize)(r % churn_slots);
+		usize size = churn_min_size + (usize)((r >> 32) % (churn_max_size - churn_min_size + 1));
+
+		if (churn->use_malloc) {
+			free(churn->slots[slot]);
+			churn->slots[slot] = malloc(size);
+		} else {
+			core_free(churn->slots[slot]);
+			churn->slots[slot] = core_alloc(size);
+		}
+
+		/* Touches the block, as any real user would. */
+		*(u8*)churn->slots[slot] = (u8)r;
+	}
+}
+
+static void free_churn(struct churn* churn) {
+	for (usize i = 0; i < churn_slots; i++) {
+		if (churn->use_malloc) {
+			free(churn->slots[i]);
+		} else {
+			core_free(churn->slots[i]);
+		}
+
+		churn->slots[i] = null;
+	}
+}
+
+static void churn_worker(struct thread* thread) {
+	struct churn* churn = get_thread_uptr(thread);
+
+	run_churn(churn);
+	free_churn(churn);
+
+	if (!churn->use_malloc) {
+		alloc_thread_deinit();
+	}
+}
+
+/* Returns millions of operations per second over all of the threads. */
+static f64 churn_threads(bool use_malloc, u32 thread_count, u64 ops) {
+	struct thread* threads = calloc(thread_count, sizeof *threads);
+	struct churn* churns = calloc(thread_count, sizeof *churns);
+
+	for (u32 i = 0; i < thread_count; i++) {
+		churns[i] = (struct churn) {
+			.use_malloc = use_malloc,
+			.ops = ops,
+			.seed = 0x9e3779b97f4a7c15ull * (i + 1),
+			.slots = calloc(churn_slots, sizeof(void*))
+		};
+
+		init_thread(threads + i, churn_worker);
+		set_thread_uptr(threads + i, churns + i);
+	}
+
+	u64 start = get_timer();
+
+	for (u32 i = 0; i < thread_count; i++) {
+		thread_execute(threads + i);
+	}
+
+	for (u32 i = 0; i < thread_count; i++) {
+		thread_join(threads + i);
+		deinit_thread(threads + i);
+	}
+
+	f64 seconds = bench_seconds(start);
+
+	for (u32 i = 0; i < thread_count; i++) {
+		free(churns[i].slots);
+	}
+
+	free(churns);
+	free(threads);
+
+	return (f64)(ops * thread_count) / seconds / 1000000.0;
+}
+
+static void report_class_usage() {
+	struct alloc_class_usage usage[alloc_class_count];
+	core_get_class_usage(usage);
+
+	info("Pool occupancy with %d blocks live:", churn_slots);
+
+	for (u32 i = 0; i < alloc_class_count; i++) {
+		if (usage[i].block_size == 0) { continue; }
+
+		info("  %5zu bytes: %6zu used of %6zu reserved", usage[i].block_size,
+			usage[i].blocks_used, usage[i].blocks_reserved);
+	}
+}
+
+i32 bench_alloc(i32 argc, const char** argv) {
+	u64 ops = 4000000;
+	u32 thread_count = cr_min(get_processor_count(), 4);
+
+	if (argc > 0) {
+		ops = strtoull(argv[0], null, 10);
+	}
+
+	if (argc > 1) {
+		thread_count = (u32)strtoul(argv[1], null, 10);
+	}
+
+	if (ops == 0 || thread_count == 0) {
+		error("Usage: bench alloc [operations per thread] [threads]");
+		return 1;
+	}
+
+#ifdef debug
+	warning("This is a debug build, so core_alloc is the tracking allocator.");
+#endif
+
+	info("Churn of %d..%d byte blocks, %d live per thread, %llu operations per thread:",
+		churn_min_size, churn_max_size, churn_slots, (unsigned long long)ops);
+
+	u32 counts[] = { 1, thread_count };
+
+	for (usize i = 0; i < (thread_count > 1 ? 2 : 1); i++) {
+		f64 with_malloc = churn_threads(true,  counts[i], ops);
+		f64 with_core   = churn_threads(false, counts[i], ops);
+
+		info("  %2u thread%s  malloc %7.2f Mops/s  core_alloc %7.2f Mops/s",
+			counts[i], counts[i] == 1 ? " " : "s", with_malloc, with_core);
+	}
+
+	/* Once more on this thread, to see how full the size classes are with
+	 * a typical spread of live blocks. */
+	struct churn churn = {
+		.ops = ops,
+		.seed = 1,
+		.slots = calloc(churn_slots, sizeof(void*))
+	};
+
+	run_churn(&churn);
+	report_class_usage();
+	free_churn(&churn);
+
+	free(churn.slots);
+
+	return 0;
+}
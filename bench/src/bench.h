@@ -0,0 +1,16 @@
+#pragma once
+
+#include <corrosion/common.h>
+
+/* Each benchmark is a subcommand of the bench program. They get the
+ * arguments following their name and return the exit code. */
+i32 bench_hash(i32 argc, const char** argv);
+i32 bench_alloc(i32 argc, const char** argv);
+i32 bench_load(i32 argc, const char** argv);
+i32 bench_dtable(i32 argc, const char** argv);
+
+/* Seconds since start, which is a get_timer value. */
+f64 bench_seconds(u64 start);
+
+/* Keeps the compiler from optimising away work whose result is unused. */
+extern volatile u64 bench_sink;
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <corrosion/core.h>
+#include <corrosion/dtable.h>
+#include <corrosion/res.h>
+#include <corrosion/timer.h>
+
+#include "bench.h"
+
+/* Measures how fast dtables are read: parsed into a tree of dtables, which
+ * copies every key and string, parsed into a read-only document, and
+ * decoded from the binary encoding of the same table.
+ *
+ * The text is either a file or one that is made up on the spot, of many
+ * entities with a bit of every kind of value, much like a level would be. */
+
+#define parse_rounds 64
+#define parse_time_limit 1.0
+
+static const char* binary_path = "bench_dtable.dtb";
+
+static char* make_text(usize entity_count) {
+	usize cap = entity_count * 512 + 1;
+	char* text = core_alloc(cap);
+	usize len = 0;
+
+	for (usize i = 0; i < entity_count; i++) {
+		len += (usize)snprintf(text + len, cap - len,
+			"entity_%zu = {\n"
+			"\tname = \"Crate number %zu\";\n"
+			"\tmodel = \"res/meshes/props/crate_%03zu.fbx\";\n"
+			"\thealth = %zu;\n"
+			"\tmass = %zu.25;\n"
+			"\tstatic = %s;\n"
+			"\tposition = v3(%zu.5, 0.0, -%zu.75);\n"
+			"\tscale = v2(1.0, 2.0);\n"
+			"\ttint = colour(#cd6363);\n"
+			"\ttransform = {\n"
+			"\t\trotation = v4(0.0, 0.707, 0.0, 0.707);\n"
+			"\t\tparent = \"entity_%zu\";\n"
+			"\t}\n"
+			"}\n\n",
+			i, i, i % 1000, 100 + i % 50, i % 90, i % 3 == 0 ? "true" : "false",
+			i % 256, i % 128, i / 2);
+	}
+
+	return text;
+}
+
+static void report(const char* name, u64 start, usize bytes, usize rounds) {
+	f64 seconds = bench_seconds(start);
+
+	info("  %-24s %9.1f MiB/s  %9.3f ms per pass", name,
+		(f64)(bytes * rounds) / (1024.0 * 1024.0) / seconds, seconds * 1000.0 / (f64)rounds);
+}
+
+static bool bench_parse(const char* text, usize size) {
+	u64 start = get_timer();
+	usize rounds = 0;
+
+	do {
+		struct dtable dt = { 0 };
+		if (!parse_dtable(&dt, text)) {
+			error("Failed to parse the text.");
+			return false;
+		}
+
+		bench_sink += vector_count(dt.children);
+		deinit_dtable(&dt);
+	} while (++rounds < parse_rounds && bench_seconds(start) < parse_time_limit);
+
+	report("parse_dtable", start, size, rounds);
+
+	start = get_timer();
+	rounds = 0;
+
+	do {
+		struct dtable_doc doc;
+		if (!parse_dtable_doc(&doc, text)) {
+			error("Failed to parse the text.");
+			return false;
+		}
+
+		bench_sink += doc.root.child_count;
+		deinit_dtable_doc(&doc);
+	} while (++rounds < parse_rounds && bench_seconds(start) < parse_time_limit);
+
+	report("parse_dtable_doc", start, size, rounds);
+
+	return true;
+}
+
+static bool bench_binary(const char* text) {
+	struct dtable dt = { 0 };
+	if (!parse_dtable(&dt, text)) {
+		return false;
+	}
+
+	bool written = write_dtable_binary(&dt, binary_path);
+	deinit_dtable(&dt);
+
+	u8* data;
+	usize size;
+	if (!written || !read_raw(binary_path, &data, &size)) {
+		error("Failed to write `%s'.", binary_path);
+		remove(binary_path);
+		return false;
+	}
+
+	remove(binary_path);
+
+	u64 start = get_timer();
+	usize rounds = 0;
+	bool ok = true;
+
+	do {
+		struct dtable_doc doc;
+		if (!read_dtable_binary(&doc, data, size)) {
+			error("Failed to read the binary encoding.");
+			ok = false;
+			break;
+		}
+
+		bench_sink += doc.root.child_count;
+		deinit_dtable_doc(&doc);
+	} while (++rounds < parse_rounds && bench_seconds(start) < parse_time_limit);
+
+	if (ok) {
+		report("read_dtable_binary", start, size, rounds);
+		info("  The binary encoding is %zu bytes.", size);
+	}
+
+	core_free(data);
+
+	return ok;
+}
+
+i32 bench_dtable(i32 argc, const char** argv) {
+	usize entity_count = 20000;
+	char* text = null;
+
+	if (argc > 0) {
+		if (!read_raw_text(argv[0], &text)) {
+			error("Failed to read `%s'.", argv[0]);
+			return 1;
+		}
+	} else {
+		text = make_text(entity_count);
+	}
+
+	usize size = strlen(text);
+
+	info("%s, %zu bytes:", argc > 0 ? argv[0] : "Generated entities", size);
+
+	bool ok = bench_parse(text, size) && bench_binary(text);
+
+	core_free(text);
+
+	return ok ? 0 : 1;
+}
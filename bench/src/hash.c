@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <corrosion/core.h>
+#include <corrosion/maths.h>
+#include <corrosion/timer.h>
+
+#include "bench.h"
+
+/* Compares elf_hash with hash_bytes as the hash of string keyed tables, and
+ * string keys with keys whose hash is worked out once up front
+ * (hashed_string) and with interned keys, which are hashed by pointer.
+ *
+ * Collision chains are measured by replaying the table's own probing: The
+ * hashes are placed into a model of the control bytes the way table_set
+ * places them, then each key is looked up again, counting the groups that
+ * are probed and the keys that have to be compared before it is found. */
+
+/* Each measurement makes up to this many passes over the keys, but stops
+ * after the first pass that ends past the time limit, since lookups that
+ * degrade into long chains can be thousands of times slower. */
+#define lookup_rounds 16
+#define lookup_time_limit 1.0
+
+typedef table(const char*, u32) string_table;
+
+static u64 elf_hash_string(const u8* data, usize size) {
+	const char* str = *(const char**)data;
+	return elf_hash((const u8*)str, strlen(str));
+}
+
+static u64 hash_bytes_string(const u8* data, usize size) {
+	const char* str = *(const char**)data;
+	return hash_bytes((const u8*)str, strlen(str));
+}
+
+static i32 compare_u64(const void* a, const void* b) {
+	u64 x = *(const u64*)a, y = *(const u64*)b;
+	return x < y ? -1 : x > y;
+}
+
+struct chain_stats {
+	f64 mean_groups, mean_compares;
+	usize max_groups, max_compares;
+	usize full_collisions;
+};
+
+static void measure_chains(const u64* hashes, usize count, struct chain_stats* stats) {
+	memset(stats, 0, sizeof *stats);
+
+	usize capacity = table_group_size;
+	while ((f64)count > (f64)capacity * table_load_factor) {
+		capacity *= 2;
+	}
+
+	usize mask = capacity / table_group_size - 1;
+
+	u8* ctrl = core_alloc(capacity);
+	usize* owners = core_alloc(capacity * sizeof *owners);
+	memset(ctrl, table_ctrl_empty, capacity);
+
+	for (usize i = 0; i < count; i++) {
+		usize group = (usize)(hashes[i] >> 7) & mask;
+
+		for (usize stride = 1;; group = (group + stride++) & mask) {
+			usize slot = group * table_group_size;
+			usize end = slot + table_group_size;
+
+			while (slot < end && ctrl[slot] != table_ctrl_empty) { slot++; }
+
+			if (slot < end) {
+				ctrl[slot] = (u8)(hashes[i] & 0x7f);
+				owners[slot] = i;
+				break;
+			}
+		}
+	}
+
+	usize total_groups = 0, total_compares = 0;
+
+	for (usize i = 0; i < count; i++) {
+		u8 h2 = (u8)(hashes[i] & 0x7f);
+		usize group = (usize)(hashes[i] >> 7) & mask;
+		usize groups = 0, compares = 0;
+		bool found = false;
+
+		for (usize stride = 1; !found; group = (group + stride++) & mask) {
+			groups++;
+
+			for (usize slot = group * table_group_size; slot < (group + 1) * table_group_size; slot++) {
+				if (ctrl[slot] != h2) { continue; }
+
+				compares++;
+				if (owners[slot] == i) {
+					found = true;
+					break;
+				}
+			}
+		}
+
+		total_groups += groups;
+		total_compares += compares;
+		stats->max_groups = cr_max(stats->max_groups, groups);
+		stats->max_compares = cr_max(stats->max_compares, compares);
+	}
+
+	stats->mean_groups = (f64)total_groups / (f64)count;
+	stats->mean_compares = (f64)total_compares / (f64)count;
+
+	/* The keys are all different, so equal hashes are real collisions that
+	 * no amount of probing can tell apart without comparing the keys. */
+	u64* sorted = core_alloc(count * sizeof *sorted);
+	memcpy(sorted, hashes, count * sizeof *sorted);
+	qsort(sorted, count, sizeof *sorted, compare_u64);
+
+	for (usize i = 1; i < count; i++) {
+		stats->full_collisions += sorted[i] == sorted[i - 1];
+	}
+
+	core_free(sorted);
+	core_free(owners);
+	core_free(ctrl);
+}
+
+static void bench_hash_function(const char* name, u64 (*hash)(const u8*, usize), char** keys, usize count) {
+	u64* hashes = core_alloc(count * sizeof *hashes);
+	usize bytes = 0;
+
+	for (usize i = 0; i < count; i++) {
+		usize len = strlen(keys[i]);
+		hashes[i] = hash((const u8*)keys[i], len);
+		bytes += len;
+	}
+
+	u64 start = get_timer();
+	u64 sink = 0;
+
+	usize rounds = 0;
+
+	do {
+		for (usize i = 0; i < count; i++) {
+			sink += hash((const u8*)keys[i], strlen(keys[i]));
+		}
+	} while (++rounds < lookup_rounds && bench_seconds(start) < lookup_time_limit);
+
+	f64 seconds = bench_seconds(start);
+	bench_sink += sink;
+
+	struct chain_stats stats;
+	measure_chains(hashes, count, &stats);
+
+	info("  %-10s %9.1f MiB/s  groups probed %.3f (max %zu)  keys compared %.3f (max %zu)  equal hashes %zu",
+		name, (f64)(bytes * rounds) / (1024.0 * 1024.0) / seconds,
+		stats.mean_groups, stats.max_groups, stats.mean_compares, stats.max_compares, stats.full_collisions);
+
+	core_free(hashes);
+}
+
+static void report_lookups(const char* name, u64 start, usize count, usize rounds) {
+	f64 seconds = bench_seconds(start);
+
+	info("  %-44s %8.2f M lookups/s", name, (f64)(count * rounds) / seconds / 1000000.0);
+}
+
+/* Lookups are made with copies of the keys, as they would be coming from
+ * elsewhere, so that comparing them can't shortcut on equal pointers. */
+static void bench_string_lookups(const char* name, table_hash_fun hash, char** keys, char** probes, usize count) {
+	string_table t = { .hash = hash, .compare = table_compare_string };
+
+	for (usize i = 0; i < count; i++) {
+		table_set(t, keys[i], (u32)i);
+	}
+
+	u64 start = get_timer();
+	u64 sink = 0;
+
+	usize rounds = 0;
+
+	do {
+		for (usize i = 0; i < count; i++) {
+			sink += *(u32*)table_get(t, probes[i]);
+		}
+	} while (++rounds < lookup_rounds && bench_seconds(start) < lookup_time_limit);
+
+	report_lookups(name, start, count, rounds);
+	bench_sink += sink;
+
+	free_table(t);
+}
+
+static void bench_hashed_lookups(char** keys, char** probes, usize count) {
+	table(struct hashed_string, u32) t = {
+		.hash    = table_hash_hashed_string,
+		.compare = table_compare_hashed_string
+	};
+
+	struct hashed_string* hashed = core_alloc(count * sizeof *hashed);
+
+	for (usize i = 0; i < count; i++) {
+		table_set(t, make_hashed_string(keys[i]), (u32)i);
+		hashed[i] = make_hashed_string(probes[i]);
+	}
+
+	u64 start = get_timer();
+	u64 sink = 0;
+
+	usize rounds = 0;
+
+	do {
+		for (usize i = 0; i < count; i++) {
+			sink += *(u32*)table_get(t, hashed[i]);
+		}
+	} while (++rounds < lookup_rounds && bench_seconds(start) < lookup_time_limit);
+
+	report_lookups("hashed_string, hashed up front", start, count, rounds);
+	bench_sink += sink;
+
+	core_free(hashed);
+	free_table(t);
+}
+
+static void bench_interned_lookups(char** keys, char** probes, usize count) {
+	string_table t = { 0 };
+
+	const char** handles = core_alloc(count * sizeof *handles);
+
+	for (usize i = 0; i < count; i++) {
+		handles[i] = intern_string(keys[i]);
+		table_set(t, handles[i], (u32)i);
+	}
+
+	u64 start = get_timer();
+	u64 sink = 0;
+
+	usize rounds = 0;
+
+	do {
+		for (usize i = 0; i < count; i++) {
+			sink += *(u32*)table_get(t, handles[i]);
+		}
+	} while (++rounds < lookup_rounds && bench_seconds(start) < lookup_time_limit);
+
+	report_lookups("interned, handle kept by the caller", start, count, rounds);
+
+	start = get_timer();
+
+	rounds = 0;
+
+	do {
+		for (usize i = 0; i < count; i++) {
+			sink += *(u32*)table_get(t, lookup_interned_string(probes[i]));
+		}
+	} while (++rounds < lookup_rounds && bench_seconds(start) < lookup_time_limit);
+
+	report_lookups("interned, lookup_interned_string each time", start, count, rounds);
+	bench_sink += sink;
+
+	core_free(handles);
+	free_table(t);
+}
+
+static void bench_key_set(const char* name, const char* format, usize count) {
+	char** keys = core_alloc(count * sizeof *keys);
+	char** probes = core_alloc(count * sizeof *probes);
+
+	char buffer[256];
+
+	for (usize i = 0; i < count; i++) {
+		snprintf(buffer, sizeof buffer, format, (u32)(i / 256), (u32)i);
+		keys[i] = copy_string(buffer);
+		probes[i] = copy_string(buffer);
+	}
+
+	info("%s, %zu keys, e.g. `%s':", name, count, keys[count / 2]);
+
+	bench_hash_function("elf_hash", elf_hash, keys, count);
+	bench_hash_function("hash_bytes", hash_bytes, keys, count);
+
+	bench_string_lookups("const char*, elf_hash", elf_hash_string, keys, probes, count);
+	bench_string_lookups("const char*, hash_bytes", hash_bytes_string, keys, probes, count);
+	bench_hashed_lookups(keys, probes, count);
+	bench_interned_lookups(keys, probes, count);
+
+	for (usize i = 0; i < count; i++) {
+		core_free(keys[i]);
+		core_free(probes[i]);
+	}
+
+	core_free(keys);
+	core_free(probes);
+}
+
+i32 bench_hash(i32 argc, const char** argv) {
+	usize count = 1 << 16;
+
+	if (argc > 0) {
+		count = (usize)strtoull(argv[0], null, 10);
+		if (count == 0) {
+			error("Invalid key count `%s'.", argv[0]);
+			return 1;
+		}
+	}
+
+	bench_key_set("Short identifiers", "u%u_%u", count);
+	bench_key_set("Resource paths", "res/textures/level_%03u/props/crate_%06u.png", count);
+
+	return 0;
+}
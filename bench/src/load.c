@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <corrosion/core.h>
+#include <corrosion/job.h>
+#include <corrosion/res.h>
+#include <corrosion/timer.h>
+
+#include "bench.h"
+
+/* Loads a set of files, by default the sandbox's and the demos' assets, one
+ * at a time and in batches, both through the resource manager and straight
+ * from disk, each cold and warm.
+ *
+ * A cold pass first drops the files from the page cache, which only works
+ * on Linux; Elsewhere, both passes are warm. The resources are of a type
+ * that does nothing with the data and has a budget of zero, so that they
+ * are unloaded again as soon as a pass has released them.
+ *
+ * The default paths are relative to the repository's root, which is where
+ * the program should be run from without arguments. */
+
+static const char* default_paths[] = {
+	"sbox/res",
+	"sbox/test.dt",
+	"demos/3d/meshes",
+	"demos/blur/textures",
+	"demos/voxel/res",
+	"demos/ui/stylesheet.dt"
+};
+
+static const char* bench_type = "bench file";
+
+static vector(char*) files;
+static usize file_bytes;
+
+static void add_path(const char* path) {
+	struct file_info info;
+	if (!get_file_info(path, &info)) {
+		warning("`%s' doesn't exist.", path);
+		return;
+	}
+
+	if (info.type != file_directory) {
+		vector_push(files, copy_string(path));
+		return;
+	}
+
+	struct dir_iter* it = new_dir_iter(path);
+	if (!it) {
+		warning("Failed to read directory `%s'.", path);
+		return;
+	}
+
+	/* The iterator's entry is only valid if the directory isn't empty. */
+	if (dir_iter_cur(it)->iter) {
+		do {
+			add_path(dir_iter_cur(it)->name);
+		} while (dir_iter_next(it));
+	}
+
+	free_dir_iter(it);
+}
+
+static void evict_files() {
+#ifdef __linux__
+	for (usize i = 0; i < vector_count(files); i++) {
+		i32 fd = open(files[i], O_RDONLY);
+		if (fd < 0) { continue; }
+
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+#endif
+}
+
+static void bench_file_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
+	*(usize*)payload = raw_size;
+}
+
+static void bench_file_on_unload(void* payload, usize payload_size) {}
+
+static void load_read_raw(struct resource* resources) {
+	for (usize i = 0; i < vector_count(files); i++) {
+		u8* data;
+		usize size;
+
+		if (read_raw(files[i], &data, &size)) {
+			bench_sink += size;
+			core_free(data);
+		}
+	}
+}
+
+static void on_batch_read(usize index, u8* data, usize size, void* uptr) {
+	if (data) {
+		bench_sink += size;
+		core_free(data);
+	}
+}
+
+static void load_read_file_batch(struct resource* resources) {
+	read_file_batch((const char**)files, vector_count(files), on_batch_read, null);
+}
+
+static void load_res(struct resource* resources) {
+	for (usize i = 0; i < vector_count(files); i++) {
+		resources[i] = res_load(bench_type, files[i], null);
+	}
+}
+
+static void load_res_async(struct resource* resources) {
+	for (usize i = 0; i < vector_count(files); i++) {
+		resources[i] = res_load_async(bench_type, files[i], null);
+	}
+
+	for (usize i = 0; i < vector_count(files); i++) {
+		res_wait(resources + i);
+	}
+}
+
+static void load_res_batch(struct resource* resources) {
+	res_load_batch_async(bench_type, (const char**)files, vector_count(files), null, resources);
+
+	for (usize i = 0; i < vector_count(files); i++) {
+		res_wait(resources + i);
+	}
+}
+
+static f64 time_pass(void (*load)(struct resource*), struct resource* resources, bool cold) {
+	memset(resources, 0, vector_count(files) * sizeof *resources);
+
+	if (cold) {
+		evict_files();
+	}
+
+	u64 start = get_timer();
+	load(resources);
+	f64 seconds = bench_seconds(start);
+
+	for (usize i = 0; i < vector_count(files); i++) {
+		if (resources[i].id) {
+			bench_sink += *(usize*)resources[i].payload;
+			res_unload(resources + i);
+		}
+	}
+
+	return seconds;
+}
+
+static void bench_method(const char* name, void (*load)(struct resource*), struct resource* resources) {
+	f64 cold = time_pass(load, resources, true);
+	f64 warm = time_pass(load, resources, false);
+
+	f64 mib = (f64)file_bytes / (1024.0 * 1024.0);
+
+	info("  %-32s cold %8.2f ms %8.1f MiB/s  warm %8.2f ms %8.1f MiB/s",
+		name, cold * 1000.0, mib / cold, warm * 1000.0, mib / warm);
+}
+
+i32 bench_load(i32 argc, const char** argv) {
+	if (argc > 0) {
+		for (i32 i = 0; i < argc; i++) {
+			add_path(argv[i]);
+		}
+	} else {
+		for (usize i = 0; i < sizeof default_paths / sizeof *default_paths; i++) {
+			add_path(default_paths[i]);
+		}
+	}
+
+	if (vector_count(files) == 0) {
+		error("No files to load.");
+		free_vector(files);
+		return 1;
+	}
+
+	for (usize i = 0; i < vector_count(files); i++) {
+		u8* data;
+		usize size;
+
+		if (read_raw(files[i], &data, &size)) {
+			file_bytes += size;
+			core_free(data);
+		}
+	}
+
+#ifndef __linux__
+	warning("Files can't be dropped from the cache on this platform, so cold passes are warm.");
+#endif
+
+	jobs_init(0);
+	res_init("bench");
+
+	reg_res_type(bench_type, &(struct res_config) {
+		.payload_size = sizeof(usize),
+		.free_raw_on_load = true,
+		.budget = 0,
+		.on_load = bench_file_on_load,
+		.on_unload = bench_file_on_unload
+	});
+
+	struct resource* resources = core_alloc(vector_count(files) * sizeof *resources);
+
+	info("%zu files, %.2f MiB:", vector_count(files), (f64)file_bytes / (1024.0 * 1024.0));
+
+	bench_method("read_raw, one at a time",   load_read_raw,        resources);
+	bench_method("read_file_batch",           load_read_file_batch, resources);
+	bench_method("res_load, one at a time",   load_res,             resources);
+	bench_method("res_load_async, res_wait",  load_res_async,       resources);
+	bench_method("res_load_batch_async",      load_res_batch,       resources);
+
+	core_free(resources);
+
+	res_deinit();
+	jobs_deinit();
+
+	for (usize i = 0; i < vector_count(files); i++) {
+		core_free(files[i]);
+	}
+
+	free_vector(files);
+
+	return 0;
+}
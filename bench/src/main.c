@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include <corrosion/core.h>
+#include <corrosion/timer.h>
+
+#include "bench.h"
+
+/* Usage: bench benchmark [arguments...]
+ *
+ * Runs one of the benchmarks below and logs its results. Build in the
+ * release configuration for meaningful numbers. */
+
+volatile u64 bench_sink;
+
+static const struct {
+	const char* name;
+	i32 (*run)(i32 argc, const char** argv);
+	const char* usage;
+} benchmarks[] = {
+	{ "hash",   bench_hash,   "hash [key count]" },
+	{ "alloc",  bench_alloc,  "alloc [operations per thread] [threads]" },
+	{ "load",   bench_load,   "load [files and directories...]" },
+	{ "dtable", bench_dtable, "dtable [file]" }
+};
+
+f64 bench_seconds(u64 start) {
+	return (f64)(get_timer() - start) / (f64)get_timer_frequency();
+}
+
+i32 main(i32 argc, const char** argv) {
+	if (argc < 2) {
+		error("Usage: %s benchmark [arguments...]", argv[0]);
+
+		for (usize i = 0; i < sizeof benchmarks / sizeof *benchmarks; i++) {
+			info("  %s", benchmarks[i].usage);
+		}
+
+		return 1;
+	}
+
+	for (usize i = 0; i < sizeof benchmarks / sizeof *benchmarks; i++) {
+		if (strcmp(argv[1], benchmarks[i].name) == 0) {
+			alloc_init();
+			string_pool_init();
+			init_timer();
+
+			i32 result = benchmarks[i].run(argc - 2, argv + 2);
+
+			string_pool_deinit();
+			frame_arena_deinit();
+			leak_check();
+			alloc_deinit();
+
+			return result;
+		}
+	}
+
+	error("Unknown benchmark `%s'.", argv[1]);
+	return 1;
+}
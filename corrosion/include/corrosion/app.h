@@ -23,6 +23,10 @@ struct app_config {
 	const char* name;
 	struct video_config video_config;
 	struct window_config window_config;
+
+	/* Where decoded resources are cached between runs, see
+	 * res_set_cook_dir. Null disables the cache. */
+	const char* cook_dir;
 };
 
 #ifdef cr_entrypoint
@@ -30,6 +34,7 @@ struct app_config {
 #include "window.h"
 #include "res.h"
 #include "gizmo.h"
+#include "job.h"
 #include "timer.h"
 
 void reconfigure_app(struct app_config config);
@@ -56,6 +61,11 @@ void __cr_app_update() {
 	table_lookup_count = 0;
 	heap_allocation_count = 0;
 
+	frame_arena_reset();
+	alloc_profiler_new_frame();
+
+	res_update();
+
 	update_events();
 
 	video.begin(true);
@@ -80,6 +90,14 @@ static bool run(i32 argc, const char** argv) {
 
 	res_init(argv[0]);
 
+#ifdef debug
+	res_enable_hot_reload(true);
+#endif
+
+	if (cfg->cook_dir) {
+		res_set_cook_dir(cfg->cook_dir);
+	}
+
 	init_video(&cfg->video_config);
 
 	gizmos_init();
@@ -119,6 +137,8 @@ void reconfigure_app(struct app_config config) {
 
 i32 main(i32 argc, const char** argv) {
 	alloc_init();
+	string_pool_init();
+	jobs_init(0);
 
 #ifndef __EMSCRIPTEN__
 	want_reconfigure = false;
@@ -134,6 +154,10 @@ i32 main(i32 argc, const char** argv) {
 	run(argc, argv);
 #endif
 
+	jobs_deinit();
+	string_pool_deinit();
+	frame_arena_deinit();
+
 	leak_check();
 
 	alloc_deinit();
@@ -11,6 +11,12 @@
  * to be accessed by an atlas, which is wasteful on memory. This
  * therefore shouldn't be used for large textures. */
 
+/* A span of the atlas' width and the height that it's filled to. */
+struct atlas_skyline_node {
+	i32 x, y;
+	i32 width;
+};
+
 struct atlas {
 	struct texture* texture;
 	v2i size;
@@ -18,6 +24,9 @@ struct atlas {
 	u32 flags;
 
 	table(const struct texture*, v4i) rects;
+
+	/* The top edge of everything that has been packed, left to right. */
+	vector(struct atlas_skyline_node) skyline;
 };
 
 struct atlas* new_atlas(u32 flags);
@@ -25,6 +34,10 @@ void free_atlas(struct atlas* atlas);
 
 void reset_atlas(struct atlas* atlas);
 
-/* Returns true if the texture was re-created. */
+/* Packs the texture in and copies it over. When it doesn't fit, the atlas
+ * doubles in size and copies what it had across on the GPU, so textures
+ * that were already added keep their rects. That replaces atlas->texture:
+ * It returns true when that happens, and anything that samples the atlas
+ * must be pointed at the new one, with video.pipeline_change_texture. */
 bool atlas_add_texture(struct atlas* atlas, const struct texture* texture);
 void atlas_update_texture(struct atlas* atlas, const struct texture* texture);
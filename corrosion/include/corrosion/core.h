@@ -15,9 +15,15 @@
 extern u32 table_lookup_count;
 extern u32 heap_allocation_count;
 
+/* hash_bytes is the default hash function used by tables and should be
+ * preferred over elf_hash, which is kept for compatibility. */
 u64 elf_hash(const u8* data, usize size);
+u64 hash_bytes(const u8* data, usize size);
 u64 hash_string(const char* str);
 
+/* Mixes two hashes into one. The order matters. */
+u64 hash_combine(u64 a, u64 b);
+
 void info(const char* fmt, ...);
 void error(const char* fmt, ...);
 void warning(const char* fmt, ...);
@@ -51,21 +57,78 @@ void* debug_core_calloc(usize count, usize size, struct alloc_code_info info);
 void* debug_core_realloc(void* ptr, usize size, struct alloc_code_info info);
 void debug_core_free(void* ptr, struct alloc_code_info info);
 
+/* Aggregate counters for every distinct core_alloc call site, only kept in
+ * debug mode. core_get_alloc_sites copies up to max sites into sites and
+ * returns the total number of sites, which may be larger than max. */
+struct alloc_site_stats {
+	const char* file;
+	u32 line;
+
+	usize live_bytes;
+	usize peak_bytes;
+	usize alloc_count;
+};
+
+/* Allocation profiler, only available in debug mode. While it's running,
+ * every call site also records how much it allocates per frame, how often
+ * it reallocates and how many frames its blocks live for, bucketed by
+ * powers of two: Bucket 0 counts blocks freed in the frame they were
+ * allocated in and bucket n counts lifetimes of [2^(n-1), 2^n) frames, with
+ * the last bucket taking everything longer.
+ *
+ * alloc_profiler_new_frame must be called once per frame; The app entry
+ * point does this. alloc_profiler_dump writes the results as CSV, or as JSON
+ * if the path ends in ".json". Setting the CR_ALLOC_PROFILE environment
+ * variable to a path starts the profiler in alloc_init and dumps to that
+ * path in leak_check. */
+#define alloc_lifetime_bucket_count 12
+
+/* In release mode, small allocations are served from per-size-class free
+ * lists (see alloc.c), unless cr_no_pool_alloc is defined. core_get_class_usage
+ * fills an array of alloc_class_count entries with the occupancy of each size
+ * class. Threads other than the main thread should call alloc_thread_deinit
+ * before they exit so that their cached blocks can be reused. */
+#define alloc_class_count    9
+#define alloc_min_class_size 16
+#define alloc_max_class_size (alloc_min_class_size << (alloc_class_count - 1))
+
+struct alloc_class_usage {
+	usize block_size;
+	usize blocks_used;
+	usize blocks_reserved;
+};
+
 void* release_core_alloc(usize size);
 void* release_core_calloc(usize count, usize size);
 void* release_core_realloc(void* ptr, usize size);
 void release_core_free(void* ptr);
 
 usize release_core_get_memory_usage();
+void release_core_get_class_usage(struct alloc_class_usage* usage);
 void release_alloc_init();
 void release_alloc_deinit();
+void release_alloc_thread_deinit();
 void release_leak_check();
 
+usize release_core_get_alloc_sites(struct alloc_site_stats* sites, usize max);
+void release_alloc_profiler_start();
+void release_alloc_profiler_stop();
+void release_alloc_profiler_new_frame();
+bool release_alloc_profiler_dump(const char* path);
+
 usize debug_core_get_memory_usage();
+void debug_core_get_class_usage(struct alloc_class_usage* usage);
 void debug_alloc_init();
 void debug_alloc_deinit();
+void debug_alloc_thread_deinit();
 void debug_leak_check();
 
+usize debug_core_get_alloc_sites(struct alloc_site_stats* sites, usize max);
+void debug_alloc_profiler_start();
+void debug_alloc_profiler_stop();
+void debug_alloc_profiler_new_frame();
+bool debug_alloc_profiler_dump(const char* path);
+
 #ifdef debug
 #define core_alloc(s_) debug_core_alloc(s_, (struct alloc_code_info) { __FILE__, __LINE__ })
 #define core_calloc(c_, s_) debug_core_calloc(c_, s_, (struct alloc_code_info) { __FILE__, __LINE__ })
@@ -73,8 +136,15 @@ void debug_leak_check();
 #define core_free(p_) debug_core_free(p_, (struct alloc_code_info) { __FILE__, __LINE__ })
 
 #define core_get_memory_usage() debug_core_get_memory_usage()
+#define core_get_class_usage(u_) debug_core_get_class_usage(u_)
+#define core_get_alloc_sites(s_, m_) debug_core_get_alloc_sites(s_, m_)
+#define alloc_profiler_start() debug_alloc_profiler_start()
+#define alloc_profiler_stop() debug_alloc_profiler_stop()
+#define alloc_profiler_new_frame() debug_alloc_profiler_new_frame()
+#define alloc_profiler_dump(p_) debug_alloc_profiler_dump(p_)
 #define alloc_init() debug_alloc_init()
 #define alloc_deinit() debug_alloc_deinit()
+#define alloc_thread_deinit() debug_alloc_thread_deinit()
 #define leak_check() debug_leak_check()
 #else
 #define core_alloc(s_) release_core_alloc(s_)
@@ -83,8 +153,15 @@ void debug_leak_check();
 #define core_free(p_) release_core_free(p_)
 
 #define core_get_memory_usage() release_core_get_memory_usage()
+#define core_get_class_usage(u_) release_core_get_class_usage(u_)
+#define core_get_alloc_sites(s_, m_) release_core_get_alloc_sites(s_, m_)
+#define alloc_profiler_start() release_alloc_profiler_start()
+#define alloc_profiler_stop() release_alloc_profiler_stop()
+#define alloc_profiler_new_frame() release_alloc_profiler_new_frame()
+#define alloc_profiler_dump(p_) release_alloc_profiler_dump(p_)
 #define alloc_init() release_alloc_init()
 #define alloc_deinit() release_alloc_deinit()
+#define alloc_thread_deinit() release_alloc_thread_deinit()
 #define leak_check() release_leak_check()
 #endif
 
@@ -92,9 +169,64 @@ void* align_address(void* address, usize alignment);
 void* aligned_core_alloc(usize size, usize alignment);
 void aligned_core_free(void* ptr);
 
+/* Linear allocator.
+ *
+ * Allocations are made by bumping a pointer and can't be freed on their own;
+ * Instead, the whole arena is reset at once. When the current block runs out
+ * a new one is chained on, and on reset the blocks are merged into a single
+ * block big enough for everything allocated since the last reset. Once the
+ * usage settles, an arena doesn't touch the heap at all.
+ *
+ * An arena may be zero-initialised, in which case it uses
+ * arena_default_block_size for its first block.
+ *
+ * Every thread has its own frame arena. The application resets the main
+ * thread's frame arena at the start of each frame, so memory from frame_alloc
+ * is only valid until the end of the current frame. Other threads should call
+ * frame_arena_reset themselves when their temporaries are no longer needed
+ * and frame_arena_deinit before they exit. */
+#define arena_default_block_size 65536
+
+struct arena_block;
+
+struct arena {
+	struct arena_block* block;
+	usize block_size;
+};
+
+void init_arena(struct arena* arena, usize block_size);
+void deinit_arena(struct arena* arena);
+void* arena_alloc(struct arena* arena, usize size);
+void* arena_realloc(struct arena* arena, void* ptr, usize old_size, usize new_size);
+void arena_reset(struct arena* arena);
+
+struct arena* get_frame_arena();
+void frame_arena_reset();
+void frame_arena_deinit();
+
+#define frame_alloc(s_) arena_alloc(get_frame_arena(), s_)
+
 /* String manipulation. */
 char* copy_string(const char* str);
 
+/* String interning.
+ *
+ * intern_string returns a pointer to a copy of the string that is unique
+ * for its contents: interning two equal strings yields the same pointer.
+ * Interned strings live until string_pool_deinit, so they can be used as
+ * table keys that are hashed and compared by pointer alone, using the
+ * default (null) hash and compare functions and no copy or free functions.
+ *
+ * lookup_interned_string returns null if the string has never been interned,
+ * which means it can't be a key in any interned table; Use it for lookups
+ * so that the pool doesn't grow with strings that are never stored.
+ *
+ * The pool is thread-safe. */
+void string_pool_init();
+void string_pool_deinit();
+const char* intern_string(const char* str);
+const char* lookup_interned_string(const char* str);
+
 /*struct type_info {
 	u64 id;
 	usize size;
@@ -113,6 +245,15 @@ char* copy_string(const char* str);
  * Keys and values can be any type. Tables should be
  * initialised to zero before use.
  *
+ * The table uses open addressing with a separate array of control
+ * bytes, one per slot. A control byte is either table_ctrl_empty,
+ * table_ctrl_deleted or, for an occupied slot, the low seven bits of
+ * the key's hash. Lookups compare a whole group of table_group_size
+ * control bytes against the hash fragment at once (using SSE2 where
+ * available) and only compare keys of slots that match it. The
+ * capacity is always a power of two and a multiple of the group
+ * size.
+ *
  * Usage example:
  *
  * table(u32, i32) test_table = { 0 };
@@ -133,7 +274,8 @@ char* copy_string(const char* str);
  * free_table(test_table);
  */
 
-#define table_load_factor 0.75
+#define table_load_factor 0.875
+#define table_group_size 16
 
 /* Takes a struct value instead of a type and gets
  * the offset of a property. */
@@ -141,8 +283,8 @@ char* copy_string(const char* str);
 	(usize)(((u8*)(&((v_).m_))) - ((u8*)(&(v_))))
 
 enum {
-	table_el_state_active = 0, /* A normal element. */
-	table_el_state_inactive    /* An element that has been deleted. */
+	table_ctrl_empty   = 0x80, /* A slot that has never been used. */
+	table_ctrl_deleted = 0xfe  /* A slot whose element has been deleted. */
 };
 
 typedef u64  (*table_hash_fun)(const u8* bytes, usize size);
@@ -164,18 +306,41 @@ inline static u8* table_copy_string(const u8* src) {
 	return (u8*)copy_string((const char*)src);
 }
 
+/* String key that carries its length and hash, so that the table never has
+ * to re-hash it when probing or resizing and mismatching keys can usually be
+ * rejected without touching the characters. Since the string pointer is the
+ * first member, table_copy_string and table_free_string can be used as the
+ * copy and free functions of a table keyed by hashed strings. */
+struct hashed_string {
+	const char* str;
+	usize len;
+	u64 hash;
+};
+
+struct hashed_string make_hashed_string(const char* str);
+
+inline static u64 table_hash_hashed_string(const u8* data, usize size) {
+	return ((const struct hashed_string*)data)->hash;
+}
+
+inline static bool table_compare_hashed_string(const u8* a, const u8* b) {
+	const struct hashed_string* sa = (const struct hashed_string*)a;
+	const struct hashed_string* sb = (const struct hashed_string*)b;
+
+	return sa->hash == sb->hash && sa->len == sb->len && memcmp(sa->str, sb->str, sa->len) == 0;
+}
+
 #define _table_el(kt_, vt_) \
 	struct { \
 		kt_ key; \
 		vt_ value; \
-		u8 state; \
-		bool isnt_null; \
 	}
 
 #define table(kt_, vt_) \
 	struct { \
 		_table_el(kt_, vt_)* entries; \
-		usize count, capacity; \
+		u8* ctrl; /* Stored in the same allocation as entries. */ \
+		usize count, deleted, capacity; \
 		\
 		/* Temporary element, key and value for assigning to
 		 * take a pointer to to allow literals to be passed
@@ -190,73 +355,70 @@ inline static u8* table_copy_string(const u8* src) {
 	}
 
 /* Internal table functions, to be called upon by the table macros. */
-void* _find_table_el(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity,
-	usize key_size, const void* key, usize key_off, usize val_off, usize state_off, usize isnt_null_off, usize* ind);
-void* _table_get(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity,
-	usize count, usize key_size, const void* key, usize key_off, usize val_off, usize state_off, usize isnt_null_off);
-void* _table_first_key(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity,
-	usize count, usize key_size, usize key_off, usize val_off, usize state_off, usize isnt_null_off);
-void* _table_next_key(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity,
-	usize count, usize key_size, const void* key, usize key_off, usize val_off, usize state_off, usize isnt_null_off);
-
-#define _table_is_el_null(t_, el_) \
-	(!*(bool*)((el_) + voffsetof((t_).e, isnt_null)))
+void _table_rehash(table_hash_fun hash, u8* els, u8* ctrl, usize capacity, const u8* old_els, const u8* old_ctrl,
+	usize old_capacity, usize el_size, usize key_size, usize key_off);
+void* _table_insert(table_hash_fun hash, table_compare_fun compare, u8* ctrl, void* els, usize el_size, usize capacity,
+	usize key_size, const void* key, usize key_off, usize* count, usize* deleted, bool* is_new);
+void* _table_remove(table_hash_fun hash, table_compare_fun compare, u8* ctrl, void* els, usize el_size, usize capacity,
+	usize key_size, const void* key, usize key_off, usize* count, usize* deleted);
+void* _table_get(table_hash_fun hash, table_compare_fun compare, const u8* ctrl, void* els, usize el_size, usize capacity,
+	usize count, usize key_size, const void* key, usize key_off, usize val_off);
+void* _table_first_key(const u8* ctrl, void* els, usize el_size, usize capacity, usize count, usize key_off);
+void* _table_next_key(table_hash_fun hash, table_compare_fun compare, const u8* ctrl, void* els, usize el_size, usize capacity,
+	usize count, usize key_size, const void* key, usize key_off);
+
+/* The control bytes are allocated together with the entries, directly
+ * after them, so that a table only ever owns a single heap block. */
+#define _table_resize_into(t_, cap_, block_) \
+	do { \
+		usize cap__ = (cap_); \
+		u8* els_ = (block_); \
+		u8* ctrl_ = els_ + cap__ * sizeof (t_).e; \
+		_table_rehash((t_).hash, els_, ctrl_, cap__, (u8*)(t_).entries, (t_).ctrl, (t_).capacity, \
+			sizeof (t_).e, sizeof (t_).k, voffsetof((t_).e, key)); \
+		(t_).entries = (void*)els_; \
+		(t_).ctrl = ctrl_; \
+		(t_).capacity = cap__; \
+		(t_).deleted = 0; \
+	} while (0)
 
 #define _table_resize(t_, cap_) \
 	do { \
-		u8* els_ = core_alloc((cap_) * sizeof (t_).e); \
-		for (usize i_ = 0; i_ < (cap_); i_++) { \
-			els_[(i_ * sizeof (t_).e) + voffsetof((t_).e, isnt_null)] = false; \
-			els_[(i_ * sizeof (t_).e) + voffsetof((t_).e, state)]     = table_el_state_active; \
-		} \
-		\
-		(t_).count = 0; \
-		for (usize i_ = 0; i_ < (t_).capacity; i_++) { \
-			u8* el_ = (((u8*)(t_).entries) + i_ * sizeof (t_).e); \
-			if (_table_is_el_null(t_, el_)) { continue; } \
-			u8* dst_ = _find_table_el((t_).hash, (t_).compare, els_, sizeof *(t_).entries, (cap_), sizeof (t_).k, \
-				el_ + voffsetof(*(t_).entries, key),\
-				voffsetof(*(t_).entries, key), voffsetof(*(t_).entries, value), voffsetof((t_).e, state), \
-				voffsetof((t_).e, isnt_null), null); \
-			memcpy(dst_ + voffsetof((t_).e, key),       el_ + voffsetof((t_).e, key),       sizeof (t_).k); \
-			memcpy(dst_ + voffsetof((t_).e, value),     el_ + voffsetof((t_).e, value),     sizeof (t_).v); \
-			memcpy(dst_ + voffsetof((t_).e, state),     el_ + voffsetof((t_).e, state),     sizeof(u8)); \
-			memcpy(dst_ + voffsetof((t_).e, isnt_null), el_ + voffsetof((t_).e, isnt_null), sizeof(bool)); \
-			(t_).count++; \
-		} \
-		if ((t_).entries) { core_free((t_).entries); } \
-		(t_).entries = (void*)els_; \
-		(t_).capacity = (cap_); \
+		void* old_els_ = (t_).entries; \
+		_table_resize_into(t_, cap_, core_alloc((cap_) * (sizeof (t_).e + 1))); \
+		if (old_els_) { core_free(old_els_); } \
 	} while (0)
 
+#define _arena_table_resize(a_, t_, cap_) \
+	_table_resize_into(t_, cap_, arena_alloc((a_), (cap_) * (sizeof (t_).e + 1)))
+
 #define free_table(t_) \
 	do { \
 		if ((t_).entries) { \
 			if ((t_).free_key) { \
 				for (usize i_ = 0; i_ < (t_).capacity; i_++) { \
-					u8* el_ = (((u8*)(t_).entries) + i_ * sizeof (t_).e); \
-					if (_table_is_el_null(t_, el_)) { continue; } \
-					(t_).free_key(el_ + voffsetof((t_).e, key)); \
+					if ((t_).ctrl[i_] & 0x80) { continue; } \
+					(t_).free_key((u8*)&(t_).entries[i_].key); \
 				} \
 			} \
 			core_free((t_).entries); \
 		} \
 	} while (0)
 
-#define table_set(t_, k_, v_) \
+/* Grows the table when it would pass the load factor. If most of the used
+ * slots are tombstones the table is instead rebuilt at the same size. */
+#define _table_set(t_, k_, v_, resize_) \
 	do { \
-		if ((t_).count >= (t_).capacity * table_load_factor) { \
-			usize new_cap_ = (t_).capacity < 8 ? 8 : (t_).capacity * 2; \
-			_table_resize((t_), new_cap_); \
+		if ((t_).count + (t_).deleted + 1 > (t_).capacity * table_load_factor) { \
+			usize new_cap_ = (t_).capacity < table_group_size ? table_group_size : \
+				(((t_).count + 1) * 2 > (t_).capacity * table_load_factor ? (t_).capacity * 2 : (t_).capacity); \
+			resize_; \
 		} \
 		(t_).k = k_; \
-		u8* el_ = _find_table_el((t_).hash, (t_).compare, (t_).entries, sizeof *(t_).entries, (t_).capacity, sizeof (t_).k, \
-			&(t_).k,\
-			voffsetof((t_).e, key), voffsetof((t_).e, value), voffsetof((t_).e, state), voffsetof((t_).e, isnt_null), null); \
-		if (_table_is_el_null(t_, el_)) { \
-			if (el_[voffsetof((t_).e, state)] == table_el_state_active) { \
-				(t_).count++; \
-			} \
+		bool is_new_; \
+		u8* el_ = _table_insert((t_).hash, (t_).compare, (t_).ctrl, (t_).entries, sizeof *(t_).entries, (t_).capacity, \
+			sizeof (t_).k, &(t_).k, voffsetof((t_).e, key), &(t_).count, &(t_).deleted, &is_new_); \
+		if (is_new_) { \
 			if ((t_).copy_key) { \
 				(t_).k = k_; \
 				u8* tk_; \
@@ -267,42 +429,43 @@ void* _table_next_key(table_hash_fun hash, table_compare_fun compare, void* els,
 			memcpy(el_ + voffsetof((t_).e, key),   &(t_).k, sizeof (t_).k); \
 		} \
 		(t_).v = (v_); \
-		el_[voffsetof((t_).e, isnt_null)] = true; \
 		memcpy(el_ + voffsetof((t_).e, value), &(t_).v, sizeof (t_).v); \
 	} while (0)
 
+#define table_set(t_, k_, v_) \
+	_table_set(t_, k_, v_, _table_resize((t_), new_cap_))
+
+/* Like table_set, but the table's storage is allocated from an arena.
+ * Tables that are only ever set this way must not be passed to free_table;
+ * They go away when the arena is reset and must be zeroed before they are
+ * used again. */
+#define arena_table_set(a_, t_, k_, v_) \
+	_table_set(t_, k_, v_, _arena_table_resize((a_), (t_), new_cap_))
+
 #define table_get(t_, k_) \
 	((t_).k = (k_), \
-		_table_get((t_).hash, (t_).compare, (t_).entries, sizeof *(t_).entries, (t_).capacity, (t_).count, sizeof (t_).k, \
-			&(t_).k,\
-			voffsetof((t_).e, key), voffsetof((t_).e, value), voffsetof((t_).e, state), voffsetof((t_).e, isnt_null)))
+		_table_get((t_).hash, (t_).compare, (t_).ctrl, (t_).entries, sizeof *(t_).entries, (t_).capacity, (t_).count, \
+			sizeof (t_).k, &(t_).k, voffsetof((t_).e, key), voffsetof((t_).e, value)))
 
 #define table_delete(t_, k_) \
 	do { \
 		if ((t_).count > 0) { \
 			(t_).k = (k_); \
-			u8* el_ = _find_table_el((t_).hash, (t_).compare, (t_).entries, sizeof *(t_).entries, (t_).capacity, sizeof (t_).k, \
-				&(t_).k,\
-				voffsetof((t_).e, key), voffsetof((t_).e, value), voffsetof((t_).e, state), voffsetof((t_).e, isnt_null), null); \
-			if (!_table_is_el_null(t_, el_)) { \
-				if ((t_).free_key) { \
-					(t_).free_key(el_ + voffsetof((t_).e, key)); \
-				} \
-				el_[voffsetof((t_).e, isnt_null)] = false; \
-				el_[voffsetof((t_).e, state)] = table_el_state_inactive; \
+			u8* el_ = _table_remove((t_).hash, (t_).compare, (t_).ctrl, (t_).entries, sizeof *(t_).entries, (t_).capacity, \
+				sizeof (t_).k, &(t_).k, voffsetof((t_).e, key), &(t_).count, &(t_).deleted); \
+			if (el_ && (t_).free_key) { \
+				(t_).free_key(el_ + voffsetof((t_).e, key)); \
 			} \
 		} \
 	} while (0)
 
 #define table_first(t_) \
-	_table_first_key((t_).hash, (t_).compare, (t_).entries, sizeof *(t_).entries, (t_).capacity, (t_).count, sizeof (t_).k, \
-			voffsetof((t_).e, key), voffsetof((t_).e, value), voffsetof((t_).e, state), voffsetof((t_).e, isnt_null))
+	_table_first_key((t_).ctrl, (t_).entries, sizeof *(t_).entries, (t_).capacity, (t_).count, voffsetof((t_).e, key))
 
 #define table_next(t_, k_) \
 	((t_).k = (k_), \
-		_table_next_key((t_).hash, (t_).compare, (t_).entries, sizeof *(t_).entries, (t_).capacity, (t_).count, sizeof (t_).k, \
-			&(t_).k, \
-			voffsetof((t_).e, key), voffsetof((t_).e, value), voffsetof((t_).e, state), voffsetof((t_).e, isnt_null)))
+		_table_next_key((t_).hash, (t_).compare, (t_).ctrl, (t_).entries, sizeof *(t_).entries, (t_).capacity, (t_).count, \
+			sizeof (t_).k, &(t_).k, voffsetof((t_).e, key)))
 
 /* Dynamic array.
  *
@@ -389,6 +552,43 @@ struct vector_header {
 		} \
 	} while (0)
 
+/* Like vector_push and vector_allocate, but growing into an arena. Vectors
+ * that are only ever grown this way must not be passed to free_vector; They
+ * go away when the arena is reset and must be set back to null before they
+ * are used again. */
+#define arena_vector_push(a_, v_, e_) \
+	do { \
+		arena_vector_allocate(a_, v_, vector_count(v_) + 1); \
+		(v_)[(((struct vector_header*)(v_)) - 1)->count++] = (e_); \
+	} while (0)
+
+#define arena_vector_allocate(a_, v_, c_) \
+	do { \
+		usize c__ = (c_); \
+		if (!(v_)) { \
+			struct vector_header h_ = { \
+				.count = 0, \
+				.capacity = c__ > vector_default_capacity ? c__ : vector_default_capacity, \
+				.element_size = sizeof(*(v_)) \
+			}; \
+			\
+			(v_) = arena_alloc((a_), sizeof(struct vector_header) + h_.element_size * h_.capacity); \
+			\
+			memcpy((v_), &h_, sizeof(struct vector_header)); \
+			\
+			(v_) = (void*)((struct vector_header*)(v_) + 1); \
+		} else { \
+			struct vector_header* h_ = ((struct vector_header*)(v_)) - 1; \
+			\
+			if (c__ > h_->capacity) { \
+				usize old_size_ = sizeof(struct vector_header) + h_->element_size * h_->capacity; \
+				while (h_->capacity < c__) { h_->capacity *= 2; } \
+				h_ = arena_realloc((a_), h_, old_size_, sizeof(struct vector_header) + h_->element_size * h_->capacity); \
+				(v_) = (void*)(h_ + 1); \
+			} \
+		} \
+	} while (0)
+
 #define vector_pop(v_) \
 	(v_) + (((((struct vector_header*)(v_)) - 1)->count--) - 1)
 
@@ -401,6 +601,14 @@ struct vector_header {
 		} \
 	} while (0)
 
+/* Drops every element from n_ onwards. n_ mustn't be past the end. */
+#define vector_truncate(v_, n_) \
+	do { \
+		if (v_) { \
+			(((struct vector_header*)(v_)) - 1)->count = (n_); \
+		} \
+	} while (0)
+
 #define vector_delete(v_, idx_) \
 	do { \
 		if (v_) { \
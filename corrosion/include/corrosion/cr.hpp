@@ -608,7 +608,9 @@ namespace corrosion {
 			filter_none   = impl::texture_flags_filter_none,
 			storage       = impl::texture_flags_storage,
 			repeat        = impl::texture_flags_repeat,
-			clamp         = impl::texture_flags_clamp
+			clamp         = impl::texture_flags_clamp,
+			mipmaps       = impl::texture_flags_mipmaps,
+			compress      = impl::texture_flags_compress
 		};
 
 		enum class Format : u32 {
@@ -624,6 +626,11 @@ namespace corrosion {
 			rgba8i  = impl::texture_format_rgba8i,
 			rgba16f = impl::texture_format_rgba16f,
 			rgba32f = impl::texture_format_rgba32f,
+			bc1     = impl::texture_format_bc1,
+			bc3     = impl::texture_format_bc3,
+			bc4     = impl::texture_format_bc4,
+			bc5     = impl::texture_format_bc5,
+			bc7     = impl::texture_format_bc7,
 			count   = impl::texture_format_count
 		};
 
@@ -662,6 +669,10 @@ namespace corrosion {
 		void copy_to(Texture& dst, v2i dst_offset, v2i src_offset, v2i region) {
 			impl::video.texture_copy(dst.as_impl(), dst_offset, as_impl(), src_offset, region);
 		}
+
+		void update(v2i offset, v2i size, const void* data) {
+			impl::video.update_texture(as_impl(), offset, size, data);
+		}
 		
 		void copy_to(Texture& dst, v3i dst_offset, v3i src_offset, v3i region) {
 			impl::video.texture_copy_3d(dst.as_impl(), dst_offset, as_impl(), src_offset, region);
@@ -1018,6 +1029,10 @@ namespace corrosion {
 		void change_shader(const Shader& shader) {
 			impl::video.pipeline_change_shader(as_impl(), shader.as_impl());
 		}
+
+		void change_texture(const char* set, const char* descriptor, const Texture& texture) {
+			impl::video.pipeline_change_texture(as_impl(), set, descriptor, texture.as_impl());
+		}
 	};
 
 	class Video {
@@ -1096,6 +1111,14 @@ namespace corrosion {
 			return reinterpret_cast<Font*>(impl::new_font(raw, raw_size, size));
 		}
 
+		static Font* create_sdf(const u8* raw, usize raw_size, f32 size) {
+			return reinterpret_cast<Font*>(impl::new_sdf_font(raw, raw_size, size));
+		}
+
+		bool is_sdf() {
+			return impl::font_is_sdf(as_impl());
+		}
+
 		void release() {
 			impl::free_font(as_impl());
 		}
@@ -1127,6 +1150,12 @@ namespace corrosion {
 		Text_Renderer(void* uptr, void (*draw_char)(void*, const Texture*, v2f, v4f, v4f)) {
 			this->uptr = uptr;
 			this->draw_character = (void (*)(void*, const impl::texture*, impl::v2f, impl::v4f, impl::v4f))draw_char;
+			this->draw_sdf_character = null;
+		}
+
+		Text_Renderer(void* uptr, void (*draw_char)(void*, const Texture*, v2f, v4f, v4f),
+			void (*draw_sdf_char)(void*, const Texture*, v2f, v2f, v4f, v4f)) : Text_Renderer(uptr, draw_char) {
+			this->draw_sdf_character = (void (*)(void*, const impl::texture*, impl::v2f, impl::v2f, impl::v4f, impl::v4f))draw_sdf_char;
 		}
 
 		void render_text(Font* font, const char* text, v2f pos, v4f col) {
@@ -1202,6 +1231,10 @@ namespace corrosion {
 			return reinterpret_cast<Font*>(impl::load_font(filename, size, r));
 		}
 
+		static Font* load_sdf_font(const char* filename, i32 size, Resource* r = null) {
+			return reinterpret_cast<Font*>(impl::load_sdf_font(filename, size, r));
+		}
+
 		static void init(const char* argv0) {
 			impl::res_init(argv0);
 		}
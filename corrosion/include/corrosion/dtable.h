@@ -88,8 +88,16 @@ struct dtable {
 	struct dtable_value value;
 
 	vector(struct dtable) children;
+
+	/* Hashed index over `children', built by the first dtable_get_child on
+	 * a table with at least dtable_index_threshold children and kept up to
+	 * date by dtable_add_child. */
+	u32* index;
+	usize index_mask;
 };
 
+#define dtable_index_threshold 16
+
 struct dtable new_dtable(const char* name);
 struct dtable new_number_dtable(const char* name, f64 value);
 struct dtable new_uinteger_dtable(const char* name, u64 value);
@@ -101,6 +109,9 @@ struct dtable new_v2_dtable(const char* name, v2f value);
 struct dtable new_v3_dtable(const char* name, v3f value);
 struct dtable new_v4_dtable(const char* name, v4f value);
 
+/* Takes over `child' and everything it owns, such as its string and its
+ * children, which are freed along with `dt'. The caller mustn't deinit
+ * `child' afterwards. */
 void dtable_add_child(struct dtable* dt, const struct dtable* child);
 
 void write_dtable(const struct dtable* dt, const char* filename);
@@ -110,4 +121,98 @@ bool parse_dtable(struct dtable* dt, const char* text);
 
 void deinit_dtable(struct dtable* dt);
 
+/* Copies the child called `key' into `dst'. The copy shares the child's
+ * string and children, so it mustn't be deinited or added to. It leaves out
+ * the child's index, so look things up in it with dtable_find_child, as
+ * dtable_get_child would build an index that nothing frees. */
 bool dtable_find_child(const struct dtable* dt, const char* key, struct dtable* dst);
+
+/* Like dtable_find_child, but returns a pointer to the child instead of a
+ * copy, or null. The pointer is valid until the next dtable_add_child on
+ * `dt'. Large tables get a hashed index on their first lookup. */
+struct dtable* dtable_get_child(struct dtable* dt, const char* key);
+
+/* Read-only documents.
+ *
+ * parse_dtable_doc reads the same syntax as parse_dtable into a tree that is
+ * cheaper to build: Every node comes out of a single arena, the children of
+ * a table sit next to each other in one array, and keys and strings are
+ * slices of the source text rather than copies. Parsing even a large file
+ * takes a handful of allocations, and deinit_dtable_doc frees them all at
+ * once.
+ *
+ * Slices aren't null-terminated, and the text must outlive the document.
+ *
+ *     struct dtable_doc doc;
+ *     if (parse_dtable_doc(&doc, source_text)) {
+ *         const struct dtable_node* a_key = dtable_node_find(&doc.root, "a_key");
+ *         const struct dtable_node* str = a_key ? dtable_node_find(a_key, "some_string") : null;
+ *         if (str && str->type == dtable_string) {
+ *             info("a_key:some_string: %.*s", (int)str->as.string.len, str->as.string.chars);
+ *         }
+ *
+ *         deinit_dtable_doc(&doc);
+ *     }
+ */
+struct dtable_slice {
+	const char* chars;
+	usize len;
+};
+
+struct dtable_node {
+	struct dtable_slice key;
+
+	u32 type;
+	u32 child_count;
+
+	union {
+		f64 number;
+		u64 uinteger;
+		bool boolean;
+		struct dtable_slice string;
+		v4f colour;
+		v2f v2;
+		v3f v3;
+		v4f v4;
+	} as;
+
+	struct dtable_node* children;
+};
+
+struct dtable_doc {
+	struct arena arena;
+
+	/* A table holding everything at the top level of the text. */
+	struct dtable_node root;
+};
+
+/* Returns zero on failure, in which case there is nothing to deinit. */
+bool parse_dtable_doc(struct dtable_doc* doc, const char* text);
+void deinit_dtable_doc(struct dtable_doc* doc);
+
+/* Returns null if `node' has no child called `key'. */
+const struct dtable_node* dtable_node_find(const struct dtable_node* node, const char* key);
+
+bool dtable_slice_eq(struct dtable_slice slice, const char* str);
+
+/* Binary encoding.
+ *
+ * write_dtable_binary stores a table in a compact form that
+ * read_dtable_binary turns into a document without parsing any text: It
+ * makes a single allocation for the nodes, and keys and strings point into
+ * `data', which must outlive the document. That makes it a good fit for
+ * map_file and read_raw_view:
+ *
+ *     struct file_map map;
+ *     struct dtable_doc doc;
+ *     if (map_file("level.dtb", &map) && read_dtable_binary(&doc, map.data, map.size)) {
+ *         ...
+ *         deinit_dtable_doc(&doc);
+ *     }
+ *
+ *     unmap_file(&map);
+ *
+ * read_dtable_binary checks every offset, so a corrupt file fails to load
+ * rather than producing a broken tree. */
+bool write_dtable_binary(const struct dtable* dt, const char* filename);
+bool read_dtable_binary(struct dtable_doc* doc, const u8* data, usize size);
@@ -25,7 +25,21 @@
  *     }
  *
  *     render_text(&tr, font, "Hello, world!", make_v2f(0.0f, 0.0f), make_rgba(0xffffff, 255));
- */
+ *
+ * Glyphs are rasterised the first time that they are drawn. The atlas
+ * handed to draw_character is single-channel (texture_format_r8i) and holds
+ * the glyph's coverage in its red channel. A font may use several atlases,
+ * but never frees one until it is deinitialised.
+ *
+ * Distance field fonts store each glyph's distance to its outline instead,
+ * once, and are scaled to the size that they're drawn at, so they stay
+ * crisp at any size or DPI scale. Every distance field font made from the
+ * same file shares one set of atlases, whatever its size, so a new size
+ * costs next to nothing. They're drawn with draw_sdf_character, which gets
+ * the size of the quad to draw as well, because it no longer matches the
+ * rect in the atlas. The atlas is filtered linearly and holds 0.5 on the
+ * outline, going to zero outside it and one inside; Thresholding it with
+ * smoothstep over about a pixel, using fwidth, gives antialiased edges. */
 
 struct font;
 
@@ -36,15 +50,49 @@ void free_font(struct font* font);
 void init_font(struct font* font, const u8* raw, usize raw_size, f32 size);
 void deinit_font(struct font* font);
 
+/* Unlike bitmap fonts, distance field fonts copy raw, which can be freed as
+ * soon as they're initialised. get_font_data returns the copy, which
+ * belongs to the font. */
+struct font* new_sdf_font(const u8* raw, usize raw_size, f32 size);
+void init_sdf_font(struct font* font, const u8* raw, usize raw_size, f32 size);
+bool font_is_sdf(const struct font* font);
+
 void* get_font_data(struct font* font);
 
+/* Different for every font that is initialised, even if it reuses the memory
+ * of one that has been freed or reloaded, so that anything cached against a
+ * font can tell that it's stale. */
+u64 get_font_id(const struct font* font);
+
 struct text_renderer {
 	void* uptr;
 
 	void (*draw_character)(void* uptr, const struct texture* atlas, v2f position, v4f rect, v4f colour);
+
+	/* Optional, for distance field fonts. */
+	void (*draw_sdf_character)(void* uptr, const struct texture* atlas, v2f position, v2f dimensions, v4f rect, v4f colour);
 };
 
 void render_text(const struct text_renderer* renderer, struct font* font, const char* text, v2f position, v4f colour);
+/* Text that has already been laid out. Each glyph's position is relative to
+ * the top left of the text. */
+struct text_glyph {
+	const struct texture* atlas;
+	v2f position;
+	v2f dimensions;
+	v4f rect;
+};
+
+/* Positions the glyphs of `text' once, so that it can be drawn again with
+ * render_text_glyphs without looking up any metrics. glyphs must have room
+ * for strlen(text) glyphs; Returns how many were written, and, if
+ * dimensions isn't null, stores the same size as get_text_dimensions.
+ * Every glyph is rasterised and uploaded straight away, so the result stays
+ * drawable for as long as the font lives. */
+usize layout_text(struct font* font, const char* text, struct text_glyph* glyphs, v2f* dimensions);
+void render_text_glyphs(const struct text_renderer* renderer, struct font* font,
+	const struct text_glyph* glyphs, usize count, v2f position, v4f colour);
+
 v2f get_char_dimensions(struct font* font, const char* c);
 v2f get_text_dimensions(struct font* font, const char* text);
 v2f get_text_n_dimensions(struct font* font, const char* text, usize n);
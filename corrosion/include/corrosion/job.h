@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+
+/* Work-stealing job system.
+ *
+ * Every worker thread, plus the thread that called jobs_init, owns a
+ * Chase-Lev deque of jobs. A thread pushes and pops jobs at the bottom of
+ * its own deque, while idle threads steal from the top of the others. Idle
+ * workers sleep on a semaphore that is signalled whenever jobs are queued.
+ *
+ * Jobs are queued on the calling thread's own deque, so only the thread
+ * that called jobs_init and the jobs themselves can spread work across the
+ * workers; Any other thread runs its jobs right away.
+ *
+ * Every job is associated with an optional counter, which is incremented
+ * when the job is queued and decremented once it has finished. job_wait
+ * executes queued jobs itself until the counter reaches zero, so waiting
+ * never wastes the calling thread and jobs can safely wait on other jobs.
+ *
+ * Workers reset their frame arena whenever they run out of work, so a job
+ * mustn't hand memory from frame_alloc to anything that outlives it. */
+
+typedef void (*job_func_t)(void* uptr);
+typedef void (*job_range_func_t)(void* uptr, usize begin, usize end);
+
+struct job {
+	job_func_t func;
+	void* uptr;
+};
+
+struct job_counter {
+	volatile i64 value;
+};
+
+/* A worker_count of zero starts one worker for each processor except the
+ * calling thread's. */
+void jobs_init(u32 worker_count);
+void jobs_deinit();
+
+u32 get_job_worker_count();
+
+void job_run(const struct job* jobs, usize count, struct job_counter* counter);
+bool job_done(struct job_counter* counter);
+void job_wait(struct job_counter* counter);
+
+/* Calls func over [0, count) in batches of at most batch_size items and
+ * waits for all of them to finish. */
+void job_parallel_for(usize count, usize batch_size, job_range_func_t func, void* uptr);
@@ -7,9 +7,15 @@
  * of each resource. res_use_pak causes read_raw and
  * read_raw_text to read from the current package.
  * Packages only support reading and batch writing.
- * Packages are in the Quake PAK format.
+ * Packages are in version two of the PAK format,
+ * which adds LZ4 compression, content hashes and
+ * deduplication, or in the original Quake format;
+ * pak_open tells them apart by the header's ID.
  *
- * The resource manager is not thread safe. */
+ * The resource manager is not thread safe, but res_load_async reads and
+ * decodes resources on the job system's worker threads. Reading from a
+ * bound package is safe from any thread, as long as it isn't unbound or
+ * closed at the same time. */
 
 enum {
 	file_normal = 0,
@@ -57,6 +63,51 @@ bool get_file_info(const char* path, struct file_info* info);
 
 bool create_dir(const char* name);
 
+/* A read-only view of a whole file, mapped into memory. */
+struct file_map {
+	const u8* data;
+	usize size;
+};
+
+bool map_file(const char* path, struct file_map* map);
+void unmap_file(struct file_map* map);
+
+/* Reads a file from start to end, asking the OS to read ahead of it. See
+ * res_stream_open for a buffered reader that also reads packages.
+ * file_reader_read returns the amount of bytes read, which is only less
+ * than size at the end of the file or on error. file_reader_seek moves
+ * relative to the current position. */
+struct file_reader;
+
+struct file_reader* new_file_reader(const char* path);
+void free_file_reader(struct file_reader* reader);
+u64 file_reader_size(const struct file_reader* reader);
+usize file_reader_read(struct file_reader* reader, void* buf, usize size);
+bool file_reader_seek(struct file_reader* reader, i64 offset);
+
+/* Reads many whole files at once, for loading lots of small files quickly.
+ * On Linux, the reads are queued together through io_uring; Elsewhere, or if
+ * io_uring is unavailable, the job system's workers read one file each with
+ * blocking calls. on_read is called for every file as soon as it has been
+ * read, with a buffer from core_alloc that it takes over, followed by a null
+ * terminator that size doesn't include. data is null if the file couldn't be
+ * read. on_read may be called from any thread, including several at once.
+ * Returns once every file has been handed to on_read. */
+void read_file_batch(const char** paths, usize count,
+	void (*on_read)(usize index, u8* data, usize size, void* uptr), void* uptr);
+
+/* Reports files that have been written to. Uses inotify on Linux and
+ * ReadDirectoryChangesW on Windows, which watch the files' directories, so
+ * polling costs a single system call when nothing has changed. Elsewhere,
+ * or if inotify is unavailable, each poll checks the modification time of
+ * one file, taking turns. Paths are reported exactly as they were added. */
+struct file_watcher;
+
+struct file_watcher* new_file_watcher();
+void free_file_watcher(struct file_watcher* watcher);
+void file_watcher_add(struct file_watcher* watcher, const char* path);
+void file_watcher_poll(struct file_watcher* watcher, void (*on_change)(const char* path, void* uptr), void* uptr);
+
 /* If a PAK archive is currently
  * bound, read_raw and read_raw_text will read from the currently
  * bound PAK archive. Otherwise, they read from a file.
@@ -66,6 +117,38 @@ bool write_raw(const char* path, const u8* buf, usize size);
 bool read_raw_text(const char* path, char** buf);
 bool write_raw_text(const char* path, const char* buf);
 
+/* Like read_raw, but returns a pointer straight into the bound PAK archive
+ * instead of a copy. The view stays valid until the archive is closed.
+ * Without a bound archive, the file is read into a buffer owned by the
+ * view. Either way, the view must be released with free_raw_view. */
+struct raw_view {
+	const u8* data;
+	usize size;
+	bool owned;
+};
+
+bool read_raw_view(const char* path, struct raw_view* view);
+void free_raw_view(struct raw_view* view);
+
+/* Reads a file a piece at a time, so that large files needn't be held in
+ * memory all at once. Loose files are read through a small buffer. Entries
+ * of the bound package are read straight from its mapping, except for
+ * compressed ones, which are decompressed whole when they are opened, since
+ * they are stored as a single block. Streams may be used on worker threads.
+ *
+ * res_stream_read returns the amount of bytes read, which is only less than
+ * size at the end of the stream or on error. res_stream_skip moves relative
+ * to the current position, backwards if offset is negative, and fails if
+ * that would leave the stream. */
+struct res_stream;
+
+struct res_stream* res_stream_open(const char* path);
+void res_stream_close(struct res_stream* stream);
+u64 res_stream_size(const struct res_stream* stream);
+usize res_stream_read(struct res_stream* stream, void* buf, usize size);
+bool res_stream_skip(struct res_stream* stream, i64 offset);
+bool res_stream_eof(const struct res_stream* stream);
+
 void res_init(const char* argv0);
 void res_deinit();
 
@@ -73,6 +156,9 @@ void res_deinit();
  * bind a PAK archive once opened. If a PAK archive is currently
  * bound, read_raw and read_raw_text will read from the currently
  * bound PAK archive. Otherwise, they read from a file.
+ *
+ * Archives are memory mapped and their entries are looked up through a
+ * hash index built by pak_open.
  */
 struct res_pak;
 
@@ -82,13 +168,54 @@ const struct res_pak* res_bound_pack();
 struct res_pak* pak_open(const char* path, usize offset);
 void pak_close(struct res_pak* pak);
 
+/* Version two of the format compresses entries with LZ4. The high
+ * compression mode is slow to pack, but no slower to load. */
+#define pak_version 2
+
+enum {
+	pak_compression_none = 0,
+	pak_compression_lz4,
+	pak_compression_lz4_hc
+};
+
 struct pak_write_file {
 	const char* src;
 	const char* dst;
+
+	/* Ignored by write_pak. */
+	u32 compression;
+};
+
+struct pak_write_stats {
+	usize file_count;
+	u64 input_bytes;
+
+	/* Files that couldn't be read and were left out of the package. */
+	usize skipped_count;
+
+	/* Bytes of files whose contents were already in the package. */
+	u64 deduplicated_bytes;
+
+	/* Bytes of files that were copied from the previous package instead
+	 * of being compressed again. */
+	u64 reused_bytes;
+
+	u64 output_bytes;
 };
 
-/* Returns the amount of bytes written. */
+/* Returns the amount of bytes written, or zero if the package couldn't be
+ * written. write_pak writes the original Quake format and write_pak_v2
+ * writes version two, compressing the files on the job system. pak_open
+ * reads either.
+ *
+ * write_pak_v2 stores files with identical contents once. If previous is
+ * not null, it is an earlier version of the package and any contents that
+ * it already holds with the same compression are copied from it, which
+ * makes repacking after a small change cheap. previous must not be the
+ * file being written. stats may be null. */
 usize write_pak(const char* outname, struct pak_write_file* files, usize file_count);
+usize write_pak_v2(const char* outname, struct pak_write_file* files, usize file_count,
+	const struct res_pak* previous, struct pak_write_stats* stats);
 
 struct res_config {
 	usize payload_size;
@@ -118,37 +245,169 @@ struct res_config {
 	const void* alt_raw;
 	usize alt_raw_size;
 
+	/* Resources that are no longer referenced stay in the cache, so that
+	 * loading them again is free, until the size of all resources of this
+	 * type passes the budget. Then the least recently used ones are
+	 * unloaded. A budget of zero unloads resources as soon as they're no
+	 * longer referenced. See res_report_size. */
+	usize budget;
+
+	/* If not zero, what on_decode returns is cached on disk, in the
+	 * directory set by res_set_cook_dir, so that later runs can skip
+	 * on_decode for as long as the file stays the same. The decoded data is
+	 * written out as is, so it mustn't contain pointers. Change the version
+	 * whenever on_decode's output changes, to discard the old data. */
+	u32 cook_version;
+
 	/* For internal use. */
 	const char* _name;
+	u64 _hash;
+	usize _size;
+	u64 _lru_first; /* The least recently used unreferenced resource. */
+	u64 _lru_last;
+
+	/* Optional. Called before on_load, on a worker thread when the resource
+	 * is loaded with res_load_async. It should do the CPU-heavy part of
+	 * loading that doesn't need the GPU or the resource manager, such as
+	 * decoding an image. It mustn't keep the raw data around; Instead it
+	 * returns a buffer from core_alloc that on_load receives as the raw data,
+	 * to which free_raw_on_load then applies. */
+	u8* (*on_decode)(const char* filename, const u8* raw, usize raw_size, usize* decoded_size, void* udata);
+
+	/* Like on_decode, but reads the file through a stream instead of
+	 * receiving all of it at once. Set at most one of the two. When the
+	 * decoded data is cooked, the whole file is read up front anyway, to
+	 * check it against the cache, and the stream reads from memory. */
+	u8* (*on_decode_stream)(const char* filename, struct res_stream* stream, usize* decoded_size, void* udata);
 
 	void (*on_load)(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata);
 	void (*on_unload)(void* payload, usize payload_size);
 };
 
 struct resource {
-	const char* key;
+	u64 id; /* See res_id. */
 	void* payload;
 };
 
 void reg_res_type(const char* type, const struct res_config* config);
 
-/* Returns the resource payload. */
+/* A resource's ID is a hash of its type, filename and user data, so it is
+ * the same on every run and every platform. It never is zero. Computing it
+ * doesn't allocate; An ID computed up front, such as at init time, can be
+ * handed to res_acquire to skip even the hashing. */
+u64 res_id(const char* type, const char* filename, const void* udata);
+
+/* Takes another reference to a resource that has already been loaded, or
+ * is loading. Returns a resource with a null payload if it hasn't. */
+struct resource res_acquire(u64 id);
+
+/* Enables the cache of decoded resources in dir, creating it if needed,
+ * see res_config.cook_version. Null disables it. This must not be called
+ * while resources are loading. */
+void res_set_cook_dir(const char* dir);
+
+/* Resources are reference counted: Every res_load must be matched by a
+ * res_unload, and only the last res_unload actually releases the resource,
+ * subject to its type's budget. */
 struct resource res_load(const char* type, const char* filename, void* udata);
 void res_unload(const struct resource* r);
 
+/* Called from on_load to report how much memory the resource uses, such as
+ * the size of a texture's pixels. Sizes reported by one on_load call are
+ * added up. If on_load reports nothing, the size is the payload size. */
+void res_report_size(usize size);
+
+void res_set_budget(const char* type, usize budget);
+
+/* The combined size of all loaded resources of a type. */
+usize res_get_type_size(const char* type);
+
+/* Starts loading a resource in the background and returns it right away.
+ * The payload must not be used until res_ready returns true or res_wait has
+ * returned. Loading the same resource again while it's in flight returns
+ * the same resource, and res_load waits for it to finish.
+ *
+ * The file is read and on_decode is called on a worker thread, while
+ * on_load always runs on the main thread: Either in res_ready or res_wait,
+ * or in res_update, which the app calls once per frame. */
+struct resource res_load_async(const char* type, const char* filename, void* udata);
+bool res_ready(const struct resource* r);
+void res_wait(const struct resource* r);
+void res_update();
+
+/* Like res_load_async for each of the files, but the files of the resources
+ * that aren't loaded yet are all read at once by read_file_batch, on a worker
+ * thread, and each is decoded on the job system as soon as it has been read.
+ * This is much faster for lots of small files, such as at startup. Files in
+ * a bound package are already mapped, so they're loaded as by
+ * res_load_async. resources must hold count resources. */
+void res_load_batch_async(const char* type, const char** filenames, usize count, void* udata, struct resource* resources);
+
+/* Watches the files of resources loaded from then on, except for those that
+ * come out of a package, and reloads them in res_update when they change:
+ * on_unload and on_load run again on the same payload, so pointers to it
+ * stay valid. The app enables this in debug builds. */
+void res_enable_hot_reload(bool enable);
+
 struct texture* load_texture(const char* filename, u32 flags, struct resource* r);
+struct texture* load_texture_async(const char* filename, u32 flags, struct resource* r);
 struct font*    load_font(const char* filename, i32 size, struct resource* r);
+struct font*    load_sdf_font(const char* filename, i32 size, struct resource* r);
 struct shader*  load_shader(const char* filename, struct resource* r);
 
 /* Primitive resources. */
 
-/* Represents an image loaded from disk. 32 bits per-pixel, RGBA. */
+/* Represents an image loaded from disk. 32 bits per-pixel, RGBA.
+ *
+ * An image may hold a chain of mip levels, one after the other, each half
+ * the size of the last, rounded down, down to a single pixel. A mip_count
+ * of zero means one level.
+ *
+ * If block_format isn't zero, it is the block compressed texture format
+ * that colours is in instead, see compress_image. */
 struct image {
 	v2i size;
 	u8* colours;
+	u32 mip_count;
+	u32 block_format;
 };
 
+u32 get_mip_count(v2i size);
+v2i get_mip_size(v2i size, u32 level);
+
+/* The size of the pixels of all of the image's levels, in bytes. */
+usize get_image_size(const struct image* image);
+
+/* Fills in every level after the first by averaging 2x2 blocks of the level
+ * before it. colours must have room for mip_count levels. */
+void generate_image_mips(struct image* image);
+
+/* Block compresses every level of an RGBA image into dst, in one of the
+ * block compressed texture formats from video.h, for video.new_texture with
+ * the same format. dst's colours are allocated with core_alloc. */
+void compress_image(const struct image* src, u32 format, struct image* dst);
+
+/* The reverse of compress_image, for GPUs that don't support the format.
+ * dst's colours are null if src's are. */
+void decompress_image(const struct image* src, u32 format, struct image* dst);
+
 void init_image_from_raw(struct image* image, const u8* raw, usize raw_size);
+
+/* Decodes raw into a struct image allocated with core_alloc, followed by its
+ * pixels in the same allocation, so that it can be cooked. Suitable for
+ * res_config.on_decode. Such an image must be retrieved with
+ * get_decoded_image, which fixes up the pointer to its pixels, and must not
+ * be passed to deinit_image. */
+u8* decode_image_raw(const char* filename, const u8* raw, usize raw_size, usize* decoded_size, void* udata);
+struct image* get_decoded_image(u8* raw);
+
+/* Like decode_image_raw, for res_config.on_decode_stream. */
+u8* decode_image_stream(const char* filename, struct res_stream* stream, usize* decoded_size, void* udata);
+
+/* Like decode_image_stream, where udata points to texture flags. Generates
+ * the full mip chain if they include texture_flags_mipmaps, and compresses
+ * the image if they include texture_flags_compress. */
+u8* decode_texture_stream(const char* filename, struct res_stream* stream, usize* decoded_size, void* udata);
 void deinit_image(struct image* image);
 
 void flip_image_y(struct image* image);
@@ -29,6 +29,8 @@ struct simple_renderer {
 	v4i clip;
 
 	struct atlas* atlas;
+	const struct texture* glyph_atlas;
+	bool glyph_sdf;
 
 	usize count;
 	usize offset;
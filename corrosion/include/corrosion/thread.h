@@ -15,11 +15,22 @@ struct thread {
 	thread_worker_t worker;
 };
 
+/* Holds an SRWLOCK. */
 struct mutex {
 	u64 handle;
 };
+
+/* Holds a CONDITION_VARIABLE. */
+struct cond {
+	u64 handle;
+};
+
+struct semaphore {
+	u64 handle;
+};
 #else
 #include <pthread.h>
+#include <semaphore.h>
 
 struct thread {
 	pthread_t handle;
@@ -32,6 +43,14 @@ struct mutex {
 	pthread_mutex_t mutex;
 };
 
+struct cond {
+	pthread_cond_t cond;
+};
+
+struct semaphore {
+	sem_t sem;
+};
+
 #endif
 
 void init_thread(struct thread* thread, thread_worker_t worker);
@@ -46,3 +65,57 @@ void init_mutex(struct mutex* mutex);
 void deinit_mutex(struct mutex* mutex);
 void lock_mutex(struct mutex* mutex);
 void unlock_mutex(struct mutex* mutex);
+
+/* Condition variables. As usual, cond_wait may wake up spuriously. */
+void init_cond(struct cond* cond);
+void deinit_cond(struct cond* cond);
+void cond_wait(struct cond* cond, struct mutex* mutex);
+void cond_signal(struct cond* cond);
+void cond_broadcast(struct cond* cond);
+
+void init_semaphore(struct semaphore* semaphore, u32 count);
+void deinit_semaphore(struct semaphore* semaphore);
+void semaphore_wait(struct semaphore* semaphore);
+void semaphore_signal(struct semaphore* semaphore, u32 count);
+
+void thread_yield();
+u32 get_processor_count();
+
+/* Atomic operations on 64-bit integers. All of them are sequentially
+ * consistent. atomic_add_i64 returns the new value and atomic_cas_i64
+ * returns true if *ptr was equal to expected and has been replaced. */
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+force_inline i64 atomic_load_i64(volatile i64* ptr) {
+	return _InterlockedOr64(ptr, 0);
+}
+
+force_inline void atomic_store_i64(volatile i64* ptr, i64 val) {
+	_InterlockedExchange64(ptr, val);
+}
+
+force_inline i64 atomic_add_i64(volatile i64* ptr, i64 val) {
+	return _InterlockedExchangeAdd64(ptr, val) + val;
+}
+
+force_inline bool atomic_cas_i64(volatile i64* ptr, i64 expected, i64 desired) {
+	return _InterlockedCompareExchange64(ptr, desired, expected) == expected;
+}
+#else
+force_inline i64 atomic_load_i64(volatile i64* ptr) {
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+force_inline void atomic_store_i64(volatile i64* ptr, i64 val) {
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+force_inline i64 atomic_add_i64(volatile i64* ptr, i64 val) {
+	return __atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+force_inline bool atomic_cas_i64(volatile i64* ptr, i64 expected, i64 desired) {
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#endif
@@ -34,6 +34,8 @@ struct ui_renderer {
 	v4i clip;
 
 	struct atlas* atlas;
+	const struct texture* glyph_atlas;
+	bool glyph_sdf;
 
 	usize count;
 	usize offset;
@@ -77,6 +79,15 @@ struct ui_renderer_text {
 	struct font* font;
 };
 
+/* Text laid out beforehand with layout_text. */
+struct ui_renderer_glyphs {
+	v2f position;
+	const struct text_glyph* glyphs;
+	usize count;
+	v4f colour;
+	struct font* font;
+};
+
 struct ui_renderer* new_ui_renderer(const struct framebuffer* framebuffer);
 void free_ui_renderer(struct ui_renderer* renderer);
 void ui_renderer_push(struct ui_renderer* renderer, const struct ui_renderer_quad* quad);
@@ -85,3 +96,4 @@ void ui_renderer_flush(struct ui_renderer* renderer);
 void ui_renderer_end_frame(struct ui_renderer* renderer);
 void ui_renderer_clip(struct ui_renderer* renderer, v4i clip);
 void ui_renderer_push_text(struct ui_renderer* renderer, const struct ui_renderer_text* text);
+void ui_renderer_push_glyphs(struct ui_renderer* renderer, const struct ui_renderer_glyphs* glyphs);
@@ -151,7 +151,18 @@ enum {
 	texture_flags_filter_none    = 1 << 2,
 	texture_flags_storage        = 1 << 3,
 	texture_flags_repeat         = 1 << 4,
-	texture_flags_clamp          = 1 << 5
+	texture_flags_clamp          = 1 << 5,
+
+	/* Samples the image's mip levels, see struct image. load_texture
+	 * generates them on the CPU, on a worker thread for load_texture_async.
+	 * Not for use with texture_flags_storage. */
+	texture_flags_mipmaps        = 1 << 6,
+
+	/* Block compresses the image as load_texture decodes it, after
+	 * generating any mip levels: to BC1 if it's opaque and BC7 otherwise.
+	 * Both the decoding and the compression are cooked. Not for use with
+	 * texture_flags_storage. */
+	texture_flags_compress       = 1 << 7
 };
 
 enum {
@@ -167,6 +178,16 @@ enum {
 	texture_format_rgba8i,
 	texture_format_rgba16f,
 	texture_format_rgba32f,
+
+	/* Block compressed formats, which store each 4x4 block of texels in 8
+	 * or 16 bytes; See compress_image. They can't be used for storage or
+	 * rendered to. Where the GPU doesn't support them, they are
+	 * decompressed on the CPU when the texture is created. */
+	texture_format_bc1,  /* RGB with 1-bit alpha, 4 bits per texel. */
+	texture_format_bc3,  /* RGBA, 8 bits per texel. */
+	texture_format_bc4,  /* R, 4 bits per texel. */
+	texture_format_bc5,  /* RG, 8 bits per texel. */
+	texture_format_bc7,  /* RGBA, 8 bits per texel. */
 	texture_format_count
 };
 
@@ -278,12 +299,22 @@ struct video {
 	void (*begin_pipeline)(const struct pipeline* pipeline);
 	void (*end_pipeline)(const struct pipeline* pipeline);
 	void (*recreate_pipeline)(struct pipeline* pipeline);
+
+	/* Descriptor sets and descriptors are found by name. Names that come
+	 * from intern_string are found without hashing them, which is worth
+	 * doing for calls that are made every frame. */
 	void (*update_pipeline_uniform)(struct pipeline* pipeline, const char* set, const char* descriptor, const void* data);
 	void (*init_pipeline_uniform)(struct pipeline* pipeline, const char* set, const char* descriptor, const void* data);
 	void (*pipeline_push_buffer)(struct pipeline* pipeline, usize offset, usize size, const void* data);
 	void (*bind_pipeline_descriptor_set)(struct pipeline* pipeline, const char* set, usize target);
 	void (*pipeline_change_shader)(struct pipeline* pipeline, const struct shader* shader);
 
+	/* Points a texture descriptor at another texture, which is a lot
+	 * cheaper than re-creating the pipeline. Draws that have already been
+	 * issued keep sampling the old one; Later ones sample the new one once
+	 * the descriptor set has been bound again. */
+	void (*pipeline_change_texture)(struct pipeline* pipeline, const char* set, const char* descriptor, const struct texture* texture);
+
 	/* Storage. */
 	struct storage* (*new_storage)(u32 flags, usize size, void* initial_data);
 	void (*update_storage)(struct storage* storage, void* data);
@@ -317,6 +348,10 @@ struct video {
 	v2i  (*get_texture_size)(const struct texture* texture);
 	v3i  (*get_texture_3d_size)(const struct texture* texture);
 	void (*texture_copy)(struct texture* dst, v2i dst_offset, const struct texture* src, v2i src_offset, v2i dimensions);
+
+	/* Replaces a region of the first mip level with tightly packed texels in
+	 * the texture's format. Not for block compressed textures. */
+	void (*update_texture)(struct texture* texture, v2i offset, v2i size, const void* data);
 	void (*texture_copy_3d)(struct texture* dst, v3i dst_offset, const struct texture* src, v3i src_offset, v3i dimensions);
 	void (*texture_barrier)(struct texture* texture, u32 state);
 
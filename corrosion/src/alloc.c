@@ -1,64 +1,321 @@
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "core.h"
+#include "maths.h"
 #include "thread.h"
 
-usize memory_usage = 0;
+#ifdef _MSC_VER
+#define thread_local_storage __declspec(thread)
+#else
+#define thread_local_storage _Thread_local
+#endif
 
 /* Memory allocator for use in debug mode that checks for memory leaks.
  *
- * This works by storing and "alloc_info" struct behind the allocation
+ * This works by storing an "alloc_info" struct behind the allocation
  * and adding that struct to a linked list each time a block is allocated,
  * with the struct being removed from the list on each deallocation.
- * The leak_check function traverses the list and anything that's still
- * in the list is reported as leaked memory.
+ * The leak_check function traverses the lists and anything that's still
+ * in them is reported as leaked memory.
  *
- * This allocator is thread-safe. */
+ * The lists are sharded per-thread so that the allocator doesn't need a
+ * lock: A thread links its allocations into its own shard and is the only
+ * one that ever touches that shard's list. Blocks freed by another thread
+ * are pushed onto the owning shard's "remote" stack with a compare-and-swap
+ * instead, and the owner unlinks and frees them the next time it allocates.
+ *
+ * A shard outlives its thread, since blocks allocated from it may still be
+ * alive; alloc_thread_deinit releases it so that the next new thread can
+ * adopt it, along with any remote frees that are still pending.
+ *
+ * Every block also points at the counters of its call site. Call sites live
+ * in a fixed-size, insert-only hash table that is updated with atomic
+ * operations. The profiler's counters live in the call sites as well and
+ * are only updated while it's running.
+ *
+ * leak_check must only be called once all other threads that allocate have
+ * finished. Everything else is thread-safe. */
+
+#define alloc_site_capacity 8192
+#define alloc_site_cache_size 64
+
+struct alloc_site {
+	volatile i64 state;
 
-struct alloc_info {
 	const char* file;
 	u32 line;
+
+	volatile i64 live;
+	volatile i64 peak;
+	volatile i64 count;
+
+	struct {
+		volatile i64 allocs;
+		volatile i64 bytes;
+		volatile i64 reallocs;
+		volatile i64 frees;
+
+		volatile i64 frame_allocs;
+		volatile i64 frame_bytes;
+		volatile i64 max_frame_allocs;
+		volatile i64 max_frame_bytes;
+
+		volatile i64 lifetimes[alloc_lifetime_bucket_count];
+	} prof;
+};
+
+enum {
+	alloc_site_empty = 0,
+	alloc_site_writing,
+	alloc_site_ready
+};
+
+struct alloc_shard;
+
+struct alloc_info {
+	struct alloc_site* site;
+	struct alloc_shard* shard;
 	usize size;
+	i64 birth_frame;
 
 	struct alloc_info* next;
 	struct alloc_info* prev;
+	struct alloc_info* next_remote;
+};
+
+struct alloc_shard {
+	list(struct alloc_info) list;
+	volatile i64 remote;
+	bool owned;
+
+	struct alloc_shard* next_shard;
 };
 
-list(struct alloc_info) alloc_list;
-struct mutex list_mutex;
+static struct {
+	struct mutex shards_mutex;
+	struct alloc_shard* shards;
+
+	struct alloc_site sites[alloc_site_capacity];
+	struct alloc_site overflow_site;
+
+	/* One plus the indices into sites, in the order they were claimed. Zero
+	 * means the slot has been counted but not written yet. */
+	volatile u16 site_order[alloc_site_capacity];
+	volatile i64 site_count;
+
+	volatile i64 frame;
+	volatile i64 profiling;
+	i64 profiled_frames;
+	const char* profile_path;
+} tracker;
+
+static thread_local_storage struct alloc_shard* current_shard;
+
+/* Most allocations come from a handful of hot call sites, so each thread
+ * remembers the sites it resolved most recently. */
+static thread_local_storage struct alloc_site* site_cache[alloc_site_cache_size];
 
 void debug_alloc_init() {
-	memset(&alloc_list, 0, sizeof alloc_list);
-	init_mutex(&list_mutex);
+	memset(&tracker, 0, sizeof tracker);
+	init_mutex(&tracker.shards_mutex);
+
+	tracker.overflow_site.file = "<too many call sites>";
+	tracker.overflow_site.state = alloc_site_ready;
+
+	tracker.profile_path = getenv("CR_ALLOC_PROFILE");
+	if (tracker.profile_path) {
+		debug_alloc_profiler_start();
+	}
 }
 
 void debug_alloc_deinit() {
-	deinit_mutex(&list_mutex);
+	struct alloc_shard* shard = tracker.shards;
+	while (shard) {
+		struct alloc_shard* next = shard->next_shard;
+		free(shard);
+		shard = next;
+	}
+
+	current_shard = null;
+	tracker.shards = null;
+
+	memset(site_cache, 0, sizeof site_cache);
+
+	deinit_mutex(&tracker.shards_mutex);
 }
 
-static void alloc_insert(struct alloc_info* node, struct alloc_info* new_node) {
-	lock_mutex(&list_mutex);
-	list_insert(alloc_list, node, new_node);
-	unlock_mutex(&list_mutex);
+static void unlink_block(struct alloc_shard* shard, struct alloc_info* node) {
+	list_remove(shard->list, node);
 }
 
-static void alloc_add(struct alloc_info* info) {
-	lock_mutex(&list_mutex);
+/* Must only be called by the thread that owns the shard. */
+static void drain_remote(struct alloc_shard* shard) {
+	i64 head = atomic_load_i64(&shard->remote);
+	while (!atomic_cas_i64(&shard->remote, head, 0)) {
+		head = atomic_load_i64(&shard->remote);
+	}
 
-	heap_allocation_count++;
-	memory_usage += info->size;
-	list_push(alloc_list, info);
+	struct alloc_info* node = (struct alloc_info*)(uptr)head;
+	while (node) {
+		struct alloc_info* next = node->next_remote;
+
+		unlink_block(shard, node);
+		free(node);
+
+		node = next;
+	}
+}
+
+static void push_remote(struct alloc_shard* shard, struct alloc_info* node) {
+	i64 head;
+	do {
+		head = atomic_load_i64(&shard->remote);
+		node->next_remote = (struct alloc_info*)(uptr)head;
+	} while (!atomic_cas_i64(&shard->remote, head, (i64)(uptr)node));
+}
+
+static struct alloc_shard* get_shard() {
+	if (current_shard) { return current_shard; }
+
+	lock_mutex(&tracker.shards_mutex);
+
+	struct alloc_shard* shard = tracker.shards;
+	while (shard && shard->owned) {
+		shard = shard->next_shard;
+	}
+
+	if (!shard) {
+		shard = calloc(1, sizeof *shard);
+		if (!shard) {
+			abort_with("Out of memory.");
+		}
+
+		shard->next_shard = tracker.shards;
+		tracker.shards = shard;
+	}
+
+	shard->owned = true;
+
+	unlock_mutex(&tracker.shards_mutex);
 
-	unlock_mutex(&list_mutex);
+	current_shard = shard;
+	return shard;
 }
 
-static void alloc_remove(struct alloc_info* node) {
-	lock_mutex(&list_mutex);
+static struct alloc_site* find_site(struct alloc_code_info cinfo, u64 hash) {
+	usize mask = alloc_site_capacity - 1;
 
-	memory_usage -= node->size;
-	list_remove(alloc_list, node);
+	for (usize i = 0, idx = hash & mask; i < alloc_site_capacity; i++, idx = (idx + 1) & mask) {
+		struct alloc_site* site = tracker.sites + idx;
 
-	unlock_mutex(&list_mutex);
+		i64 state = atomic_load_i64(&site->state);
+
+		if (state == alloc_site_empty) {
+			if (atomic_cas_i64(&site->state, alloc_site_empty, alloc_site_writing)) {
+				site->file = cinfo.file;
+				site->line = cinfo.line;
+				atomic_store_i64(&site->state, alloc_site_ready);
+
+				tracker.site_order[atomic_add_i64(&tracker.site_count, 1) - 1] = (u16)(idx + 1);
+				return site;
+			}
+
+			state = atomic_load_i64(&site->state);
+		}
+
+		/* Another thread is claiming this slot; It's only a couple of stores away. */
+		while (state == alloc_site_writing) {
+			state = atomic_load_i64(&site->state);
+		}
+
+		if (site->file == cinfo.file && site->line == cinfo.line) {
+			return site;
+		}
+	}
+
+	return &tracker.overflow_site;
+}
+
+static struct alloc_site* get_site(struct alloc_code_info cinfo) {
+	u64 hash = ((u64)(uptr)cinfo.file ^ ((u64)cinfo.line << 32)) * 0x9e3779b97f4a7c15ull;
+	hash ^= hash >> 29;
+
+	struct alloc_site** cached = site_cache + ((hash >> 7) & (alloc_site_cache_size - 1));
+	struct alloc_site* site = *cached;
+
+	if (site && site->file == cinfo.file && site->line == cinfo.line) {
+		return site;
+	}
+
+	site = find_site(cinfo, hash);
+	*cached = site;
+
+	return site;
+}
+
+static void max_i64(volatile i64* ptr, i64 val) {
+	i64 cur = atomic_load_i64(ptr);
+	while (val > cur && !atomic_cas_i64(ptr, cur, val)) {
+		cur = atomic_load_i64(ptr);
+	}
+}
+
+static void alloc_add(struct alloc_info* info, struct alloc_code_info cinfo, bool is_realloc) {
+	struct alloc_shard* shard = get_shard();
+
+	if (atomic_load_i64(&shard->remote)) {
+		drain_remote(shard);
+	}
+
+	struct alloc_site* site = get_site(cinfo);
+
+	info->site = site;
+	info->shard = shard;
+	info->birth_frame = tracker.frame;
+
+	max_i64(&site->peak, atomic_add_i64(&site->live, (i64)info->size));
+	atomic_add_i64(&site->count, 1);
+
+	if (tracker.profiling) {
+		atomic_add_i64(&site->prof.allocs, 1);
+		atomic_add_i64(&site->prof.bytes, (i64)info->size);
+		atomic_add_i64(&site->prof.frame_allocs, 1);
+		atomic_add_i64(&site->prof.frame_bytes, (i64)info->size);
+
+		if (is_realloc) {
+			atomic_add_i64(&site->prof.reallocs, 1);
+		}
+	}
+
+	heap_allocation_count++;
+	list_push(shard->list, info);
+}
+
+/* Takes the block out of the statistics. Returns true if the calling thread
+ * owns the block's shard and has unlinked it, in which case the block can be
+ * reused or freed right away; Otherwise the block has been handed over to
+ * the owner and must not be touched again. */
+static bool alloc_remove(struct alloc_info* node) {
+	atomic_add_i64(&node->site->live, -(i64)node->size);
+
+	if (node->shard == current_shard) {
+		unlink_block(node->shard, node);
+		return true;
+	}
+
+	push_remote(node->shard, node);
+	return false;
+}
+
+static usize lifetime_bucket(i64 frames) {
+	usize bucket = 0;
+	while (frames > 0 && bucket < alloc_lifetime_bucket_count - 1) {
+		frames >>= 1;
+		bucket++;
+	}
+
+	return bucket;
 }
 
 void* debug_core_alloc(usize size, struct alloc_code_info cinfo) {
@@ -71,11 +328,9 @@ void* debug_core_alloc(usize size, struct alloc_code_info cinfo) {
 	}
 
 	struct alloc_info* info = (void*)ptr;
-	info->file = cinfo.file;
-	info->line = cinfo.line;
 	info->size = size;
 
-	alloc_add(info);
+	alloc_add(info, cinfo, false);
 
 	void* r = ptr + sizeof *info;
 
@@ -99,9 +354,32 @@ void* debug_core_realloc(void* p, usize size, struct alloc_code_info cinfo) {
 	}
 
 	u8* ptr = p;
+	i64 birth_frame = -1;
 
 	if (ptr) {
 		struct alloc_info* old_info = (void*)(ptr - sizeof *old_info);
+
+		/* A block that belongs to another thread's shard can't be moved,
+		 * since it's still linked into that shard's list. */
+		if (old_info->shard != get_shard()) {
+			u8* new_ptr = malloc(sizeof(struct alloc_info) + size);
+			if (!new_ptr) {
+				abort_with("Out of memory.");
+			}
+
+			struct alloc_info* info = (void*)new_ptr;
+			info->size = size;
+
+			alloc_add(info, cinfo, true);
+			info->birth_frame = old_info->birth_frame;
+
+			memcpy(new_ptr + sizeof *info, ptr, cr_min(size, old_info->size));
+			alloc_remove(old_info);
+
+			return new_ptr + sizeof *info;
+		}
+
+		birth_frame = old_info->birth_frame;
 		alloc_remove(old_info);
 	}
 
@@ -112,11 +390,14 @@ void* debug_core_realloc(void* p, usize size, struct alloc_code_info cinfo) {
 	}
 
 	struct alloc_info* info = (void*)new_ptr;
-	info->file = cinfo.file;
-	info->line = cinfo.line;
 	info->size = size;
 
-	alloc_add(info);
+	alloc_add(info, cinfo, ptr != null);
+
+	/* A reallocated block keeps its age. */
+	if (birth_frame >= 0) {
+		info->birth_frame = birth_frame;
+	}
 
 	void* r = new_ptr + sizeof *info;
 
@@ -130,38 +411,652 @@ void debug_core_free(void* p, struct alloc_code_info info) {
 
 	struct alloc_info* old_info = (void*)(ptr - sizeof *old_info);
 
-	alloc_remove(old_info);
+	if (tracker.profiling) {
+		struct alloc_site* site = old_info->site;
+
+		atomic_add_i64(&site->prof.frees, 1);
+		atomic_add_i64(&site->prof.lifetimes[lifetime_bucket(tracker.frame - old_info->birth_frame)], 1);
+	}
+
+	if (alloc_remove(old_info)) {
+		free(old_info);
+	}
+}
 
-	free(old_info);
+/* Returns null for a site that is still being claimed. */
+static struct alloc_site* get_site_by_order(usize i) {
+	u16 idx = tracker.site_order[i];
+	return idx ? tracker.sites + idx - 1 : null;
 }
 
 usize debug_core_get_memory_usage() {
-	return memory_usage;
+	i64 r = atomic_load_i64(&tracker.overflow_site.live);
+
+	usize count = (usize)atomic_load_i64(&tracker.site_count);
+	for (usize i = 0; i < count; i++) {
+		struct alloc_site* site = get_site_by_order(i);
+		if (site) {
+			r += atomic_load_i64(&site->live);
+		}
+	}
+
+	return (usize)r;
+}
+
+/* The debug allocator doesn't use size classes. */
+void debug_core_get_class_usage(struct alloc_class_usage* usage) {
+	memset(usage, 0, sizeof *usage * alloc_class_count);
+}
+
+usize debug_core_get_alloc_sites(struct alloc_site_stats* sites, usize max) {
+	usize count = 0;
+
+	usize site_count = (usize)atomic_load_i64(&tracker.site_count);
+	for (usize i = 0; i < site_count + 1; i++) {
+		struct alloc_site* site = i < site_count ? get_site_by_order(i) : &tracker.overflow_site;
+
+		if (!site || atomic_load_i64(&site->count) == 0) { continue; }
+
+		if (count < max) {
+			sites[count] = (struct alloc_site_stats) {
+				.file        = site->file,
+				.line        = site->line,
+				.live_bytes  = (usize)atomic_load_i64(&site->live),
+				.peak_bytes  = (usize)atomic_load_i64(&site->peak),
+				.alloc_count = (usize)atomic_load_i64(&site->count)
+			};
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+/* Releases the calling thread's shard. Blocks allocated from it stay
+ * tracked and can still be freed from any thread. */
+void debug_alloc_thread_deinit() {
+	if (!current_shard) { return; }
+
+	drain_remote(current_shard);
+
+	lock_mutex(&tracker.shards_mutex);
+	current_shard->owned = false;
+	unlock_mutex(&tracker.shards_mutex);
+
+	current_shard = null;
 }
 
 void debug_leak_check() {
-	if (debug_core_get_memory_usage() != 0) {
-		lock_mutex(&list_mutex);
+	usize usage = debug_core_get_memory_usage();
+
+	if (usage != 0) {
+		lock_mutex(&tracker.shards_mutex);
 
-		struct alloc_info* node = alloc_list.head;
-		while (node) {
-			warning("Leaked block of %llu bytes allocated at: %s:%u", node->size, node->file, node->line);
+		for (struct alloc_shard* shard = tracker.shards; shard; shard = shard->next_shard) {
+			drain_remote(shard);
 
-			node = node->next;
+			struct alloc_info* node = shard->list.head;
+			while (node) {
+				warning("Leaked block of %llu bytes allocated at: %s:%u", node->size, node->site->file, node->site->line);
+
+				node = node->next;
+			}
 		}
 
-		unlock_mutex(&list_mutex);
+		unlock_mutex(&tracker.shards_mutex);
 
-		info("Total leaked memory: %llu", memory_usage);
+		info("Total leaked memory: %llu", usage);
 	} else {
 		info("No leaks from tracked allocations.");
 	}
+
+	if (tracker.profile_path) {
+		debug_alloc_profiler_dump(tracker.profile_path);
+	}
+}
+
+void debug_alloc_profiler_start() {
+	usize count = (usize)atomic_load_i64(&tracker.site_count);
+	for (usize i = 0; i < count + 1; i++) {
+		struct alloc_site* site = i < count ? get_site_by_order(i) : &tracker.overflow_site;
+		if (site) {
+			memset((void*)&site->prof, 0, sizeof site->prof);
+		}
+	}
+
+	tracker.profiled_frames = 0;
+	atomic_store_i64(&tracker.profiling, 1);
+}
+
+void debug_alloc_profiler_stop() {
+	atomic_store_i64(&tracker.profiling, 0);
+}
+
+/* Folds the per-frame counters of every site into their maximums. Blocks
+ * allocated while this runs may be counted towards the next frame. */
+void debug_alloc_profiler_new_frame() {
+	atomic_add_i64(&tracker.frame, 1);
+
+	if (!atomic_load_i64(&tracker.profiling)) { return; }
+
+	tracker.profiled_frames++;
+
+	usize count = (usize)atomic_load_i64(&tracker.site_count);
+	for (usize i = 0; i < count + 1; i++) {
+		struct alloc_site* site = i < count ? get_site_by_order(i) : &tracker.overflow_site;
+		if (!site) { continue; }
+
+		i64 allocs = atomic_load_i64(&site->prof.frame_allocs);
+		i64 bytes  = atomic_load_i64(&site->prof.frame_bytes);
+
+		if (allocs == 0) { continue; }
+
+		atomic_add_i64(&site->prof.frame_allocs, -allocs);
+		atomic_add_i64(&site->prof.frame_bytes,  -bytes);
+
+		max_i64(&site->prof.max_frame_allocs, allocs);
+		max_i64(&site->prof.max_frame_bytes,  bytes);
+	}
+}
+
+struct alloc_profile_entry {
+	const char* file;
+	u32 line;
+
+	i64 allocs, bytes, reallocs, frees;
+	i64 max_frame_allocs, max_frame_bytes;
+	i64 live, peak;
+	i64 lifetimes[alloc_lifetime_bucket_count];
+};
+
+static int cmp_profile_entries(const void* a, const void* b) {
+	const struct alloc_profile_entry* x = a;
+	const struct alloc_profile_entry* y = b;
+
+	if (x->allocs != y->allocs) {
+		return x->allocs < y->allocs ? 1 : -1;
+	}
+
+	return x->bytes < y->bytes ? 1 : x->bytes > y->bytes ? -1 : 0;
 }
 
+/* Call sites are written out sorted by the number of allocations they made
+ * while the profiler was running, busiest first. */
+bool debug_alloc_profiler_dump(const char* path) {
+	usize count = (usize)atomic_load_i64(&tracker.site_count);
+
+	/* Not core_alloc, so that dumping doesn't show up in the profile. */
+	struct alloc_profile_entry* entries = malloc(sizeof *entries * (count + 1));
+	if (!entries) {
+		abort_with("Out of memory.");
+	}
+
+	usize entry_count = 0;
+	for (usize i = 0; i < count + 1; i++) {
+		struct alloc_site* site = i < count ? get_site_by_order(i) : &tracker.overflow_site;
+		if (!site || atomic_load_i64(&site->prof.allocs) == 0) { continue; }
+
+		struct alloc_profile_entry* e = entries + entry_count++;
+
+		e->file             = site->file;
+		e->line             = site->line;
+		e->allocs           = atomic_load_i64(&site->prof.allocs);
+		e->bytes            = atomic_load_i64(&site->prof.bytes);
+		e->reallocs         = atomic_load_i64(&site->prof.reallocs);
+		e->frees            = atomic_load_i64(&site->prof.frees);
+		e->max_frame_allocs = atomic_load_i64(&site->prof.max_frame_allocs);
+		e->max_frame_bytes  = atomic_load_i64(&site->prof.max_frame_bytes);
+		e->live             = atomic_load_i64(&site->live);
+		e->peak             = atomic_load_i64(&site->peak);
+
+		for (usize j = 0; j < alloc_lifetime_bucket_count; j++) {
+			e->lifetimes[j] = atomic_load_i64(&site->prof.lifetimes[j]);
+		}
+
+		/* Include the frame that's still in progress. */
+		i64 frame_allocs = atomic_load_i64(&site->prof.frame_allocs);
+		i64 frame_bytes  = atomic_load_i64(&site->prof.frame_bytes);
+		e->max_frame_allocs = cr_max(e->max_frame_allocs, frame_allocs);
+		e->max_frame_bytes  = cr_max(e->max_frame_bytes,  frame_bytes);
+	}
+
+	qsort(entries, entry_count, sizeof *entries, cmp_profile_entries);
+
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		error("Failed to open `%s' for writing.", path);
+		free(entries);
+		return false;
+	}
+
+	f64 frames = (f64)cr_max(tracker.profiled_frames, 1);
+
+	usize path_len = strlen(path);
+	bool json = path_len >= 5 && strcmp(path + path_len - 5, ".json") == 0;
+
+	if (json) {
+		fprintf(file, "{\n\t\"frames\": %lld,\n\t\"sites\": [", (long long)tracker.profiled_frames);
+	} else {
+		fprintf(file, "file,line,allocs,bytes,reallocs,frees,allocs_per_frame,bytes_per_frame,"
+			"max_frame_allocs,max_frame_bytes,live_bytes,peak_bytes");
+
+		for (usize j = 0; j < alloc_lifetime_bucket_count; j++) {
+			fprintf(file, ",lifetime_%llu", (unsigned long long)j);
+		}
+
+		fprintf(file, "\n");
+	}
+
+	for (usize i = 0; i < entry_count; i++) {
+		struct alloc_profile_entry* e = entries + i;
+
+		if (json) {
+			fprintf(file, "%s\n\t\t{ \"file\": \"", i == 0 ? "" : ",");
+
+			/* Escape the backslashes in Windows paths. */
+			for (const char* c = e->file; *c; c++) {
+				if (*c == '\\' || *c == '"') { fputc('\\', file); }
+				fputc(*c, file);
+			}
+
+			fprintf(file, "\", \"line\": %u, \"allocs\": %lld, \"bytes\": %lld, \"reallocs\": %lld, \"frees\": %lld, "
+				"\"allocs_per_frame\": %g, \"bytes_per_frame\": %g, \"max_frame_allocs\": %lld, \"max_frame_bytes\": %lld, "
+				"\"live_bytes\": %lld, \"peak_bytes\": %lld, \"lifetimes\": [",
+				e->line, (long long)e->allocs, (long long)e->bytes, (long long)e->reallocs, (long long)e->frees,
+				(f64)e->allocs / frames, (f64)e->bytes / frames, (long long)e->max_frame_allocs, (long long)e->max_frame_bytes,
+				(long long)e->live, (long long)e->peak);
+
+			for (usize j = 0; j < alloc_lifetime_bucket_count; j++) {
+				fprintf(file, "%s%lld", j == 0 ? "" : ", ", (long long)e->lifetimes[j]);
+			}
+
+			fprintf(file, "] }");
+		} else {
+			fprintf(file, "\"%s\",%u,%lld,%lld,%lld,%lld,%g,%g,%lld,%lld,%lld,%lld",
+				e->file, e->line, (long long)e->allocs, (long long)e->bytes, (long long)e->reallocs, (long long)e->frees,
+				(f64)e->allocs / frames, (f64)e->bytes / frames, (long long)e->max_frame_allocs, (long long)e->max_frame_bytes,
+				(long long)e->live, (long long)e->peak);
+
+			for (usize j = 0; j < alloc_lifetime_bucket_count; j++) {
+				fprintf(file, ",%lld", (long long)e->lifetimes[j]);
+			}
+
+			fprintf(file, "\n");
+		}
+	}
+
+	if (json) {
+		fprintf(file, "\n\t]\n}\n");
+	}
+
+	fclose(file);
+	free(entries);
+
+	info("Wrote allocation profile of %llu call sites to `%s'.", (unsigned long long)entry_count, path);
+
+	return true;
+}
+
+/* Call sites are only tracked in debug mode. */
+usize release_core_get_alloc_sites(struct alloc_site_stats* sites, usize max) {
+	return 0;
+}
+
+void release_alloc_profiler_start() {
+	warning("The allocation profiler is only available in debug builds.");
+}
+
+void release_alloc_profiler_stop() {}
+void release_alloc_profiler_new_frame() {}
+
+bool release_alloc_profiler_dump(const char* path) {
+	return false;
+}
+
+#ifndef cr_no_pool_alloc
+
+/* Allocator for use in release mode.
+ *
+ * Allocations of up to alloc_max_class_size bytes are rounded up to a power
+ * of two size class and served from segregated free lists; Anything bigger
+ * goes to malloc. Every block has a 16 byte header behind it that records its
+ * size class, so that it can be freed without knowing its size.
+ *
+ * Each thread keeps a small cache of free blocks per class, so that most
+ * allocations and deallocations don't take a lock. A cache that runs dry
+ * refills a batch of blocks from the global free list, which in turn carves
+ * new blocks out of large slabs, and a cache that holds too many blocks
+ * gives half of them back.
+ *
+ * Statistics are counted per-thread and folded into the global counters
+ * whenever a thread touches the global lists, so they lag behind a little
+ * for threads other than the caller.
+ *
+ * Define cr_no_pool_alloc to use plain malloc instead. */
+
+#define pool_header_size 16
+#define pool_slab_size   (256 * 1024)
+#define pool_batch_size  32
+#define pool_cache_max   (pool_batch_size * 2)
+#define pool_large_class 0xffffffff
+
+struct pool_header {
+	u32 cls;
+	usize size;
+};
+
+struct pool_block {
+	struct pool_block* next;
+};
+
+struct pool_slab {
+	struct pool_slab* next;
+};
+
+static struct {
+	struct mutex mutex;
+
+	struct pool_block* free[alloc_class_count];
+	usize free_count[alloc_class_count];
+
+	struct pool_slab* slabs;
+	u8* slab_cur;
+	usize slab_left;
+
+	usize reserved[alloc_class_count];
+	i64 used[alloc_class_count];
+	i64 large_bytes;
+} pool;
+
+static thread_local_storage struct {
+	struct pool_block* free[alloc_class_count];
+	usize count[alloc_class_count];
+
+	i64 used_delta[alloc_class_count];
+	i64 large_delta;
+} pool_cache;
+
+static inline usize class_size(u32 cls) {
+	return (usize)alloc_min_class_size << cls;
+}
+
+static inline u32 size_class(usize size) {
+	u32 cls = 0;
+	while (class_size(cls) < size) { cls++; }
+	return cls;
+}
+
+static inline struct pool_header* get_header(void* ptr) {
+	return (struct pool_header*)((u8*)ptr - pool_header_size);
+}
+
+/* Must be called with the pool mutex held. */
+static void fold_cache_stats() {
+	for (u32 i = 0; i < alloc_class_count; i++) {
+		pool.used[i] += pool_cache.used_delta[i];
+		pool_cache.used_delta[i] = 0;
+	}
+
+	pool.large_bytes += pool_cache.large_delta;
+	pool_cache.large_delta = 0;
+}
+
+/* Must be called with the pool mutex held. */
+static struct pool_block* carve_block(u32 cls) {
+	usize stride = pool_header_size + class_size(cls);
+
+	if (pool.slab_left < stride) {
+		struct pool_slab* slab = malloc(pool_slab_size);
+		if (!slab) {
+			abort_with("Out of memory.");
+		}
+
+		heap_allocation_count++;
+
+		slab->next = pool.slabs;
+		pool.slabs = slab;
+
+		pool.slab_cur  = (u8*)slab + pool_header_size;
+		pool.slab_left = pool_slab_size - pool_header_size;
+	}
+
+	struct pool_header* header = (void*)pool.slab_cur;
+	header->cls = cls;
+	header->size = class_size(cls);
+
+	pool.slab_cur  += stride;
+	pool.slab_left -= stride;
+
+	pool.reserved[cls]++;
+
+	return (struct pool_block*)((u8*)header + pool_header_size);
+}
+
+static void refill_cache(u32 cls) {
+	lock_mutex(&pool.mutex);
+
+	fold_cache_stats();
+
+	for (usize i = 0; i < pool_batch_size; i++) {
+		struct pool_block* block = pool.free[cls];
+		if (block) {
+			pool.free[cls] = block->next;
+			pool.free_count[cls]--;
+		} else {
+			block = carve_block(cls);
+		}
+
+		block->next = pool_cache.free[cls];
+		pool_cache.free[cls] = block;
+		pool_cache.count[cls]++;
+	}
+
+	unlock_mutex(&pool.mutex);
+}
+
+static void flush_cache(u32 cls, usize count) {
+	lock_mutex(&pool.mutex);
+
+	fold_cache_stats();
+
+	for (usize i = 0; i < count && pool_cache.free[cls]; i++) {
+		struct pool_block* block = pool_cache.free[cls];
+		pool_cache.free[cls] = block->next;
+		pool_cache.count[cls]--;
+
+		block->next = pool.free[cls];
+		pool.free[cls] = block;
+		pool.free_count[cls]++;
+	}
+
+	unlock_mutex(&pool.mutex);
+}
+
+static void* pool_alloc(usize size) {
+	if (size > alloc_max_class_size) {
+		struct pool_header* header = malloc(pool_header_size + size);
+		if (!header) {
+			abort_with("Out of memory.");
+		}
+
+		heap_allocation_count++;
+
+		header->cls = pool_large_class;
+		header->size = size;
+
+		pool_cache.large_delta += (i64)size;
+
+		return (u8*)header + pool_header_size;
+	}
+
+	u32 cls = size_class(size);
+
+	if (!pool_cache.free[cls]) {
+		refill_cache(cls);
+	}
+
+	struct pool_block* block = pool_cache.free[cls];
+	pool_cache.free[cls] = block->next;
+	pool_cache.count[cls]--;
+	pool_cache.used_delta[cls]++;
+
+	return block;
+}
+
+static void pool_free(void* ptr) {
+	struct pool_header* header = get_header(ptr);
+
+	if (header->cls == pool_large_class) {
+		pool_cache.large_delta -= (i64)header->size;
+		free(header);
+		return;
+	}
+
+	u32 cls = header->cls;
+
+	struct pool_block* block = ptr;
+	block->next = pool_cache.free[cls];
+	pool_cache.free[cls] = block;
+	pool_cache.count[cls]++;
+	pool_cache.used_delta[cls]--;
+
+	if (pool_cache.count[cls] > pool_cache_max) {
+		flush_cache(cls, pool_cache.count[cls] / 2);
+	}
+}
+
+usize release_core_get_memory_usage() {
+	usize r = 0;
+
+	lock_mutex(&pool.mutex);
+
+	fold_cache_stats();
+
+	for (u32 i = 0; i < alloc_class_count; i++) {
+		r += (usize)pool.used[i] * class_size(i);
+	}
+
+	r += (usize)pool.large_bytes;
+
+	unlock_mutex(&pool.mutex);
+
+	return r;
+}
+
+void release_core_get_class_usage(struct alloc_class_usage* usage) {
+	lock_mutex(&pool.mutex);
+
+	fold_cache_stats();
+
+	for (u32 i = 0; i < alloc_class_count; i++) {
+		usage[i].block_size = class_size(i);
+		usage[i].blocks_used = (usize)pool.used[i];
+		usage[i].blocks_reserved = pool.reserved[i];
+	}
+
+	unlock_mutex(&pool.mutex);
+}
+
+void release_alloc_init() {
+	memset(&pool, 0, sizeof pool);
+	memset(&pool_cache, 0, sizeof pool_cache);
+
+	init_mutex(&pool.mutex);
+}
+
+void release_alloc_deinit() {
+	struct pool_slab* slab = pool.slabs;
+	while (slab) {
+		struct pool_slab* next = slab->next;
+		free(slab);
+		slab = next;
+	}
+
+	memset(&pool_cache, 0, sizeof pool_cache);
+
+	deinit_mutex(&pool.mutex);
+}
+
+/* Gives the calling thread's cached blocks back to the global free lists.
+ * Threads other than the main thread should call this before exiting. */
+void release_alloc_thread_deinit() {
+	for (u32 i = 0; i < alloc_class_count; i++) {
+		flush_cache(i, pool_cache.count[i]);
+	}
+}
+
+void release_leak_check() {}
+
+void* release_core_alloc(usize size) {
+	if (size == 0) { return null; }
+
+	return pool_alloc(size);
+}
+
+void* release_core_calloc(usize count, usize size) {
+	if (count * size == 0) { return null; }
+
+	void* ptr = pool_alloc(count * size);
+	memset(ptr, 0, count * size);
+
+	return ptr;
+}
+
+void* release_core_realloc(void* p, usize size) {
+	if (size == 0) {
+		release_core_free(p);
+		return null;
+	}
+
+	if (!p) {
+		return pool_alloc(size);
+	}
+
+	struct pool_header* header = get_header(p);
+
+	if (header->cls != pool_large_class) {
+		if (size <= header->size) {
+			return p;
+		}
+	} else if (size > alloc_max_class_size) {
+		usize old_size = header->size;
+
+		header = realloc(header, pool_header_size + size);
+		if (!header) {
+			abort_with("Out of memory.");
+		}
+
+		heap_allocation_count++;
+
+		header->size = size;
+		pool_cache.large_delta += (i64)size - (i64)old_size;
+
+		return (u8*)header + pool_header_size;
+	}
+
+	void* ptr = pool_alloc(size);
+	memcpy(ptr, p, cr_min(size, header->size));
+	pool_free(p);
+
+	return ptr;
+}
+
+void release_core_free(void* p) {
+	if (p) { pool_free(p); }
+}
+
+#else
+
 usize release_core_get_memory_usage() { return 0; }
 
+void release_core_get_class_usage(struct alloc_class_usage* usage) {
+	memset(usage, 0, sizeof *usage * alloc_class_count);
+}
+
 void release_alloc_init() {}
 void release_alloc_deinit() {}
+void release_alloc_thread_deinit() {}
 void release_leak_check() {}
 
 void* release_core_alloc(usize size) {
@@ -173,6 +1068,8 @@ void* release_core_alloc(usize size) {
 		abort_with("Out of memory.");
 	}
 
+	heap_allocation_count++;
+
 	return ptr;
 }
 
@@ -185,6 +1082,8 @@ void* release_core_calloc(usize count, usize size) {
 		abort_with("Out of memory.");
 	}
 
+	heap_allocation_count++;
+
 	return ptr;
 }
 
@@ -200,6 +1099,8 @@ void* release_core_realloc(void* p, usize size) {
 		abort_with("Out of memory.");
 	}
 
+	heap_allocation_count++;
+
 	return ptr;
 }
 
@@ -207,6 +1108,8 @@ void release_core_free(void* p) {
 	if (p) { free(p); }
 }
 
+#endif
+
 void* aligned_core_alloc(usize size, usize alignment) {
 	usize offset = alignment - 1 + sizeof(void*);
 
@@ -223,3 +1126,115 @@ void aligned_core_free(void* ptr) {
 		core_free(((void**)ptr)[-1]);
 	}
 }
+
+/* Linear allocator. Blocks are chained backwards from the current block so
+ * that they can be merged on reset. */
+struct arena_block {
+	struct arena_block* prev;
+	usize size, used;
+};
+
+#define arena_alignment 16
+#define arena_header_size ((sizeof(struct arena_block) + arena_alignment - 1) & ~(usize)(arena_alignment - 1))
+
+static struct arena_block* new_arena_block(usize size, struct arena_block* prev) {
+	struct arena_block* block = core_alloc(arena_header_size + size);
+	block->prev = prev;
+	block->size = size;
+	block->used = 0;
+
+	return block;
+}
+
+static inline u8* arena_block_data(struct arena_block* block) {
+	return (u8*)block + arena_header_size;
+}
+
+void init_arena(struct arena* arena, usize block_size) {
+	arena->block = null;
+	arena->block_size = block_size;
+}
+
+void deinit_arena(struct arena* arena) {
+	struct arena_block* block = arena->block;
+	while (block) {
+		struct arena_block* prev = block->prev;
+		core_free(block);
+		block = prev;
+	}
+
+	arena->block = null;
+}
+
+void* arena_alloc(struct arena* arena, usize size) {
+	if (size == 0) { return null; }
+
+	size = (size + arena_alignment - 1) & ~(usize)(arena_alignment - 1);
+
+	struct arena_block* block = arena->block;
+
+	if (!block || block->used + size > block->size) {
+		usize block_size = arena->block_size ? arena->block_size : arena_default_block_size;
+		arena->block = block = new_arena_block(size > block_size ? size : block_size, block);
+	}
+
+	void* r = arena_block_data(block) + block->used;
+	block->used += size;
+
+	return r;
+}
+
+/* Grows the allocation in place if it is the last one made from the
+ * current block; Otherwise a new allocation is made and the old contents
+ * are copied over. */
+void* arena_realloc(struct arena* arena, void* ptr, usize old_size, usize new_size) {
+	if (!ptr) {
+		return arena_alloc(arena, new_size);
+	}
+
+	usize old_aligned = (old_size + arena_alignment - 1) & ~(usize)(arena_alignment - 1);
+	usize new_aligned = (new_size + arena_alignment - 1) & ~(usize)(arena_alignment - 1);
+
+	struct arena_block* block = arena->block;
+	if (block && (u8*)ptr + old_aligned == arena_block_data(block) + block->used &&
+		block->used - old_aligned + new_aligned <= block->size) {
+		block->used = block->used - old_aligned + new_aligned;
+		return ptr;
+	}
+
+	void* r = arena_alloc(arena, new_size);
+	memcpy(r, ptr, old_size < new_size ? old_size : new_size);
+
+	return r;
+}
+
+void arena_reset(struct arena* arena) {
+	struct arena_block* block = arena->block;
+	if (!block) { return; }
+
+	if (block->prev) {
+		usize total = 0;
+		for (struct arena_block* b = block; b; b = b->prev) {
+			total += b->size;
+		}
+
+		deinit_arena(arena);
+		arena->block = new_arena_block(total, null);
+	} else {
+		block->used = 0;
+	}
+}
+
+static thread_local_storage struct arena frame_arena;
+
+struct arena* get_frame_arena() {
+	return &frame_arena;
+}
+
+void frame_arena_reset() {
+	arena_reset(&frame_arena);
+}
+
+void frame_arena_deinit() {
+	deinit_arena(&frame_arena);
+}
@@ -1,5 +1,33 @@
 #include "atlas.h"
 
+/* Textures are packed with a skyline: The atlas keeps the top edge of
+ * everything packed so far, as a list of horizontal spans, and a new
+ * texture goes wherever along it its top would be lowest, on top of the
+ * highest span that it covers. The space underneath it is lost, but that
+ * is rarely much when textures are added roughly largest first, and it
+ * makes packing a texture a walk over a handful of spans. */
+
+/* Skyline nodes stay sorted by x, so they can't be removed by swapping. */
+static void skyline_insert(struct atlas* atlas, usize i, struct atlas_skyline_node node) {
+	vector_push(atlas->skyline, node);
+
+	struct atlas_skyline_node* nodes = atlas->skyline;
+	memmove(nodes + i + 1, nodes + i, (vector_count(nodes) - i - 1) * sizeof *nodes);
+	nodes[i] = node;
+}
+
+static void skyline_remove(struct atlas* atlas, usize i) {
+	struct atlas_skyline_node* nodes = atlas->skyline;
+	memmove(nodes + i, nodes + i + 1, (vector_count(nodes) - i - 1) * sizeof *nodes);
+
+	vector_truncate(atlas->skyline, vector_count(atlas->skyline) - 1);
+}
+
+static void reset_skyline(struct atlas* atlas) {
+	vector_clear(atlas->skyline);
+	vector_push(atlas->skyline, ((struct atlas_skyline_node) { 0, 0, atlas->size.x }));
+}
+
 struct atlas* new_atlas(u32 flags) {
 	struct atlas* atlas = core_calloc(1, sizeof(struct atlas));
 
@@ -11,6 +39,9 @@ struct atlas* new_atlas(u32 flags) {
 	atlas->flags = flags;
 
 	atlas->texture = video.new_texture(&image, flags, texture_format_rgba8i);
+	atlas->size = image.size;
+
+	reset_skyline(atlas);
 
 	return atlas;
 }
@@ -19,6 +50,7 @@ void free_atlas(struct atlas* atlas) {
 	video.free_texture(atlas->texture);
 
 	free_table(atlas->rects);
+	free_vector(atlas->skyline);
 
 	core_free(atlas);
 }
@@ -26,62 +58,140 @@ void free_atlas(struct atlas* atlas) {
 void reset_atlas(struct atlas* atlas) {
 	free_table(atlas->rects);
 	memset(&atlas->rects, 0, sizeof atlas->rects);
+
+	reset_skyline(atlas);
 }
 
-bool atlas_add_texture(struct atlas* atlas, const struct texture* new_texture) {
-	/* TODO: Proper packing algorithm. */
+/* The y that a texture of the given size would sit at if its left edge was
+ * at node i's, or -1 if it would stick out of the atlas. */
+static i32 skyline_fit(const struct atlas* atlas, usize i, v2i size) {
+	i32 x = atlas->skyline[i].x;
+	if (x + size.x > atlas->size.x) {
+		return -1;
+	}
 
-	bool recreated = false;
+	i32 y = 0;
+	i32 width_left = size.x;
+	for (; width_left > 0; i++) {
+		y = cr_max(y, atlas->skyline[i].y);
+		width_left -= atlas->skyline[i].width;
+	}
 
-	table_set(atlas->rects, new_texture, make_v4i(0, 0, 0, 0));
+	return y + size.y > atlas->size.y ? -1 : y;
+}
 
-	v2i final_size = make_v2i(0, 0);
-	for (const struct texture** texture_ptr = table_first(atlas->rects);
-		texture_ptr;
-		texture_ptr = table_next(atlas->rects, *texture_ptr)) {
-		const struct texture* texture = *texture_ptr;
+static bool skyline_find(const struct atlas* atlas, v2i size, usize* node, v2i* pos) {
+	i32 best_bottom = INT32_MAX;
+	i32 best_width = INT32_MAX;
+
+	for (usize i = 0; i < vector_count(atlas->skyline); i++) {
+		i32 y = skyline_fit(atlas, i, size);
+		if (y < 0) {
+			continue;
+		}
+
+		i32 bottom = y + size.y;
+		i32 width = atlas->skyline[i].width;
+		if (bottom < best_bottom || (bottom == best_bottom && width < best_width)) {
+			best_bottom = bottom;
+			best_width = width;
+
+			*node = i;
+			*pos = make_v2i(atlas->skyline[i].x, y);
+		}
+	}
 
-		v2i size = video.get_texture_size(texture);
+	return best_bottom != INT32_MAX;
+}
 
-		final_size.x += size.x;
-		final_size.y = cr_max(final_size.y, size.y);
-	}
+/* Raises the skyline over the newly placed rect, trimming or removing the
+ * spans that it now covers and merging neighbours at the same height. */
+static void skyline_add(struct atlas* atlas, usize node, v2i pos, v2i size) {
+	skyline_insert(atlas, node, (struct atlas_skyline_node) { pos.x, pos.y + size.y, size.x });
 
-	if (final_size.x > atlas->size.x || final_size.y > atlas->size.y) {
-		/* The atlas needs more space, re-create the destination texture. */
+	usize i = node + 1;
+	while (i < vector_count(atlas->skyline)) {
+		struct atlas_skyline_node* n = atlas->skyline + i;
+		i32 right = pos.x + size.x;
 
-		video.free_texture(atlas->texture);
-		struct image image = {
-			.colours = null,
-			.size = final_size
-		};
+		if (n->x >= right) {
+			break;
+		}
 
-		atlas->texture = video.new_texture(&image, atlas->flags, texture_format_rgba8i);
-		atlas->size = final_size;
+		i32 overlap = right - n->x;
+		if (overlap < n->width) {
+			n->x += overlap;
+			n->width -= overlap;
+			break;
+		}
 
-		recreated = true;
+		skyline_remove(atlas, i);
 	}
 
-	v2i dst_pos = make_v2i(0, 0);
+	for (i = 0; i + 1 < vector_count(atlas->skyline);) {
+		struct atlas_skyline_node* n = atlas->skyline + i;
 
-	for (struct texture** texture_ptr = table_first(atlas->rects);
-		texture_ptr;
-		texture_ptr = table_next(atlas->rects, *texture_ptr)) {
-		struct texture* texture = *texture_ptr;
-		v4i* dst_rect = table_get(atlas->rects, texture);
+		if (n->y == n[1].y) {
+			n->width += n[1].width;
+			skyline_remove(atlas, i + 1);
+		} else {
+			i++;
+		}
+	}
+}
+
+/* Doubles whichever side is shorter, the width first, until the texture
+ * fits. What the old texture held is copied across in one go on the GPU,
+ * to the same place, so the rects that have been handed out stay valid. */
+static void grow_atlas(struct atlas* atlas, v2i size, usize* node, v2i* pos) {
+	v2i old_size = atlas->size;
+
+	do {
+		if (atlas->size.x <= atlas->size.y) {
+			struct atlas_skyline_node* last = vector_end(atlas->skyline) - 1;
+			if (last->y == 0) {
+				last->width += atlas->size.x;
+			} else {
+				vector_push(atlas->skyline, ((struct atlas_skyline_node) { atlas->size.x, 0, atlas->size.x }));
+			}
+
+			atlas->size.x *= 2;
+		} else {
+			atlas->size.y *= 2;
+		}
+	} while (!skyline_find(atlas, size, node, pos));
+
+	struct image image = {
+		.colours = null,
+		.size = atlas->size
+	};
+
+	struct texture* texture = video.new_texture(&image, atlas->flags, texture_format_rgba8i);
 
-		v2i size = video.get_texture_size(texture);
+	video.texture_copy(texture, make_v2i(0, 0), atlas->texture, make_v2i(0, 0), old_size);
 
-		dst_rect->x = dst_pos.x;
-		dst_rect->y = dst_pos.y;
-		dst_rect->z = size.x;
-		dst_rect->w = size.y;
+	video.free_texture(atlas->texture);
+	atlas->texture = texture;
+}
 
-		video.texture_copy(atlas->texture, dst_pos, texture, make_v2i(0, 0), size);
+bool atlas_add_texture(struct atlas* atlas, const struct texture* texture) {
+	v2i size = video.get_texture_size(texture);
+
+	bool recreated = false;
 
-		dst_pos.x += size.x;
+	usize node;
+	v2i pos;
+	if (!skyline_find(atlas, size, &node, &pos)) {
+		grow_atlas(atlas, size, &node, &pos);
+		recreated = true;
 	}
 
+	skyline_add(atlas, node, pos, size);
+
+	table_set(atlas->rects, texture, make_v4i(pos.x, pos.y, size.x, size.y));
+
+	video.texture_copy(atlas->texture, pos, texture, make_v2i(0, 0), size);
+
 	return recreated;
 }
 
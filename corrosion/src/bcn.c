@@ -0,0 +1,924 @@
+#include <string.h>
+
+#include "bcn.h"
+#include "core.h"
+#include "job.h"
+#include "video.h"
+
+/* How many times the endpoints are fitted to the indices chosen for the
+ * last ones. Most of the gain is in the first pass. */
+#define bcn_refine_passes 2
+
+/* One block's texels, row by row, as RGBA. */
+typedef f32 bcn_texels[16][4];
+
+struct bc7_mode {
+	u8 subsets;
+	u8 partition_bits;
+	u8 rotation_bits;
+	u8 selection_bits;
+	u8 colour_bits;
+	u8 alpha_bits;
+	u8 endpoint_pbits;
+	u8 shared_pbits;
+	u8 index_bits;
+	u8 index_bits2;
+};
+
+static const struct bc7_mode bc7_modes[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+};
+
+/* Which subset each texel belongs to: One bit per texel for two subsets and
+ * two bits per texel for three. */
+static const u16 bc7_partitions2[64] = {
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+	0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+	0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+	0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+	0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+	0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+	0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+};
+
+static const u32 bc7_partitions3[64] = {
+	0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+	0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+	0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+	0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+	0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+	0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+	0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+	0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+};
+
+/* The anchor texel of every subset but the first, whose anchor is always
+ * the first texel. An anchor's index is stored with one bit less. */
+static const u8 bc7_anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static const u8 bc7_anchors3[2][64] = {
+	{
+		 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+		 3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+		 8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+		 3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+	},
+	{
+		15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+		15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+		15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+		15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+	}
+};
+
+static const u8 bc7_weights2[4]  = { 0, 21, 43, 64 };
+static const u8 bc7_weights3[8]  = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const u8 bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+bool bcn_is_block_format(u32 format) {
+	switch (format) {
+		case texture_format_bc1:
+		case texture_format_bc3:
+		case texture_format_bc4:
+		case texture_format_bc5:
+		case texture_format_bc7:
+			return true;
+	}
+
+	return false;
+}
+
+usize bcn_block_size(u32 format) {
+	return format == texture_format_bc1 || format == texture_format_bc4 ? 8 : 16;
+}
+
+usize bcn_level_size(v2i size, u32 format) {
+	usize blocks_x = ((usize)size.x + 3) / 4;
+	usize blocks_y = ((usize)size.y + 3) / 4;
+
+	return blocks_x * blocks_y * bcn_block_size(format);
+}
+
+/* Blocks are little endian bit streams. The block must be zeroed before it
+ * is written to. */
+static void bcn_put_bits(u8* block, u32* pos, u32 value, u32 count) {
+	for (u32 i = 0; i < count; i++, (*pos)++) {
+		block[*pos >> 3] |= (u8)(((value >> i) & 1) << (*pos & 7));
+	}
+}
+
+static u32 bcn_get_bits(const u8* block, u32* pos, u32 count) {
+	u32 value = 0;
+
+	for (u32 i = 0; i < count; i++, (*pos)++) {
+		value |= (u32)((block[*pos >> 3] >> (*pos & 7)) & 1) << i;
+	}
+
+	return value;
+}
+
+force_inline f32 bcn_square(f32 x) {
+	return x * x;
+}
+
+force_inline bool bcn_included(const bool* include, u32 i) {
+	return !include || include[i];
+}
+
+/* Finds the mean of the included texels and the direction in which they
+ * vary the most, by power iteration on their covariance. The axis is zero
+ * if they don't vary at all. */
+static void bcn_principal_axis(const bcn_texels texels, const bool* include, u32 channels, f32* mean, f32* axis) {
+	f32 count = 0.0f;
+
+	for (u32 c = 0; c < 4; c++) {
+		mean[c] = 0.0f;
+		axis[c] = 0.0f;
+	}
+
+	for (u32 i = 0; i < 16; i++) {
+		if (!bcn_included(include, i)) { continue; }
+
+		for (u32 c = 0; c < channels; c++) {
+			mean[c] += texels[i][c];
+		}
+
+		count += 1.0f;
+	}
+
+	if (count == 0.0f) { return; }
+
+	for (u32 c = 0; c < channels; c++) {
+		mean[c] /= count;
+	}
+
+	f32 covariance[4][4] = { 0 };
+
+	for (u32 i = 0; i < 16; i++) {
+		if (!bcn_included(include, i)) { continue; }
+
+		for (u32 a = 0; a < channels; a++) {
+			for (u32 b = 0; b < channels; b++) {
+				covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+			}
+		}
+	}
+
+	/* The row of the channel that varies the most is a good first guess. */
+	u32 widest = 0;
+	for (u32 c = 1; c < channels; c++) {
+		if (covariance[c][c] > covariance[widest][widest]) {
+			widest = c;
+		}
+	}
+
+	f32 v[4];
+	memcpy(v, covariance[widest], sizeof v);
+
+	for (u32 iter = 0; iter < 8; iter++) {
+		f32 next[4] = { 0 };
+		f32 largest = 0.0f;
+
+		for (u32 a = 0; a < channels; a++) {
+			for (u32 b = 0; b < channels; b++) {
+				next[a] += covariance[a][b] * v[b];
+			}
+
+			largest = cr_max(largest, cr_max(next[a], -next[a]));
+		}
+
+		if (largest == 0.0f) { return; }
+
+		for (u32 c = 0; c < channels; c++) {
+			v[c] = next[c] / largest;
+		}
+	}
+
+	f32 length = 0.0f;
+	for (u32 c = 0; c < channels; c++) {
+		length += v[c] * v[c];
+	}
+
+	length = sqrtf(length);
+
+	for (u32 c = 0; c < channels; c++) {
+		axis[c] = v[c] / length;
+	}
+}
+
+/* The extremes of the included texels along the axis through their mean. */
+static void bcn_axis_endpoints(const bcn_texels texels, const bool* include, u32 channels, f32* a, f32* b) {
+	f32 mean[4], axis[4];
+	bcn_principal_axis(texels, include, channels, mean, axis);
+
+	f32 lo = 0.0f, hi = 0.0f;
+
+	for (u32 i = 0; i < 16; i++) {
+		if (!bcn_included(include, i)) { continue; }
+
+		f32 t = 0.0f;
+		for (u32 c = 0; c < channels; c++) {
+			t += (texels[i][c] - mean[c]) * axis[c];
+		}
+
+		lo = cr_min(lo, t);
+		hi = cr_max(hi, t);
+	}
+
+	for (u32 c = 0; c < channels; c++) {
+		a[c] = clamp(mean[c] + axis[c] * hi, 0.0f, 255.0f);
+		b[c] = clamp(mean[c] + axis[c] * lo, 0.0f, 255.0f);
+	}
+}
+
+/* Solves for the endpoints that best reproduce the included texels as
+ * a * w + b * (1 - w), where w is each texel's weight. Fails if the weights
+ * don't pin both endpoints down. */
+static bool bcn_least_squares(const bcn_texels texels, const f32* weights, const bool* include, u32 channels, f32* a, f32* b) {
+	f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	f32 ax[4] = { 0 }, bx[4] = { 0 };
+
+	for (u32 i = 0; i < 16; i++) {
+		if (!bcn_included(include, i)) { continue; }
+
+		f32 w = weights[i];
+		f32 v = 1.0f - w;
+
+		aa += w * w;
+		ab += w * v;
+		bb += v * v;
+
+		for (u32 c = 0; c < channels; c++) {
+			ax[c] += w * texels[i][c];
+			bx[c] += v * texels[i][c];
+		}
+	}
+
+	f32 det = aa * bb - ab * ab;
+	if (det < 1e-6f) { return false; }
+
+	for (u32 c = 0; c < channels; c++) {
+		a[c] = clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+		b[c] = clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+	}
+
+	return true;
+}
+
+static u16 bcn_pack_565(const f32* c) {
+	i32 r = clamp((i32)(c[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+	i32 g = clamp((i32)(c[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+	i32 b = clamp((i32)(c[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+
+	return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void bcn_unpack_565(u16 c, i32* out) {
+	i32 r = (c >> 11) & 31;
+	i32 g = (c >> 5) & 63;
+	i32 b = c & 31;
+
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+}
+
+/* In the three colour mode, the last entry is transparent black. */
+static void bcn_colour_palette(u16 c0, u16 c1, bool three, i32 (*palette)[3]) {
+	bcn_unpack_565(c0, palette[0]);
+	bcn_unpack_565(c1, palette[1]);
+
+	for (u32 c = 0; c < 3; c++) {
+		if (three) {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		} else {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+}
+
+/* Texels that aren't opaque get index 3. */
+static f32 bcn_colour_indices(const bcn_texels texels, const bool* opaque, const i32 (*palette)[3], u32 levels, u8* indices) {
+	f32 total = 0.0f;
+
+	for (u32 i = 0; i < 16; i++) {
+		if (!opaque[i]) {
+			indices[i] = 3;
+			continue;
+		}
+
+		f32 best = 1e30f;
+
+		for (u32 j = 0; j < levels; j++) {
+			f32 e =
+				bcn_square(texels[i][0] - (f32)palette[j][0]) +
+				bcn_square(texels[i][1] - (f32)palette[j][1]) +
+				bcn_square(texels[i][2] - (f32)palette[j][2]);
+
+			if (e < best) {
+				best = e;
+				indices[i] = (u8)j;
+			}
+		}
+
+		total += best;
+	}
+
+	return total;
+}
+
+/* A BC1 colour block. With allow_transparent, texels with alpha below 128
+ * use the three colour mode's transparent black; Otherwise the block is
+ * always in four colour mode, as BC3 requires. */
+static void bcn_encode_colour(const bcn_texels texels, bool allow_transparent, u8* out) {
+	/* The weight of the first endpoint for each index. */
+	static const f32 weights4[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	static const f32 weights3[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+
+	bool opaque[16];
+	bool three = false;
+
+	for (u32 i = 0; i < 16; i++) {
+		opaque[i] = !allow_transparent || texels[i][3] >= 128.0f;
+		three |= !opaque[i];
+	}
+
+	f32 a[4], b[4];
+	bcn_axis_endpoints(texels, opaque, 3, a, b);
+
+	u16 best_c0 = 0, best_c1 = 0;
+	u8 best_indices[16] = { 0 };
+	f32 best_error = 1e30f;
+
+	for (u32 pass = 0; pass <= bcn_refine_passes; pass++) {
+		u16 c0 = bcn_pack_565(a);
+		u16 c1 = bcn_pack_565(b);
+
+		i32 palette[4][3];
+		bcn_colour_palette(c0, c1, three, palette);
+
+		u8 indices[16];
+		f32 e = bcn_colour_indices(texels, opaque, (const i32 (*)[3])palette, three ? 3 : 4, indices);
+
+		if (e < best_error) {
+			best_error = e;
+			best_c0 = c0;
+			best_c1 = c1;
+			memcpy(best_indices, indices, sizeof indices);
+		}
+
+		if (e == 0.0f) { break; }
+
+		f32 weights[16];
+		for (u32 i = 0; i < 16; i++) {
+			weights[i] = three ? weights3[indices[i]] : weights4[indices[i]];
+		}
+
+		if (!bcn_least_squares(texels, weights, opaque, 3, a, b)) { break; }
+	}
+
+	/* The order of the endpoints selects the mode. Swapping them swaps the
+	 * indices of the endpoints and, with four colours, of the two between. */
+	u8 map[4] = { 0, 1, 2, 3 };
+
+	if (three ? best_c0 > best_c1 : best_c0 < best_c1) {
+		u16 t = best_c0;
+		best_c0 = best_c1;
+		best_c1 = t;
+
+		map[0] = 1;
+		map[1] = 0;
+
+		if (!three) {
+			map[2] = 3;
+			map[3] = 2;
+		}
+	} else if (!three && best_c0 == best_c1) {
+		/* That would be the three colour mode, so stick to the first. */
+		memset(map, 0, sizeof map);
+	}
+
+	out[0] = (u8)best_c0;
+	out[1] = (u8)(best_c0 >> 8);
+	out[2] = (u8)best_c1;
+	out[3] = (u8)(best_c1 >> 8);
+
+	for (u32 i = 0; i < 16; i++) {
+		out[4 + i / 4] |= (u8)(map[best_indices[i]] << ((i % 4) * 2));
+	}
+}
+
+/* r0 > r1 selects eight levels between the two; Otherwise there are six
+ * and the last two are 0 and 255. */
+static void bcn_channel_palette(i32 r0, i32 r1, i32* palette) {
+	palette[0] = r0;
+	palette[1] = r1;
+
+	if (r0 > r1) {
+		for (i32 i = 1; i < 7; i++) {
+			palette[i + 1] = ((7 - i) * r0 + i * r1 + 3) / 7;
+		}
+	} else {
+		for (i32 i = 1; i < 5; i++) {
+			palette[i + 1] = ((5 - i) * r0 + i * r1 + 2) / 5;
+		}
+
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static i32 bcn_channel_indices(const i32* values, i32 r0, i32 r1, u8* indices) {
+	i32 palette[8];
+	bcn_channel_palette(r0, r1, palette);
+
+	i32 total = 0;
+
+	for (u32 i = 0; i < 16; i++) {
+		i32 best = 0x7fffffff;
+
+		for (u32 j = 0; j < 8; j++) {
+			i32 d = values[i] - palette[j];
+
+			if (d * d < best) {
+				best = d * d;
+				indices[i] = (u8)j;
+			}
+		}
+
+		total += best;
+	}
+
+	return total;
+}
+
+/* A BC4 block, as also used for BC3's alpha and BC5's two channels. */
+static void bcn_encode_channel(const bcn_texels texels, u32 channel, u8* out) {
+	i32 values[16];
+
+	i32 lo = 255, hi = 0;
+
+	/* The extremes that aren't 0 or 255, which the six level mode has. */
+	i32 inner_lo = 255, inner_hi = 0;
+
+	for (u32 i = 0; i < 16; i++) {
+		values[i] = (i32)texels[i][channel];
+
+		lo = cr_min(lo, values[i]);
+		hi = cr_max(hi, values[i]);
+
+		if (values[i] > 0 && values[i] < 255) {
+			inner_lo = cr_min(inner_lo, values[i]);
+			inner_hi = cr_max(inner_hi, values[i]);
+		}
+	}
+
+	if (inner_lo > inner_hi) {
+		inner_lo = inner_hi = 0;
+	}
+
+	u8 indices8[16], indices6[16];
+	i32 error8 = bcn_channel_indices(values, hi, lo, indices8);
+	i32 error6 = bcn_channel_indices(values, inner_lo, inner_hi, indices6);
+
+	bool six = error6 < error8;
+
+	const u8* indices = six ? indices6 : indices8;
+
+	out[0] = (u8)(six ? inner_lo : hi);
+	out[1] = (u8)(six ? inner_hi : lo);
+
+	u32 pos = 16;
+	for (u32 i = 0; i < 16; i++) {
+		bcn_put_bits(out, &pos, indices[i], 3);
+	}
+}
+
+/* Rounds an endpoint to seven bits per channel, plus the low bit that they
+ * share, whichever is closer. */
+static void bc7_quantise_endpoint(const f32* e, u32* q, u32* p) {
+	f32 best = 1e30f;
+
+	for (u32 bit = 0; bit < 2; bit++) {
+		u32 t[4];
+		f32 error = 0.0f;
+
+		for (u32 c = 0; c < 4; c++) {
+			t[c] = (u32)clamp((i32)((e[c] - (f32)bit) * 0.5f + 0.5f), 0, 127);
+			error += bcn_square((f32)((t[c] << 1) | bit) - e[c]);
+		}
+
+		if (error < best) {
+			best = error;
+			memcpy(q, t, sizeof t);
+			*p = bit;
+		}
+	}
+}
+
+static void bcn_encode_bc7(const bcn_texels texels, u8* out) {
+	f32 a[4], b[4];
+	bcn_axis_endpoints(texels, null, 4, a, b);
+
+	u32 best_q[2][4] = { 0 };
+	u32 best_p[2] = { 0 };
+	u8 best_indices[16] = { 0 };
+	f32 best_error = 1e30f;
+
+	for (u32 pass = 0; pass <= bcn_refine_passes; pass++) {
+		u32 q[2][4], p[2];
+		bc7_quantise_endpoint(a, q[0], &p[0]);
+		bc7_quantise_endpoint(b, q[1], &p[1]);
+
+		i32 palette[16][4];
+		for (u32 c = 0; c < 4; c++) {
+			i32 e0 = (i32)((q[0][c] << 1) | p[0]);
+			i32 e1 = (i32)((q[1][c] << 1) | p[1]);
+
+			for (u32 j = 0; j < 16; j++) {
+				palette[j][c] = ((64 - bc7_weights4[j]) * e0 + bc7_weights4[j] * e1 + 32) >> 6;
+			}
+		}
+
+		u8 indices[16];
+		f32 total = 0.0f;
+
+		for (u32 i = 0; i < 16; i++) {
+			f32 best = 1e30f;
+
+			for (u32 j = 0; j < 16; j++) {
+				f32 e =
+					bcn_square(texels[i][0] - (f32)palette[j][0]) +
+					bcn_square(texels[i][1] - (f32)palette[j][1]) +
+					bcn_square(texels[i][2] - (f32)palette[j][2]) +
+					bcn_square(texels[i][3] - (f32)palette[j][3]);
+
+				if (e < best) {
+					best = e;
+					indices[i] = (u8)j;
+				}
+			}
+
+			total += best;
+		}
+
+		if (total < best_error) {
+			best_error = total;
+			memcpy(best_q, q, sizeof q);
+			memcpy(best_p, p, sizeof p);
+			memcpy(best_indices, indices, sizeof indices);
+		}
+
+		if (total == 0.0f) { break; }
+
+		f32 weights[16];
+		for (u32 i = 0; i < 16; i++) {
+			weights[i] = 1.0f - (f32)bc7_weights4[indices[i]] / 64.0f;
+		}
+
+		if (!bcn_least_squares(texels, weights, null, 4, a, b)) { break; }
+	}
+
+	/* The first texel's index is stored without its top bit, so the
+	 * endpoints are swapped if it is set. */
+	u32 flip = 0;
+
+	if (best_indices[0] & 8) {
+		flip = 15;
+
+		u32 t[4];
+		memcpy(t, best_q[0], sizeof t);
+		memcpy(best_q[0], best_q[1], sizeof t);
+		memcpy(best_q[1], t, sizeof t);
+
+		u32 tp = best_p[0];
+		best_p[0] = best_p[1];
+		best_p[1] = tp;
+	}
+
+	u32 pos = 0;
+	bcn_put_bits(out, &pos, 1 << 6, 7);
+
+	for (u32 c = 0; c < 4; c++) {
+		bcn_put_bits(out, &pos, best_q[0][c], 7);
+		bcn_put_bits(out, &pos, best_q[1][c], 7);
+	}
+
+	bcn_put_bits(out, &pos, best_p[0], 1);
+	bcn_put_bits(out, &pos, best_p[1], 1);
+
+	for (u32 i = 0; i < 16; i++) {
+		bcn_put_bits(out, &pos, best_indices[i] ^ flip, i == 0 ? 3 : 4);
+	}
+}
+
+static void bcn_encode_block(const bcn_texels texels, u32 format, u8* out) {
+	memset(out, 0, bcn_block_size(format));
+
+	switch (format) {
+		case texture_format_bc1:
+			bcn_encode_colour(texels, true, out);
+			break;
+		case texture_format_bc3:
+			bcn_encode_channel(texels, 3, out);
+			bcn_encode_colour(texels, false, out + 8);
+			break;
+		case texture_format_bc4:
+			bcn_encode_channel(texels, 0, out);
+			break;
+		case texture_format_bc5:
+			bcn_encode_channel(texels, 0, out);
+			bcn_encode_channel(texels, 1, out + 8);
+			break;
+		case texture_format_bc7:
+			bcn_encode_bc7(texels, out);
+			break;
+	}
+}
+
+struct bcn_job {
+	const u8* rgba;
+	v2i size;
+	u32 format;
+	u8* dst;
+};
+
+static void bcn_encode_rows(void* uptr, usize begin, usize end) {
+	const struct bcn_job* job = uptr;
+
+	i32 blocks_x = (job->size.x + 3) / 4;
+	usize block_size = bcn_block_size(job->format);
+
+	for (usize by = begin; by < end; by++) {
+		u8* out = job->dst + by * (usize)blocks_x * block_size;
+
+		for (i32 bx = 0; bx < blocks_x; bx++) {
+			bcn_texels texels;
+
+			for (i32 y = 0; y < 4; y++) {
+				i32 sy = cr_min((i32)by * 4 + y, job->size.y - 1);
+
+				for (i32 x = 0; x < 4; x++) {
+					i32 sx = cr_min(bx * 4 + x, job->size.x - 1);
+
+					const u8* texel = job->rgba + ((usize)sy * (usize)job->size.x + (usize)sx) * 4;
+
+					for (u32 c = 0; c < 4; c++) {
+						texels[y * 4 + x][c] = (f32)texel[c];
+					}
+				}
+			}
+
+			bcn_encode_block((const f32 (*)[4])texels, job->format, out);
+			out += block_size;
+		}
+	}
+}
+
+void bcn_encode(const u8* rgba, v2i size, u32 format, u8* dst) {
+	if (size.x <= 0 || size.y <= 0) { return; }
+
+	job_parallel_for(((usize)size.y + 3) / 4, 0, bcn_encode_rows, &(struct bcn_job) {
+		.rgba   = rgba,
+		.size   = size,
+		.format = format,
+		.dst    = dst
+	});
+}
+
+static void bcn_decode_colour(const u8* block, bool allow_transparent, u8 (*out)[4]) {
+	u16 c0 = (u16)(block[0] | (block[1] << 8));
+	u16 c1 = (u16)(block[2] | (block[3] << 8));
+
+	bool three = allow_transparent && c0 <= c1;
+
+	i32 palette[4][3];
+	bcn_colour_palette(c0, c1, three, palette);
+
+	for (u32 i = 0; i < 16; i++) {
+		u32 index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+
+		for (u32 c = 0; c < 3; c++) {
+			out[i][c] = (u8)palette[index][c];
+		}
+
+		out[i][3] = three && index == 3 ? 0 : 255;
+	}
+}
+
+static void bcn_decode_channel(const u8* block, u32 channel, u8 (*out)[4]) {
+	i32 palette[8];
+	bcn_channel_palette(block[0], block[1], palette);
+
+	u32 pos = 16;
+	for (u32 i = 0; i < 16; i++) {
+		out[i][channel] = (u8)palette[bcn_get_bits(block, &pos, 3)];
+	}
+}
+
+static u32 bc7_subset(u32 subsets, u32 partition, u32 i) {
+	switch (subsets) {
+		case 2:  return (bc7_partitions2[partition] >> i) & 1;
+		case 3:  return (bc7_partitions3[partition] >> (i * 2)) & 3;
+		default: return 0;
+	}
+}
+
+static bool bc7_is_anchor(u32 subsets, u32 partition, u32 i) {
+	switch (subsets) {
+		case 2:  return i == 0 || i == bc7_anchors2[partition];
+		case 3:  return i == 0 || i == bc7_anchors3[0][partition] || i == bc7_anchors3[1][partition];
+		default: return i == 0;
+	}
+}
+
+static u32 bc7_weight(u32 bits, u32 index) {
+	switch (bits) {
+		case 2:  return bc7_weights2[index];
+		case 3:  return bc7_weights3[index];
+		default: return bc7_weights4[index];
+	}
+}
+
+static void bcn_decode_bc7(const u8* block, u8 (*out)[4]) {
+	u32 mode = 0;
+	while (mode < 8 && !(block[0] & (1 << mode))) {
+		mode++;
+	}
+
+	/* Reserved modes decode to transparent black. */
+	if (mode == 8) {
+		memset(out, 0, 16 * 4);
+		return;
+	}
+
+	const struct bc7_mode* m = &bc7_modes[mode];
+
+	u32 pos = mode + 1;
+
+	u32 partition = bcn_get_bits(block, &pos, m->partition_bits);
+	u32 rotation  = bcn_get_bits(block, &pos, m->rotation_bits);
+	u32 selection = bcn_get_bits(block, &pos, m->selection_bits);
+
+	u32 endpoint_count = m->subsets * 2u;
+	u32 endpoints[6][4];
+
+	for (u32 c = 0; c < 3; c++) {
+		for (u32 e = 0; e < endpoint_count; e++) {
+			endpoints[e][c] = bcn_get_bits(block, &pos, m->colour_bits);
+		}
+	}
+
+	for (u32 e = 0; e < endpoint_count; e++) {
+		endpoints[e][3] = bcn_get_bits(block, &pos, m->alpha_bits);
+	}
+
+	u32 colour_bits = m->colour_bits;
+	u32 alpha_bits = m->alpha_bits;
+
+	if (m->endpoint_pbits || m->shared_pbits) {
+		u32 pbits[6];
+
+		if (m->endpoint_pbits) {
+			for (u32 e = 0; e < endpoint_count; e++) {
+				pbits[e] = bcn_get_bits(block, &pos, 1);
+			}
+		} else {
+			for (u32 s = 0; s < m->subsets; s++) {
+				pbits[s * 2] = pbits[s * 2 + 1] = bcn_get_bits(block, &pos, 1);
+			}
+		}
+
+		for (u32 e = 0; e < endpoint_count; e++) {
+			for (u32 c = 0; c < (alpha_bits ? 4u : 3u); c++) {
+				endpoints[e][c] = (endpoints[e][c] << 1) | pbits[e];
+			}
+		}
+
+		colour_bits++;
+		if (alpha_bits) { alpha_bits++; }
+	}
+
+	/* Widen to eight bits by repeating the top bits at the bottom. */
+	for (u32 e = 0; e < endpoint_count; e++) {
+		for (u32 c = 0; c < 3; c++) {
+			endpoints[e][c] <<= 8 - colour_bits;
+			endpoints[e][c] |= endpoints[e][c] >> colour_bits;
+		}
+
+		if (alpha_bits) {
+			endpoints[e][3] <<= 8 - alpha_bits;
+			endpoints[e][3] |= endpoints[e][3] >> alpha_bits;
+		} else {
+			endpoints[e][3] = 255;
+		}
+	}
+
+	u32 indices[16], indices2[16];
+
+	for (u32 i = 0; i < 16; i++) {
+		indices[i] = bcn_get_bits(block, &pos, m->index_bits - bc7_is_anchor(m->subsets, partition, i));
+	}
+
+	if (m->index_bits2) {
+		for (u32 i = 0; i < 16; i++) {
+			indices2[i] = bcn_get_bits(block, &pos, m->index_bits2 - (i == 0));
+		}
+	}
+
+	for (u32 i = 0; i < 16; i++) {
+		const u32* e0 = endpoints[bc7_subset(m->subsets, partition, i) * 2];
+		const u32* e1 = endpoints[bc7_subset(m->subsets, partition, i) * 2 + 1];
+
+		/* Modes 4 and 5 have separate indices for alpha; The selection bit
+		 * swaps the two sets of indices. */
+		u32 colour_weight = bc7_weight(m->index_bits, indices[i]);
+		u32 alpha_weight = colour_weight;
+
+		if (m->index_bits2) {
+			alpha_weight = bc7_weight(m->index_bits2, indices2[i]);
+
+			if (selection) {
+				u32 t = colour_weight;
+				colour_weight = alpha_weight;
+				alpha_weight = t;
+			}
+		}
+
+		for (u32 c = 0; c < 4; c++) {
+			u32 w = c == 3 ? alpha_weight : colour_weight;
+			out[i][c] = (u8)(((64 - w) * e0[c] + w * e1[c] + 32) >> 6);
+		}
+
+		if (rotation) {
+			u8 t = out[i][3];
+			out[i][3] = out[i][rotation - 1];
+			out[i][rotation - 1] = t;
+		}
+	}
+}
+
+static void bcn_decode_block(const u8* block, u32 format, u8 (*out)[4]) {
+	switch (format) {
+		case texture_format_bc1:
+			bcn_decode_colour(block, true, out);
+			break;
+		case texture_format_bc3:
+			bcn_decode_colour(block + 8, false, out);
+			bcn_decode_channel(block, 3, out);
+			break;
+		case texture_format_bc4:
+		case texture_format_bc5:
+			memset(out, 0, 16 * 4);
+
+			for (u32 i = 0; i < 16; i++) {
+				out[i][3] = 255;
+			}
+
+			bcn_decode_channel(block, 0, out);
+
+			if (format == texture_format_bc5) {
+				bcn_decode_channel(block + 8, 1, out);
+			}
+			break;
+		case texture_format_bc7:
+			bcn_decode_bc7(block, out);
+			break;
+	}
+}
+
+void bcn_decode(const u8* src, v2i size, u32 format, u8* rgba) {
+	i32 blocks_x = (size.x + 3) / 4;
+	i32 blocks_y = (size.y + 3) / 4;
+
+	usize block_size = bcn_block_size(format);
+
+	for (i32 by = 0; by < blocks_y; by++) {
+		for (i32 bx = 0; bx < blocks_x; bx++) {
+			u8 texels[16][4];
+			bcn_decode_block(src, format, texels);
+			src += block_size;
+
+			for (i32 y = 0; y < 4 && by * 4 + y < size.y; y++) {
+				for (i32 x = 0; x < 4 && bx * 4 + x < size.x; x++) {
+					memcpy(rgba + ((usize)(by * 4 + y) * (usize)size.x + (usize)(bx * 4 + x)) * 4, texels[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+}
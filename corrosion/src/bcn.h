@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "maths.h"
+
+/* Encoders and decoders for the block compressed texture formats, BC1, BC3,
+ * BC4, BC5 and BC7, which store every 4x4 block of texels in 8 or 16 bytes.
+ * Blocks are stored row by row, and blocks that hang over the edge of an
+ * image are padded with its last row and column.
+ *
+ * Endpoints are fitted along the principal axis of each block's colours and
+ * then refined by least squares. The BC7 encoder only writes mode 6, which
+ * has a single pair of RGBA endpoints and sixteen levels in between; That
+ * is plenty for colour maps and a lot faster than searching every mode and
+ * partition. The decoder understands all eight modes. */
+
+bool bcn_is_block_format(u32 format);
+
+/* The size of one block in bytes. */
+usize bcn_block_size(u32 format);
+
+/* The size in bytes of an image of the given size, in whole blocks. */
+usize bcn_level_size(v2i size, u32 format);
+
+/* Encodes a single RGBA image. dst must hold bcn_level_size bytes. Block rows
+ * are spread across the job system. */
+void bcn_encode(const u8* rgba, v2i size, u32 format, u8* dst);
+
+/* Decodes into RGBA texels. Channels that the format doesn't have are zero,
+ * except for alpha, which is 255. */
+void bcn_decode(const u8* src, v2i size, u32 format, u8* rgba);
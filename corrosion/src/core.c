@@ -2,6 +2,16 @@
 #include <stdio.h>
 
 #include "core.h"
+#include "thread.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define table_use_sse2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 u32 table_lookup_count;
 u32 heap_allocation_count;
@@ -20,106 +30,319 @@ u64 elf_hash(const u8* data, usize size) {
 	return (hash & 0x7FFFFFFFFF);
 }
 
+/* 64-bit hash based on wyhash (final version 4) by Wang Yi, which is in the
+ * public domain. It reads eight bytes at a time and mixes using a 64x64->128-bit
+ * multiply. */
+static const u64 wy_secret[4] = {
+	0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+	0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+static inline void wy_mum(u64* a, u64* b) {
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = *a;
+	r *= *b;
+	*a = (u64)r;
+	*b = (u64)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	*a = _umul128(*a, *b, b);
+#else
+	u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b, hi, lo;
+	u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+	lo = t + (rm1 << 32);
+	c += lo < t;
+	hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+	*a = lo;
+	*b = hi;
+#endif
+}
+
+static inline u64 wy_mix(u64 a, u64 b) {
+	wy_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline u64 wy_r8(const u8* p) { u64 v; memcpy(&v, p, 8); return v; }
+static inline u64 wy_r4(const u8* p) { u32 v; memcpy(&v, p, 4); return v; }
+static inline u64 wy_r3(const u8* p, usize k) {
+	return (((u64)p[0]) << 16) | (((u64)p[k >> 1]) << 8) | p[k - 1];
+}
+
+u64 hash_bytes(const u8* p, usize size) {
+	u64 seed = wy_mix(wy_secret[0], wy_secret[1]);
+	u64 a, b;
+
+	if (size <= 16) {
+		if (size >= 4) {
+			a = (wy_r4(p) << 32) | wy_r4(p + ((size >> 3) << 2));
+			b = (wy_r4(p + size - 4) << 32) | wy_r4(p + size - 4 - ((size >> 3) << 2));
+		} else if (size > 0) {
+			a = wy_r3(p, size);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		usize i = size;
+		if (i > 48) {
+			u64 see1 = seed, see2 = seed;
+			do {
+				seed = wy_mix(wy_r8(p)      ^ wy_secret[1], wy_r8(p + 8)  ^ seed);
+				see1 = wy_mix(wy_r8(p + 16) ^ wy_secret[2], wy_r8(p + 24) ^ see1);
+				see2 = wy_mix(wy_r8(p + 32) ^ wy_secret[3], wy_r8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = wy_mix(wy_r8(p) ^ wy_secret[1], wy_r8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+
+		a = wy_r8(p + i - 16);
+		b = wy_r8(p + i - 8);
+	}
+
+	a ^= wy_secret[1];
+	b ^= seed;
+	wy_mum(&a, &b);
+
+	return wy_mix(a ^ wy_secret[0] ^ size, b ^ wy_secret[1]);
+}
+
 u64 hash_string(const char* str) {
-	return elf_hash((const u8*)str, strlen(str));
+	return hash_bytes((const u8*)str, strlen(str));
+}
+
+u64 hash_combine(u64 a, u64 b) {
+	return wy_mix(a ^ wy_secret[0], b ^ wy_secret[2]);
+}
+
+struct hashed_string make_hashed_string(const char* str) {
+	usize len = strlen(str);
+	return (struct hashed_string) { str, len, hash_bytes((const u8*)str, len) };
 }
 
 static inline u64 hash_key(const u8* bytes, usize size, table_hash_fun f) {
-	return f ? f(bytes, size) : elf_hash(bytes, size);
+	return f ? f(bytes, size) : hash_bytes(bytes, size);
 }
 
 static inline bool compare_keys(const void* a, const void* b, usize size, table_compare_fun f) {
 	return f ? f((const u8*)a, (const u8*)b) : (memcmp(a, b, size) == 0);
 }
 
-static inline bool is_el_null(const u8* el, usize off) {
-	return !*(bool*)(el + off);
-}
-
 void table_free_string(u8* ptr) {
 	core_free(*(u8**)ptr);
 }
 
-void* _find_table_el(table_hash_fun hash, table_compare_fun compare, void* els_v, usize el_size, usize capacity,
-	usize key_size, const void* key_ptr, usize key_off, usize val_off, usize state_off, usize isnt_null_off, usize* ind) {
-	usize idx = hash_key(key_ptr, key_size, hash) % capacity;
+/* Group matching. Each function returns a bit mask with bit i set if
+ * control byte i of the group satisfies the condition. */
+#ifdef table_use_sse2
+static inline u32 group_match(const u8* group, u8 h2) {
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)h2)));
+}
 
-	u8* tombstone = null;
+static inline u32 group_match_empty(const u8* group) {
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)table_ctrl_empty)));
+}
 
-	u8* els = els_v;
+/* Empty and deleted control bytes both have the high bit set. */
+static inline u32 group_match_free(const u8* group) {
+	return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+}
+#else
+static inline u32 group_match(const u8* group, u8 h2) {
+	u32 r = 0;
+	for (u32 i = 0; i < table_group_size; i++) {
+		r |= (u32)(group[i] == h2) << i;
+	}
+	return r;
+}
+
+static inline u32 group_match_empty(const u8* group) {
+	return group_match(group, table_ctrl_empty);
+}
+
+static inline u32 group_match_free(const u8* group) {
+	u32 r = 0;
+	for (u32 i = 0; i < table_group_size; i++) {
+		r |= (u32)(group[i] >> 7) << i;
+	}
+	return r;
+}
+#endif
+
+static inline u32 lowest_bit(u32 mask) {
+#if defined(_MSC_VER)
+	unsigned long r;
+	_BitScanForward(&r, mask);
+	return (u32)r;
+#else
+	return (u32)__builtin_ctz(mask);
+#endif
+}
+
+/* The upper bits of the hash select the first group to probe and the lower
+ * seven bits are stored in the control byte. Groups are probed using
+ * triangular numbers, which visits every group once when the group count
+ * is a power of two. The load factor guarantees that there is always at
+ * least one empty slot, so probing always terminates. */
+struct probe_seq {
+	usize group, mask, stride;
+};
+
+static inline struct probe_seq new_probe_seq(u64 hash, usize capacity) {
+	usize mask = (capacity / table_group_size) - 1;
+	return (struct probe_seq) { (usize)(hash >> 7) & mask, mask, 0 };
+}
+
+static inline void probe_next(struct probe_seq* seq) {
+	seq->stride++;
+	seq->group = (seq->group + seq->stride) & seq->mask;
+}
+
+static usize find_slot(table_hash_fun hash, table_compare_fun compare, const u8* ctrl, const u8* els, usize el_size,
+	usize capacity, usize key_size, const void* key, usize key_off, u64 h) {
+	u8 h2 = (u8)(h & 0x7f);
 
 	table_lookup_count++;
 
-	/* Find the first element without a key. Otherwise, finds the first element
-	 * with a key matching key_ptr, of course taking into account the table's
-	 * compare function pointer. */
-	for (;;) {
-		u8* el = els + idx * el_size;
-		if (is_el_null(el, isnt_null_off)) {
-			if (*(el + state_off) != table_el_state_inactive) {
-				if (ind) { *ind = idx; }
-				return tombstone != null ? tombstone : el;
-			} else if (tombstone == null) {
-				tombstone = el;
+	for (struct probe_seq seq = new_probe_seq(h, capacity);; probe_next(&seq)) {
+		const u8* group = ctrl + seq.group * table_group_size;
+
+		for (u32 m = group_match(group, h2); m; m &= m - 1) {
+			usize idx = seq.group * table_group_size + lowest_bit(m);
+			if (compare_keys(els + idx * el_size + key_off, key, key_size, compare)) {
+				return idx;
 			}
-		} else if (compare_keys(el + key_off, key_ptr, key_size, compare)) {
-			if (ind) { *ind = idx; }
-			return el;
 		}
 
-		idx = (idx + 1) % capacity;
+		if (group_match_empty(group)) {
+			return capacity;
+		}
 	}
 }
 
-void* _table_get(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity, usize count,
-	usize key_size, const void* key, usize key_off, usize val_off, usize state_off, usize isnt_null_off) {
-	if (count == 0) { return null; }
+static usize find_free_slot(const u8* ctrl, usize capacity, u64 h) {
+	for (struct probe_seq seq = new_probe_seq(h, capacity);; probe_next(&seq)) {
+		u32 m = group_match_free(ctrl + seq.group * table_group_size);
+		if (m) {
+			return seq.group * table_group_size + lowest_bit(m);
+		}
+	}
+}
+
+void _table_rehash(table_hash_fun hash, u8* els, u8* ctrl, usize capacity, const u8* old_els, const u8* old_ctrl,
+	usize old_capacity, usize el_size, usize key_size, usize key_off) {
+	memset(ctrl, table_ctrl_empty, capacity);
+
+	for (usize i = 0; i < old_capacity; i++) {
+		if (old_ctrl[i] & 0x80) { continue; }
+
+		const u8* el = old_els + i * el_size;
+
+		u64 h = hash_key(el + key_off, key_size, hash);
+		usize idx = find_free_slot(ctrl, capacity, h);
+
+		ctrl[idx] = (u8)(h & 0x7f);
+		memcpy(els + idx * el_size, el, el_size);
+	}
+}
+
+void* _table_insert(table_hash_fun hash, table_compare_fun compare, u8* ctrl, void* els_v, usize el_size, usize capacity,
+	usize key_size, const void* key, usize key_off, usize* count, usize* deleted, bool* is_new) {
+	u8* els = els_v;
 
-	u8* el = _find_table_el(hash, compare, els, el_size, capacity, key_size, key, key_off, val_off, state_off, isnt_null_off, null);
-	if (is_el_null(el, isnt_null_off)) {
+	u64 h = hash_key(key, key_size, hash);
+
+	usize idx = find_slot(hash, compare, ctrl, els, el_size, capacity, key_size, key, key_off, h);
+	if (idx != capacity) {
+		*is_new = false;
+		return els + idx * el_size;
+	}
+
+	idx = find_free_slot(ctrl, capacity, h);
+	if (ctrl[idx] == table_ctrl_deleted) {
+		(*deleted)--;
+	}
+
+	ctrl[idx] = (u8)(h & 0x7f);
+	(*count)++;
+
+	*is_new = true;
+	return els + idx * el_size;
+}
+
+/* Returns the removed element so that the caller can free its key. If the
+ * group still has an empty slot, no probe sequence can have passed through
+ * it, so the slot can be marked empty instead of leaving a tombstone. */
+void* _table_remove(table_hash_fun hash, table_compare_fun compare, u8* ctrl, void* els_v, usize el_size, usize capacity,
+	usize key_size, const void* key, usize key_off, usize* count, usize* deleted) {
+	u8* els = els_v;
+
+	usize idx = find_slot(hash, compare, ctrl, els, el_size, capacity, key_size, key, key_off,
+		hash_key(key, key_size, hash));
+	if (idx == capacity) {
 		return null;
 	}
 
-	return el + val_off;
+	if (group_match_empty(ctrl + (idx & ~(usize)(table_group_size - 1)))) {
+		ctrl[idx] = table_ctrl_empty;
+	} else {
+		ctrl[idx] = table_ctrl_deleted;
+		(*deleted)++;
+	}
+
+	(*count)--;
+
+	return els + idx * el_size;
 }
 
-void* _table_first_key(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity,
-	usize count, usize key_size, usize key_off, usize val_off, usize state_off, usize isnt_null_off) {
+void* _table_get(table_hash_fun hash, table_compare_fun compare, const u8* ctrl, void* els, usize el_size, usize capacity,
+	usize count, usize key_size, const void* key, usize key_off, usize val_off) {
 	if (count == 0) { return null; }
 
-	for (usize i = 0; i < capacity; i++) {
-		u8* el = (u8*)els + i * el_size;
-		if (!is_el_null(el, isnt_null_off)) {
-			return el + key_off;
+	usize idx = find_slot(hash, compare, ctrl, els, el_size, capacity, key_size, key, key_off,
+		hash_key(key, key_size, hash));
+	if (idx == capacity) {
+		return null;
+	}
+
+	return (u8*)els + idx * el_size + val_off;
+}
+
+static void* next_full(const u8* ctrl, void* els, usize el_size, usize capacity, usize key_off, usize start) {
+	for (usize i = start; i < capacity; i++) {
+		if (!(ctrl[i] & 0x80)) {
+			return (u8*)els + i * el_size + key_off;
 		}
 	}
 
 	return null;
 }
 
-void* _table_next_key(table_hash_fun hash, table_compare_fun compare, void* els, usize el_size, usize capacity,
-	usize count, usize key_size, const void* key, usize key_off, usize val_off, usize state_off, usize isnt_null_off) {
+void* _table_first_key(const u8* ctrl, void* els, usize el_size, usize capacity, usize count, usize key_off) {
 	if (count == 0) { return null; }
 
-	usize idx = 0;
+	return next_full(ctrl, els, el_size, capacity, key_off, 0);
+}
 
-	u8* el = _find_table_el(hash, compare, els, el_size, capacity, key_size, key, key_off, val_off, state_off, isnt_null_off, &idx);
-	if (is_el_null(el, isnt_null_off)) {
-		return null;
-	}
+void* _table_next_key(table_hash_fun hash, table_compare_fun compare, const u8* ctrl, void* els, usize el_size, usize capacity,
+	usize count, usize key_size, const void* key, usize key_off) {
+	if (count == 0) { return null; }
 
-	if (idx >= capacity) {
+	usize idx = find_slot(hash, compare, ctrl, els, el_size, capacity, key_size, key, key_off,
+		hash_key(key, key_size, hash));
+	if (idx == capacity) {
 		return null;
 	}
 
-	for (usize i = idx + 1; i < capacity; i++) {
-		el = (u8*)els + i * el_size;
-		if (!is_el_null(el, isnt_null_off)) {
-			return el + key_off;
-		}
-	}
-
-	return null;
+	return next_full(ctrl, els, el_size, capacity, key_off, idx + 1);
 }
 
 char* copy_string(const char* str) {
@@ -131,3 +354,95 @@ char* copy_string(const char* str) {
 
 	return r;
 }
+
+/* The string pool copies strings into large chunks, so interning a string
+ * doesn't cost an allocation of its own, and indexes them by content. */
+#define string_pool_chunk_size 16384
+
+struct string_pool_chunk {
+	struct string_pool_chunk* next;
+	usize used, size;
+};
+
+static struct {
+	table(struct hashed_string, const char*) index;
+	struct string_pool_chunk* chunks;
+	struct mutex mutex;
+} string_pool;
+
+void string_pool_init() {
+	memset(&string_pool, 0, sizeof string_pool);
+
+	string_pool.index.hash    = table_hash_hashed_string;
+	string_pool.index.compare = table_compare_hashed_string;
+
+	init_mutex(&string_pool.mutex);
+}
+
+void string_pool_deinit() {
+	free_table(string_pool.index);
+
+	struct string_pool_chunk* chunk = string_pool.chunks;
+	while (chunk) {
+		struct string_pool_chunk* next = chunk->next;
+		core_free(chunk);
+		chunk = next;
+	}
+
+	deinit_mutex(&string_pool.mutex);
+}
+
+static char* string_pool_alloc(usize size) {
+	struct string_pool_chunk* chunk = string_pool.chunks;
+
+	if (!chunk || chunk->used + size > chunk->size) {
+		usize chunk_size = size > string_pool_chunk_size ? size : string_pool_chunk_size;
+
+		chunk = core_alloc(sizeof *chunk + chunk_size);
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		chunk->next = string_pool.chunks;
+		string_pool.chunks = chunk;
+	}
+
+	char* r = (char*)(chunk + 1) + chunk->used;
+	chunk->used += size;
+
+	return r;
+}
+
+const char* intern_string(const char* str) {
+	struct hashed_string key = make_hashed_string(str);
+
+	lock_mutex(&string_pool.mutex);
+
+	const char** got = table_get(string_pool.index, key);
+	if (got) {
+		const char* r = *got;
+		unlock_mutex(&string_pool.mutex);
+		return r;
+	}
+
+	char* copy = string_pool_alloc(key.len + 1);
+	memcpy(copy, str, key.len + 1);
+
+	key.str = copy;
+	table_set(string_pool.index, key, copy);
+
+	unlock_mutex(&string_pool.mutex);
+
+	return copy;
+}
+
+const char* lookup_interned_string(const char* str) {
+	struct hashed_string key = make_hashed_string(str);
+
+	lock_mutex(&string_pool.mutex);
+
+	const char** got = table_get(string_pool.index, key);
+	const char* r = got ? *got : null;
+
+	unlock_mutex(&string_pool.mutex);
+
+	return r;
+}
@@ -103,17 +103,56 @@ struct dtable new_v4_dtable(const char* name, v4f value) {
 	return r;
 }
 
+/* The index is an open-addressed table of child indices plus one, so that
+ * zero marks an empty slot, kept at most half full. Keys that appear more
+ * than once keep their first child, like the linear search. */
+static bool dtable_index_insert(struct dtable* dt, u32 child) {
+	const struct dtable_key* key = &dt->children[child].key;
+
+	for (usize i = (usize)hash_bytes((const u8*)key->chars, key->len) & dt->index_mask;; i = (i + 1) & dt->index_mask) {
+		u32 slot = dt->index[i];
+
+		if (slot == 0) {
+			dt->index[i] = child + 1;
+			return true;
+		}
+
+		const struct dtable_key* other = &dt->children[slot - 1].key;
+		if (other->len == key->len && memcmp(other->chars, key->chars, key->len) == 0) {
+			return false;
+		}
+	}
+}
+
+static void build_dtable_index(struct dtable* dt) {
+	usize count = vector_count(dt->children);
+
+	usize capacity = 16;
+	while (capacity < count * 2) {
+		capacity *= 2;
+	}
+
+	core_free(dt->index);
+	dt->index = core_calloc(capacity, sizeof *dt->index);
+	dt->index_mask = capacity - 1;
+
+	for (usize i = 0; i < count; i++) {
+		dtable_index_insert(dt, (u32)i);
+	}
+}
+
 void dtable_add_child(struct dtable* dt, const struct dtable* child) {
 	vector_push(dt->children, *child);
-}
 
-static void write_int(void* a, usize size, FILE* file) {
-	for (i64 i = (i64)size; i >= 0; i--) {
-		u8 byte = *(((u8*)a) + i);
-		fprintf(file, "%x", byte);
-		printf("%x", byte);
+	if (dt->index) {
+		usize count = vector_count(dt->children);
+
+		if (count * 2 > dt->index_mask + 1) {
+			build_dtable_index(dt);
+		} else {
+			dtable_index_insert(dt, (u32)(count - 1));
+		}
 	}
-	printf("\n");
 }
 
 static void write_dtable_value(const struct dtable_value* val, FILE* file) {
@@ -122,7 +161,7 @@ static void write_dtable_value(const struct dtable_value* val, FILE* file) {
 			fprintf(file, "%g", val->as.number);
 			break;
 		case dtable_uinteger:
-			fprintf(file, "#%llx", val->as.uinteger);
+			fprintf(file, "#%llx", (unsigned long long)val->as.uinteger);
 			break;
 		case dtable_bool:
 			fprintf(file, val->as.boolean ? "true" : "false");
@@ -131,13 +170,13 @@ static void write_dtable_value(const struct dtable_value* val, FILE* file) {
 			fprintf(file, "\"%s\"", val->as.string);
 			break;
 		case dtable_colour: {
-			u8 r = (u8)(val->as.colour.x * 255.0f);
-			u8 g = (u8)(val->as.colour.y * 255.0f);
-			u8 b = (u8)(val->as.colour.z * 255.0f);
-			u8 a = (u8)(val->as.colour.w * 255.0f);
+			u8 r = (u8)(val->as.colour.x * 255.0f + 0.5f);
+			u8 g = (u8)(val->as.colour.y * 255.0f + 0.5f);
+			u8 b = (u8)(val->as.colour.z * 255.0f + 0.5f);
+			u8 a = (u8)(val->as.colour.w * 255.0f + 0.5f);
 
 			fprintf(file, "colour(#");
-			fprintf(file, "%x%x%x", r, g, b);
+			fprintf(file, "%02x%02x%02x", r, g, b);
 			if (a != 255) {
 				fprintf(file, ", %d", a);
 			}
@@ -153,6 +192,7 @@ static void write_dtable_value(const struct dtable_value* val, FILE* file) {
 			break;
 		case dtable_v4:
 			fprintf(file, "v4(%g, %g, %g, %g)", val->as.v4.x, val->as.v4.y, val->as.v4.z, val->as.v4.w);
+			break;
 		default: break;
 	}
 
@@ -191,6 +231,7 @@ void write_dtable(const struct dtable* dt, const char* filename) {
 	FILE* file = fopen(filename, "w");
 	if (!file) {
 		error("Failed to fopen `%s' for writing.", filename);
+		return;
 	}
 
 	for (usize i = 0; i < vector_count(dt->children); i++) {
@@ -200,6 +241,306 @@ void write_dtable(const struct dtable* dt, const char* filename) {
 	fclose(file);
 }
 
+/* Binary encoding.
+ *
+ * A header is followed by every node in breadth-first order, so that the
+ * children of each table are contiguous, starting with the top-level nodes.
+ * Nodes are sixteen bytes; Values that don't fit, the three and four
+ * component vectors, go into a block of floats after the nodes, and keys and
+ * strings into a block of characters after that, which holds every distinct
+ * string once. None of the structures have any padding, and everything is
+ * little endian. */
+#define dtable_binary_version 1
+
+struct dtable_binary_header {
+	char id[4];
+	u32 version;
+	u32 node_count;
+	u32 root_count;
+	u32 float_count;
+	u32 strings_size;
+};
+
+struct dtable_binary_node {
+	u32 key_offset;
+	u16 key_len;
+	u8 type;
+	u8 reserved;
+
+	union {
+		f64 number;
+		u64 uinteger;
+		u32 boolean;
+		f32 v2[2];
+
+		/* Into the float block. */
+		u32 floats_offset;
+
+		struct {
+			u32 first;
+			u32 count;
+		} children;
+
+		struct {
+			u32 offset;
+			u32 len;
+		} string;
+	} as;
+};
+
+struct dtable_binary_writer {
+	vector(struct dtable_binary_node) nodes;
+	vector(const struct dtable*) sources;
+	vector(f32) floats;
+	vector(char) strings;
+
+	table(struct hashed_string, u32) string_offsets;
+};
+
+static void binary_add_string(struct dtable_binary_writer* w, const char* str, u32* offset, usize* len) {
+	struct hashed_string key = make_hashed_string(str);
+
+	u32* got = table_get(w->string_offsets, key);
+	if (got) {
+		*offset = *got;
+	} else {
+		*offset = (u32)vector_count(w->strings);
+
+		for (usize i = 0; i < key.len; i++) {
+			vector_push(w->strings, str[i]);
+		}
+
+		table_set(w->string_offsets, key, *offset);
+	}
+
+	*len = key.len;
+}
+
+static void binary_add_floats(struct dtable_binary_writer* w, const f32* floats, usize count, u32* offset) {
+	*offset = (u32)vector_count(w->floats);
+
+	for (usize i = 0; i < count; i++) {
+		vector_push(w->floats, floats[i]);
+	}
+}
+
+static void binary_add_node(struct dtable_binary_writer* w, const struct dtable* dt) {
+	struct dtable_binary_node node = { .type = (u8)dt->value.type };
+
+	usize len;
+	binary_add_string(w, dt->key.chars, &node.key_offset, &len);
+	node.key_len = (u16)len;
+
+	switch (dt->value.type) {
+		case dtable_parent:
+			node.as.children.count = (u32)vector_count(dt->children);
+			break;
+		case dtable_number:
+			node.as.number = dt->value.as.number;
+			break;
+		case dtable_uinteger:
+			node.as.uinteger = dt->value.as.uinteger;
+			break;
+		case dtable_bool:
+			node.as.boolean = dt->value.as.boolean;
+			break;
+		case dtable_string:
+			binary_add_string(w, dt->value.as.string, &node.as.string.offset, &len);
+			node.as.string.len = (u32)len;
+			break;
+		case dtable_colour:
+		case dtable_v4:
+			binary_add_floats(w, (const f32*)&dt->value.as.v4, 4, &node.as.floats_offset);
+			break;
+		case dtable_v2:
+			node.as.v2[0] = dt->value.as.v2.x;
+			node.as.v2[1] = dt->value.as.v2.y;
+			break;
+		case dtable_v3:
+			binary_add_floats(w, (const f32*)&dt->value.as.v3, 3, &node.as.floats_offset);
+			break;
+	}
+
+	vector_push(w->nodes, node);
+	vector_push(w->sources, dt);
+}
+
+bool write_dtable_binary(const struct dtable* dt, const char* filename) {
+	struct dtable_binary_writer w = { 0 };
+
+	w.string_offsets.hash    = table_hash_hashed_string;
+	w.string_offsets.compare = table_compare_hashed_string;
+
+	for (usize i = 0; i < vector_count(dt->children); i++) {
+		binary_add_node(&w, dt->children + i);
+	}
+
+	/* Each table's children are appended as soon as the table is reached,
+	 * which keeps them together and puts them after their parent. */
+	for (usize i = 0; i < vector_count(w.nodes); i++) {
+		const struct dtable* src = w.sources[i];
+
+		if (src->value.type == dtable_parent) {
+			w.nodes[i].as.children.first = (u32)vector_count(w.nodes);
+
+			for (usize j = 0; j < vector_count(src->children); j++) {
+				binary_add_node(&w, src->children + j);
+			}
+		}
+	}
+
+	struct dtable_binary_header header = {
+		.id           = { 'D', 'T', 'B', 'L' },
+		.version      = dtable_binary_version,
+		.node_count   = (u32)vector_count(w.nodes),
+		.root_count   = (u32)vector_count(dt->children),
+		.float_count  = (u32)vector_count(w.floats),
+		.strings_size = (u32)vector_count(w.strings)
+	};
+
+	bool ok = false;
+
+	FILE* file = fopen(filename, "wb");
+	if (file) {
+		ok =
+			fwrite(&header, sizeof header, 1, file) == 1 &&
+			fwrite(w.nodes,   sizeof *w.nodes,  header.node_count,  file) == header.node_count &&
+			fwrite(w.floats,  sizeof *w.floats, header.float_count, file) == header.float_count &&
+			fwrite(w.strings, 1, header.strings_size, file) == header.strings_size;
+
+		fclose(file);
+	}
+
+	if (!ok) {
+		error("Failed to write `%s'.", filename);
+	}
+
+	free_vector(w.nodes);
+	free_vector(w.sources);
+	free_vector(w.floats);
+	free_vector(w.strings);
+	free_table(w.string_offsets);
+
+	return ok;
+}
+
+static bool binary_range_ok(u32 offset, u32 count, u32 size) {
+	return offset <= size && count <= size - offset;
+}
+
+bool read_dtable_binary(struct dtable_doc* doc, const u8* data, usize size) {
+	memset(doc, 0, sizeof *doc);
+
+	struct dtable_binary_header header;
+	if (size < sizeof header) {
+		error("Binary DTable is truncated.");
+		return false;
+	}
+
+	memcpy(&header, data, sizeof header);
+
+	if (memcmp(header.id, "DTBL", 4) != 0 || header.version != dtable_binary_version) {
+		error("Not a binary DTable, or of an unsupported version.");
+		return false;
+	}
+
+	u64 nodes_size  = (u64)header.node_count  * sizeof(struct dtable_binary_node);
+	u64 floats_size = (u64)header.float_count * sizeof(f32);
+	if (header.root_count > header.node_count ||
+		(u64)(size - sizeof header) < nodes_size + floats_size + header.strings_size) {
+		error("Binary DTable is truncated.");
+		return false;
+	}
+
+	const u8* src = data + sizeof header;
+	const u8* floats = src + nodes_size;
+	const char* strings = (const char*)floats + floats_size;
+
+	/* All of the nodes go into a single block, and the child indices and
+	 * string offsets are turned into pointers on the way in. */
+	usize doc_size = (usize)header.node_count * sizeof(struct dtable_node);
+	init_arena(&doc->arena, cr_max(doc_size, 16));
+	struct dtable_node* nodes = arena_alloc(&doc->arena, doc_size);
+
+	for (u32 i = 0; i < header.node_count; i++) {
+		struct dtable_binary_node n;
+		memcpy(&n, src + (usize)i * sizeof n, sizeof n);
+
+		struct dtable_node* node = nodes + i;
+		memset(node, 0, sizeof *node);
+
+		if (!binary_range_ok(n.key_offset, n.key_len, header.strings_size)) {
+			goto corrupt;
+		}
+
+		node->key.chars = strings + n.key_offset;
+		node->key.len   = n.key_len;
+		node->type      = n.type;
+
+		switch (n.type) {
+			case dtable_parent:
+				/* Children always come after their parent, so there can't
+				 * be any cycles. */
+				if (n.as.children.count > 0) {
+					if (n.as.children.first <= i || !binary_range_ok(n.as.children.first, n.as.children.count, header.node_count)) {
+						goto corrupt;
+					}
+
+					node->child_count = n.as.children.count;
+					node->children = nodes + n.as.children.first;
+				}
+				break;
+			case dtable_number:
+				node->as.number = n.as.number;
+				break;
+			case dtable_uinteger:
+				node->as.uinteger = n.as.uinteger;
+				break;
+			case dtable_bool:
+				node->as.boolean = n.as.boolean != 0;
+				break;
+			case dtable_string:
+				if (!binary_range_ok(n.as.string.offset, n.as.string.len, header.strings_size)) {
+					goto corrupt;
+				}
+
+				node->as.string.chars = strings + n.as.string.offset;
+				node->as.string.len   = n.as.string.len;
+				break;
+			case dtable_colour:
+			case dtable_v4:
+				if (!binary_range_ok(n.as.floats_offset, 4, header.float_count)) {
+					goto corrupt;
+				}
+
+				memcpy(&node->as.v4, floats + (usize)n.as.floats_offset * sizeof(f32), sizeof(f32) * 4);
+				break;
+			case dtable_v2:
+				node->as.v2 = make_v2f(n.as.v2[0], n.as.v2[1]);
+				break;
+			case dtable_v3:
+				if (!binary_range_ok(n.as.floats_offset, 3, header.float_count)) {
+					goto corrupt;
+				}
+
+				memcpy(&node->as.v3, floats + (usize)n.as.floats_offset * sizeof(f32), sizeof(f32) * 3);
+				break;
+			default: goto corrupt;
+		}
+	}
+
+	doc->root.type = dtable_parent;
+	doc->root.child_count = header.root_count;
+	doc->root.children = header.root_count > 0 ? nodes : null;
+
+	return true;
+
+corrupt:
+	error("Binary DTable is corrupt.");
+	deinit_dtable_doc(doc);
+	return false;
+}
+
 /* Parser. */
 enum {
 	tok_equal = 0,
@@ -348,7 +689,8 @@ static struct token next_tok(struct parser* parser) {
 
 		struct token tok = make_token(parser, tok_key);
 
-		for (u32 i = tok_false; i < tok_keyword_count; i++) { /* Check for keywords. */
+		/* No keyword is longer than "colour", so most keys can skip this. */
+		for (u32 i = tok_false; tok.len <= 6 && i < tok_keyword_count; i++) { /* Check for keywords. */
 			if (strlen(keywords[i]) == tok.len && memcmp(parser->start, keywords[i], tok.len) == 0) {
 				tok.type = i;
 				return tok;
@@ -421,10 +763,6 @@ static void parse_error(const struct parser* parser, const char* message) {
 	error("Parsing DTable on line %u: %s", parser->line, message);
 }
 
-/* Returns zero on failure. Recursive-decent parser. */
-static bool parse(struct dtable* dt, struct parser* parser) {
-	struct token tok = parser->token;
-
 #define advance() tok = next_tok(parser)
 #define expect_tok(t_, err_) \
 	do { \
@@ -446,66 +784,37 @@ static bool parse(struct dtable* dt, struct parser* parser) {
 		consume_tok(tok_semicolon, "Expected `;' after value."); \
 	} while (0)
 
-	if (tok.type == tok_end) {
-		goto success;
-	} else {
-		expect_tok(tok_key, "Expected a key.");
-	}
-
-	memcpy(dt->key.chars, tok.start, tok.len);
-	dt->key.len = tok.len;
-	consume_tok(tok_equal, "Expected `=' after key.");
-	advance();
+/* Parses any value but a table, starting from the current token and ending
+ * on the `;' after it. Strings aren't copied; `string' is left pointing into
+ * the source instead. Returns zero on failure. */
+static bool parse_value(struct parser* parser, struct dtable_value* value, struct dtable_slice* string) {
+	struct token tok = parser->token;
 
 	switch (tok.type) {
-		case tok_left_brace:
-			for (;;) {
-				advance();
-				parser->token = tok;
-
-				if (tok.type == tok_right_brace) {
-					break;
-				} else if (parser->token.type == tok_end) {
-					parse_error(parser, "Unexpected end.");
-					return false;
-				}
-
-				dt->value.type = dtable_parent;
-
-				struct dtable child = { 0 };
-				if (!parse(&child, parser)) {
-					return false;
-				}
-				dtable_add_child(dt, &child);
-
-				tok = parser->token;
-			}
-			break;
 		case tok_number:
-			dt->value.type = dtable_number;
-			dt->value.as.number = strtod(tok.start, null);
+			value->type = dtable_number;
+			value->as.number = strtod(tok.start, null);
 			after_value();
 			break;
 		case tok_hex:
-			dt->value.type = dtable_uinteger;
-			dt->value.as.uinteger = strtol(tok.start, null, 16);
+			value->type = dtable_uinteger;
+			value->as.uinteger = strtol(tok.start, null, 16);
 			after_value();
 			break;
 		case tok_string:
-			dt->value.type = dtable_string;
-			dt->value.as.string = core_alloc(tok.len + 1);
-			memcpy(dt->value.as.string, tok.start, tok.len);
-			dt->value.as.string[tok.len] = '\0';
+			value->type = dtable_string;
+			string->chars = tok.start;
+			string->len = tok.len;
 			after_value();
 			break;
 		case tok_true:
-			dt->value.type = dtable_bool;
-			dt->value.as.boolean = true;
+			value->type = dtable_bool;
+			value->as.boolean = true;
 			after_value();
 			break;
 		case tok_false:
-			dt->value.type = dtable_bool;
-			dt->value.as.boolean = false;
+			value->type = dtable_bool;
+			value->as.boolean = false;
 			after_value();
 			break;
 		case tok_colour: {
@@ -525,8 +834,8 @@ static bool parse(struct dtable* dt, struct parser* parser) {
 				expect_tok(tok_right_paren, "Expected `)' after value.");
 			}
 
-			dt->value.type = dtable_colour;
-			dt->value.as.colour = make_rgba(val, a);
+			value->type = dtable_colour;
+			value->as.colour = make_rgba(val, a);
 
 			after_value();
 		} break;
@@ -543,8 +852,8 @@ static bool parse(struct dtable* dt, struct parser* parser) {
 
 			consume_tok(tok_right_paren, "Expected `)' after number.");
 
-			dt->value.type = dtable_v2;
-			dt->value.as.v2 = make_v2f((f32)val1, (f32)val2);
+			value->type = dtable_v2;
+			value->as.v2 = make_v2f((f32)val1, (f32)val2);
 
 			after_value();
 		} break;
@@ -566,8 +875,8 @@ static bool parse(struct dtable* dt, struct parser* parser) {
 
 			consume_tok(tok_right_paren, "Expected `)' after number.");
 
-			dt->value.type = dtable_v3;
-			dt->value.as.v3 = make_v3f((f32)val1, (f32)val2, (f32)val3);
+			value->type = dtable_v3;
+			value->as.v3 = make_v3f((f32)val1, (f32)val2, (f32)val3);
 
 			after_value();
 		} break;
@@ -594,8 +903,8 @@ static bool parse(struct dtable* dt, struct parser* parser) {
 
 			consume_tok(tok_right_paren, "Expected `)' after number.");
 
-			dt->value.type = dtable_v4;
-			dt->value.as.v4 = make_v4f((f32)val1, (f32)val2, (f32)val3, (f32)val4);
+			value->type = dtable_v4;
+			value->as.v4 = make_v4f((f32)val1, (f32)val2, (f32)val3, (f32)val4);
 
 			after_value();
 		} break;
@@ -608,10 +917,64 @@ static bool parse(struct dtable* dt, struct parser* parser) {
 			return false;
 	}
 
-#undef advance
-#undef after_value
-#undef consume_tok
-#undef expect_tok
+	parser->token = tok;
+
+	return true;
+}
+
+/* Returns zero on failure. Recursive-decent parser. */
+static bool parse(struct dtable* dt, struct parser* parser) {
+	struct token tok = parser->token;
+
+	if (tok.type == tok_end) {
+		goto success;
+	} else {
+		expect_tok(tok_key, "Expected a key.");
+	}
+
+	dt->key.len = cr_min(tok.len, sizeof dt->key.chars - 1);
+	memcpy(dt->key.chars, tok.start, dt->key.len);
+	consume_tok(tok_equal, "Expected `=' after key.");
+	advance();
+
+	if (tok.type == tok_left_brace) {
+		for (;;) {
+			advance();
+			parser->token = tok;
+
+			if (tok.type == tok_right_brace) {
+				break;
+			} else if (parser->token.type == tok_end) {
+				parse_error(parser, "Unexpected end.");
+				return false;
+			}
+
+			dt->value.type = dtable_parent;
+
+			struct dtable child = { 0 };
+			if (!parse(&child, parser)) {
+				return false;
+			}
+			dtable_add_child(dt, &child);
+
+			tok = parser->token;
+		}
+	} else {
+		parser->token = tok;
+
+		struct dtable_slice string;
+		if (!parse_value(parser, &dt->value, &string)) {
+			return false;
+		}
+
+		if (dt->value.type == dtable_string) {
+			dt->value.as.string = core_alloc(string.len + 1);
+			memcpy(dt->value.as.string, string.chars, string.len);
+			dt->value.as.string[string.len] = '\0';
+		}
+
+		tok = parser->token;
+	}
 
 success:
 	parser->token = tok;
@@ -619,6 +982,85 @@ success:
 	return true;
 }
 
+/* Children are collected on `pending' while their parent is being parsed and
+ * moved into the arena in one piece once it is closed, so that siblings end
+ * up next to each other without ever growing an array in the arena. */
+static bool parse_node(struct dtable_node* node, struct parser* parser, struct arena* arena, vector(struct dtable_node)* pending) {
+	struct token tok = parser->token;
+
+	expect_tok(tok_key, "Expected a key.");
+
+	node->key.chars = tok.start;
+	node->key.len = tok.len;
+	consume_tok(tok_equal, "Expected `=' after key.");
+	advance();
+
+	if (tok.type == tok_left_brace) {
+		usize first = vector_count(*pending);
+
+		for (;;) {
+			advance();
+			parser->token = tok;
+
+			if (tok.type == tok_right_brace) {
+				break;
+			} else if (tok.type == tok_end) {
+				parse_error(parser, "Unexpected end.");
+				return false;
+			}
+
+			struct dtable_node child = { 0 };
+			if (!parse_node(&child, parser, arena, pending)) {
+				return false;
+			}
+			vector_push(*pending, child);
+
+			tok = parser->token;
+		}
+
+		node->type = dtable_parent;
+		node->child_count = vector_count(*pending) - first;
+
+		if (node->child_count > 0) {
+			node->children = arena_alloc(arena, node->child_count * sizeof *node->children);
+			memcpy(node->children, *pending + first, node->child_count * sizeof *node->children);
+
+			vector_truncate(*pending, first);
+		}
+	} else {
+		parser->token = tok;
+
+		struct dtable_value value;
+		if (!parse_value(parser, &value, &node->as.string)) {
+			return false;
+		}
+
+		node->type = value.type;
+
+		switch (value.type) {
+			case dtable_number:   node->as.number   = value.as.number;   break;
+			case dtable_uinteger: node->as.uinteger = value.as.uinteger; break;
+			case dtable_bool:     node->as.boolean  = value.as.boolean;  break;
+			case dtable_colour:   node->as.colour   = value.as.colour;   break;
+			case dtable_v2:       node->as.v2       = value.as.v2;       break;
+			case dtable_v3:       node->as.v3       = value.as.v3;       break;
+			case dtable_v4:       node->as.v4       = value.as.v4;       break;
+			default: break;
+		}
+
+		tok = parser->token;
+	}
+
+	parser->token = tok;
+
+	return true;
+}
+
+#undef advance
+#undef after_value
+#undef consume_tok
+#undef expect_tok
+
 bool parse_dtable(struct dtable* dt, const char* text) {
 	struct parser parser = {
 		.line = 1,
@@ -647,6 +1089,52 @@ bool parse_dtable(struct dtable* dt, const char* text) {
 	return true;
 }
 
+bool parse_dtable_doc(struct dtable_doc* doc, const char* text) {
+	memset(doc, 0, sizeof *doc);
+
+	/* Nodes take up about as much room as the text that they came from, so
+	 * sizing the first block after it keeps the arena to one or two blocks. */
+	usize text_len = strlen(text);
+	init_arena(&doc->arena, cr_max(text_len * 2, arena_default_block_size));
+
+	struct parser parser = {
+		.line = 1,
+		.start  = text,
+		.cur    = text,
+		.source = text
+	};
+
+	vector(struct dtable_node) pending = null;
+
+	parser.token = next_tok(&parser);
+
+	while (parser.token.type != tok_end) {
+		struct dtable_node child = { 0 };
+
+		if (!parse_node(&child, &parser, &doc->arena, &pending)) {
+			free_vector(pending);
+			deinit_dtable_doc(doc);
+			return false;
+		}
+
+		vector_push(pending, child);
+
+		parser.token = next_tok(&parser);
+	}
+
+	doc->root.type = dtable_parent;
+	doc->root.child_count = vector_count(pending);
+
+	if (doc->root.child_count > 0) {
+		doc->root.children = arena_alloc(&doc->arena, doc->root.child_count * sizeof *doc->root.children);
+		memcpy(doc->root.children, pending, doc->root.child_count * sizeof *doc->root.children);
+	}
+
+	free_vector(pending);
+
+	return true;
+}
+
 void deinit_dtable(struct dtable* dt) {
 	if (dt->value.type == dtable_string) {
 		core_free(dt->value.as.string);
@@ -657,15 +1145,72 @@ void deinit_dtable(struct dtable* dt) {
 	}
 
 	free_vector(dt->children);
+	core_free(dt->index);
 }
 
-bool dtable_find_child(const struct dtable* dt, const char* key, struct dtable* dst) {
+void deinit_dtable_doc(struct dtable_doc* doc) {
+	deinit_arena(&doc->arena);
+	memset(doc, 0, sizeof *doc);
+}
+
+static struct dtable* find_child(const struct dtable* dt, const char* key) {
+	if (dt->index) {
+		usize len = strlen(key);
+
+		for (usize i = (usize)hash_bytes((const u8*)key, len) & dt->index_mask;; i = (i + 1) & dt->index_mask) {
+			u32 slot = dt->index[i];
+			if (slot == 0) { return null; }
+
+			struct dtable* child = dt->children + slot - 1;
+			if (child->key.len == len && memcmp(child->key.chars, key, len) == 0) {
+				return child;
+			}
+		}
+	}
+
 	for (usize i = 0; i < vector_count(dt->children); i++) {
 		if (strcmp(dt->children[i].key.chars, key) == 0) {
-			*dst = dt->children[i];
-			return true;
+			return dt->children + i;
 		}
 	}
 
+	return null;
+}
+
+bool dtable_find_child(const struct dtable* dt, const char* key, struct dtable* dst) {
+	struct dtable* child = find_child(dt, key);
+	if (child) {
+		*dst = *child;
+
+		/* The index belongs to the child, and the copy would otherwise
+		 * update it, or free it, behind the child's back. */
+		dst->index = null;
+		dst->index_mask = 0;
+
+		return true;
+	}
+
 	return false;
 }
+
+struct dtable* dtable_get_child(struct dtable* dt, const char* key) {
+	if (!dt->index && vector_count(dt->children) >= dtable_index_threshold) {
+		build_dtable_index(dt);
+	}
+
+	return find_child(dt, key);
+}
+
+bool dtable_slice_eq(struct dtable_slice slice, const char* str) {
+	return strncmp(slice.chars, str, slice.len) == 0 && str[slice.len] == '\0';
+}
+
+const struct dtable_node* dtable_node_find(const struct dtable_node* node, const char* key) {
+	for (u32 i = 0; i < node->child_count; i++) {
+		if (dtable_slice_eq(node->children[i].key, key)) {
+			return node->children + i;
+		}
+	}
+
+	return null;
+}
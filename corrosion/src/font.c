@@ -3,22 +3,113 @@
 #include "core.h"
 #include "font.h"
 #include "stb.h"
+#include "thread.h"
+
+/* Glyphs are rasterised the first time that they are drawn and packed into
+ * single-channel atlas pages, which are shared by every codepoint. Each page
+ * is cut into shelves: rows as tall as the first glyph placed on them, which
+ * are filled left to right. A glyph goes on the shortest shelf that it fits
+ * on, and opens a new shelf below the others if there is none. When a page
+ * is full, a new page is started; Pages are never re-created, so that the
+ * textures handed out to renderers stay valid.
+ *
+ * Pages keep a copy of their texels, so that everything rasterised for one
+ * string is uploaded at once as a band of whole rows.
+ *
+ * A bitmap font owns its atlas, which is rasterised at the font's size.
+ * Distance field fonts made from the same file share one atlas, which is
+ * rasterised at sdf_font_base_size and scaled to whatever size each font is
+ * drawn at. */
+
+/* Space left between glyphs, so that filtering never bleeds into a
+ * neighbour. */
+#define glyph_padding 1
+
+/* Distance fields are stored as 128 on the outline, falling to zero at
+ * sdf_font_spread pixels outside of it, and rising towards 255 inside. */
+#define sdf_font_base_size 32.0f
+#define sdf_font_spread 4
+#define sdf_font_edge 128
+
+struct glyph {
+	u32 index;
+
+	u32 page;
+	v4i rect;
+
+	/* From the pen to the top left of the quad, and the size of the quad,
+	 * which only differs from the size of rect for distance fields. */
+	v2f offset;
+	v2f size;
+	f32 advance;
+
+	bool loaded;
+	bool rasterised;
+};
+
+struct glyph_slot {
+	u32 page;
+	v4i rect;
+};
+
+struct glyph_shelf {
+	i32 y, height;
+	i32 x;
+};
+
+struct glyph_page {
+	struct texture* texture;
+	u8* texels;
 
-#define glyphset_max 256
+	vector(struct glyph_shelf) shelves;
+	i32 bottom;
 
-struct glyph_set {
-	struct texture* atlas;
-	stbtt_bakedchar glyphs[glyphset_max];
+	/* The rows written since the last upload. */
+	i32 dirty_top, dirty_bottom;
+};
+
+struct glyph_atlas {
+	stbtt_fontinfo info;
+
+	bool sdf;
+	f32 scale;
+
+	/* Distance field atlases own a copy of the font file and are shared by
+	 * every font made from it, see find_sdf_atlas. */
+	u8* data;
+	usize data_size;
+	u64 hash;
+	u32 ref_count;
+
+	/* Where each glyph index has been rasterised to, so that codepoints
+	 * that share a glyph, such as all of the ones that the font lacks,
+	 * share the space in the atlas too. */
+	table(u32, struct glyph_slot) slots;
+
+	vector(struct glyph_page) pages;
+	i32 page_size;
 };
 
 struct font {
 	const void* data;
-	stbtt_fontinfo info;
-	struct glyph_set* sets[glyphset_max];
+	struct glyph_atlas* atlas;
+
+	u64 id;
+
 	f32 size;
+	f32 scale;
 	i32 height;
+	i32 ascent;
+
+	/* Latin-1 is looked up directly, everything else is hashed. */
+	struct glyph latin1[256];
+	table(u32, struct glyph) glyphs;
 };
 
+static table(u64, struct glyph_atlas*) sdf_atlases;
+
+static volatile i64 font_id_counter;
+
 static const char* utf8_to_codepoint(const char* p, u32* dst) {
 	u32 res, n;
 	switch (*p & 0xf0) {
@@ -35,58 +126,294 @@ static const char* utf8_to_codepoint(const char* p, u32* dst) {
 	return p + 1;
 }
 
-static struct glyph_set* load_glyph_set(struct font* font, i32 idx) {
-	struct glyph_set* set = core_calloc(1, sizeof(struct glyph_set));
+static void init_glyph_atlas(struct glyph_atlas* atlas, const u8* data, f32 size, bool sdf) {
+	if (!stbtt_InitFont(&atlas->info, data, 0)) {
+		error("Failed to initialise font.");
+	}
+
+	atlas->sdf = sdf;
+	atlas->scale = stbtt_ScaleForMappingEmToPixels(&atlas->info, size);
+
+	/* Room for a few hundred glyphs per page. */
+	atlas->page_size = 256;
+	while (atlas->page_size < (i32)(size * 16.0f) && atlas->page_size < 2048) {
+		atlas->page_size *= 2;
+	}
+}
+
+static void deinit_glyph_atlas(struct glyph_atlas* atlas) {
+	for (usize i = 0; i < vector_count(atlas->pages); i++) {
+		video.free_texture(atlas->pages[i].texture);
+		core_free(atlas->pages[i].texels);
+		free_vector(atlas->pages[i].shelves);
+	}
+
+	free_vector(atlas->pages);
+	free_table(atlas->slots);
+}
+
+/* Returns the distance field atlas of the font file `raw', making one if no
+ * font uses it yet. */
+static struct glyph_atlas* find_sdf_atlas(const u8* raw, usize raw_size) {
+	u64 hash = hash_bytes(raw, raw_size);
+
+	struct glyph_atlas** found = table_get(sdf_atlases, hash);
+	if (found && (*found)->data_size == raw_size && memcmp((*found)->data, raw, raw_size) == 0) {
+		(*found)->ref_count++;
+		return *found;
+	}
+
+	struct glyph_atlas* atlas = core_calloc(1, sizeof *atlas);
+
+	atlas->data = core_alloc(raw_size);
+	memcpy(atlas->data, raw, raw_size);
+	atlas->data_size = raw_size;
+	atlas->hash = hash;
+	atlas->ref_count = 1;
+
+	init_glyph_atlas(atlas, atlas->data, sdf_font_base_size, true);
+
+	/* A file whose hash collides with another one's just isn't shared. */
+	if (!found) {
+		table_set(sdf_atlases, hash, atlas);
+	}
+
+	return atlas;
+}
+
+static void release_glyph_atlas(struct glyph_atlas* atlas) {
+	if (atlas->sdf) {
+		if (--atlas->ref_count > 0) {
+			return;
+		}
+
+		struct glyph_atlas** found = table_get(sdf_atlases, atlas->hash);
+		if (found && *found == atlas) {
+			table_delete(sdf_atlases, atlas->hash);
+		}
+
+		if (sdf_atlases.count == 0) {
+			free_table(sdf_atlases);
+			memset(&sdf_atlases, 0, sizeof sdf_atlases);
+		}
+
+		core_free(atlas->data);
+	}
+
+	deinit_glyph_atlas(atlas);
+	core_free(atlas);
+}
+
+static void new_glyph_page(struct glyph_atlas* atlas) {
+	struct glyph_page page = {
+		.texels = core_calloc((usize)atlas->page_size * (usize)atlas->page_size, 1),
+		.dirty_top = atlas->page_size
+	};
+
+	struct image image = {
+		.colours = null,
+		.size = { atlas->page_size, atlas->page_size }
+	};
+
+	/* Distance fields are meant to be interpolated. */
+	u32 filter = atlas->sdf ? texture_flags_filter_linear : texture_flags_filter_none;
+
+	page.texture = video.new_texture(&image, filter | texture_flags_clamp, texture_format_r8i);
+
+	vector_push(atlas->pages, page);
+}
+
+/* Finds room for a glyph on one of the page's shelves, or opens a new one.
+ * Returns false if the page is full. */
+static bool glyph_page_alloc(struct glyph_page* page, i32 page_size, v2i size, v2i* pos) {
+	struct glyph_shelf* best = null;
+
+	for (usize i = 0; i < vector_count(page->shelves); i++) {
+		struct glyph_shelf* shelf = page->shelves + i;
+
+		if (shelf->height >= size.y && shelf->x + size.x <= page_size &&
+			(!best || shelf->height < best->height)) {
+			best = shelf;
+		}
+	}
+
+	if (!best) {
+		if (page->bottom + size.y > page_size || size.x > page_size) {
+			return false;
+		}
+
+		vector_push(page->shelves, ((struct glyph_shelf) { .y = page->bottom, .height = size.y }));
+		page->bottom += size.y;
+
+		best = vector_end(page->shelves) - 1;
+	}
+
+	*pos = make_v2i(best->x, best->y);
+	best->x += size.x;
+
+	return true;
+}
+
+static void draw_glyph(struct glyph_atlas* atlas, u8* dst, v2i size, u32 index) {
+	if (!atlas->sdf) {
+		stbtt_MakeGlyphBitmap(&atlas->info, dst, size.x, size.y, atlas->page_size, atlas->scale, atlas->scale, (i32)index);
+		return;
+	}
+
+	i32 w, h, x, y;
+	u8* sdf = stbtt_GetGlyphSDF(&atlas->info, atlas->scale, (i32)index, sdf_font_spread, sdf_font_edge,
+		(f32)sdf_font_edge / (f32)sdf_font_spread, &w, &h, &x, &y);
+	if (!sdf) {
+		return;
+	}
+
+	i32 rows = cr_min(h, size.y);
+	usize row_size = (usize)cr_min(w, size.x);
+
+	for (i32 row = 0; row < rows; row++) {
+		memcpy(dst + row * atlas->page_size, sdf + row * w, row_size);
+	}
+
+	stbtt_FreeSDF(sdf, null);
+}
+
+static void rasterise_glyph(struct font* font, struct glyph* glyph) {
+	glyph->rasterised = true;
+
+	if (glyph->rect.z <= 0 || glyph->rect.w <= 0) {
+		return;
+	}
+
+	struct glyph_atlas* atlas = font->atlas;
+
+	struct glyph_slot* slot = table_get(atlas->slots, glyph->index);
+	if (slot) {
+		glyph->page = slot->page;
+		glyph->rect = slot->rect;
+		return;
+	}
+
+	v2i size = make_v2i(glyph->rect.z + glyph_padding, glyph->rect.w + glyph_padding);
+	v2i pos;
+
+	if (vector_count(atlas->pages) == 0 ||
+		!glyph_page_alloc(vector_end(atlas->pages) - 1, atlas->page_size, size, &pos)) {
+		new_glyph_page(atlas);
+
+		if (!glyph_page_alloc(vector_end(atlas->pages) - 1, atlas->page_size, size, &pos)) {
+			warning("Glyph %u is too big for the font atlas.", glyph->index);
+			glyph->rect.z = glyph->rect.w = 0;
+			return;
+		}
+	}
+
+	glyph->page = (u32)vector_count(atlas->pages) - 1;
+	glyph->rect.x = pos.x;
+	glyph->rect.y = pos.y;
+
+	struct glyph_page* page = atlas->pages + glyph->page;
 
-	struct image image;
+	draw_glyph(atlas, page->texels + pos.y * atlas->page_size + pos.x,
+		make_v2i(glyph->rect.z, glyph->rect.w), glyph->index);
 
-	image.size.x = 512;
-	image.size.y = 512;
-retry:
-	image.colours = core_alloc(image.size.x * image.size.y * 4);
+	page->dirty_top    = cr_min(page->dirty_top, pos.y);
+	page->dirty_bottom = cr_max(page->dirty_bottom, pos.y + glyph->rect.w);
 
-	f32 s = stbtt_ScaleForMappingEmToPixels(&font->info, 1) /
-		stbtt_ScaleForPixelHeight(&font->info, 1);
-	i32 r = stbtt_BakeFontBitmap(font->data, 0, font->size * s,
-			image.colours, image.size.x, image.size.y, idx * 256, 256, set->glyphs);
+	table_set(atlas->slots, glyph->index, ((struct glyph_slot) { glyph->page, glyph->rect }));
+}
 
-	if (r <= 0) {
-		image.size.x *= 2;
-		image.size.y *= 2;
-		core_free(image.colours);
-		goto retry;
+/* Metrics are looked up without rasterising anything, so that measuring
+ * text never touches the atlas. */
+static struct glyph* get_glyph(struct font* font, u32 codepoint) {
+	struct glyph* glyph = codepoint < 256 ? font->latin1 + codepoint : table_get(font->glyphs, codepoint);
+	if (glyph && glyph->loaded) {
+		return glyph;
 	}
 
-	i32 ascent, descent, linegap, scaled_ascent;
-	stbtt_GetFontVMetrics(&font->info, &ascent, &descent, &linegap);
-	f32 scale = stbtt_ScaleForMappingEmToPixels(&font->info, font->size);
-	scaled_ascent = (i32)(ascent * scale + 0.5);
-	for (u32 i = 0; i < 256; i++) {
-		set->glyphs[i].yoff += scaled_ascent;
-		set->glyphs[i].xadvance = (f32)floor(set->glyphs[i].xadvance);
+	struct glyph_atlas* atlas = font->atlas;
+
+	i32 index = stbtt_FindGlyphIndex(&atlas->info, (i32)codepoint);
+
+	i32 advance, bearing;
+	stbtt_GetGlyphHMetrics(&atlas->info, index, &advance, &bearing);
+
+	/* The box is in the atlas' pixels, which are k of the font's. */
+	i32 x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	if (codepoint != '\t' && codepoint != '\n') {
+		stbtt_GetGlyphBitmapBox(&atlas->info, index, atlas->scale, atlas->scale, &x0, &y0, &x1, &y1);
 	}
 
-	for (i32 i = image.size.x * image.size.y - 1; i >= 0; i--) {
-		unsigned char n = *((u8*)image.colours + i);
-		image.colours[(i * 4) + 0] = 255;
-		image.colours[(i * 4) + 1] = 255;
-		image.colours[(i * 4) + 2] = 255;
-		image.colours[(i * 4) + 3] = n;
+	if (x0 == x1 || y0 == y1) {
+		x1 = x0;
+		y1 = y0;
+	} else if (atlas->sdf) {
+		x0 -= sdf_font_spread; y0 -= sdf_font_spread;
+		x1 += sdf_font_spread; y1 += sdf_font_spread;
 	}
 
-	set->atlas = video.new_texture(&image, texture_flags_filter_none, texture_format_rgba8i);
+	f32 k = font->scale / atlas->scale;
+
+	struct glyph new_glyph = {
+		.index   = (u32)index,
+		.rect    = make_v4i(0, 0, x1 - x0, y1 - y0),
+		.offset  = make_v2f((f32)x0 * k, (f32)y0 * k + (f32)font->ascent),
+		.size    = make_v2f((f32)(x1 - x0) * k, (f32)(y1 - y0) * k),
+		.advance = (f32)floor(advance * font->scale),
+		.loaded  = true
+	};
+
+	if (glyph) {
+		*glyph = new_glyph;
+		return glyph;
+	}
 
-	core_free(image.colours);
+	table_set(font->glyphs, codepoint, new_glyph);
 
-	return set;
+	return table_get(font->glyphs, codepoint);
 }
 
-static struct glyph_set* get_glyph_set(struct font* font, i32 codepoint) {
-	i32 idx = (codepoint >> 8) % glyphset_max;
-	if (!font->sets[idx]) {
-		font->sets[idx] = load_glyph_set(font, idx);
+/* Rasterises every glyph that `text' needs and uploads them before anything
+ * is drawn, so that the pages don't change while a renderer is batching
+ * characters from them. */
+static void prepare_glyphs(struct font* font, const char* text) {
+	const char* p = text;
+	while (*p) {
+		u32 codepoint;
+		p = utf8_to_codepoint(p, &codepoint);
+
+		struct glyph* glyph = get_glyph(font, codepoint);
+		if (!glyph->rasterised) {
+			rasterise_glyph(font, glyph);
+		}
+	}
+
+	struct glyph_atlas* atlas = font->atlas;
+
+	for (usize i = 0; i < vector_count(atlas->pages); i++) {
+		struct glyph_page* page = atlas->pages + i;
+
+		if (page->dirty_top < page->dirty_bottom) {
+			video.update_texture(page->texture,
+				make_v2i(0, page->dirty_top),
+				make_v2i(atlas->page_size, page->dirty_bottom - page->dirty_top),
+				page->texels + page->dirty_top * atlas->page_size);
+
+			page->dirty_top = atlas->page_size;
+			page->dirty_bottom = 0;
+		}
 	}
-	return font->sets[idx];
+}
+
+static void init_font_metrics(struct font* font, f32 size) {
+	font->id = (u64)atomic_add_i64(&font_id_counter, 1);
+
+	font->size = size;
+	font->scale = stbtt_ScaleForMappingEmToPixels(&font->atlas->info, size);
+
+	i32 ascent, descent, linegap;
+	stbtt_GetFontVMetrics(&font->atlas->info, &ascent, &descent, &linegap);
+	font->height = (i32)((ascent - descent + linegap) * font->scale + 0.5);
+	font->ascent = (i32)(ascent * font->scale + 0.5);
 }
 
 usize font_struct_size() {
@@ -101,6 +428,14 @@ struct font* new_font(const u8* raw, usize raw_size, f32 size) {
 	return font;
 }
 
+struct font* new_sdf_font(const u8* raw, usize raw_size, f32 size) {
+	struct font* font = core_calloc(1, sizeof(struct font));
+
+	init_sdf_font(font, raw, raw_size, size * get_dpi_scale());
+
+	return font;
+}
+
 void free_font(struct font* font) {
 	deinit_font(font);
 
@@ -112,45 +447,49 @@ void init_font(struct font* font, const u8* raw, usize raw_size, f32 size) {
 
 	font->data = raw;
 
-	font->size = size;
-
-	i32 r = stbtt_InitFont(&font->info, font->data, 0);
-	if (!r) {
-		goto fail;
-	}
+	font->atlas = core_calloc(1, sizeof *font->atlas);
+	init_glyph_atlas(font->atlas, raw, size, false);
 
-	i32 ascent, descent, linegap;
-	stbtt_GetFontVMetrics(&font->info, &ascent, &descent, &linegap);
-	f32 scale = stbtt_ScaleForMappingEmToPixels(&font->info, size);
-	font->height = (i32)((ascent - descent + linegap) * scale + 0.5);
+	init_font_metrics(font, size);
+}
 
-	stbtt_bakedchar* g = get_glyph_set(font, '\n')->glyphs;
-	g['\t'].x1 = g['\t'].x0;
-	g['\n'].x1 = g['\n'].x0;
+void init_sdf_font(struct font* font, const u8* raw, usize raw_size, f32 size) {
+	memset(font, 0, sizeof *font);
 
-	return;
+	font->atlas = find_sdf_atlas(raw, raw_size);
+	font->data = font->atlas->data;
 
-fail:
-	if (font) {
-		core_free(font);
-	}
+	init_font_metrics(font, size);
 }
 
 void deinit_font(struct font* font) {
-	for (usize i = 0; i < glyphset_max; i++) {
-		struct glyph_set* set = font->sets[i];
-		if (set) {
-			video.free_texture(set->atlas);
-			core_free(set);
-		}
-	}
+	release_glyph_atlas(font->atlas);
+
+	free_table(font->glyphs);
 }
 
 void* get_font_data(struct font* font) {
 	return (void*)font->data;
 }
 
+bool font_is_sdf(const struct font* font) {
+	return font->atlas->sdf;
+}
+
+u64 get_font_id(const struct font* font) {
+	return font->id;
+}
+
 void render_text(const struct text_renderer* renderer, struct font* font, const char* text, v2f position, v4f colour) {
+	bool sdf = font->atlas->sdf;
+
+	if (sdf && !renderer->draw_sdf_character) {
+		error("This text renderer can't draw distance field fonts.");
+		return;
+	}
+
+	prepare_glyphs(font, text);
+
 	f32 x = position.x;
 	f32 y = position.y;
 
@@ -169,18 +508,89 @@ void render_text(const struct text_renderer* renderer, struct font* font, const
 		u32 codepoint;
 		p = utf8_to_codepoint(p, &codepoint);
 
-		struct glyph_set* set = get_glyph_set(font, codepoint);
-		stbtt_bakedchar* g = &set->glyphs[codepoint & 0xff];
+		struct glyph* g = get_glyph(font, codepoint);
+
+		if (g->rect.z > 0 && g->rect.w > 0) {
+			const struct texture* page = font->atlas->pages[g->page].texture;
+			v2f pos = make_v2f(x + g->offset.x, y + g->offset.y);
+			v4f rect = make_v4f((f32)g->rect.x, (f32)g->rect.y, (f32)g->rect.z, (f32)g->rect.w);
+
+			if (sdf) {
+				renderer->draw_sdf_character(renderer->uptr, page, pos, g->size, rect, colour);
+			} else {
+				renderer->draw_character(renderer->uptr, page, pos, rect, colour);
+			}
+		}
+
+		x += g->advance;
+	}
+}
+
+usize layout_text(struct font* font, const char* text, struct text_glyph* glyphs, v2f* dimensions) {
+	prepare_glyphs(font, text);
+
+	f32 x = 0.0f;
+	f32 y = 0.0f;
+
+	v2f r = { 0.0f, (f32)font->height };
+
+	usize count = 0;
+
+	const char* p = text;
+	while (*p) {
+		if (*p == '\n') {
+			x = 0.0f;
+			y += font->height;
+			r.y += font->height;
+
+			p++;
+			continue;
+		}
+
+		u32 codepoint;
+		p = utf8_to_codepoint(p, &codepoint);
+
+		struct glyph* g = get_glyph(font, codepoint);
+
+		if (g->rect.z > 0 && g->rect.w > 0) {
+			glyphs[count++] = (struct text_glyph) {
+				.atlas      = font->atlas->pages[g->page].texture,
+				.position   = make_v2f(x + g->offset.x, y + g->offset.y),
+				.dimensions = g->size,
+				.rect       = make_v4f((f32)g->rect.x, (f32)g->rect.y, (f32)g->rect.z, (f32)g->rect.w)
+			};
+		}
+
+		x += g->advance;
+
+		if (x > r.x) { r.x = x; }
+	}
 
-		f32 w = (f32)(g->x1 - g->x0);
-		f32 h = (f32)(g->y1 - g->y0);
+	if (dimensions) {
+		*dimensions = r;
+	}
 
-		renderer->draw_character(renderer->uptr, set->atlas,
-			make_v2f(x + g->xoff, y + g->yoff),
-			make_v4f(g->x0, g->y0, w, h),
-			colour);
+	return count;
+}
 
-		x += g->xadvance;
+void render_text_glyphs(const struct text_renderer* renderer, struct font* font,
+	const struct text_glyph* glyphs, usize count, v2f position, v4f colour) {
+	bool sdf = font->atlas->sdf;
+
+	if (sdf && !renderer->draw_sdf_character) {
+		error("This text renderer can't draw distance field fonts.");
+		return;
+	}
+
+	for (usize i = 0; i < count; i++) {
+		const struct text_glyph* g = glyphs + i;
+		v2f pos = v2f_add(position, g->position);
+
+		if (sdf) {
+			renderer->draw_sdf_character(renderer->uptr, g->atlas, pos, g->dimensions, g->rect, colour);
+		} else {
+			renderer->draw_character(renderer->uptr, g->atlas, pos, g->rect, colour);
+		}
 	}
 }
 
@@ -188,9 +598,8 @@ v2f get_char_dimensions(struct font* font, const char* c) {
 	u32 codepoint;
 	utf8_to_codepoint(c, &codepoint);
 
-	struct glyph_set* set = get_glyph_set(font, codepoint);
-	stbtt_bakedchar* g = &set->glyphs[codepoint & 0xff];
-	return make_v2f(g->xadvance, font->height);
+	struct glyph* g = get_glyph(font, codepoint);
+	return make_v2f(g->advance, font->height);
 }
 
 v2f get_text_dimensions(struct font* font, const char* text) {
@@ -210,10 +619,9 @@ v2f get_text_dimensions(struct font* font, const char* text) {
 		u32 codepoint;
 		p = utf8_to_codepoint(p, &codepoint);
 
-		struct glyph_set* set = get_glyph_set(font, codepoint);
-		stbtt_bakedchar* g = &set->glyphs[codepoint & 0xff];
+		struct glyph* g = get_glyph(font, codepoint);
 
-		x += g->xadvance;
+		x += g->advance;
 
 		if (x > r.x) { r.x = x; }
 	}
@@ -240,10 +648,9 @@ v2f get_text_n_dimensions(struct font* font, const char* text, usize n) {
 		u32 codepoint;
 		p = utf8_to_codepoint(p, &codepoint);
 
-		struct glyph_set* set = get_glyph_set(font, codepoint);
-		stbtt_bakedchar* g = &set->glyphs[codepoint & 0xff];
+		struct glyph* g = get_glyph(font, codepoint);
 
-		x += g->xadvance;
+		x += g->advance;
 
 		if (x > r.x) { r.x = x; }
 
@@ -31,6 +31,10 @@ struct {
 	struct {
 		m4f camera;
 	} vertex_uniform_data;
+
+	/* Interned, so that drawing doesn't hash them every frame. */
+	const char* primary_name;
+	const char* vertex_ub_name;
 } gizmos;
 
 static void add_vertex(v3f position, v4f colour) {
@@ -60,6 +64,9 @@ void gizmos_init() {
 
 	gizmos.colour = make_rgba(0xffffff, 255);
 
+	gizmos.primary_name   = intern_string("primary");
+	gizmos.vertex_ub_name = intern_string("VertexUniformData");
+
 	gizmos.vb   = video.new_vertex_buffer(null, max_lines * sizeof(struct line_vertex), vertex_buffer_flags_dynamic);
 	gizmos.vb2d = video.new_vertex_buffer(null, max_lines * sizeof(struct line_vertex2d), vertex_buffer_flags_dynamic);
 
@@ -246,12 +253,12 @@ void gizmo_sphere(v3f centre, f32 radius) {
 }
 
 void gizmos_draw() {
-	video.update_pipeline_uniform(gizmos.pip, "primary", "VertexUniformData", &gizmos.vertex_uniform_data);
+	video.update_pipeline_uniform(gizmos.pip, gizmos.primary_name, gizmos.vertex_ub_name, &gizmos.vertex_uniform_data);
 
 	if (gizmos.vertex_count > 0) {
 		video.begin_pipeline(gizmos.pip);
 			video.bind_vertex_buffer(gizmos.vb, 0);
-			video.bind_pipeline_descriptor_set(gizmos.pip, "primary", 0);
+			video.bind_pipeline_descriptor_set(gizmos.pip, gizmos.primary_name, 0);
 			video.draw(gizmos.vertex_count, 0, 1);
 		video.end_pipeline(gizmos.pip);
 
@@ -262,12 +269,12 @@ void gizmos_draw() {
 
 	gizmos.vertex_uniform_data.camera = m4f_ortho(0.0f, (f32)window_size.x, (f32)window_size.y, 0.0f, -1.0f, 1.0f);
 
-	video.update_pipeline_uniform(gizmos.pip2d, "primary", "VertexUniformData", &gizmos.vertex_uniform_data);
+	video.update_pipeline_uniform(gizmos.pip2d, gizmos.primary_name, gizmos.vertex_ub_name, &gizmos.vertex_uniform_data);
 
 	if (gizmos.vertex_count2d > 0) {
 		video.begin_pipeline(gizmos.pip2d);
 			video.bind_vertex_buffer(gizmos.vb2d, 0);
-			video.bind_pipeline_descriptor_set(gizmos.pip2d, "primary", 0);
+			video.bind_pipeline_descriptor_set(gizmos.pip2d, gizmos.primary_name, 0);
 			video.draw(gizmos.vertex_count2d, 0, 1);
 		video.end_pipeline(gizmos.pip2d);
 
@@ -0,0 +1,314 @@
+#include "core.h"
+#include "job.h"
+#include "maths.h"
+#include "thread.h"
+
+#ifdef _MSC_VER
+#define thread_local_storage __declspec(thread)
+#else
+#define thread_local_storage _Thread_local
+#endif
+
+#define job_queue_size 4096
+#define job_spin_count 32
+
+struct job_entry {
+	job_func_t func;
+	job_range_func_t range_func;
+	void* uptr;
+	usize begin, end;
+	struct job_counter* counter;
+};
+
+/* Chase-Lev deque with a fixed capacity. Only the owner touches the bottom,
+ * other threads compete for the top. Entries are copied out before the top
+ * is claimed; A stealer whose compare-and-swap fails throws its copy away,
+ * and the owner never overwrites an entry that could still be claimed,
+ * because it refuses to push into a full queue. */
+struct job_queue {
+	volatile i64 top;
+	pad(56);
+	volatile i64 bottom;
+	pad(56);
+
+	struct job_entry entries[job_queue_size];
+};
+
+struct job_worker {
+	struct thread thread;
+	struct job_queue queue;
+};
+
+static struct {
+	/* The first worker is the thread that called jobs_init; It has a queue
+	 * but no thread of its own. */
+	struct job_worker* workers;
+	u32 worker_count;
+
+	struct semaphore wake;
+	volatile i64 sleeping;
+	volatile i64 quit;
+} jobs;
+
+static thread_local_storage struct job_worker* current_worker;
+static thread_local_storage u32 steal_seed;
+
+static bool queue_push(struct job_queue* queue, const struct job_entry* entry) {
+	i64 bottom = atomic_load_i64(&queue->bottom);
+	i64 top = atomic_load_i64(&queue->top);
+
+	if (bottom - top >= job_queue_size) {
+		return false;
+	}
+
+	queue->entries[bottom & (job_queue_size - 1)] = *entry;
+	atomic_store_i64(&queue->bottom, bottom + 1);
+
+	return true;
+}
+
+static bool queue_pop(struct job_queue* queue, struct job_entry* entry) {
+	i64 bottom = atomic_load_i64(&queue->bottom) - 1;
+	atomic_store_i64(&queue->bottom, bottom);
+
+	i64 top = atomic_load_i64(&queue->top);
+
+	if (top > bottom) {
+		atomic_store_i64(&queue->bottom, bottom + 1);
+		return false;
+	}
+
+	*entry = queue->entries[bottom & (job_queue_size - 1)];
+
+	if (top != bottom) {
+		return true;
+	}
+
+	/* This is the last entry, so race the stealers for it. */
+	bool won = atomic_cas_i64(&queue->top, top, top + 1);
+	atomic_store_i64(&queue->bottom, bottom + 1);
+
+	return won;
+}
+
+static bool queue_steal(struct job_queue* queue, struct job_entry* entry) {
+	i64 top = atomic_load_i64(&queue->top);
+	i64 bottom = atomic_load_i64(&queue->bottom);
+
+	if (top >= bottom) {
+		return false;
+	}
+
+	*entry = queue->entries[top & (job_queue_size - 1)];
+
+	return atomic_cas_i64(&queue->top, top, top + 1);
+}
+
+static bool get_job(struct job_entry* entry) {
+	if (current_worker && queue_pop(&current_worker->queue, entry)) {
+		return true;
+	}
+
+	if (jobs.worker_count == 0) { return false; }
+
+	steal_seed = steal_seed * 1103515245 + 12345;
+	u32 start = (steal_seed >> 16) % jobs.worker_count;
+
+	for (u32 i = 0; i < jobs.worker_count; i++) {
+		struct job_worker* victim = jobs.workers + (start + i) % jobs.worker_count;
+
+		if (victim != current_worker && queue_steal(&victim->queue, entry)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void execute_job(const struct job_entry* entry) {
+	if (entry->func) {
+		entry->func(entry->uptr);
+	} else {
+		entry->range_func(entry->uptr, entry->begin, entry->end);
+	}
+
+	if (entry->counter) {
+		atomic_add_i64(&entry->counter->value, -1);
+	}
+}
+
+static void submit_job(const struct job_entry* entry) {
+	if (!current_worker || !queue_push(&current_worker->queue, entry)) {
+		execute_job(entry);
+	}
+}
+
+/* Wakes up to count sleeping workers. */
+static void wake_workers(usize count) {
+	i64 sleeping = atomic_load_i64(&jobs.sleeping);
+
+	while (sleeping > 0) {
+		i64 n = cr_min(sleeping, (i64)count);
+
+		if (atomic_cas_i64(&jobs.sleeping, sleeping, sleeping - n)) {
+			semaphore_signal(&jobs.wake, (u32)n);
+			return;
+		}
+
+		sleeping = atomic_load_i64(&jobs.sleeping);
+	}
+}
+
+static void worker_func(struct thread* thread) {
+	current_worker = get_thread_uptr(thread);
+	steal_seed = (u32)(current_worker - jobs.workers);
+
+	struct job_entry entry;
+
+	while (!atomic_load_i64(&jobs.quit)) {
+		bool found = false;
+
+		for (u32 i = 0; i < job_spin_count && !found; i++) {
+			found = get_job(&entry);
+
+			if (!found) {
+				thread_yield();
+			}
+		}
+
+		if (found) {
+			execute_job(&entry);
+			continue;
+		}
+
+		frame_arena_reset();
+
+		/* Announce that this worker is going to sleep before checking for
+		 * work one last time, so that a concurrent job_run either sees it
+		 * sleeping or its jobs are found here. */
+		atomic_add_i64(&jobs.sleeping, 1);
+
+		if (get_job(&entry)) {
+			/* If somebody has already woken this worker up, the signal is
+			 * left over and the next wait returns right away. */
+			i64 sleeping = atomic_load_i64(&jobs.sleeping);
+			while (sleeping > 0 && !atomic_cas_i64(&jobs.sleeping, sleeping, sleeping - 1)) {
+				sleeping = atomic_load_i64(&jobs.sleeping);
+			}
+
+			execute_job(&entry);
+			continue;
+		}
+
+		semaphore_wait(&jobs.wake);
+	}
+
+	frame_arena_deinit();
+	alloc_thread_deinit();
+}
+
+void jobs_init(u32 worker_count) {
+	if (worker_count == 0) {
+		worker_count = cr_max(get_processor_count(), 2) - 1;
+	}
+
+	memset(&jobs, 0, sizeof jobs);
+
+	jobs.worker_count = worker_count + 1;
+	jobs.workers = core_calloc(jobs.worker_count, sizeof *jobs.workers);
+
+	init_semaphore(&jobs.wake, 0);
+
+	current_worker = jobs.workers;
+	steal_seed = 0;
+
+	for (u32 i = 1; i < jobs.worker_count; i++) {
+		struct job_worker* worker = jobs.workers + i;
+
+		init_thread(&worker->thread, worker_func);
+		set_thread_uptr(&worker->thread, worker);
+		thread_execute(&worker->thread);
+	}
+}
+
+void jobs_deinit() {
+	atomic_store_i64(&jobs.quit, 1);
+	semaphore_signal(&jobs.wake, jobs.worker_count - 1);
+
+	for (u32 i = 1; i < jobs.worker_count; i++) {
+		deinit_thread(&jobs.workers[i].thread);
+	}
+
+	deinit_semaphore(&jobs.wake);
+
+	core_free(jobs.workers);
+
+	current_worker = null;
+	jobs.workers = null;
+	jobs.worker_count = 0;
+}
+
+u32 get_job_worker_count() {
+	return jobs.worker_count;
+}
+
+void job_run(const struct job* to_run, usize count, struct job_counter* counter) {
+	if (counter) {
+		atomic_add_i64(&counter->value, (i64)count);
+	}
+
+	for (usize i = 0; i < count; i++) {
+		submit_job(&(struct job_entry) {
+			.func    = to_run[i].func,
+			.uptr    = to_run[i].uptr,
+			.counter = counter
+		});
+	}
+
+	wake_workers(count);
+}
+
+bool job_done(struct job_counter* counter) {
+	return atomic_load_i64(&counter->value) == 0;
+}
+
+void job_wait(struct job_counter* counter) {
+	struct job_entry entry;
+
+	while (!job_done(counter)) {
+		if (get_job(&entry)) {
+			execute_job(&entry);
+		} else {
+			thread_yield();
+		}
+	}
+}
+
+void job_parallel_for(usize count, usize batch_size, job_range_func_t func, void* uptr) {
+	if (count == 0) { return; }
+
+	if (batch_size == 0) {
+		batch_size = cr_max(count / (cr_max(jobs.worker_count, 1) * 4), 1);
+	}
+
+	usize batch_count = (count + batch_size - 1) / batch_size;
+
+	struct job_counter counter = { 0 };
+	atomic_add_i64(&counter.value, (i64)batch_count);
+
+	for (usize i = 0; i < batch_count; i++) {
+		usize begin = i * batch_size;
+
+		submit_job(&(struct job_entry) {
+			.range_func = func,
+			.uptr       = uptr,
+			.begin      = begin,
+			.end        = cr_min(begin + batch_size, count),
+			.counter    = &counter
+		});
+	}
+
+	wake_workers(batch_count);
+
+	job_wait(&counter);
+}
@@ -0,0 +1,302 @@
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "core.h"
+#include "lz4.h"
+#include "maths.h"
+
+#define lz4_min_match     4
+#define lz4_last_literals 5
+#define lz4_match_limit   12
+#define lz4_max_distance  65535
+#define lz4_hash_log      16
+#define lz4_chain_size    65536
+#define lz4_search_depth  64
+
+force_inline u32 lz4_read_u32(const u8* p) {
+	u32 v;
+	memcpy(&v, p, sizeof v);
+	return v;
+}
+
+force_inline u32 lz4_hash(const u8* p) {
+	return (lz4_read_u32(p) * 2654435761u) >> (32 - lz4_hash_log);
+}
+
+static u8* lz4_write_length(u8* op, usize length) {
+	for (; length >= 255; length -= 255) {
+		*op++ = 255;
+	}
+
+	*op++ = (u8)length;
+
+	return op;
+}
+
+/* A match length of zero writes the final, literal-only sequence. */
+static u8* lz4_write_sequence(u8* op, const u8* literals, usize literal_count, usize offset, usize match_length) {
+	u8* token = op++;
+
+	*token = (u8)(cr_min(literal_count, 15) << 4);
+
+	if (literal_count >= 15) {
+		op = lz4_write_length(op, literal_count - 15);
+	}
+
+	memcpy(op, literals, literal_count);
+	op += literal_count;
+
+	if (match_length == 0) {
+		return op;
+	}
+
+	*op++ = (u8)(offset);
+	*op++ = (u8)(offset >> 8);
+
+	match_length -= lz4_min_match;
+
+	*token |= (u8)cr_min(match_length, 15);
+
+	if (match_length >= 15) {
+		op = lz4_write_length(op, match_length - 15);
+	}
+
+	return op;
+}
+
+force_inline u32 lz4_lowest_bit(u64 mask) {
+#if defined(_MSC_VER)
+	unsigned long r;
+	_BitScanForward64(&r, mask);
+	return (u32)r;
+#else
+	return (u32)__builtin_ctzll(mask);
+#endif
+}
+
+/* Compares eight bytes at a time; The first differing bit gives away the
+ * first differing byte, since the machine is little endian. */
+static usize lz4_match_length(const u8* a, const u8* b, const u8* end) {
+	const u8* start = a;
+
+	while (a + 8 <= end) {
+		u64 x, y;
+		memcpy(&x, a, sizeof x);
+		memcpy(&y, b, sizeof y);
+
+		if (x != y) {
+			return (usize)(a - start) + lz4_lowest_bit(x ^ y) / 8;
+		}
+
+		a += 8;
+		b += 8;
+	}
+
+	while (a < end && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return (usize)(a - start);
+}
+
+usize lz4_compress_bound(usize size) {
+	return size + size / 255 + 16;
+}
+
+usize lz4_compress(const u8* src, usize size, u8* dst, bool high) {
+	u8* op = dst;
+
+	const u8* anchor = src;
+
+	if (size > lz4_match_limit) {
+		/* Heads hold a position plus one, so that zero means empty. */
+		u32* heads = core_calloc(1 << lz4_hash_log, sizeof *heads);
+		u16* chain = high ? core_calloc(lz4_chain_size, sizeof *chain) : null;
+
+		/* The format requires the last five bytes to be literals, and the
+		 * last match to start at least twelve bytes before the end. */
+		const u8* match_end = src + size - lz4_last_literals;
+		const u8* limit = src + size - lz4_match_limit;
+
+		const u8* ip = src;
+		const u8* next_insert = src;
+
+		while (ip < limit) {
+			const u8* match = null;
+			usize length = 0;
+
+			if (high) {
+				for (; next_insert <= ip; next_insert++) {
+					u32 h = lz4_hash(next_insert);
+					u32 pos = (u32)(next_insert - src);
+
+					usize delta = heads[h] ? pos - (heads[h] - 1) : 0;
+					chain[pos & (lz4_chain_size - 1)] = (u16)(delta > lz4_max_distance ? 0 : delta);
+
+					heads[h] = pos + 1;
+				}
+
+				u32 pos = (u32)(ip - src);
+				u16 delta = chain[pos & (lz4_chain_size - 1)];
+
+				for (u32 i = 0; delta && i < lz4_search_depth; i++) {
+					pos -= delta;
+
+					const u8* candidate = src + pos;
+
+					if ((usize)(ip - candidate) > lz4_max_distance) { break; }
+
+					if (candidate[length] == ip[length]) {
+						usize l = lz4_match_length(ip, candidate, match_end);
+
+						if (l > length) {
+							length = l;
+							match = candidate;
+						}
+					}
+
+					delta = chain[pos & (lz4_chain_size - 1)];
+				}
+			} else {
+				u32 h = lz4_hash(ip);
+				u32 head = heads[h];
+
+				heads[h] = (u32)(ip - src) + 1;
+
+				if (head) {
+					const u8* candidate = src + head - 1;
+
+					if ((usize)(ip - candidate) <= lz4_max_distance && lz4_read_u32(candidate) == lz4_read_u32(ip)) {
+						match = candidate;
+						length = lz4_match_length(ip, candidate, match_end);
+					}
+				}
+			}
+
+			if (length < lz4_min_match) {
+				/* Skip ahead faster the longer nothing has matched. */
+				ip += high ? 1 : 1 + ((usize)(ip - anchor) >> 6);
+				continue;
+			}
+
+			while (ip > anchor && match > src && ip[-1] == match[-1]) {
+				ip--;
+				match--;
+				length++;
+			}
+
+			op = lz4_write_sequence(op, anchor, (usize)(ip - anchor), (usize)(ip - match), length);
+
+			ip += length;
+			anchor = ip;
+		}
+
+		core_free(heads);
+		core_free(chain);
+	}
+
+	op = lz4_write_sequence(op, anchor, (usize)(src + size - anchor), 0, 0);
+
+	return (usize)(op - dst);
+}
+
+static bool lz4_read_length(const u8** ip, const u8* end, usize* length) {
+	u8 b;
+
+	do {
+		if (*ip >= end) { return false; }
+
+		b = *(*ip)++;
+		*length += b;
+	} while (b == 255);
+
+	return true;
+}
+
+bool lz4_decompress(const u8* src, usize src_size, u8* dst, usize dst_size) {
+	const u8* ip = src;
+	const u8* ip_end = src + src_size;
+
+	u8* op = dst;
+	u8* op_end = dst + dst_size;
+
+	while (ip < ip_end) {
+		u8 token = *ip++;
+
+		usize literal_count = token >> 4;
+		if (literal_count == 15 && !lz4_read_length(&ip, ip_end, &literal_count)) {
+			return false;
+		}
+
+		if (literal_count <= 16 && ip_end - ip >= 32 && op_end - op >= 32) {
+			/* Short runs are copied in one go with room to spare. */
+			memcpy(op, ip, 16);
+		} else {
+			if ((usize)(ip_end - ip) < literal_count || (usize)(op_end - op) < literal_count) {
+				return false;
+			}
+
+			memcpy(op, ip, literal_count);
+		}
+
+		ip += literal_count;
+		op += literal_count;
+
+		/* The last sequence has no match. */
+		if (ip == ip_end) { break; }
+
+		if (ip_end - ip < 2) { return false; }
+
+		usize offset = (usize)ip[0] | ((usize)ip[1] << 8);
+		ip += 2;
+
+		if (offset == 0 || offset > (usize)(op - dst)) {
+			return false;
+		}
+
+		usize length = token & 15;
+		if (length == 15 && !lz4_read_length(&ip, ip_end, &length)) {
+			return false;
+		}
+
+		length += lz4_min_match;
+
+		if ((usize)(op_end - op) < length) {
+			return false;
+		}
+
+		const u8* match = op - offset;
+
+		if (offset >= 16 && (usize)(op_end - op) >= length + 16) {
+			/* The chunks can't overlap, and overshooting the end of the
+			 * match is fine, since there is room and it gets overwritten. */
+			u8* end = op + length;
+
+			for (; op < end; op += 16, match += 16) {
+				memcpy(op, match, 16);
+			}
+
+			op = end;
+		} else if (offset >= 8 && (usize)(op_end - op) >= length + 8) {
+			u8* end = op + length;
+
+			for (; op < end; op += 8, match += 8) {
+				memcpy(op, match, 8);
+			}
+
+			op = end;
+		} else {
+			for (usize i = 0; i < length; i++) {
+				op[i] = match[i];
+			}
+
+			op += length;
+		}
+	}
+
+	return op == op_end;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "common.h"
+
+/* Compressor and decompressor for the LZ4 block format.
+ *
+ * The high compression mode searches a hash chain for the longest match
+ * instead of taking the first one. It is a lot slower to compress, but the
+ * output is smaller and decompresses exactly as fast. */
+
+usize lz4_compress_bound(usize size);
+
+/* dst must hold at least lz4_compress_bound(size) bytes. Returns the size of
+ * the compressed block. */
+usize lz4_compress(const u8* src, usize size, u8* dst, bool high);
+
+/* Fails if the block is malformed or doesn't decompress to exactly
+ * dst_size bytes. */
+bool lz4_decompress(const u8* src, usize src_size, u8* dst, usize dst_size);
@@ -2,12 +2,23 @@
 #include <stdio.h>
 
 #include "core.h"
+#include "bcn.h"
 #include "bir.h"
 #include "font.h"
+#include "job.h"
+#include "lz4.h"
 #include "maths.h"
 #include "res.h"
 #include "stb.h"
+#include "thread.h"
+#include "video.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define image_use_sse2
+#include <emmintrin.h>
+#endif
+
+/* Version one is the original Quake format. */
 struct pak_header {
 	char id[4];
 	u32 offset;
@@ -20,13 +31,61 @@ struct pak_entry {
 	u32 size;
 };
 
+/* Version two adds compression, 64-bit offsets, names of any length and
+ * content hashes. The directory is an array of entries followed by a block
+ * of null-terminated names, and every entry's data starts on a
+ * pak_alignment boundary relative to the header. Neither structure has any
+ * padding, so both are read and written as they are. */
+struct pak2_header {
+	char id[4];
+	u32 version;
+	u64 entry_offset;
+	u64 entry_count;
+	u64 names_offset;
+	u64 names_size;
+};
+
+struct pak2_entry {
+	u64 offset;
+	u64 size;
+	u64 raw_size;
+	u64 hash;
+	u32 name_offset;
+	u16 compression;
+
+	/* The method the entry was meant to be compressed with, which differs
+	 * from the one that it is stored with if it didn't compress. */
+	u16 requested_compression;
+};
+
+#define pak_alignment 64
+
+/* An entry of either version, as it is kept in memory. */
+struct pak_file {
+	const char* name;
+	u64 offset;
+	u64 size;
+	u64 raw_size;
+	u64 hash;
+	u32 compression;
+	u32 requested_compression;
+};
+
 const struct res_pak {
-	FILE* handle;
+	struct file_map map;
 
 	usize header_offset;
+	u32 version;
+
+	struct pak_file* files;
+	usize file_count;
 
-	struct pak_entry* entries;
-	usize entry_count;
+	char* names;
+
+	/* Open-addressed hash index over the entry names. Each slot holds an
+	 * entry index plus one, so that zero marks an empty slot. */
+	u32* index;
+	usize index_mask;
 }* bound_pak;
 
 void res_use_pak(const struct res_pak* pak) {
@@ -37,44 +96,228 @@ const struct res_pak* res_bound_pack() {
 	return bound_pak;
 }
 
+static bool pak_range_ok(const struct res_pak* pak, u64 offset, u64 size) {
+	u64 available = pak->map.size - pak->header_offset;
+
+	return offset <= available && size <= available - offset;
+}
+
+static const struct pak_file* pak_find(const struct res_pak* pak, const char* name) {
+	for (usize i = (usize)hash_string(name) & pak->index_mask;; i = (i + 1) & pak->index_mask) {
+		u32 slot = pak->index[i];
+		if (slot == 0) { return null; }
+
+		const struct pak_file* f = pak->files + slot - 1;
+
+		if (strcmp(f->name, name) == 0) {
+			return f;
+		}
+	}
+}
+
+static const u8* pak_data(const struct res_pak* pak, const struct pak_file* f) {
+	return pak->map.data + pak->header_offset + f->offset;
+}
+
+/* Copies an entry into dst, which must hold raw_size bytes, decompressing
+ * it if needed. */
+static bool pak_extract(const struct res_pak* pak, const struct pak_file* f, u8* dst) {
+	const u8* src = pak_data(pak, f);
+
+	switch (f->compression) {
+		case pak_compression_none:
+			memcpy(dst, src, (usize)f->size);
+			break;
+		case pak_compression_lz4:
+		case pak_compression_lz4_hc:
+			if (!lz4_decompress(src, (usize)f->size, dst, (usize)f->raw_size)) {
+				error("`%s' is corrupt in package.", f->name);
+				return false;
+			}
+			break;
+		default:
+			error("`%s' uses an unknown compression method (%u).", f->name, f->compression);
+			return false;
+	}
+
+#ifdef debug
+	if (pak->version >= 2 && hash_bytes(dst, (usize)f->raw_size) != f->hash) {
+		error("`%s' doesn't match its hash in package.", f->name);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+static bool pak_load_v1(struct res_pak* pak, const char* path) {
+	struct pak_header header;
+	memcpy(&header, pak->map.data + pak->header_offset, sizeof header);
+
+	if (!pak_range_ok(pak, header.offset, header.size)) {
+		return false;
+	}
+
+	usize count = (usize)header.size / sizeof(struct pak_entry);
+
+	/* The entries are kept for their names. */
+	struct pak_entry* entries = core_alloc(count * sizeof *entries);
+	memcpy(entries, pak->map.data + pak->header_offset + header.offset, count * sizeof *entries);
+
+	pak->names = (char*)entries;
+	pak->file_count = count;
+	pak->files = core_calloc(count, sizeof *pak->files);
+
+	for (usize i = 0; i < count; i++) {
+		struct pak_entry* e = entries + i;
+
+		e->name[sizeof e->name - 1] = '\0';
+
+		pak->files[i] = (struct pak_file) {
+			.name     = e->name,
+			.offset   = e->offset,
+			.size     = e->size,
+			.raw_size = e->size
+		};
+	}
+
+	return true;
+}
+
+static bool pak_load_v2(struct res_pak* pak, const char* path) {
+	struct pak2_header header;
+
+	if (!pak_range_ok(pak, 0, sizeof header)) {
+		return false;
+	}
+
+	memcpy(&header, pak->map.data + pak->header_offset, sizeof header);
+
+	if (header.version != pak_version) {
+		error("`%s' has an unsupported package version (%u).", path, header.version);
+		return false;
+	}
+
+	if (header.entry_count > (u64)UINT32_MAX ||
+		!pak_range_ok(pak, header.entry_offset, header.entry_count * sizeof(struct pak2_entry)) ||
+		!pak_range_ok(pak, header.names_offset, header.names_size) || header.names_size == 0) {
+		return false;
+	}
+
+	/* The names are copied so that the last one is guaranteed to be
+	 * terminated. */
+	pak->names = core_alloc((usize)header.names_size);
+	memcpy(pak->names, pak->map.data + pak->header_offset + header.names_offset, (usize)header.names_size);
+	pak->names[header.names_size - 1] = '\0';
+
+	pak->file_count = (usize)header.entry_count;
+	pak->files = core_calloc(pak->file_count, sizeof *pak->files);
+
+	const u8* src = pak->map.data + pak->header_offset + header.entry_offset;
+
+	for (usize i = 0; i < pak->file_count; i++) {
+		struct pak2_entry e;
+		memcpy(&e, src + i * sizeof e, sizeof e);
+
+		pak->files[i] = (struct pak_file) {
+			.name                  = pak->names + (e.name_offset < header.names_size ? e.name_offset : header.names_size - 1),
+			.offset                = e.offset,
+			.size                  = e.size,
+			.raw_size              = e.raw_size,
+			.hash                  = e.hash,
+			.compression           = e.compression,
+			.requested_compression = e.requested_compression
+		};
+
+		if (e.compression == pak_compression_none && e.raw_size != e.size) {
+			pak->files[i].raw_size = e.size;
+		}
+	}
+
+	return true;
+}
+
 struct res_pak* pak_open(const char* path, usize header_offset) {
-	FILE* handle = fopen(path, "rb");
-	if (!handle) {
+	struct file_map map;
+	if (!map_file(path, &map)) {
 		error("Failed to open `%s'.", path);
 		return null;
 	}
 
 	struct res_pak* pak = core_calloc(1, sizeof(struct res_pak));
 
+	pak->map = map;
 	pak->header_offset = header_offset;
 
-	fseek(handle, (long)pak->header_offset, SEEK_SET);
+	char id[4];
+
+	if (header_offset > map.size || !pak_range_ok(pak, 0, sizeof(struct pak_header))) {
+		goto invalid;
+	}
 
-	pak->handle = handle;
+	memcpy(id, map.data + header_offset, sizeof id);
 
-	struct pak_header header;
-	fread(header.id, 1, sizeof header.id, handle);
-	fread(&header.offset, 1, sizeof header.offset, handle);
-	fread(&header.size, 1, sizeof header.size, handle);
+	bool loaded = false;
+
+	if (memcmp(id, "PACK", sizeof id) == 0) {
+		pak->version = 1;
+		loaded = pak_load_v1(pak, path);
+	} else if (memcmp(id, "PAK2", sizeof id) == 0) {
+		pak->version = 2;
+		loaded = pak_load_v2(pak, path);
+	}
+
+	if (!loaded) {
+		goto invalid;
+	}
+
+	/* Keep the load factor at or below one half. */
+	usize index_size = 16;
+	while (index_size < pak->file_count * 2) {
+		index_size <<= 1;
+	}
 
-	pak->entry_count = (usize)header.size / sizeof(struct pak_entry);
-	pak->entries = core_alloc((usize)header.size);
+	pak->index = core_calloc(index_size, sizeof *pak->index);
+	pak->index_mask = index_size - 1;
 
-	fseek(handle, header.offset + (long)pak->header_offset, SEEK_SET);
+	for (usize i = 0; i < pak->file_count; i++) {
+		struct pak_file* f = pak->files + i;
 
-	for (usize i = 0; i < pak->entry_count; i++) {
-		struct pak_entry* e = pak->entries + i;
-		fread(&e->name, 1, sizeof e->name, handle);
-		fread(&e->offset, 1, sizeof e->offset, handle);
-		fread(&e->size, 1, sizeof e->size, handle);
+		if (!pak_range_ok(pak, f->offset, f->size)) {
+			error("`%s' in `%s' lies outside of the package.", f->name, path);
+			f->offset = 0;
+			f->size = 0;
+			f->raw_size = 0;
+			f->compression = pak_compression_none;
+		}
+
+		/* Like the old linear search, the first entry with a given name wins. */
+		if (!pak_find(pak, f->name)) {
+			usize slot = (usize)hash_string(f->name) & pak->index_mask;
+			while (pak->index[slot]) {
+				slot = (slot + 1) & pak->index_mask;
+			}
+
+			pak->index[slot] = (u32)(i + 1);
+		}
 	}
 
 	return pak;
+
+invalid:
+	error("`%s' is not a valid package.", path);
+	unmap_file(&pak->map);
+	core_free(pak->files);
+	core_free(pak->names);
+	core_free(pak);
+	return null;
 }
 
 void pak_close(struct res_pak* pak) {
-	fclose(pak->handle);
-	core_free(pak->entries);
+	unmap_file(&pak->map);
+	core_free(pak->index);
+	core_free(pak->files);
+	core_free(pak->names);
 	core_free(pak);
 }
 
@@ -157,421 +400,1905 @@ usize write_pak(const char* outname, struct pak_write_file* files, usize file_co
 	return written;
 }
 
-bool read_raw(const char* path, u8** buf, usize* size) {
-	*buf = null;
-	size ? *size = 0 : 0;
+/* A file being packed by write_pak_v2. */
+struct pak_pack_item {
+	const struct pak_write_file* file;
 
-	if (bound_pak) {
-		for (usize i = 0; i < bound_pak->entry_count; i++) {
-			struct pak_entry* e = bound_pak->entries + i;
+	bool ok;
+	u64 raw_size;
+	u64 hash;
 
-			if (strcmp(e->name, path) == 0) {
-				fseek(bound_pak->handle, e->offset + (long)bound_pak->header_offset, SEEK_SET);
+	/* The first item with the same contents; The item itself, unless it
+	 * is a duplicate. */
+	usize original;
 
-				*buf = core_alloc((usize)e->size);
-				
-				if (size) { *size = (usize)e->size; }
+	/* An entry of the previous package with the same hash. If it really
+	 * holds the same contents, it is copied instead of compressing them
+	 * again. */
+	const struct pak_file* previous;
 
-				fread(*buf, 1, (usize)e->size, bound_pak->handle);
+	struct file_map map;
 
-				return true;
-			}
-		}
+	/* Null if the item is stored as it is or copied from the previous
+	 * package. */
+	u8* packed;
 
-		error("Failed to find `%s' in package.", path);
+	u64 offset;
+	u64 size;
+	u32 compression;
+};
 
-		return false;
-	} else {
-		FILE* file = fopen(path, "rb");
-		if (!file) {
-			error("Failed to open file %s.", path);
-			return false;
-		}
+struct pak_pack_batch {
+	struct pak_pack_item* items;
+	const usize* order;
+	const struct res_pak* previous;
+};
 
-		fseek(file, 0, SEEK_END);
-		const usize file_size = ftell(file);
-		rewind(file);
+static void pak_hash_items(void* uptr, usize begin, usize end) {
+	struct pak_pack_item* items = uptr;
 
-		*buf = core_alloc(file_size);
-		const usize bytes_read = fread(*buf, sizeof(char), file_size, file);
-		if (bytes_read < file_size) {
-			warning("Failed to read all of file `%s'.\n", path);
-		}
+	for (usize i = begin; i < end; i++) {
+		struct pak_pack_item* item = items + i;
 
-		if (size) {
-			*size = file_size;
-		}
+		struct file_map map;
 
-		fclose(file);
-	}
+		item->ok = map_file(item->file->src, &map);
+		if (!item->ok) { continue; }
 
-	return true;
+		item->raw_size = map.size;
+		item->hash = hash_bytes(map.data, map.size);
+
+		unmap_file(&map);
+	}
 }
 
-bool write_raw(const char* path, const u8* buf, usize size) {
-	FILE* file = fopen(path, "wb");
+static bool pak_same_files(const char* a, const char* b) {
+	struct file_map map_a, map_b;
 
-	if (!file) {
-		error("Failed to open file `%s' for writing.\n", path);
+	if (!map_file(a, &map_a)) { return false; }
+
+	if (!map_file(b, &map_b)) {
+		unmap_file(&map_a);
 		return false;
 	}
 
-	fwrite(buf, 1, size, file);
+	bool same = map_a.size == map_b.size && (map_a.size == 0 || memcmp(map_a.data, map_b.data, map_a.size) == 0);
 
-	fclose(file);
+	unmap_file(&map_a);
+	unmap_file(&map_b);
 
-	return true;
+	return same;
 }
 
-bool read_raw_text(const char* path, char** buf) {
-	*buf = null;
+static bool pak_entry_matches(const struct res_pak* pak, const struct pak_file* f, const struct file_map* map) {
+	if (f->raw_size != map->size) { return false; }
+	if (map->size == 0) { return true; }
 
-	if (bound_pak) {
-		for (usize i = 0; i < bound_pak->entry_count; i++) {
-			struct pak_entry* e = bound_pak->entries + i;
+	if (f->compression == pak_compression_none) {
+		return memcmp(pak_data(pak, f), map->data, map->size) == 0;
+	}
 
-			if (strcmp(e->name, path) == 0) {
-				fseek(bound_pak->handle, e->offset + (long)bound_pak->header_offset, SEEK_SET);
+	u8* buf = core_alloc(map->size);
 
-				*buf = core_alloc((usize)e->size + 1);
+	bool same = pak_extract(pak, f, buf) && memcmp(buf, map->data, map->size) == 0;
 
-				fread(*buf, 1, (usize)e->size, bound_pak->handle);
-				(*buf)[e->size] = '\0';
+	core_free(buf);
 
-				return true;
-			}
-		}
+	return same;
+}
 
-		error("Failed to find `%s' in package.", path);
+static void pak_pack_items(void* uptr, usize begin, usize end) {
+	struct pak_pack_batch* batch = uptr;
 
-		return false;
-	} else {
-		FILE* file = fopen(path, "r");
-		if (!file) {
-			error("Failed to fopen file `%s'.", path);
-			return false;
+	for (usize i = begin; i < end; i++) {
+		struct pak_pack_item* item = batch->items + batch->order[i];
+
+		/* The file may have gone away since it was hashed. */
+		item->ok = map_file(item->file->src, &item->map) && item->map.size == item->raw_size;
+		if (!item->ok) {
+			unmap_file(&item->map);
+			continue;
 		}
 
-		fseek(file, 0, SEEK_END);
-		const usize file_size = ftell(file);
-		rewind(file);
+		if (item->previous && pak_entry_matches(batch->previous, item->previous, &item->map)) {
+			item->size = item->previous->size;
+			item->compression = item->previous->compression;
+			continue;
+		}
 
-		*buf = core_alloc(file_size + 1);
-		const usize bytes_read = fread(*buf, sizeof(char), file_size, file);
+		item->previous = null;
 
-		(*buf)[bytes_read] = '\0';
+		item->size = item->map.size;
+		item->compression = pak_compression_none;
 
-		fclose(file);
+		if (item->file->compression == pak_compression_none || item->map.size == 0) {
+			continue;
+		}
+
+		u8* packed = core_alloc(lz4_compress_bound(item->map.size));
+		usize packed_size = lz4_compress(item->map.data, item->map.size, packed,
+			item->file->compression == pak_compression_lz4_hc);
+
+		/* Data that doesn't compress is better off stored as it is. */
+		if (packed_size < item->map.size) {
+			item->packed = packed;
+			item->size = packed_size;
+			item->compression = item->file->compression;
+		} else {
+			core_free(packed);
+		}
 	}
+}
 
-	return true;
+static usize pak_write_padding(FILE* file, u64 pos) {
+	static const u8 zeroes[pak_alignment] = { 0 };
+
+	usize padding = (usize)((pak_alignment - pos % pak_alignment) % pak_alignment);
+	fwrite(zeroes, 1, padding, file);
+
+	return padding;
 }
 
-bool write_raw_text(const char* path, const char* buf) {
-	FILE* file = fopen(path, "w");
+usize write_pak_v2(const char* outname, struct pak_write_file* files, usize file_count,
+	const struct res_pak* previous, struct pak_write_stats* stats) {
 
-	if (!file) {
-		error("Failed to open file `%s' for reading.\n", path);
-		return false;
+	struct pak_write_stats temp_stats;
+	if (!stats) {
+		stats = &temp_stats;
 	}
 
-	usize size = strlen(buf);
+	memset(stats, 0, sizeof *stats);
 
-	fwrite(buf, 1, size, file);
+	FILE* outfile = fopen(outname, "wb");
+	if (!outfile) {
+		error("Failed to open `%s' for writing.", outname);
+		return 0;
+	}
 
-	fclose(file);
+	struct pak_pack_item* items = core_calloc(file_count, sizeof *items);
 
-	return true;
-}
+	for (usize i = 0; i < file_count; i++) {
+		items[i].file = files + i;
+	}
 
-void init_image_from_raw(struct image* image, const u8* raw, usize raw_size) {
-	i32 c;
+	job_parallel_for(file_count, 0, pak_hash_items, items);
 
-	u8* data = stbi_load_from_memory(raw, (i32)raw_size, &image->size.x, &image->size.y, &c, 4);
-	if (!data) {
-		error("Failed to parse image: %s", stbi_failure_reason());
-	}
+	/* Files with the same contents are stored once, with an entry for each
+	 * of them. Equal hashes are only a hint; The contents are compared to
+	 * make sure. */
+	table(u64, usize) by_hash = { 0 };
+	vector(usize) unique = null;
 
-	image->colours = data;
+	for (usize i = 0; i < file_count; i++) {
+		struct pak_pack_item* item = items + i;
 
-#ifdef __EMSCRIPTEN__
-	/* I have no idea why this is necessary, but for some reason when loading images
-	 * with Emscripten they are flipped...
-	 *
-	 * TODO: Figure out why. */
-	flip_image_y(image);
-#endif
-}
+		if (!item->ok) {
+			error("Failed to open `%s'.", item->file->src);
+			continue;
+		}
 
-void deinit_image(struct image* image) {
-	stbi_image_free(image->colours);
-}
+		stats->file_count++;
+		stats->input_bytes += item->raw_size;
 
-void flip_image_y(struct image* image) {
-	const usize stride = image->size.x * 4;
-	u8* row  = core_alloc(stride);
-	u8* low  = image->colours;
-	u8* high = &image->colours[(image->size.y - 1) * stride];
+		usize* got = table_get(by_hash, item->hash);
 
-	for (; low < high; low += stride, high -= stride) {
-		memcpy(row, low, stride);
-		memcpy(low, high, stride);
-		memcpy(high, row, stride);
+		if (got && items[*got].raw_size == item->raw_size && pak_same_files(items[*got].file->src, item->file->src)) {
+			item->original = *got;
+			stats->deduplicated_bytes += item->raw_size;
+			continue;
+		}
+
+		if (!got) {
+			table_set(by_hash, item->hash, i);
+		}
+
+		item->original = i;
+		vector_push(unique, i);
 	}
 
-	core_free(row);
-}
+	free_table(by_hash);
 
-struct res {
-	u8* payload;
-	const char* config_name;
-	const char* name;
-	usize payload_size;
-	bool ok;
-};
+	/* In incremental mode, contents that are already in the previous
+	 * package and were packed with the same compression method are copied
+	 * over from it. */
+	if (previous && previous->version >= 2) {
+		table(u64, const struct pak_file*) previous_by_hash = { 0 };
 
-table(const char*, struct res_config) res_registry;
-table(const char*, struct res)        res_cache;
-const char* last_copied_cache_key = null;
-const char* last_copied_type_key = null;
+		for (usize i = 0; i < previous->file_count; i++) {
+			const struct pak_file* f = previous->files + i;
 
-inline static u8* res_cache_table_copy_string(const u8* src) {
-	char* r = copy_string((const char*)src);
-	last_copied_cache_key = r;
-	return (u8*)r;
-}
+			if (!table_get(previous_by_hash, f->hash)) {
+				table_set(previous_by_hash, f->hash, f);
+			}
+		}
 
-inline static u8* res_registry_table_copy_string(const u8* src) {
-	char* r = copy_string((const char*)src);
-	last_copied_type_key = r;
-	return (u8*)r;
-}
+		for (usize i = 0; i < vector_count(unique); i++) {
+			struct pak_pack_item* item = items + unique[i];
 
-static void image_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
-	struct image* image = payload;
+			const struct pak_file** got = table_get(previous_by_hash, item->hash);
 
-	init_image_from_raw(image, raw, raw_size);
-}
+			if (got && (*got)->requested_compression == item->file->compression) {
+				item->previous = *got;
+			}
+		}
 
-static void image_on_unload(void* payload, usize payload_size) {
-	struct image* image = payload;
+		free_table(previous_by_hash);
+	}
 
-	stbi_image_free(image->colours);
-}
+	struct pak2_header header = { .id = "PAK2", .version = pak_version };
 
-static void ttf_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
-	f32 size = 14.0f;
+	fwrite(&header, 1, sizeof header, outfile);
 
-	if (udata) {
-		size = (f32)(*(i32*)udata);
-	}
+	u64 pos = sizeof header;
 
-	init_font(payload, raw, raw_size, size);
-}
+	/* Unique files are compressed in parallel, a batch at a time, so that
+	 * only a batch's worth of them has to be held in memory. */
+	usize batch_size = cr_max(get_job_worker_count(), 1) * 4;
 
-static void ttf_on_unload(void* payload, usize payload_size) {
-	void* data = get_font_data(payload);
-	deinit_font(payload);
-	core_free(data);
-}
+	for (usize first = 0; first < vector_count(unique); first += batch_size) {
+		usize count = cr_min(batch_size, vector_count(unique) - first);
 
-void res_init(const char* argv0) {
-	bound_pak = null;
+		job_parallel_for(count, 1, pak_pack_items, &(struct pak_pack_batch) {
+			.items    = items,
+			.order    = unique + first,
+			.previous = previous
+		});
 
-	memset(&res_registry, 0, sizeof res_registry);
-	memset(&res_cache, 0, sizeof res_cache);
+		for (usize i = 0; i < count; i++) {
+			struct pak_pack_item* item = items + unique[first + i];
 
-	res_registry.hash = table_hash_string;
-	res_registry.compare = table_compare_string;
-	res_registry.free_key = table_free_string;
-	res_registry.copy_key = res_registry_table_copy_string;
+			if (!item->ok) {
+				error("`%s' changed while it was being packed.", item->file->src);
+				continue;
+			}
 
-	res_cache.hash = table_hash_string;
-	res_cache.compare = table_compare_string;
-	res_cache.free_key = table_free_string;
-	res_cache.copy_key = res_cache_table_copy_string;
+			pos += pak_write_padding(outfile, pos);
 
-	reg_res_type("image", &(struct res_config) {
-		.payload_size = sizeof(struct image),
-		.free_raw_on_load = true,
-		.terminate_raw = false,
+			const u8* data = item->map.data;
+
+			if (item->packed) {
+				data = item->packed;
+			} else if (item->previous) {
+				data = pak_data(previous, item->previous);
+				stats->reused_bytes += item->raw_size;
+			}
+
+			fwrite(data, 1, (usize)item->size, outfile);
+
+			item->offset = pos;
+			pos += item->size;
+
+			core_free(item->packed);
+			unmap_file(&item->map);
+		}
+	}
+
+	free_vector(unique);
+
+	vector(struct pak2_entry) entries = null;
+	vector(char) names = null;
+
+	for (usize i = 0; i < file_count; i++) {
+		struct pak_pack_item* item = items + i;
+		if (!item->ok) { continue; }
+
+		const struct pak_pack_item* original = items + item->original;
+		if (!original->ok) { continue; }
+
+		vector_push(entries, ((struct pak2_entry) {
+			.offset                = original->offset,
+			.size                  = original->size,
+			.raw_size              = item->raw_size,
+			.hash                  = item->hash,
+			.name_offset           = (u32)vector_count(names),
+			.compression           = (u16)original->compression,
+			.requested_compression = (u16)original->file->compression
+		}));
+
+		for (const char* c = item->file->dst; *c; c++) {
+			vector_push(names, *c);
+		}
+
+		vector_push(names, '\0');
+	}
+
+	core_free(items);
+
+	pos += pak_write_padding(outfile, pos);
+
+	header.entry_offset = pos;
+	header.entry_count = vector_count(entries);
+
+	fwrite(entries, sizeof *entries, vector_count(entries), outfile);
+	pos += vector_count(entries) * sizeof *entries;
+
+	/* An empty name block is invalid, so there is always at least one
+	 * terminator. */
+	if (vector_count(names) == 0) {
+		vector_push(names, '\0');
+	}
+
+	header.names_offset = pos;
+	header.names_size = vector_count(names);
+
+	fwrite(names, 1, vector_count(names), outfile);
+	pos += vector_count(names);
+
+	fseek(outfile, 0, SEEK_SET);
+	fwrite(&header, 1, sizeof header, outfile);
+
+	stats->skipped_count = file_count - vector_count(entries);
+
+	free_vector(entries);
+	free_vector(names);
+
+	bool failed = ferror(outfile) != 0;
+	failed |= fclose(outfile) != 0;
+
+	if (failed) {
+		error("Failed to write `%s'.", outname);
+		return 0;
+	}
+
+	stats->output_bytes = pos;
+
+	return (usize)pos;
+}
+
+bool read_raw(const char* path, u8** buf, usize* size) {
+	*buf = null;
+	size ? *size = 0 : 0;
+
+	if (bound_pak) {
+		const struct pak_file* f = pak_find(bound_pak, path);
+		if (!f) {
+			error("Failed to find `%s' in package.", path);
+			return false;
+		}
+
+		*buf = core_alloc((usize)f->raw_size);
+
+		if (!pak_extract(bound_pak, f, *buf)) {
+			core_free(*buf);
+			*buf = null;
+			return false;
+		}
+
+		if (size) { *size = (usize)f->raw_size; }
+
+		return true;
+	} else {
+		FILE* file = fopen(path, "rb");
+		if (!file) {
+			error("Failed to open file %s.", path);
+			return false;
+		}
+
+		fseek(file, 0, SEEK_END);
+		const usize file_size = ftell(file);
+		rewind(file);
+
+		*buf = core_alloc(file_size);
+		const usize bytes_read = fread(*buf, sizeof(char), file_size, file);
+		if (bytes_read < file_size) {
+			warning("Failed to read all of file `%s'.\n", path);
+		}
+
+		if (size) {
+			*size = file_size;
+		}
+
+		fclose(file);
+	}
+
+	return true;
+}
+
+bool write_raw(const char* path, const u8* buf, usize size) {
+	FILE* file = fopen(path, "wb");
+
+	if (!file) {
+		error("Failed to open file `%s' for writing.\n", path);
+		return false;
+	}
+
+	fwrite(buf, 1, size, file);
+
+	fclose(file);
+
+	return true;
+}
+
+bool read_raw_view(const char* path, struct raw_view* view) {
+	memset(view, 0, sizeof *view);
+
+	if (bound_pak) {
+		const struct pak_file* f = pak_find(bound_pak, path);
+		if (!f) {
+			error("Failed to find `%s' in package.", path);
+			return false;
+		}
+
+		view->size = (usize)f->raw_size;
+
+		if (f->compression == pak_compression_none) {
+			view->data = pak_data(bound_pak, f);
+			return true;
+		}
+
+		/* Compressed entries are decompressed on demand. */
+		u8* buf = core_alloc(view->size);
+
+		if (!pak_extract(bound_pak, f, buf)) {
+			core_free(buf);
+			view->size = 0;
+			return false;
+		}
+
+		view->data = buf;
+		view->owned = true;
+
+		return true;
+	}
+
+	u8* buf;
+	if (!read_raw(path, &buf, &view->size)) {
+		return false;
+	}
+
+	view->data = buf;
+	view->owned = true;
+
+	return true;
+}
+
+void free_raw_view(struct raw_view* view) {
+	if (view->owned) {
+		core_free((u8*)view->data);
+	}
+
+	memset(view, 0, sizeof *view);
+}
+
+#define res_stream_buffer_size (64 * 1024)
+
+struct res_stream {
+	/* Loose files are read through the buffer, everything else is in
+	 * memory, in the view. */
+	struct file_reader* file;
+	u8* buffer;
+	usize buffer_pos, buffer_size;
+
+	struct raw_view view;
+
+	u64 size, pos;
+};
+
+struct res_stream* res_stream_open(const char* path) {
+	struct res_stream* stream = core_calloc(1, sizeof *stream);
+
+	if (bound_pak) {
+		if (!read_raw_view(path, &stream->view)) {
+			core_free(stream);
+			return null;
+		}
+
+		stream->size = stream->view.size;
+
+		return stream;
+	}
+
+	stream->file = new_file_reader(path);
+	if (!stream->file) {
+		error("Failed to open file %s.", path);
+		core_free(stream);
+		return null;
+	}
+
+	stream->buffer = core_alloc(res_stream_buffer_size);
+	stream->size = file_reader_size(stream->file);
+
+	return stream;
+}
+
+void res_stream_close(struct res_stream* stream) {
+	if (stream->file) {
+		free_file_reader(stream->file);
+	}
+
+	core_free(stream->buffer);
+	free_raw_view(&stream->view);
+	core_free(stream);
+}
+
+u64 res_stream_size(const struct res_stream* stream) {
+	return stream->size;
+}
+
+usize res_stream_read(struct res_stream* stream, void* buf, usize size) {
+	u8* dst = buf;
+
+	if (!stream->file) {
+		usize n = (usize)cr_min((u64)size, stream->size - stream->pos);
+
+		memcpy(dst, stream->view.data + stream->pos, n);
+		stream->pos += n;
+
+		return n;
+	}
+
+	usize total = 0;
+
+	while (total < size) {
+		usize buffered = stream->buffer_size - stream->buffer_pos;
+
+		if (buffered > 0) {
+			usize n = cr_min(buffered, size - total);
+
+			memcpy(dst + total, stream->buffer + stream->buffer_pos, n);
+			stream->buffer_pos += n;
+			total += n;
+		} else if (size - total >= res_stream_buffer_size) {
+			/* Large reads skip the buffer. */
+			usize wanted = size - total;
+			usize n = file_reader_read(stream->file, dst + total, wanted);
+			total += n;
+
+			if (n < wanted) { break; }
+		} else {
+			stream->buffer_pos = 0;
+			stream->buffer_size = file_reader_read(stream->file, stream->buffer, res_stream_buffer_size);
+
+			if (stream->buffer_size == 0) { break; }
+		}
+	}
+
+	stream->pos += total;
+
+	return total;
+}
+
+bool res_stream_skip(struct res_stream* stream, i64 offset) {
+	if ((offset < 0 && (u64)-offset > stream->pos) || (offset > 0 && (u64)offset > stream->size - stream->pos)) {
+		return false;
+	}
+
+	if (stream->file) {
+		i64 buffer_pos = (i64)stream->buffer_pos + offset;
+
+		if (buffer_pos >= 0 && buffer_pos <= (i64)stream->buffer_size) {
+			stream->buffer_pos = (usize)buffer_pos;
+		} else {
+			/* The file is positioned at the end of the buffer. */
+			if (!file_reader_seek(stream->file, buffer_pos - (i64)stream->buffer_size)) {
+				return false;
+			}
+
+			stream->buffer_pos = 0;
+			stream->buffer_size = 0;
+		}
+	}
+
+	stream->pos = (u64)((i64)stream->pos + offset);
+
+	return true;
+}
+
+bool res_stream_eof(const struct res_stream* stream) {
+	return stream->pos >= stream->size;
+}
+
+bool read_raw_text(const char* path, char** buf) {
+	*buf = null;
+
+	if (bound_pak) {
+		const struct pak_file* f = pak_find(bound_pak, path);
+		if (!f) {
+			error("Failed to find `%s' in package.", path);
+			return false;
+		}
+
+		*buf = core_alloc((usize)f->raw_size + 1);
+
+		if (!pak_extract(bound_pak, f, (u8*)*buf)) {
+			core_free(*buf);
+			*buf = null;
+			return false;
+		}
+
+		(*buf)[f->raw_size] = '\0';
+
+		return true;
+	} else {
+		FILE* file = fopen(path, "r");
+		if (!file) {
+			error("Failed to fopen file `%s'.", path);
+			return false;
+		}
+
+		fseek(file, 0, SEEK_END);
+		const usize file_size = ftell(file);
+		rewind(file);
+
+		*buf = core_alloc(file_size + 1);
+		const usize bytes_read = fread(*buf, sizeof(char), file_size, file);
+
+		(*buf)[bytes_read] = '\0';
+
+		fclose(file);
+	}
+
+	return true;
+}
+
+bool write_raw_text(const char* path, const char* buf) {
+	FILE* file = fopen(path, "w");
+
+	if (!file) {
+		error("Failed to open file `%s' for reading.\n", path);
+		return false;
+	}
+
+	usize size = strlen(buf);
+
+	fwrite(buf, 1, size, file);
+
+	fclose(file);
+
+	return true;
+}
+
+static void init_image_from_stbi(struct image* image, u8* data) {
+	if (!data) {
+		error("Failed to parse image: %s", stbi_failure_reason());
+	}
+
+	image->colours = data;
+
+#ifdef __EMSCRIPTEN__
+	/* I have no idea why this is necessary, but for some reason when loading images
+	 * with Emscripten they are flipped...
+	 *
+	 * TODO: Figure out why. */
+	flip_image_y(image);
+#endif
+}
+
+void init_image_from_raw(struct image* image, const u8* raw, usize raw_size) {
+	i32 c;
+
+	u8* data = stbi_load_from_memory(raw, (i32)raw_size, &image->size.x, &image->size.y, &c, 4);
+	init_image_from_stbi(image, data);
+}
+
+u32 get_mip_count(v2i size) {
+	u32 count = 1;
+
+	for (i32 s = cr_max(size.x, size.y); s > 1; s /= 2) {
+		count++;
+	}
+
+	return count;
+}
+
+v2i get_mip_size(v2i size, u32 level) {
+	return make_v2i(cr_max(size.x >> level, 1), cr_max(size.y >> level, 1));
+}
+
+usize get_image_size(const struct image* image) {
+	usize size = 0;
+
+	for (u32 i = 0; i < cr_max(image->mip_count, 1); i++) {
+		v2i mip_size = get_mip_size(image->size, i);
+
+		if (image->block_format) {
+			size += bcn_level_size(mip_size, image->block_format);
+		} else {
+			size += (usize)mip_size.x * (usize)mip_size.y * 4;
+		}
+	}
+
+	return size;
+}
+
+/* Each pixel is the average of a 2x2 block of the level above. Odd sizes
+ * round down, so the last row or column of such a level is dropped, except
+ * once a side is down to one pixel. */
+static void downsample_image(const u8* src, v2i src_size, u8* dst, v2i dst_size) {
+	for (i32 y = 0; y < dst_size.y; y++) {
+		const u8* row0 = src + (usize)cr_min(y * 2,     src_size.y - 1) * (usize)src_size.x * 4;
+		const u8* row1 = src + (usize)cr_min(y * 2 + 1, src_size.y - 1) * (usize)src_size.x * 4;
+
+		u8* out = dst + (usize)y * (usize)dst_size.x * 4;
+
+		i32 x = 0;
+
+#ifdef image_use_sse2
+		/* Two output pixels at a time: Widen both rows to 16 bits, add them,
+		 * then add the neighbouring pixels and round. */
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+
+		for (; x + 2 <= dst_size.x && x * 2 + 4 <= src_size.x; x += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+			lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+			__m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+
+			_mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, zero));
+		}
+#endif
+
+		for (; x < dst_size.x; x++) {
+			i32 x0 = x * 2;
+			i32 x1 = cr_min(x * 2 + 1, src_size.x - 1);
+
+			for (i32 c = 0; c < 4; c++) {
+				out[x * 4 + c] = (u8)((row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c] + 2) >> 2);
+			}
+		}
+	}
+}
+
+void generate_image_mips(struct image* image) {
+	u8* src = image->colours;
+
+	for (u32 i = 1; i < image->mip_count; i++) {
+		v2i src_size = get_mip_size(image->size, i - 1);
+		v2i dst_size = get_mip_size(image->size, i);
+
+		u8* dst = src + (usize)src_size.x * (usize)src_size.y * 4;
+
+		downsample_image(src, src_size, dst, dst_size);
+
+		src = dst;
+	}
+}
+
+/* dst's colours must have room for every level. */
+static void compress_image_levels(const struct image* src, struct image* dst) {
+	const u8* pixels = src->colours;
+	u8* blocks = dst->colours;
+
+	for (u32 i = 0; i < cr_max(src->mip_count, 1); i++) {
+		v2i mip_size = get_mip_size(src->size, i);
+
+		bcn_encode(pixels, mip_size, dst->block_format, blocks);
+
+		pixels += (usize)mip_size.x * (usize)mip_size.y * 4;
+		blocks += bcn_level_size(mip_size, dst->block_format);
+	}
+}
+
+void compress_image(const struct image* src, u32 format, struct image* dst) {
+	*dst = (struct image) {
+		.size         = src->size,
+		.mip_count    = src->mip_count,
+		.block_format = format
+	};
+
+	dst->colours = core_alloc(get_image_size(dst));
+
+	compress_image_levels(src, dst);
+}
+
+void decompress_image(const struct image* src, u32 format, struct image* dst) {
+	*dst = (struct image) {
+		.size      = src->size,
+		.mip_count = src->mip_count
+	};
+
+	if (!src->colours) { return; }
+
+	dst->colours = core_alloc(get_image_size(dst));
+
+	const u8* blocks = src->colours;
+	u8* pixels = dst->colours;
+
+	for (u32 i = 0; i < cr_max(src->mip_count, 1); i++) {
+		v2i mip_size = get_mip_size(src->size, i);
+
+		bcn_decode(blocks, mip_size, format, pixels);
+
+		blocks += bcn_level_size(mip_size, format);
+		pixels += (usize)mip_size.x * (usize)mip_size.y * 4;
+	}
+}
+
+static bool is_image_opaque(const struct image* image) {
+	usize count = (usize)image->size.x * (usize)image->size.y;
+
+	for (usize i = 0; i < count; i++) {
+		if (image->colours[i * 4 + 3] != 255) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* The pixels follow the image, so that the whole thing can be cooked. */
+static u8* pack_decoded_image(struct image* decoded, bool mips, usize* decoded_size) {
+	struct image packed = {
+		.size = decoded->colours ? decoded->size : make_v2i(0, 0),
+		.mip_count = decoded->colours && mips ? get_mip_count(decoded->size) : 1
+	};
+
+	usize pixels_size = get_image_size(&packed);
+
+	*decoded_size = sizeof packed + pixels_size;
+	struct image* image = core_alloc(*decoded_size);
+
+	*image = packed;
+	image->colours = (u8*)(image + 1);
+
+	if (decoded->colours) {
+		memcpy(image->colours, decoded->colours, (usize)packed.size.x * (usize)packed.size.y * 4);
+		generate_image_mips(image);
+	}
+
+	deinit_image(decoded);
+
+	return (u8*)image;
+}
+
+u8* decode_image_raw(const char* filename, const u8* raw, usize raw_size, usize* decoded_size, void* udata) {
+	struct image decoded = { 0 };
+	init_image_from_raw(&decoded, raw, raw_size);
+
+	return pack_decoded_image(&decoded, false, decoded_size);
+}
+
+static i32 image_stream_read(void* uptr, char* data, i32 size) {
+	return (i32)res_stream_read(uptr, data, (usize)size);
+}
+
+static void image_stream_skip(void* uptr, i32 n) {
+	res_stream_skip(uptr, n);
+}
+
+static i32 image_stream_eof(void* uptr) {
+	return res_stream_eof(uptr);
+}
+
+static u8* decode_image_stream_mips(struct res_stream* stream, bool mips, usize* decoded_size) {
+	const stbi_io_callbacks callbacks = {
+		.read = image_stream_read,
+		.skip = image_stream_skip,
+		.eof  = image_stream_eof
+	};
+
+	struct image decoded = { 0 };
+	i32 c;
+
+	u8* data = stbi_load_from_callbacks(&callbacks, stream, &decoded.size.x, &decoded.size.y, &c, 4);
+	init_image_from_stbi(&decoded, data);
+
+	return pack_decoded_image(&decoded, mips, decoded_size);
+}
+
+u8* decode_image_stream(const char* filename, struct res_stream* stream, usize* decoded_size, void* udata) {
+	return decode_image_stream_mips(stream, false, decoded_size);
+}
+
+/* Replaces an image from pack_decoded_image with a compressed copy, whose
+ * blocks likewise follow it. BC1 has half the size of BC7, but only one
+ * bit of alpha. */
+static u8* compress_decoded_image(u8* raw, usize* decoded_size) {
+	struct image* decoded = get_decoded_image(raw);
+
+	/* Nothing was decoded. */
+	if (decoded->size.x == 0) {
+		return raw;
+	}
+
+	struct image packed = {
+		.size         = decoded->size,
+		.mip_count    = decoded->mip_count,
+		.block_format = is_image_opaque(decoded) ? texture_format_bc1 : texture_format_bc7
+	};
+
+	*decoded_size = sizeof packed + get_image_size(&packed);
+	struct image* image = core_alloc(*decoded_size);
+
+	*image = packed;
+	image->colours = (u8*)(image + 1);
+
+	compress_image_levels(decoded, image);
+
+	core_free(raw);
+
+	return (u8*)image;
+}
+
+u8* decode_texture_stream(const char* filename, struct res_stream* stream, usize* decoded_size, void* udata) {
+	u32 flags = udata ? *(u32*)udata : 0;
+
+	u8* raw = decode_image_stream_mips(stream, flags & texture_flags_mipmaps, decoded_size);
+
+	if (flags & texture_flags_compress) {
+		raw = compress_decoded_image(raw, decoded_size);
+	}
+
+	return raw;
+}
+
+struct image* get_decoded_image(u8* raw) {
+	struct image* image = (struct image*)raw;
+
+	if (image) {
+		image->colours = (u8*)(image + 1);
+	}
+
+	return image;
+}
+
+void deinit_image(struct image* image) {
+	stbi_image_free(image->colours);
+}
+
+void flip_image_y(struct image* image) {
+	const usize stride = image->size.x * 4;
+	u8* row  = core_alloc(stride);
+	u8* low  = image->colours;
+	u8* high = &image->colours[(image->size.y - 1) * stride];
+
+	for (; low < high; low += stride, high -= stride) {
+		memcpy(row, low, stride);
+		memcpy(low, high, stride);
+		memcpy(high, row, stride);
+	}
+
+	core_free(row);
+}
+
+/* A resource that is being loaded by res_load_async. Everything that the
+ * worker thread needs is copied in here, since the tables may be resized
+ * while it runs. */
+struct res_request {
+	u64 id;
+	const char* filename; /* Stored after the request, in the same allocation. */
+	struct res_config config;
+	void* udata;
+
+	struct job_counter counter;
+
+	u8* raw;
+	usize raw_size;
+	bool owns_raw;
+	bool ok;
+};
+
+struct res {
+	u8* payload;
+	const char* config_name;
+	u64 id;
+	usize payload_size;
+	bool ok;
+
+	/* Non-null while the resource is still loading. */
+	struct res_request* request;
+
+	u32 ref_count;
+
+	/* As reported by on_load, see res_report_size. */
+	usize size;
+
+	/* Links in the type's list of unreferenced resources, by ID. */
+	u64 lru_prev;
+	u64 lru_next;
+
+	/* Kept for hot reloading, see res_enable_hot_reload. The filename is
+	 * owned by the resource and null if the file isn't watched. */
+	char* filename;
+	void* udata;
+};
+
+/* The registry is keyed by interned strings and the cache by resource ID. */
+table(const char*, struct res_config) res_registry;
+table(u64, struct res)                res_cache;
+
+vector(struct res_request*) res_pending;
+
+static struct file_watcher* res_watcher;
+
+static char* cook_dir;
+
+static void image_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
+	struct image* decoded = get_decoded_image(raw);
+	struct image* image = payload;
+
+	usize pixels_size = (usize)decoded->size.x * (usize)decoded->size.y * 4;
+
+	/* The raw data is freed once this returns. */
+	image->size = decoded->size;
+	image->colours = core_alloc(pixels_size);
+	memcpy(image->colours, decoded->colours, pixels_size);
+
+	res_report_size(payload_size + pixels_size);
+}
+
+static void image_on_unload(void* payload, usize payload_size) {
+	struct image* image = payload;
+
+	core_free(image->colours);
+}
+
+static void ttf_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
+	f32 size = 14.0f;
+
+	if (udata) {
+		size = (f32)(*(i32*)udata);
+	}
+
+	init_font(payload, raw, raw_size, size);
+
+	/* The font keeps the file's contents. */
+	res_report_size(payload_size + raw_size);
+}
+
+static void ttf_on_unload(void* payload, usize payload_size) {
+	void* data = get_font_data(payload);
+	deinit_font(payload);
+	core_free(data);
+}
+
+/* Every size of a distance field font shares the glyphs and the copy of the
+ * file of the first one loaded, so the raw data isn't kept. */
+static void sdf_font_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
+	f32 size = 14.0f;
+
+	if (udata) {
+		size = (f32)(*(i32*)udata);
+	}
+
+	init_sdf_font(payload, raw, raw_size, size);
+
+	res_report_size(payload_size);
+}
+
+static void sdf_font_on_unload(void* payload, usize payload_size) {
+	deinit_font(payload);
+}
+
+/* Resource IDs are hashes already. */
+static u64 hash_res_id(const u8* data, usize size) {
+	u64 id;
+	memcpy(&id, data, sizeof id);
+	return id;
+}
+
+void res_init(const char* argv0) {
+	bound_pak = null;
+
+
+	res_pending = null;
+	res_watcher = null;
+	cook_dir = null;
+
+	memset(&res_registry, 0, sizeof res_registry);
+	memset(&res_cache, 0, sizeof res_cache);
+	res_cache.hash = hash_res_id;
+
+	reg_res_type("image", &(struct res_config) {
+		.payload_size = sizeof(struct image),
+		.free_raw_on_load = true,
+		.terminate_raw = false,
 		.alt_raw = bir_error_png,
 		.alt_raw_size = bir_error_png_size,
+		.cook_version = 3,
+		.on_decode = decode_image_raw,
 		.on_load = image_on_load,
 		.on_unload = image_on_unload
 	});
 
-	reg_res_type("true type font", &(struct res_config) {
-		.payload_size = font_struct_size(),
-		.udata_size = sizeof(i32),
-		.free_raw_on_load = false,
-		.terminate_raw = false,
-		.alt_raw = bir_DejaVuSans_ttf,
-		.alt_raw_size = bir_DejaVuSans_ttf_size,
-		.on_load = ttf_on_load,
-		.on_unload = ttf_on_unload
-	});
+	reg_res_type("true type font", &(struct res_config) {
+		.payload_size = font_struct_size(),
+		.udata_size = sizeof(i32),
+		.free_raw_on_load = false,
+		.terminate_raw = false,
+		.alt_raw = bir_DejaVuSans_ttf,
+		.alt_raw_size = bir_DejaVuSans_ttf_size,
+		.on_load = ttf_on_load,
+		.on_unload = ttf_on_unload
+	});
+
+	reg_res_type("sdf font", &(struct res_config) {
+		.payload_size = font_struct_size(),
+		.udata_size = sizeof(i32),
+		.free_raw_on_load = true,
+		.terminate_raw = false,
+		.alt_raw = bir_DejaVuSans_ttf,
+		.alt_raw_size = bir_DejaVuSans_ttf_size,
+		.on_load = sdf_font_on_load,
+		.on_unload = sdf_font_on_unload
+	});
+}
+
+void res_deinit() {
+	while (vector_count(res_pending) > 0) {
+		res_wait(&(struct resource) { res_pending[0]->id, null });
+	}
+
+	free_vector(res_pending);
+
+	for (u64* i = table_first(res_cache); i; i = table_next(res_cache, *i)) {
+		struct res* res = table_get(res_cache, *i);
+
+		struct res_config* config = table_get(res_registry, res->config_name);
+
+		config->on_unload(res->payload, res->payload_size);
+
+		core_free(res->payload);
+		core_free(res->udata);
+		core_free(res->filename);
+	}
+
+	if (res_watcher) {
+		free_file_watcher(res_watcher);
+		res_watcher = null;
+	}
+
+	res_set_cook_dir(null);
+
+	free_table(res_cache);
+	free_table(res_registry);
+}
+
+void reg_res_type(const char* type, const struct res_config* config) {
+	const char* name = intern_string(type);
+
+	table_set(res_registry, name, *config);
+	struct res_config* c = table_get(res_registry, name);
+	c->_name = name;
+	c->_hash = hash_string(name);
+}
+
+static struct res_config* find_res_type(const char* type) {
+	const char* type_name = lookup_interned_string(type);
+	return type_name ? table_get(res_registry, type_name) : null;
+}
+
+static struct res_config* get_res_config(const char* type, const char* filename) {
+	struct res_config* config = find_res_type(type);
+
+	if (!config) {
+		error("Loading `%s': No resource handler registered for this type of file (%s).", filename, type);
+	}
+
+	return config;
+}
+
+/* The type and the user data are part of the ID, so that one file can be
+ * loaded as different types of resource, or with different user data,
+ * without them being confused in the cache. */
+static u64 make_res_id(const struct res_config* config, const char* filename, const void* udata) {
+	u64 id = hash_combine(config->_hash, hash_string(filename));
+
+	if (udata && config->udata_size) {
+		id = hash_combine(id, hash_bytes(udata, config->udata_size));
+	}
+
+	/* Zero means no resource. */
+	return id ? id : 1;
+}
+
+u64 res_id(const char* type, const char* filename, const void* udata) {
+	struct res_config* config = get_res_config(type, filename);
+
+	return config ? make_res_id(config, filename, udata) : 0;
+}
+
+/* The size reported by the on_load call that is currently running. Loads
+ * can nest, so this is saved and restored around every call. */
+static usize reported_size;
+static bool size_reported;
+
+void res_report_size(usize size) {
+	reported_size += size;
+	size_reported = true;
+}
+
+/* Calls on_load and returns the size that it reported. */
+static usize call_on_load(const struct res_config* config, const char* filename, u8* raw, usize raw_size,
+	void* payload, usize payload_size, void* udata) {
+
+	usize outer_size = reported_size;
+	bool outer_reported = size_reported;
+
+	reported_size = 0;
+	size_reported = false;
+
+	config->on_load(filename, raw, raw_size, payload, payload_size, udata);
+
+	usize size = size_reported ? reported_size : payload_size;
+
+	reported_size = outer_size;
+	size_reported = outer_reported;
+
+	return size;
+}
+
+static void lru_remove(struct res_config* config, struct res* res) {
+	if (res->lru_prev) {
+		((struct res*)table_get(res_cache, res->lru_prev))->lru_next = res->lru_next;
+	} else {
+		config->_lru_first = res->lru_next;
+	}
+
+	if (res->lru_next) {
+		((struct res*)table_get(res_cache, res->lru_next))->lru_prev = res->lru_prev;
+	} else {
+		config->_lru_last = res->lru_prev;
+	}
+
+	res->lru_prev = 0;
+	res->lru_next = 0;
+}
+
+static void lru_push(struct res_config* config, struct res* res) {
+	res->lru_prev = config->_lru_last;
+	res->lru_next = 0;
+
+	if (config->_lru_last) {
+		((struct res*)table_get(res_cache, config->_lru_last))->lru_next = res->id;
+	} else {
+		config->_lru_first = res->id;
+	}
+
+	config->_lru_last = res->id;
+}
+
+/* Takes another reference to a cached resource. */
+static void acquire_res(struct res* res) {
+	if (res->ref_count++ == 0) {
+		lru_remove(table_get(res_registry, res->config_name), res);
+	}
+}
+
+static void destroy_res(struct res_config* config, struct res* res) {
+	config->on_unload(res->payload, res->payload_size);
+
+	core_free(res->payload);
+	core_free(res->udata);
+	core_free(res->filename);
+
+	config->_size -= res->size;
+
+	table_delete(res_cache, res->id);
 }
 
-void res_deinit() {
-	for (const char** i = table_first(res_cache); i; i = table_next(res_cache, *i)) {
-		struct res* res = table_get(res_cache, *i);
+/* Unloads the least recently used unreferenced resources of a type until
+ * it fits into its budget. */
+static void trim_res_type(struct res_config* config) {
+	while (config->_size > config->budget && config->_lru_first) {
+		struct res* res = table_get(res_cache, config->_lru_first);
 
-		struct res_config* config = table_get(res_registry, res->config_name);
+		lru_remove(config, res);
+		destroy_res(config, res);
+	}
+}
 
-		config->on_unload(res->payload, res->payload_size);
+void res_set_budget(const char* type, usize budget) {
+	struct res_config* config = find_res_type(type);
+	if (!config) {
+		error("No resource handler registered for type `%s'.", type);
+		return;
+	}
 
-		core_free(res->payload);
+	config->budget = budget;
+	trim_res_type(config);
+}
+
+usize res_get_type_size(const char* type) {
+	struct res_config* config = find_res_type(type);
+
+	return config ? config->_size : 0;
+}
+
+/* Cooked data is stored in a file named after the resource ID, so that it is
+ * replaced rather than piling up when the source changes. */
+struct cook_header {
+	char id[4];
+	u32 version;
+	u64 source_hash;
+	u64 size;
+};
+
+static void get_cook_path(char* path, usize path_size, u64 id) {
+	snprintf(path, path_size, "%s/%016llx.cooked", cook_dir, (unsigned long long)id);
+}
+
+static u8* read_cooked(const struct res_config* config, u64 id, u64 source_hash, usize* size) {
+	char path[1024];
+	get_cook_path(path, sizeof path, id);
+
+	FILE* file = fopen(path, "rb");
+	if (!file) { return null; }
+
+	struct cook_header header;
+	u8* data = null;
+
+	if (fread(&header, sizeof header, 1, file) == 1 &&
+		memcmp(header.id, "COOK", 4) == 0 &&
+		header.version == config->cook_version &&
+		header.source_hash == source_hash) {
+		data = core_alloc(header.size);
+
+		if (fread(data, 1, header.size, file) != header.size) {
+			core_free(data);
+			data = null;
+		}
 	}
 
-	free_table(res_cache);
-	free_table(res_registry);
+	fclose(file);
+
+	*size = data ? header.size : 0;
+	return data;
 }
 
-void reg_res_type(const char* type, const struct res_config* config) {
-	table_set(res_registry, type, *config);
-	struct res_config* c = table_get(res_registry, type);
-	c->_name = last_copied_type_key;
+/* Writes to a temporary file first, so that a crash can't leave a truncated
+ * file behind for the next run to load. */
+static void write_cooked(const struct res_config* config, u64 id, u64 source_hash, const u8* data, usize size) {
+	char path[1024], temp_path[1040];
+	get_cook_path(path, sizeof path, id);
+	snprintf(temp_path, sizeof temp_path, "%s.tmp", path);
+
+	FILE* file = fopen(temp_path, "wb");
+	if (!file) {
+		warning("Failed to open `%s' for writing.", temp_path);
+		return;
+	}
+
+	struct cook_header header = {
+		.id          = "COOK",
+		.version     = config->cook_version,
+		.source_hash = source_hash,
+		.size        = size
+	};
+
+	bool ok = fwrite(&header, sizeof header, 1, file) == 1 && fwrite(data, 1, size, file) == size;
+	ok = fclose(file) == 0 && ok;
+
+	remove(path);
+
+	if (!ok || rename(temp_path, path) != 0) {
+		warning("Failed to write `%s'.", path);
+		remove(temp_path);
+	}
 }
 
-static usize base64_size(usize size) {
-	return 4 * ((size + 2) / 3);
+/* Runs whichever decoder the config has on data that is in memory. */
+static u8* decode_res(const struct res_config* config, const char* filename, const u8* raw, usize raw_size,
+	usize* decoded_size, void* udata) {
+
+	if (config->on_decode) {
+		return config->on_decode(filename, raw, raw_size, decoded_size, udata);
+	}
+
+	struct res_stream stream = {
+		.view = { raw, raw_size },
+		.size = raw_size
+	};
+
+	return config->on_decode_stream(filename, &stream, decoded_size, udata);
 }
 
-static char encoding_table[] = {
-	'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
-	'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
-	'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
-	'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
-	'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
-	'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-	'w', 'x', 'y', 'z', '0', '1', '2', '3',
-	'4', '5', '6', '7', '8', '9', '+', '/'
-};
+static bool stream_res_data(const struct res_config* config, const char* filename, void* udata, u8** raw, usize* raw_size, bool* owns_raw) {
+	struct res_stream* stream = res_stream_open(filename);
+
+	if (stream) {
+		*raw = config->on_decode_stream(filename, stream, raw_size, udata);
+		res_stream_close(stream);
+	} else if (config->alt_raw && config->alt_raw_size) {
+		*raw = decode_res(config, filename, config->alt_raw, config->alt_raw_size, raw_size, udata);
+	}
+
+	*owns_raw = *raw != null;
 
-static i32 mod_table[] = {0, 2, 1};
+	return stream != null;
+}
+
+/* Falls back to the config's alternative raw data if the file couldn't be
+ * read, and decodes the raw data, or loads the cooked result of an earlier
+ * decode. Takes over raw and the view. */
+static void decode_res_data(const struct res_config* config, u64 id, const char* filename, void* udata, bool ok,
+	struct raw_view* view, u8** raw, usize* raw_size, bool* owns_raw) {
 
-/* From: https://stackoverflow.com/a/6782480/9549501 */
-static void base64_encode(char* out, const u8* data, usize size) {
-	usize os = base64_size(size);
+	if (!ok) {
+		core_free(*raw);
+		*raw = null;
 
-	for (usize i = 0, j = 0; i < size;) {
-		u32 octet_a = i < size ? (u8)data[i++] : 0;
-		u32 octet_b = i < size ? (u8)data[i++] : 0;
-		u32 octet_c = i < size ? (u8)data[i++] : 0;
-		
-		u32 triple = (octet_a << 0x10) + (octet_b << 0x08) + octet_c;
-		
-		out[j++] = encoding_table[(triple >> 3 * 6) & 0x3F];
-		out[j++] = encoding_table[(triple >> 2 * 6) & 0x3F];
-		out[j++] = encoding_table[(triple >> 1 * 6) & 0x3F];
-		out[j++] = encoding_table[(triple >> 0 * 6) & 0x3F];
+		if (config->alt_raw && config->alt_raw_size) {
+			*raw = (u8*)config->alt_raw;
+			*raw_size = config->alt_raw_size;
+		}
 	}
-	
-	for (int i = 0; i < mod_table[size % 3]; i++) {
-		out[os - 1 - i] = '=';
+
+	if ((config->on_decode || config->on_decode_stream) && *raw) {
+		/* The alternative raw data is cheap to decode and not worth caching. */
+		bool cook = ok && cook_dir && config->cook_version;
+		u64 source_hash = cook ? hash_bytes(*raw, *raw_size) : 0;
+
+		usize decoded_size = 0;
+		u8* decoded = cook ? read_cooked(config, id, source_hash, &decoded_size) : null;
+
+		if (!decoded) {
+			decoded = decode_res(config, filename, *raw, *raw_size, &decoded_size, udata);
+
+			if (cook && decoded) {
+				write_cooked(config, id, source_hash, decoded, decoded_size);
+			}
+		}
+
+		if (*owns_raw) {
+			core_free(*raw);
+		}
+
+		free_raw_view(view);
+
+		*raw = decoded;
+		*raw_size = decoded_size;
+		*owns_raw = decoded != null;
 	}
 }
 
-/* Get a unique ID buffer for each resource, based on the config type and the user data. This allows
- * the same filename to be used for different resource types and with different user data configs without
- * the system confusing them for each other in the resource cache. */
-static char* get_resource_id_bytebuffer(const char* filename, const void* udata, const char* type, const struct res_config* config) {
-	usize filename_len = strlen(filename);
-	usize type_len = strlen(type);
-	usize udata_len = base64_size(config->udata_size);
+/* Reads a resource's file, falling back to the config's alternative raw
+ * data if that fails, and decodes it, or loads the cooked result of an
+ * earlier decode. This is called from worker threads, so it mustn't touch
+ * the resource tables. */
+static bool read_res_data(const struct res_config* config, u64 id, const char* filename, void* udata, u8** raw, usize* raw_size, bool* owns_raw) {
+	bool ok;
 
-	char* buf = core_alloc(filename_len + type_len + udata_len + 1);
-	memcpy(buf, filename, filename_len);
-	memcpy(buf + filename_len, type, type_len);
+	*raw = null;
+	*raw_size = 0;
 
-	if (udata) {
-		base64_encode(buf + filename_len + type_len, udata, config->udata_size);
+	bool cook = cook_dir && config->cook_version;
+
+	/* Without a cache to check, a streaming decoder reads the file itself. */
+	if (config->on_decode_stream && !cook) {
+		return stream_res_data(config, filename, udata, raw, raw_size, owns_raw);
+	}
+
+	struct raw_view view = { 0 };
+
+	if (config->terminate_raw) {
+		ok = read_raw_text(filename, (char**)raw);
+
+		if (ok) { *raw_size = strlen((char*)*raw) + 1; }
+
+		*owns_raw = ok;
+	} else if (config->on_decode || config->on_decode_stream) {
+		/* Decoders don't hold on to their input, so it can come straight out
+		 * of the bound package. */
+		ok = read_raw_view(filename, &view);
+
+		*raw = (u8*)view.data;
+		*raw_size = view.size;
+		*owns_raw = false;
+	} else {
+		ok = read_raw(filename, raw, raw_size);
+
+		*owns_raw = ok;
 	}
 
-	buf[filename_len + udata_len + type_len] = '\0';
+	decode_res_data(config, id, filename, udata, ok, &view, raw, raw_size, owns_raw);
 
-	return buf;
+	return ok;
 }
 
-struct resource res_load(const char* type, const char* filename, void* udata) {
-	struct res_config* config = table_get(res_registry, type);
+/* Resources from a package never change, so only loose files are watched. */
+static void watch_res(struct res* res, const struct res_config* config, const char* filename, void* udata) {
+	if (!res_watcher || bound_pak) { return; }
+
+	res->filename = copy_string(filename);
 
+	if (udata && config->udata_size) {
+		res->udata = core_alloc(config->udata_size);
+		memcpy(res->udata, udata, config->udata_size);
+	}
+
+	file_watcher_add(res_watcher, res->filename);
+}
+
+struct resource res_load(const char* type, const char* filename, void* udata) {
+	struct res_config* config = get_res_config(type, filename);
 	if (!config) {
-		error("Loading `%s': No resource handler registered for this type of file (%s).", filename, type);
-		return (struct resource) { null, null };
+		return (struct resource) { 0, null };
 	}
 
-	char* resource_id_buf = get_resource_id_bytebuffer(filename, udata, type, config);
+	u64 id = make_res_id(config, filename, udata);
 
-	struct res* got = table_get(res_cache, resource_id_buf);
+	struct res* got = table_get(res_cache, id);
 	if (got) {
-		core_free(resource_id_buf);
-		return (struct resource) { got->name, got->payload };
+		if (got->request) {
+			res_wait(&(struct resource) { id, null });
+			got = table_get(res_cache, id);
+		}
+
+		acquire_res(got);
+
+		return (struct resource) { id, got->payload };
 	}
 
 	struct res new_res = {
 		.payload = core_calloc(1, config->payload_size),
 		.payload_size = config->payload_size,
-		.config_name = config->_name
+		.config_name = config->_name,
+		.id = id,
+		.ref_count = 1
 	};
 
 	u8* raw;
 	usize raw_size;
+	bool owns_raw;
 
-	bool error;
+	watch_res(&new_res, config, filename, udata);
 
-	if (config->terminate_raw) {
-		error = !read_raw_text(filename, (char**)&raw);
+	new_res.ok = read_res_data(config, id, filename, udata, &raw, &raw_size, &owns_raw);
+
+	new_res.size = call_on_load(config, filename, raw, raw_size, new_res.payload, new_res.payload_size, udata);
+
+	if (config->free_raw_on_load && owns_raw) {
+		core_free(raw);
+	}
+
+	table_set(res_cache, id, new_res);
+
+	config->_size += new_res.size;
+	trim_res_type(config);
+
+	return (struct resource) { id, new_res.payload };
+}
+
+static void res_load_job(void* uptr) {
+	struct res_request* request = uptr;
+
+	request->ok = read_res_data(&request->config, request->id, request->filename, request->udata,
+		&request->raw, &request->raw_size, &request->owns_raw);
+}
+
+/* Adds a resource that is still loading to the cache. The caller starts
+ * the job that loads it. */
+static struct res_request* new_res_request(const struct res_config* config, u64 id, const char* filename, void* udata, void** payload) {
+	usize filename_size = strlen(filename) + 1;
+
+	struct res_request* request = core_calloc(1, sizeof *request + filename_size);
+	request->id = id;
+	request->filename = memcpy(request + 1, filename, filename_size);
+	request->config = *config;
+
+	/* The caller's user data usually lives on the stack. */
+	if (udata && config->udata_size) {
+		request->udata = core_alloc(config->udata_size);
+		memcpy(request->udata, udata, config->udata_size);
+	}
+
+	struct res new_res = {
+		.payload = core_calloc(1, config->payload_size),
+		.payload_size = config->payload_size,
+		.config_name = config->_name,
+		.id = id,
+		.request = request,
+		.ref_count = 1
+	};
+
+	watch_res(&new_res, config, filename, udata);
+
+	table_set(res_cache, id, new_res);
+	vector_push(res_pending, request);
+
+	*payload = new_res.payload;
+
+	return request;
+}
+
+struct resource res_load_async(const char* type, const char* filename, void* udata) {
+	struct res_config* config = get_res_config(type, filename);
+	if (!config) {
+		return (struct resource) { 0, null };
+	}
+
+	u64 id = make_res_id(config, filename, udata);
+
+	struct res* got = table_get(res_cache, id);
+	if (got) {
+		acquire_res(got);
+
+		return (struct resource) { id, got->payload };
+	}
+
+	void* payload;
+	struct res_request* request = new_res_request(config, id, filename, udata, &payload);
+
+	job_run(&(struct job) { res_load_job, request }, 1, &request->counter);
+
+	return (struct resource) { id, payload };
+}
+
+static void res_decode_job(void* uptr) {
+	struct res_request* request = uptr;
 
-		if (!error) { raw_size = strlen((char*)raw) + 1; }
+	decode_res_data(&request->config, request->id, request->filename, request->udata, request->ok,
+		&(struct raw_view) { 0 }, &request->raw, &request->raw_size, &request->owns_raw);
+}
+
+static void on_res_batch_read(usize index, u8* data, usize size, void* uptr) {
+	struct res_request* request = ((struct res_request**)uptr)[index];
+
+	request->ok = data != null;
+	request->raw = data;
+	request->raw_size = data && request->config.terminate_raw ? strlen((char*)data) + 1 : size;
+	request->owns_raw = request->ok;
+
+	if (request->config.on_decode || request->config.on_decode_stream) {
+		job_run(&(struct job) { res_decode_job, request }, 1, &request->counter);
 	} else {
-		error = !read_raw(filename, &raw, &raw_size);
+		res_decode_job(request);
 	}
 
-	if (error) {
-		core_free(raw);
+	/* Lets go of the request only once the decode job holds on to it. */
+	atomic_add_i64(&request->counter.value, -1);
+}
 
-		if (config->alt_raw && config->alt_raw_size) {
-			raw = (u8*)config->alt_raw;
-			raw_size = config->alt_raw_size;
+/* The requests are followed by their filenames, in the same allocation. */
+struct res_batch {
+	usize count;
+	struct res_request** requests;
+	const char** filenames;
+};
+
+static void res_batch_job(void* uptr) {
+	struct res_batch* batch = uptr;
+
+	read_file_batch(batch->filenames, batch->count, on_res_batch_read, batch->requests);
+
+	core_free(batch);
+}
+
+void res_load_batch_async(const char* type, const char** filenames, usize count, void* udata, struct resource* resources) {
+	struct res_config* config = find_res_type(type);
+
+	/* Files in a package are mapped already, so there is nothing to batch. */
+	if (!config || bound_pak) {
+		for (usize i = 0; i < count; i++) {
+			resources[i] = res_load_async(type, filenames[i], udata);
+		}
+
+		return;
+	}
+
+	struct res_batch* batch = core_alloc(sizeof *batch + count * (sizeof *batch->requests + sizeof *batch->filenames));
+	batch->count = 0;
+	batch->requests = (struct res_request**)(batch + 1);
+	batch->filenames = (const char**)(batch->requests + count);
+
+	for (usize i = 0; i < count; i++) {
+		u64 id = make_res_id(config, filenames[i], udata);
+
+		struct res* got = table_get(res_cache, id);
+		if (got) {
+			acquire_res(got);
+
+			resources[i] = (struct resource) { id, got->payload };
+			continue;
+		}
+
+		void* payload;
+		struct res_request* request = new_res_request(config, id, filenames[i], udata, &payload);
+
+		/* Keeps the request from looking finished until its file has been
+		 * read; See on_res_batch_read. */
+		atomic_add_i64(&request->counter.value, 1);
+
+		batch->requests[batch->count] = request;
+		batch->filenames[batch->count] = request->filename;
+		batch->count++;
+
+		resources[i] = (struct resource) { id, payload };
+	}
+
+	if (batch->count == 0) {
+		core_free(batch);
+		return;
+	}
+
+	job_run(&(struct job) { res_batch_job, batch }, 1, null);
+}
+
+/* Runs on_load for a request whose job has finished. */
+static void finalise_request(struct res_request* request) {
+	for (usize i = 0; i < vector_count(res_pending); i++) {
+		if (res_pending[i] == request) {
+			vector_delete(res_pending, i);
+			break;
+		}
+	}
+
+	struct res* res = table_get(res_cache, request->id);
+	res->request = null;
+	res->ok = request->ok;
+
+	/* on_load may load other resources, which can resize the cache, so the
+	 * entry is looked up again afterwards. */
+	void* payload = res->payload;
+	usize payload_size = res->payload_size;
+
+	usize size = call_on_load(&request->config, request->filename, request->raw, request->raw_size,
+		payload, payload_size, request->udata);
+
+	if (request->config.free_raw_on_load && request->owns_raw) {
+		core_free(request->raw);
+	}
+
+	res = table_get(res_cache, request->id);
+	res->size = size;
+
+	struct res_config* config = table_get(res_registry, res->config_name);
+
+	config->_size += size;
+	trim_res_type(config);
+
+	core_free(request->udata);
+	core_free(request);
+}
+
+bool res_ready(const struct resource* r) {
+	struct res* res = table_get(res_cache, r->id);
+	if (!res) { return false; }
+
+	if (res->request) {
+		if (!job_done(&res->request->counter)) {
+			return false;
 		}
+
+		finalise_request(res->request);
+	}
+
+	return true;
+}
+
+void res_wait(const struct resource* r) {
+	struct res* res = table_get(res_cache, r->id);
+	if (!res || !res->request) { return; }
+
+	struct res_request* request = res->request;
+
+	job_wait(&request->counter);
+	finalise_request(request);
+}
+
+void res_enable_hot_reload(bool enable) {
+	if (enable && !res_watcher) {
+		res_watcher = new_file_watcher();
+	} else if (!enable && res_watcher) {
+		free_file_watcher(res_watcher);
+		res_watcher = null;
 	}
+}
+
+/* Reloads a resource into the same payload, so that pointers to it stay
+ * valid. */
+static void reload_res(u64 id) {
+	struct res* res = table_get(res_cache, id);
+	struct res_config* config = table_get(res_registry, res->config_name);
 
-	new_res.ok = !error;
+	const char* filename = res->filename;
+	void* udata = res->udata;
+	void* payload = res->payload;
+	usize payload_size = res->payload_size;
 
-	config->on_load(filename, raw, raw_size, new_res.payload, new_res.payload_size, udata);
+	u8* raw;
+	usize raw_size;
+	bool owns_raw;
+
+	bool ok = read_res_data(config, id, filename, udata, &raw, &raw_size, &owns_raw);
+
+	config->on_unload(payload, payload_size);
+	memset(payload, 0, payload_size);
 
-	if (config->free_raw_on_load && !error) {
+	usize size = call_on_load(config, filename, raw, raw_size, payload, payload_size, udata);
+
+	if (config->free_raw_on_load && owns_raw) {
 		core_free(raw);
 	}
 
-	table_set(res_cache, resource_id_buf, new_res);
+	res = table_get(res_cache, id);
+	res->ok = ok;
 
-	struct res* new_res_ptr = table_get(res_cache, resource_id_buf);
-	new_res_ptr->name = last_copied_cache_key;
+	config->_size = config->_size - res->size + size;
+	res->size = size;
 
-	core_free(resource_id_buf);
+	trim_res_type(config);
 
-	return (struct resource) { new_res_ptr->name, new_res.payload };
+	if (ok) {
+		info("Reloaded `%s'.", filename);
+	} else {
+		warning("Failed to reload `%s'.", filename);
+	}
 }
 
-void res_unload(const struct resource* r) {
-	struct res* res = table_get(res_cache, r->key);
+static void on_file_changed(const char* path, void* uptr) {
+	/* One file can back several resources, such as a font at different
+	 * sizes. Reloading may load other resources, so they're gathered
+	 * first. Resources that are still loading pick up the change anyway. */
+	vector(u64) ids = null;
+
+	for (u64* i = table_first(res_cache); i; i = table_next(res_cache, *i)) {
+		struct res* res = table_get(res_cache, *i);
+
+		if (res->filename && !res->request && strcmp(res->filename, path) == 0) {
+			vector_push(ids, res->id);
+		}
+	}
+
+	for (usize i = 0; i < vector_count(ids); i++) {
+		if (table_get(res_cache, ids[i])) {
+			reload_res(ids[i]);
+		}
+	}
+
+	free_vector(ids);
+}
+
+void res_update() {
+	if (res_watcher) {
+		file_watcher_poll(res_watcher, on_file_changed, null);
+	}
+
+	for (usize i = 0; i < vector_count(res_pending);) {
+		if (job_done(&res_pending[i]->counter)) {
+			finalise_request(res_pending[i]);
+		} else {
+			i++;
+		}
+	}
+}
+
+struct resource res_acquire(u64 id) {
+	struct res* res = table_get(res_cache, id);
 	if (!res) {
-		error("Failed to unload resource.");
-		return;
+		return (struct resource) { 0, null };
 	}
 
-	struct res_config* config = table_get(res_registry, res->config_name);
+	acquire_res(res);
 
-	config->on_unload(res->payload, res->payload_size);
+	return (struct resource) { id, res->payload };
+}
 
-	if (res->ok) {
-		core_free(res->payload);
+void res_set_cook_dir(const char* dir) {
+	core_free(cook_dir);
+	cook_dir = null;
+
+	if (dir) {
+		create_dir(dir);
+		cook_dir = copy_string(dir);
+	}
+}
+
+void res_unload(const struct resource* r) {
+	res_wait(r);
+
+	struct res* res = table_get(res_cache, r->id);
+	if (!res || res->ref_count == 0) {
+		error("Failed to unload resource.");
+		return;
+	}
+
+	if (--res->ref_count > 0) {
+		return;
 	}
 
-	table_delete(res_cache, r->key);
+	struct res_config* config = table_get(res_registry, res->config_name);
+
+	lru_push(config, res);
+	trim_res_type(config);
 }
 
 struct texture* load_texture(const char* filename, u32 flags, struct resource* r) {
@@ -585,6 +2312,11 @@ struct texture* load_texture(const char* filename, u32 flags, struct resource* r
 	return r->payload;
 }
 
+struct texture* load_texture_async(const char* filename, u32 flags, struct resource* r) {
+	*r = res_load_async("texture", filename, &flags);
+	return r->payload;
+}
+
 struct font* load_font(const char* filename, i32 size, struct resource* r) {
 	struct resource temp;
 
@@ -596,6 +2328,17 @@ struct font* load_font(const char* filename, i32 size, struct resource* r) {
 	return r->payload;
 }
 
+struct font* load_sdf_font(const char* filename, i32 size, struct resource* r) {
+	struct resource temp;
+
+	if (!r) {
+		r = &temp;
+	}
+
+	*r = res_load("sdf font", filename, &size);
+	return r->payload;
+}
+
 struct shader* load_shader(const char* filename, struct resource* r) {
 	struct resource temp;
 
@@ -1,3 +1,5 @@
+#include <stdio.h>
+
 #include "core.h"
 #include "res.h"
 
@@ -20,3 +22,114 @@ struct dir_entry* dir_iter_cur(struct dir_iter* it) {
 bool dir_iter_next(struct dir_iter* it) {
 	abort_with("Not implemented.");
 }
+
+/* The file system is already in memory, so mapping a file just reads it. */
+bool map_file(const char* path, struct file_map* map) {
+	memset(map, 0, sizeof *map);
+
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	map->size = ftell(file);
+	rewind(file);
+
+	u8* data = core_alloc(map->size);
+	fread(data, 1, map->size, file);
+
+	fclose(file);
+
+	map->data = data;
+
+	return true;
+}
+
+void unmap_file(struct file_map* map) {
+	core_free((u8*)map->data);
+
+	memset(map, 0, sizeof *map);
+}
+
+struct file_reader {
+	FILE* file;
+	u64 size;
+};
+
+struct file_reader* new_file_reader(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return null;
+	}
+
+	struct file_reader* reader = core_calloc(1, sizeof *reader);
+	reader->file = file;
+
+	fseek(file, 0, SEEK_END);
+	reader->size = (u64)ftell(file);
+	rewind(file);
+
+	return reader;
+}
+
+void free_file_reader(struct file_reader* reader) {
+	fclose(reader->file);
+	core_free(reader);
+}
+
+u64 file_reader_size(const struct file_reader* reader) {
+	return reader->size;
+}
+
+usize file_reader_read(struct file_reader* reader, void* buf, usize size) {
+	return fread(buf, 1, size, reader->file);
+}
+
+bool file_reader_seek(struct file_reader* reader, i64 offset) {
+	return fseek(reader->file, (long)offset, SEEK_CUR) == 0;
+}
+
+static u8* read_batch_file(const char* path, usize* size) {
+	struct file_reader* reader = new_file_reader(path);
+	if (!reader) {
+		error("Failed to open file %s.", path);
+		*size = 0;
+		return null;
+	}
+
+	u8* data = core_alloc((usize)file_reader_size(reader) + 1);
+
+	*size = file_reader_read(reader, data, (usize)file_reader_size(reader));
+	data[*size] = 0;
+
+	free_file_reader(reader);
+
+	return data;
+}
+
+void read_file_batch(const char** paths, usize count, void (*on_read)(usize index, u8* data, usize size, void* uptr), void* uptr) {
+	for (usize i = 0; i < count; i++) {
+		usize size;
+		u8* data = read_batch_file(paths[i], &size);
+
+		on_read(i, data, size, uptr);
+	}
+}
+
+/* Files can't change behind the application's back here. */
+struct file_watcher {
+	u8 unused;
+};
+
+struct file_watcher* new_file_watcher() {
+	return core_calloc(1, sizeof(struct file_watcher));
+}
+
+void free_file_watcher(struct file_watcher* watcher) {
+	core_free(watcher);
+}
+
+void file_watcher_add(struct file_watcher* watcher, const char* path) {}
+
+void file_watcher_poll(struct file_watcher* watcher, void (*on_change)(const char* path, void* uptr), void* uptr) {}
@@ -1,7 +1,20 @@
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
 
 #include "core.h"
+#include "job.h"
 #include "res.h"
 
 bool get_file_info(const char* path, struct file_info* info) {
@@ -93,3 +106,602 @@ bool create_dir(const char* name) {
 
 	return r == 0;
 }
+
+bool map_file(const char* path, struct file_map* map) {
+	memset(map, 0, sizeof *map);
+
+	i32 fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat s;
+	if (fstat(fd, &s) != 0) {
+		close(fd);
+		return false;
+	}
+
+	map->size = (usize)s.st_size;
+
+	/* mmap refuses to map zero bytes. */
+	if (map->size > 0) {
+		void* data = mmap(null, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+
+		map->data = data;
+	}
+
+	/* The mapping keeps the file alive on its own. */
+	close(fd);
+
+	return true;
+}
+
+void unmap_file(struct file_map* map) {
+	if (map->data) {
+		munmap((void*)map->data, map->size);
+	}
+
+	memset(map, 0, sizeof *map);
+}
+
+/* How far ahead of the reader the OS is asked to read. */
+#define file_read_ahead (4 * 1024 * 1024)
+
+struct file_reader {
+	i32 fd;
+	u64 size;
+	u64 pos;
+
+	/* Everything before this has been asked for. */
+	u64 advised;
+};
+
+/* The kernel reads ahead on its own, but only a little at a time. Asking for
+ * the next window once half of the last one has been consumed keeps it
+ * going in the background while the caller works on what it has. */
+static void file_reader_read_ahead(struct file_reader* reader) {
+#ifdef POSIX_FADV_WILLNEED
+	if (reader->advised < reader->pos) {
+		reader->advised = reader->pos;
+	}
+
+	if (reader->advised < reader->size && reader->pos + file_read_ahead / 2 >= reader->advised) {
+		posix_fadvise(reader->fd, (off_t)reader->advised, file_read_ahead, POSIX_FADV_WILLNEED);
+		reader->advised += file_read_ahead;
+	}
+#endif
+}
+
+struct file_reader* new_file_reader(const char* path) {
+	i32 fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return null;
+	}
+
+	struct stat s;
+	if (fstat(fd, &s) != 0) {
+		close(fd);
+		return null;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	struct file_reader* reader = core_calloc(1, sizeof *reader);
+	reader->fd = fd;
+	reader->size = (u64)s.st_size;
+
+	file_reader_read_ahead(reader);
+
+	return reader;
+}
+
+void free_file_reader(struct file_reader* reader) {
+	close(reader->fd);
+	core_free(reader);
+}
+
+u64 file_reader_size(const struct file_reader* reader) {
+	return reader->size;
+}
+
+usize file_reader_read(struct file_reader* reader, void* buf, usize size) {
+	usize total = 0;
+
+	while (total < size) {
+		ssize_t n = read(reader->fd, (u8*)buf + total, size - total);
+
+		if (n < 0 && errno == EINTR) { continue; }
+		if (n <= 0) { break; }
+
+		total += (usize)n;
+	}
+
+	reader->pos += total;
+	file_reader_read_ahead(reader);
+
+	return total;
+}
+
+bool file_reader_seek(struct file_reader* reader, i64 offset) {
+	off_t pos = lseek(reader->fd, (off_t)offset, SEEK_CUR);
+	if (pos < 0) {
+		return false;
+	}
+
+	reader->pos = (u64)pos;
+
+	return true;
+}
+
+struct file_batch {
+	const char** paths;
+	void (*on_read)(usize index, u8* data, usize size, void* uptr);
+	void* uptr;
+};
+
+/* Opens a file and allocates a buffer for all of it, plus a terminator. */
+static bool open_batch_file(const char* path, i32* fd, u8** data, usize* size) {
+	*fd = open(path, O_RDONLY);
+	if (*fd < 0) {
+		error("Failed to open file %s.", path);
+		return false;
+	}
+
+	struct stat s;
+	if (fstat(*fd, &s) != 0) {
+		error("Failed to open file %s.", path);
+		close(*fd);
+		return false;
+	}
+
+	*size = (usize)s.st_size;
+	*data = core_alloc(*size + 1);
+
+	return true;
+}
+
+/* Hands a file over to on_read. A file that got shorter while it was read
+ * is cut short, and one that failed to read is reported as missing. */
+static void finish_batch_file(const struct file_batch* batch, usize index, i32 fd, u8* data, usize size, bool ok) {
+	close(fd);
+
+	if (!ok) {
+		error("Failed to read file %s.", batch->paths[index]);
+		core_free(data);
+		data = null;
+		size = 0;
+	} else {
+		data[size] = 0;
+	}
+
+	batch->on_read(index, data, size, batch->uptr);
+}
+
+static void read_file_batch_range(void* uptr, usize begin, usize end) {
+	const struct file_batch* batch = uptr;
+
+	for (usize i = begin; i < end; i++) {
+		i32 fd;
+		u8* data;
+		usize size;
+
+		if (!open_batch_file(batch->paths[i], &fd, &data, &size)) {
+			batch->on_read(i, null, 0, batch->uptr);
+			continue;
+		}
+
+		usize total = 0;
+		bool ok = true;
+
+		while (total < size) {
+			ssize_t n = pread(fd, data + total, size - total, (off_t)total);
+
+			if (n < 0 && errno == EINTR) { continue; }
+			if (n < 0) { ok = false; }
+			if (n <= 0) { break; }
+
+			total += (usize)n;
+		}
+
+		finish_batch_file(batch, i, fd, data, total, ok);
+	}
+}
+
+#ifdef __linux__
+/* At most this many reads are in flight at once, which also bounds the
+ * amount of open files. */
+#define file_batch_ring_size 64
+
+struct uring {
+	i32 fd;
+
+	u8* sq_ring;
+	usize sq_ring_size;
+	u8* cq_ring;
+	usize cq_ring_size;
+
+	u32* sq_tail;
+	u32* sq_array;
+	u32 sq_mask;
+
+	u32* cq_head;
+	u32* cq_tail;
+	u32 cq_mask;
+
+	struct io_uring_sqe* sqes;
+	usize sqes_size;
+	struct io_uring_cqe* cqes;
+};
+
+/* Set once io_uring_setup has failed, such as when a container's seccomp
+ * profile blocks it, so that it isn't tried again. */
+static volatile bool uring_unavailable;
+
+static void deinit_uring(struct uring* ring) {
+	if (ring->sqes) { munmap(ring->sqes, ring->sqes_size); }
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) { munmap(ring->cq_ring, ring->cq_ring_size); }
+	if (ring->sq_ring) { munmap(ring->sq_ring, ring->sq_ring_size); }
+
+	close(ring->fd);
+}
+
+static void* map_uring(i32 fd, usize size, u64 offset) {
+	void* p = mmap(null, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t)offset);
+
+	return p == MAP_FAILED ? null : p;
+}
+
+static bool init_uring(struct uring* ring, u32 entries) {
+	memset(ring, 0, sizeof *ring);
+
+	struct io_uring_params p = { 0 };
+
+	ring->fd = (i32)syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0) {
+		return false;
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(u32);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	/* Newer kernels share one mapping between both rings. */
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->sq_ring_size = cr_max(ring->sq_ring_size, ring->cq_ring_size);
+	}
+
+	ring->sq_ring = map_uring(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+
+	if (ring->sq_ring && (p.features & IORING_FEAT_SINGLE_MMAP)) {
+		ring->cq_ring = ring->sq_ring;
+	} else if (ring->sq_ring) {
+		ring->cq_ring = map_uring(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = map_uring(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+
+	if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+		deinit_uring(ring);
+		return false;
+	}
+
+	ring->sq_tail  = (u32*)(ring->sq_ring + p.sq_off.tail);
+	ring->sq_array = (u32*)(ring->sq_ring + p.sq_off.array);
+	ring->sq_mask  = *(u32*)(ring->sq_ring + p.sq_off.ring_mask);
+
+	ring->cq_head = (u32*)(ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (u32*)(ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = *(u32*)(ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes    = (struct io_uring_cqe*)(ring->cq_ring + p.cq_off.cqes);
+
+	return true;
+}
+
+struct batch_read {
+	i32 fd;
+	u8* data;
+	usize size;
+	usize done;
+
+	struct iovec iov;
+};
+
+/* Queues a read of the rest of a file. Only one read per file is in flight,
+ * so a short read simply queues another. */
+static void uring_queue_read(struct uring* ring, struct batch_read* read, usize index) {
+	read->iov.iov_base = read->data + read->done;
+	read->iov.iov_len  = cr_min(read->size - read->done, (usize)1 << 30);
+
+	u32 tail = *ring->sq_tail;
+	u32 slot = tail & ring->sq_mask;
+
+	struct io_uring_sqe* sqe = ring->sqes + slot;
+	memset(sqe, 0, sizeof *sqe);
+
+	sqe->opcode    = IORING_OP_READV;
+	sqe->fd        = read->fd;
+	sqe->addr      = (u64)(uptr)&read->iov;
+	sqe->len       = 1;
+	sqe->off       = read->done;
+	sqe->user_data = index;
+
+	ring->sq_array[slot] = slot;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Keeps the ring full: Files are opened and their reads queued as earlier
+ * ones complete, and every completion is handed to on_read straight away,
+ * while the rest are still being read. */
+static bool read_file_batch_uring(const struct file_batch* batch, usize count) {
+	if (uring_unavailable) { return false; }
+
+	struct uring ring;
+	if (!init_uring(&ring, file_batch_ring_size)) {
+		uring_unavailable = true;
+		return false;
+	}
+
+	struct batch_read* reads = core_calloc(count, sizeof *reads);
+
+	usize next = 0;
+	u32 queued = 0;
+	u32 in_flight = 0;
+
+	while (next < count || in_flight > 0) {
+		for (; next < count && in_flight < file_batch_ring_size; next++) {
+			struct batch_read* read = reads + next;
+
+			if (!open_batch_file(batch->paths[next], &read->fd, &read->data, &read->size)) {
+				batch->on_read(next, null, 0, batch->uptr);
+				continue;
+			}
+
+			if (read->size == 0) {
+				finish_batch_file(batch, next, read->fd, read->data, 0, true);
+				continue;
+			}
+
+			uring_queue_read(&ring, read, next);
+			queued++;
+			in_flight++;
+		}
+
+		if (in_flight == 0) { continue; }
+
+		i32 submitted = (i32)syscall(__NR_io_uring_enter, ring.fd, queued, 1, IORING_ENTER_GETEVENTS, null, 0);
+		if (submitted < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) { continue; }
+
+			/* The kernel may still be writing to the buffers. */
+			abort_with("io_uring_enter failed: %s", strerror(errno));
+		}
+
+		queued -= (u32)submitted;
+
+		u32 head = *ring.cq_head;
+		u32 tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; head++) {
+			const struct io_uring_cqe* cqe = ring.cqes + (head & ring.cq_mask);
+
+			usize index = (usize)cqe->user_data;
+			struct batch_read* read = reads + index;
+
+			if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+				uring_queue_read(&ring, read, index);
+				queued++;
+				continue;
+			}
+
+			if (cqe->res > 0) {
+				read->done += (usize)cqe->res;
+
+				if (read->done < read->size) {
+					uring_queue_read(&ring, read, index);
+					queued++;
+					continue;
+				}
+			}
+
+			in_flight--;
+
+			finish_batch_file(batch, index, read->fd, read->data, read->done, cqe->res >= 0);
+		}
+
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	core_free(reads);
+	deinit_uring(&ring);
+
+	return true;
+}
+#endif
+
+void read_file_batch(const char** paths, usize count, void (*on_read)(usize index, u8* data, usize size, void* uptr), void* uptr) {
+	struct file_batch batch = {
+		.paths   = paths,
+		.on_read = on_read,
+		.uptr    = uptr
+	};
+
+#ifdef __linux__
+	if (read_file_batch_uring(&batch, count)) {
+		return;
+	}
+#endif
+
+	/* The workers block on their reads, so each takes one file at a time. */
+	job_parallel_for(count, 1, read_file_batch_range, &batch);
+}
+
+/* get_file_info only has whole seconds, which misses quick edits. */
+static u64 file_mod_time_ns(const char* path) {
+	struct stat s;
+	if (stat(path, &s) != 0) {
+		return 0;
+	}
+
+	return (u64)s.st_mtim.tv_sec * 1000000000 + (u64)s.st_mtim.tv_nsec;
+}
+
+struct watched_file {
+	char* path;
+	const char* name; /* Points into path, past the directory. */
+	i32 wd;
+	u64 mod_time;
+	bool changed;
+};
+
+struct file_watcher {
+	/* The inotify instance, or -1 when polling. */
+	i32 fd;
+
+	vector(struct watched_file) files;
+
+	/* The file that the next poll checks when polling. */
+	usize next;
+};
+
+struct file_watcher* new_file_watcher() {
+	struct file_watcher* watcher = core_calloc(1, sizeof *watcher);
+
+	watcher->fd = -1;
+
+#ifdef __linux__
+	watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (watcher->fd < 0) {
+		warning("inotify is unavailable, falling back to polling for file changes.");
+	}
+#endif
+
+	return watcher;
+}
+
+void free_file_watcher(struct file_watcher* watcher) {
+	/* Closing the instance removes all of its watches. */
+	if (watcher->fd >= 0) {
+		close(watcher->fd);
+	}
+
+	for (usize i = 0; i < vector_count(watcher->files); i++) {
+		core_free(watcher->files[i].path);
+	}
+
+	free_vector(watcher->files);
+	core_free(watcher);
+}
+
+void file_watcher_add(struct file_watcher* watcher, const char* path) {
+	for (usize i = 0; i < vector_count(watcher->files); i++) {
+		if (strcmp(watcher->files[i].path, path) == 0) { return; }
+	}
+
+	struct watched_file file = {
+		.wd = -1
+	};
+
+	const char* slash = strrchr(path, '/');
+
+	file.mod_time = file_mod_time_ns(path);
+
+#ifdef __linux__
+	if (watcher->fd >= 0) {
+		/* Editors often save by renaming a new file over the old one, so the
+		 * directory is watched rather than the file itself. inotify hands
+		 * back the same descriptor for a directory that is already watched. */
+		char dir[1024];
+
+		if (slash) {
+			usize len = cr_min((usize)(slash - path), sizeof dir - 1);
+			memcpy(dir, path, len);
+			dir[len] = '\0';
+		} else {
+			strcpy(dir, ".");
+		}
+
+		file.wd = inotify_add_watch(watcher->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+
+		if (file.wd < 0) {
+			warning("Failed to watch directory `%s'.", dir);
+			return;
+		}
+	}
+#endif
+
+	file.path = copy_string(path);
+	file.name = slash ? file.path + (slash - path) + 1 : file.path;
+
+	vector_push(watcher->files, file);
+}
+
+#ifdef __linux__
+static bool read_inotify_events(struct file_watcher* watcher) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	bool any = false;
+
+	for (;;) {
+		ssize_t n = read(watcher->fd, buf, sizeof buf);
+		if (n <= 0) { break; }
+
+		for (char* p = buf; p < buf + n;) {
+			const struct inotify_event* e = (const struct inotify_event*)p;
+
+			for (usize i = 0; e->len > 0 && i < vector_count(watcher->files); i++) {
+				struct watched_file* file = watcher->files + i;
+
+				if (file->wd == e->wd && strcmp(file->name, e->name) == 0) {
+					file->changed = true;
+					any = true;
+				}
+			}
+
+			p += sizeof *e + e->len;
+		}
+	}
+
+	return any;
+}
+#endif
+
+void file_watcher_poll(struct file_watcher* watcher, void (*on_change)(const char* path, void* uptr), void* uptr) {
+	usize count = vector_count(watcher->files);
+	if (count == 0) { return; }
+
+#ifdef __linux__
+	if (watcher->fd >= 0) {
+		if (!read_inotify_events(watcher)) { return; }
+
+		/* A file may have been saved several times since the last poll, but
+		 * it is only reported once. */
+		for (usize i = 0; i < count; i++) {
+			struct watched_file* file = watcher->files + i;
+
+			if (file->changed) {
+				file->changed = false;
+				on_change(file->path, uptr);
+			}
+		}
+
+		return;
+	}
+#endif
+
+	struct watched_file* file = watcher->files + (watcher->next++ % count);
+
+	u64 mod_time = file_mod_time_ns(file->path);
+	if (mod_time != 0 && mod_time != file->mod_time) {
+		file->mod_time = mod_time;
+		on_change(file->path, uptr);
+	}
+}
@@ -1,6 +1,7 @@
 #include <Windows.h>
 
 #include "core.h"
+#include "job.h"
 #include "res.h"
 
 static u64 file_mod_time(const char* name) {
@@ -137,4 +138,357 @@ bool dir_iter_next(struct dir_iter* it) {
 
 bool create_dir(const char* name) {
 	return (bool)CreateDirectoryA(name, null);
-}
\ No newline at end of file
+}
+bool map_file(const char* path, struct file_map* map) {
+	memset(map, 0, sizeof *map);
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	map->size = (usize)size.QuadPart;
+
+	/* Empty files can't be mapped. */
+	if (map->size > 0) {
+		HANDLE mapping = CreateFileMappingA(file, null, PAGE_READONLY, 0, 0, null);
+		if (!mapping) {
+			CloseHandle(file);
+			return false;
+		}
+
+		map->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+		/* The view keeps the mapping and the file alive on its own. */
+		CloseHandle(mapping);
+
+		if (!map->data) {
+			CloseHandle(file);
+			return false;
+		}
+	}
+
+	CloseHandle(file);
+
+	return true;
+}
+
+void unmap_file(struct file_map* map) {
+	if (map->data) {
+		UnmapViewOfFile(map->data);
+	}
+
+	memset(map, 0, sizeof *map);
+}
+
+struct file_reader {
+	HANDLE handle;
+	u64 size;
+};
+
+struct file_reader* new_file_reader(const char* path) {
+	/* Sequential scan makes the cache manager read further ahead. */
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, null);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return null;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size)) {
+		CloseHandle(handle);
+		return null;
+	}
+
+	struct file_reader* reader = core_calloc(1, sizeof *reader);
+	reader->handle = handle;
+	reader->size = (u64)size.QuadPart;
+
+	return reader;
+}
+
+void free_file_reader(struct file_reader* reader) {
+	CloseHandle(reader->handle);
+	core_free(reader);
+}
+
+u64 file_reader_size(const struct file_reader* reader) {
+	return reader->size;
+}
+
+usize file_reader_read(struct file_reader* reader, void* buf, usize size) {
+	usize total = 0;
+
+	while (total < size) {
+		DWORD n;
+		DWORD to_read = (DWORD)cr_min(size - total, 1 << 30);
+
+		if (!ReadFile(reader->handle, (u8*)buf + total, to_read, &n, null) || n == 0) {
+			break;
+		}
+
+		total += n;
+	}
+
+	return total;
+}
+
+bool file_reader_seek(struct file_reader* reader, i64 offset) {
+	LARGE_INTEGER distance;
+	distance.QuadPart = offset;
+
+	return SetFilePointerEx(reader->handle, distance, null, FILE_CURRENT);
+}
+
+struct file_batch {
+	const char** paths;
+	void (*on_read)(usize index, u8* data, usize size, void* uptr);
+	void* uptr;
+};
+
+static u8* read_batch_file(const char* path, usize* size) {
+	struct file_reader* reader = new_file_reader(path);
+	if (!reader) {
+		error("Failed to open file %s.", path);
+		*size = 0;
+		return null;
+	}
+
+	u8* data = core_alloc((usize)file_reader_size(reader) + 1);
+
+	*size = file_reader_read(reader, data, (usize)file_reader_size(reader));
+	data[*size] = 0;
+
+	free_file_reader(reader);
+
+	return data;
+}
+
+static void read_file_batch_range(void* uptr, usize begin, usize end) {
+	const struct file_batch* batch = uptr;
+
+	for (usize i = begin; i < end; i++) {
+		usize size;
+		u8* data = read_batch_file(batch->paths[i], &size);
+
+		batch->on_read(i, data, size, batch->uptr);
+	}
+}
+
+/* The workers block on their reads, so each takes one file at a time. */
+void read_file_batch(const char** paths, usize count, void (*on_read)(usize index, u8* data, usize size, void* uptr), void* uptr) {
+	struct file_batch batch = {
+		.paths   = paths,
+		.on_read = on_read,
+		.uptr    = uptr
+	};
+
+	job_parallel_for(count, 1, read_file_batch_range, &batch);
+}
+
+struct watched_dir {
+	char path[MAX_PATH];
+
+	HANDLE handle;
+	OVERLAPPED overlapped;
+
+	DWORD buffer[1024];
+};
+
+struct watched_file {
+	char* path;
+	const char* name; /* Points into path, past the directory. */
+	struct watched_dir* dir;
+	bool changed;
+};
+
+struct file_watcher {
+	vector(struct watched_dir*) dirs;
+	vector(struct watched_file) files;
+};
+
+static bool watch_dir(struct watched_dir* dir) {
+	return ReadDirectoryChangesW(dir->handle, dir->buffer, sizeof dir->buffer, false,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, null, &dir->overlapped, null);
+}
+
+struct file_watcher* new_file_watcher() {
+	return core_calloc(1, sizeof(struct file_watcher));
+}
+
+void free_file_watcher(struct file_watcher* watcher) {
+	for (usize i = 0; i < vector_count(watcher->dirs); i++) {
+		struct watched_dir* dir = watcher->dirs[i];
+
+		/* The buffer mustn't be freed while the read is still pending. */
+		if (dir->handle != INVALID_HANDLE_VALUE) {
+			DWORD bytes;
+			CancelIoEx(dir->handle, &dir->overlapped);
+			GetOverlappedResult(dir->handle, &dir->overlapped, &bytes, true);
+
+			CloseHandle(dir->handle);
+		}
+
+		CloseHandle(dir->overlapped.hEvent);
+		core_free(dir);
+	}
+
+	for (usize i = 0; i < vector_count(watcher->files); i++) {
+		core_free(watcher->files[i].path);
+	}
+
+	free_vector(watcher->dirs);
+	free_vector(watcher->files);
+	core_free(watcher);
+}
+
+static struct watched_dir* get_watched_dir(struct file_watcher* watcher, const char* path) {
+	for (usize i = 0; i < vector_count(watcher->dirs); i++) {
+		if (_stricmp(watcher->dirs[i]->path, path) == 0) {
+			return watcher->dirs[i];
+		}
+	}
+
+	struct watched_dir* dir = core_calloc(1, sizeof *dir);
+	strcpy(dir->path, path);
+
+	dir->handle = CreateFileA(path, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		null, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, null);
+	if (dir->handle == INVALID_HANDLE_VALUE) {
+		core_free(dir);
+		return null;
+	}
+
+	dir->overlapped.hEvent = CreateEventA(null, true, false, null);
+
+	if (!watch_dir(dir)) {
+		CloseHandle(dir->overlapped.hEvent);
+		CloseHandle(dir->handle);
+		core_free(dir);
+		return null;
+	}
+
+	vector_push(watcher->dirs, dir);
+
+	return dir;
+}
+
+void file_watcher_add(struct file_watcher* watcher, const char* path) {
+	for (usize i = 0; i < vector_count(watcher->files); i++) {
+		if (strcmp(watcher->files[i].path, path) == 0) { return; }
+	}
+
+	const char* slash = strrchr(path, '/');
+	const char* backslash = strrchr(path, '\\');
+	if (backslash > slash) { slash = backslash; }
+
+	char dir_path[MAX_PATH];
+
+	if (slash) {
+		usize len = cr_min((usize)(slash - path), sizeof dir_path - 1);
+		memcpy(dir_path, path, len);
+		dir_path[len] = '\0';
+	} else {
+		strcpy(dir_path, ".");
+	}
+
+	struct watched_dir* dir = get_watched_dir(watcher, dir_path);
+	if (!dir) {
+		warning("Failed to watch directory `%s'.", dir_path);
+		return;
+	}
+
+	char* copy = copy_string(path);
+
+	vector_push(watcher->files, ((struct watched_file) {
+		.path = copy,
+		.name = slash ? copy + (slash - path) + 1 : copy,
+		.dir  = dir
+	}));
+}
+
+static void read_dir_changes(struct file_watcher* watcher, struct watched_dir* dir, DWORD size) {
+	/* Zero bytes means that the buffer overflowed, so anything in the
+	 * directory may have changed. */
+	if (size == 0) {
+		for (usize i = 0; i < vector_count(watcher->files); i++) {
+			if (watcher->files[i].dir == dir) {
+				watcher->files[i].changed = true;
+			}
+		}
+
+		return;
+	}
+
+	const u8* p = (const u8*)dir->buffer;
+
+	for (;;) {
+		const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+
+		if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED ||
+			info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+			char name[MAX_PATH];
+
+			i32 len = WideCharToMultiByte(CP_UTF8, 0, info->FileName, (i32)(info->FileNameLength / sizeof(WCHAR)),
+				name, sizeof name - 1, null, null);
+			name[len] = '\0';
+
+			for (usize i = 0; i < vector_count(watcher->files); i++) {
+				struct watched_file* file = watcher->files + i;
+
+				if (file->dir == dir && _stricmp(file->name, name) == 0) {
+					file->changed = true;
+				}
+			}
+		}
+
+		if (info->NextEntryOffset == 0) { break; }
+
+		p += info->NextEntryOffset;
+	}
+}
+
+void file_watcher_poll(struct file_watcher* watcher, void (*on_change)(const char* path, void* uptr), void* uptr) {
+	bool any = false;
+
+	for (usize i = 0; i < vector_count(watcher->dirs); i++) {
+		struct watched_dir* dir = watcher->dirs[i];
+
+		if (dir->handle == INVALID_HANDLE_VALUE) { continue; }
+
+		DWORD size;
+		if (!GetOverlappedResult(dir->handle, &dir->overlapped, &size, false)) {
+			continue;
+		}
+
+		read_dir_changes(watcher, dir, size);
+		any = true;
+
+		ResetEvent(dir->overlapped.hEvent);
+
+		if (!watch_dir(dir)) {
+			warning("Stopped watching directory `%s'.", dir->path);
+
+			CloseHandle(dir->handle);
+			dir->handle = INVALID_HANDLE_VALUE;
+		}
+	}
+
+	if (!any) { return; }
+
+	/* Editors tend to write a file in several steps, but it is only
+	 * reported once per poll. */
+	for (usize i = 0; i < vector_count(watcher->files); i++) {
+		struct watched_file* file = watcher->files + i;
+
+		if (file->changed) {
+			file->changed = false;
+			on_change(file->path, uptr);
+		}
+	}
+}
@@ -38,11 +38,18 @@ layout (location = 0) in VSOut {
 } fs_in;
 
 layout (binding = 1) uniform sampler2D atlas;
+layout (binding = 2) uniform sampler2D glyph_atlas;
 
 void main() {
 	vec4 texture_colour = vec4(1.0);
 
-	if (fs_in.use_texture > 0.0f) {
+	if (fs_in.use_texture > 2.5f) {
+		float dist = texture(glyph_atlas, fs_in.uv).r;
+		float edge = max(fwidth(dist) * 0.75f, 0.0001f);
+		texture_colour = vec4(1.0, 1.0, 1.0, smoothstep(0.5f - edge, 0.5f + edge, dist));
+	} else if (fs_in.use_texture > 1.5f) {
+		texture_colour = vec4(1.0, 1.0, 1.0, texture(glyph_atlas, fs_in.uv).r);
+	} else if (fs_in.use_texture > 0.0f) {
 		texture_colour = texture(atlas, fs_in.uv);
 	}
 
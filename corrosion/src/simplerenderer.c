@@ -2,6 +2,15 @@
 #include "simplerenderer.h"
 #include "window.h"
 
+/* The names of the descriptors, interned once so that the calls made for
+ * every batch find them by pointer instead of hashing the strings. */
+static struct {
+	const char* primary;
+	const char* vertex_ub;
+	const char* atlas;
+	const char* glyph_atlas;
+} names;
+
 static void create_pipeline(struct simple_renderer* renderer) {
 	renderer->pipeline = video.new_pipeline(
 		pipeline_flags_blend | pipeline_flags_dynamic_scissor | pipeline_flags_draw_tris,
@@ -68,9 +77,18 @@ static void create_pipeline(struct simple_renderer* renderer) {
 								.type = pipeline_resource_texture,
 								.texture = renderer->atlas->texture
 							}
+						},
+						{
+							.name    = "glyph_atlas",
+							.binding = 2,
+							.stage   = pipeline_stage_fragment,
+							.resource = {
+								.type = pipeline_resource_texture,
+								.texture = renderer->glyph_atlas ? renderer->glyph_atlas : renderer->atlas->texture
+							}
 						}
 					},
-					.count = 2,
+					.count = 3,
 				}
 			},
 			.count = 1
@@ -87,7 +105,48 @@ static bool overlap_clip(const struct simple_renderer* renderer, v4f rect) {
 		rect.y < renderer->clip.y + renderer->clip.w;
 }
 
+/* Glyphs are single channel, so they can't be copied into the atlas and are
+ * sampled from their own texture instead. Switching to another one draws
+ * what has been batched against the old one first. */
+static void use_glyph_atlas(struct simple_renderer* renderer, const struct texture* texture, bool sdf) {
+	renderer->glyph_sdf = sdf;
+
+	if (renderer->glyph_atlas == texture) {
+		return;
+	}
+
+	if (renderer->count > 0) {
+		usize count = renderer->count;
+		simple_renderer_flush(renderer);
+		renderer->offset += count;
+	}
+
+	renderer->glyph_atlas = texture;
+
+	video.pipeline_change_texture(renderer->pipeline, names.primary, names.glyph_atlas, texture);
+}
+
+/* The atlas may grow to fit the texture, which moves what it holds to new
+ * UVs, so what has been batched so far is drawn first. */
+static void add_to_atlas(struct simple_renderer* renderer, const struct texture* texture) {
+	if (renderer->count > 0) {
+		usize count = renderer->count;
+		simple_renderer_flush(renderer);
+		renderer->offset += count;
+	}
+
+	if (atlas_add_texture(renderer->atlas, texture)) {
+		video.pipeline_change_texture(renderer->pipeline, names.primary, names.atlas, renderer->atlas->texture);
+
+		if (!renderer->glyph_atlas) {
+			video.pipeline_change_texture(renderer->pipeline, names.primary, names.glyph_atlas, renderer->atlas->texture);
+		}
+	}
+}
+
 static void draw_text_character(void* uptr, const struct texture* atlas, v2f position, v4f rect, v4f colour) {
+	use_glyph_atlas(uptr, atlas, false);
+
 	simple_renderer_push(uptr, &(struct simple_renderer_quad) {
 		.position = position,
 		.dimensions = make_v2f(rect.z, rect.w),
@@ -97,12 +156,30 @@ static void draw_text_character(void* uptr, const struct texture* atlas, v2f pos
 	});
 }
 
+static void draw_sdf_text_character(void* uptr, const struct texture* atlas, v2f position, v2f dimensions, v4f rect, v4f colour) {
+	use_glyph_atlas(uptr, atlas, true);
+
+	simple_renderer_push(uptr, &(struct simple_renderer_quad) {
+		.position = position,
+		.dimensions = dimensions,
+		.colour = colour,
+		.rect = rect,
+		.texture = atlas
+	});
+}
+
 struct simple_renderer* new_simple_renderer(const struct framebuffer* framebuffer) {
 	struct simple_renderer* renderer = core_calloc(1, sizeof(struct simple_renderer));
 
+	names.primary     = intern_string("primary");
+	names.vertex_ub   = intern_string("VertexUniformData");
+	names.atlas       = intern_string("atlas");
+	names.glyph_atlas = intern_string("glyph_atlas");
+
 	renderer->text_renderer = (struct text_renderer) {
 		.uptr = renderer,
-		.draw_character = draw_text_character
+		.draw_character = draw_text_character,
+		.draw_sdf_character = draw_sdf_text_character
 	};
 
 	renderer->atlas = new_atlas(texture_flags_filter_none);
@@ -196,16 +273,21 @@ void simple_renderer_push(struct simple_renderer* renderer, const struct simple_
 
 	v4f rect = quad->rect;
 	f32 tx = 0.0f, ty = 0.0f, tw = 0.0f, th = 0.0f;
+	f32 use_texture = quad->texture != null ? 1.0f : 0.0f;
+
+	if (quad->texture && quad->texture == renderer->glyph_atlas) {
+		v2i size = video.get_texture_size(quad->texture);
+
+		tx = rect.x / (f32)size.x;
+		ty = rect.y / (f32)size.y;
+		tw = rect.z / (f32)size.x;
+		th = rect.w / (f32)size.y;
 
-	if (quad->texture) {
+		use_texture = renderer->glyph_sdf ? 3.0f : 2.0f;
+	} else if (quad->texture) {
 		v4i* atlas_rect = table_get(renderer->atlas->rects, quad->texture);
 		if (!atlas_rect) {
-			if (atlas_add_texture(renderer->atlas, quad->texture)) {
-				video.free_pipeline(renderer->pipeline);
-				create_pipeline(renderer);
-				return;
-			}
-
+			add_to_atlas(renderer, quad->texture);
 			atlas_rect = table_get(renderer->atlas->rects, quad->texture);
 		}
 
@@ -220,8 +302,6 @@ void simple_renderer_push(struct simple_renderer* renderer, const struct simple_
 		th = rect.w / (f32)renderer->atlas->size.y;
 	}
 
-	f32 use_texture = quad->texture != null ? 1.0f : 0.0f;
- 
  	struct simple_renderer_vertex verts[] = {
  		{ .position = { x1, y2 }, .uv = { tx,      ty + th }, .colour = quad->colour, .use_texture = use_texture },
 		{ .position = { x2, y2 }, .uv = { tx + tw, ty + th }, .colour = quad->colour, .use_texture = use_texture },
@@ -239,14 +319,14 @@ void simple_renderer_flush(struct simple_renderer* renderer) {
 	v2i window_size = video.get_framebuffer_size(renderer->framebuffer);
 
 	renderer->vertex_ub.projection = m4f_ortho(0.0f, (f32)window_size.x, (f32)window_size.y, 0.0f, -1.0f, 1.0f);
-	video.update_pipeline_uniform(renderer->pipeline, "primary", "VertexUniformData", &renderer->vertex_ub);
+	video.update_pipeline_uniform(renderer->pipeline, names.primary, names.vertex_ub, &renderer->vertex_ub);
 
 	video.begin_pipeline(renderer->pipeline);
 		video.set_scissor(renderer->clip);
 
 		video.bind_vertex_buffer(renderer->vb, 0);
 		video.bind_index_buffer(renderer->ib);
-		video.bind_pipeline_descriptor_set(renderer->pipeline, "primary", 0);
+		video.bind_pipeline_descriptor_set(renderer->pipeline, names.primary, 0);
 		video.draw_indexed(renderer->count * simple_renderer_indices_per_quad, renderer->offset * simple_renderer_indices_per_quad, 1);
 	video.end_pipeline(renderer->pipeline);
 
@@ -1,5 +1,7 @@
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <unistd.h>
 
 #include "thread.h"
 #include "core.h"
@@ -66,3 +68,50 @@ void lock_mutex(struct mutex* mutex) {
 void unlock_mutex(struct mutex* mutex) {
 	pthread_mutex_unlock(&mutex->mutex);
 }
+
+void init_cond(struct cond* cond) {
+	pthread_cond_init(&cond->cond, null);
+}
+
+void deinit_cond(struct cond* cond) {
+	pthread_cond_destroy(&cond->cond);
+}
+
+void cond_wait(struct cond* cond, struct mutex* mutex) {
+	pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+void cond_signal(struct cond* cond) {
+	pthread_cond_signal(&cond->cond);
+}
+
+void cond_broadcast(struct cond* cond) {
+	pthread_cond_broadcast(&cond->cond);
+}
+
+void init_semaphore(struct semaphore* semaphore, u32 count) {
+	sem_init(&semaphore->sem, 0, count);
+}
+
+void deinit_semaphore(struct semaphore* semaphore) {
+	sem_destroy(&semaphore->sem);
+}
+
+void semaphore_wait(struct semaphore* semaphore) {
+	while (sem_wait(&semaphore->sem) != 0) {}
+}
+
+void semaphore_signal(struct semaphore* semaphore, u32 count) {
+	for (u32 i = 0; i < count; i++) {
+		sem_post(&semaphore->sem);
+	}
+}
+
+void thread_yield() {
+	sched_yield();
+}
+
+u32 get_processor_count() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (u32)count : 1;
+}
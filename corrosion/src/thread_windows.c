@@ -53,18 +53,66 @@ void set_thread_uptr(struct thread* thread, void* ptr) {
 	thread->uptr = ptr;
 }
 
+/* Mutexes and condition variables are slim reader/writer locks and
+ * CONDITION_VARIABLEs stored directly in the handle, since both are a
+ * single pointer that doesn't need to be destroyed. Unlike the kernel
+ * mutexes from CreateMutex, they stay in user mode when uncontended. */
 void init_mutex(struct mutex* mutex) {
-	mutex->handle = (u64)CreateMutex(null, false, null);
+	InitializeSRWLock((PSRWLOCK)&mutex->handle);
 }
 
-void deinit_mutex(struct mutex* mutex) {
-	CloseHandle((HANDLE)mutex->handle);
-}
+void deinit_mutex(struct mutex* mutex) {}
 
 void lock_mutex(struct mutex* mutex) {
-	WaitForSingleObject((HANDLE)mutex->handle, INFINITE);
+	AcquireSRWLockExclusive((PSRWLOCK)&mutex->handle);
 }
 
 void unlock_mutex(struct mutex* mutex) {
-	ReleaseMutex((HANDLE)mutex->handle);
+	ReleaseSRWLockExclusive((PSRWLOCK)&mutex->handle);
+}
+
+void init_cond(struct cond* cond) {
+	InitializeConditionVariable((PCONDITION_VARIABLE)&cond->handle);
+}
+
+void deinit_cond(struct cond* cond) {}
+
+void cond_wait(struct cond* cond, struct mutex* mutex) {
+	SleepConditionVariableSRW((PCONDITION_VARIABLE)&cond->handle, (PSRWLOCK)&mutex->handle, INFINITE, 0);
+}
+
+void cond_signal(struct cond* cond) {
+	WakeConditionVariable((PCONDITION_VARIABLE)&cond->handle);
+}
+
+void cond_broadcast(struct cond* cond) {
+	WakeAllConditionVariable((PCONDITION_VARIABLE)&cond->handle);
+}
+
+void init_semaphore(struct semaphore* semaphore, u32 count) {
+	semaphore->handle = (u64)CreateSemaphore(null, count, LONG_MAX, null);
+}
+
+void deinit_semaphore(struct semaphore* semaphore) {
+	CloseHandle((HANDLE)semaphore->handle);
+}
+
+void semaphore_wait(struct semaphore* semaphore) {
+	WaitForSingleObject((HANDLE)semaphore->handle, INFINITE);
+}
+
+void semaphore_signal(struct semaphore* semaphore, u32 count) {
+	if (count > 0) {
+		ReleaseSemaphore((HANDLE)semaphore->handle, count, null);
+	}
+}
+
+void thread_yield() {
+	SwitchToThread();
+}
+
+u32 get_processor_count() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
 }
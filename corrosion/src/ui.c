@@ -57,9 +57,29 @@ struct ui_cmd_draw_circle {
 	f32 radius;
 };
 
+/* Text is laid out once and kept for as long as it keeps being drawn, so
+ * that a label that doesn't change costs a hash lookup each frame instead
+ * of a walk over its characters. Layouts are owned by the UI and live in
+ * text_layouts, keyed by a hash of the font, the text and the wrap width.
+ * Those are kept alongside the layout, so that a hit can be checked. */
+struct ui_text_layout {
+	struct text_glyph* glyphs;
+	usize count;
+
+	v2f dimensions;
+
+	i32 life;
+
+	u64 font_id;
+	i32 wrap_width;
+	char* text;
+	usize text_len;
+};
+
 struct ui_cmd_draw_text {
 	struct ui_cmd cmd;
 	struct font* font;
+	const struct ui_text_layout* layout;
 	v2f position;
 	v2f dimensions;
 	v4f colour;
@@ -148,12 +168,37 @@ struct ui_style {
 	optional(v4f) outline_colour;
 };
 
+/* Stylesheet tables are keyed by interned class names. */
 struct ui_stylesheet {
 	table(const char*, struct ui_style) normal;
 	table(const char*, struct ui_style) hovered;
 	table(const char*, struct ui_style) active;
 } default_stylesheet;
 
+/* The classes that the widgets are built on, interned in ui_init so that
+ * styling a widget finds its base class without going to the string pool. */
+static struct {
+	const char* label;
+	const char* button;
+	const char* input;
+	const char* container;
+	const char* knob;
+	const char* picture;
+	const char* tree_button;
+	const char* tree_header;
+	const char* tree_container;
+	const char* picker;
+	const char* combo;
+	const char* combo_container;
+} base_classes;
+
+/* A widget's class string, split up and interned the first time that it is
+ * used. The text is kept to tell apart strings that have the same hash. */
+struct ui_class_list {
+	char* text;
+	vector(const char*) classes;
+};
+
 struct container_commander {
 	i32 z;
 	usize offset;
@@ -179,14 +224,13 @@ struct ui {
 	v2f cursor_pos;
 	v4f current_clip;
 
-	char* wrap_buffer;
-	usize wrap_buffer_size;
-
 	vector(struct ui_container) container_stack;
 
 	char* temp_str;
 	usize temp_str_size;
 
+	table(u64, struct ui_class_list) class_lists;
+
 	u64 active;
 	u64 dragging;
 	u64 hovered;
@@ -211,6 +255,12 @@ struct ui {
 
 	vector(struct ui_container_meta*) sorted_containers;
 
+	table(u64, struct ui_text_layout*) text_layouts;
+
+	/* Keys of the container metadata and layouts that ui_begin frees,
+	 * kept to save allocating it every frame. */
+	vector(u64) to_delete;
+
 	/* Probably not the best way to solve this problem. */
 	table(u64, bool) number_input_trailing_fullstops;
 
@@ -322,19 +372,180 @@ void ui_draw_circle(struct ui* ui, v2f position, f32 radius, v4f colour) {
 	cmd->radius = radius;
 }
 
-void ui_draw_text(struct ui* ui, v2f position, v2f dimensions, const char* text, v4f colour) {
+static i32 word_wrap_len(struct font* font, const char* string, i32 width) {
+	i32 i = 0;
+
+	i32 string_len = (i32)strlen(string);
+	i32 line_start = 0;
+
+	i32 len = 0;
+
+	while (i < string_len) {
+		for (i32 c = 1; c < width - 8; c += get_char_dimensions(font, string + i).x) {
+			if (i >= string_len) {
+				len++;
+				return len;
+			}
+
+			len++;
+
+			if (string[i] == '\n') {
+				line_start = i;
+				c = 1;
+			}
+
+			i++;
+		}
+
+		if (isspace(string[i])) {
+			i++;
+			len++;
+			line_start = i;
+		} else {
+			for (i32 c = i; c > 0; c--) {
+				if (isspace(string[c])) {
+					i = c + 1;
+					line_start = i;
+					break;
+				}
+
+				if (c <= line_start) {
+					i++;
+					len++;
+					break;
+				}
+			}
+		}
+	}
+
+	len++;
+
+	return len;
+}
+
+static char* word_wrap(struct font* font, char* buffer, const char* string, i32 width) {
+	i32 i = 0;
+
+	i32 string_len = (i32)strlen(string);
+	i32 line_start = 0;
+
+	while (i < string_len) {
+		for (i32 c = 1; c < width - 8; c += get_char_dimensions(font, string + i).x) {
+			if (i >= string_len) {
+				buffer[i] = '\0';
+				return buffer;
+			}
+
+			buffer[i] = string[i];
+
+			if (string[i] == '\n') {
+				line_start = i;
+				c = 1;
+			}
+
+			i++;
+		}
+
+		if (isspace(string[i])) {
+			buffer[i++] = '\n';
+			line_start = i;
+		} else {
+			for (i32 c = i; c > 0; c--) {
+				if (isspace(string[c])) {
+					buffer[c] = '\n';
+					i = c + 1;
+					line_start = i;
+					break;
+				}
+
+				if (c <= line_start) {
+					buffer[i++] = '\n';
+					break;
+				}
+			}
+		}
+	}
+
+	buffer[i] = '\0';
+
+	return buffer;
+}
+
+/* A wrap_width of zero doesn't wrap the text. */
+static const struct ui_text_layout* get_text_layout(struct ui* ui, const char* text, i32 wrap_width) {
+	u64 font_id = get_font_id(ui->font);
+	u64 key = hash_combine(hash_combine(font_id, hash_string(text)), (u64)wrap_width);
+
+	usize text_len = strlen(text);
+
+	/* If another text has the same key, the layout can't be replaced, as
+	 * this frame's commands may still point at it, so the new one is made
+	 * for this frame only. */
+	bool collided = false;
+
+	struct ui_text_layout** cached = table_get(ui->text_layouts, key);
+	if (cached) {
+		struct ui_text_layout* l = *cached;
+
+		if (l->font_id == font_id && l->wrap_width == wrap_width &&
+			l->text_len == text_len && memcmp(l->text, text, text_len) == 0) {
+			l->life = 60;
+			return l;
+		}
+
+		collided = true;
+	}
+
+	const char* original = text;
+
+	/* TODO: Do this more cleanly. That is, take into account Unicode. I did
+	 * this quickly on a short time budget. */
+	if (wrap_width > 0) {
+		i32 wrap_count = word_wrap_len(ui->font, text, wrap_width);
+		char* wrap_buffer = frame_alloc(wrap_count + 1);
+
+		strcpy(wrap_buffer, text);
+
+		word_wrap(ui->font, wrap_buffer, text, wrap_width);
+
+		text = wrap_buffer;
+	}
+
 	usize len = strlen(text);
 
-	struct ui_cmd_draw_text* cmd = ui_cmd_add(ui, sizeof(struct ui_cmd_draw_text) + len + 1);
+	usize size = sizeof(struct ui_text_layout) + len * sizeof(struct text_glyph) + text_len + 1;
+
+	struct ui_text_layout* layout = collided ? frame_alloc(size) : core_alloc(size);
+	layout->glyphs = (struct text_glyph*)(layout + 1);
+	layout->count = layout_text(ui->font, text, layout->glyphs, &layout->dimensions);
+	layout->life = 60;
+
+	layout->font_id = font_id;
+	layout->wrap_width = wrap_width;
+	layout->text = (char*)(layout->glyphs + len);
+	layout->text_len = text_len;
+	memcpy(layout->text, original, text_len + 1);
+
+	if (!collided) {
+		table_set(ui->text_layouts, key, layout);
+	}
+
+	return layout;
+}
+
+static void ui_draw_text_layout(struct ui* ui, v2f position, v2f dimensions, const struct ui_text_layout* layout, v4f colour) {
+	struct ui_cmd_draw_text* cmd = ui_cmd_add(ui, sizeof(struct ui_cmd_draw_text));
 	cmd->cmd.type = ui_cmd_draw_text;
-	cmd->cmd.size = (sizeof *cmd) + len + 1;
+	cmd->cmd.size = sizeof *cmd;
 	cmd->position = position;
 	cmd->dimensions = dimensions;
 	cmd->colour = colour;
 	cmd->font = ui->font;
+	cmd->layout = layout;
+}
 
-	memcpy(cmd + 1, text, len);
-	((char*)(cmd + 1))[len] = '\0';
+void ui_draw_text(struct ui* ui, v2f position, v2f dimensions, const char* text, v4f colour) {
+	ui_draw_text_layout(ui, position, dimensions, get_text_layout(ui, text, 0), colour);
 }
 
 void ui_clip(struct ui* ui, v4f rect) {
@@ -398,16 +609,22 @@ static inline void ui_build_style_variant(struct ui* ui, const char* class_name,
 	}
 }
 
-static struct ui_style ui_get_style(struct ui* ui, const char* base_class, const char* class, u32 variant) {
-	const struct ui_style* base_ptr = table_get(ui->stylesheet->normal, base_class);
+static const struct ui_class_list* get_class_list(struct ui* ui, const char* class) {
+	u64 hash = hash_string(class);
 
-	if (!base_ptr) {
-		error("Base class `%s' not found in stylesheet.", base_class);
-		return (struct ui_style) { 0 };
+	struct ui_class_list* list = table_get(ui->class_lists, hash);
+	if (list && strcmp(list->text, class) == 0) {
+		return list;
 	}
 
-	struct ui_style base = *base_ptr;
-	ui_build_style_variant(ui, base_class, &base, variant);
+	/* Either the string is new or it has the same hash as another one,
+	 * which it then replaces. */
+	if (list) {
+		core_free(list->text);
+		free_vector(list->classes);
+	}
+
+	struct ui_class_list new_list = { .text = copy_string(class) };
 
 	usize class_name_size = strlen(class) + 1;
 	if (class_name_size > ui->temp_str_size) {
@@ -417,18 +634,43 @@ static struct ui_style ui_get_style(struct ui* ui, const char* base_class, const
 
 	memcpy(ui->temp_str, class, class_name_size);
 
-	char* cur_class = strtok(ui->temp_str, " ");
-	while (cur_class) {
-		const struct ui_style* class_ptr = table_get(ui->stylesheet->normal, cur_class);
+	char* cur_class_name = strtok(ui->temp_str, " ");
+	while (cur_class_name) {
+		vector_push(new_list.classes, intern_string(cur_class_name));
+		cur_class_name = strtok(null, " ");
+	}
 
-		if (!class_ptr) {
-			error("Class `%s' not found in stylesheet.", cur_class);
-		} else {
-			ui_build_style(&base, class_ptr);
-			ui_build_style_variant(ui, cur_class, &base, variant);
-		}
+	table_set(ui->class_lists, hash, new_list);
+
+	return table_get(ui->class_lists, hash);
+}
 
-		cur_class = strtok(null, " ");
+/* base_class must be one of base_classes. */
+static struct ui_style ui_get_style(struct ui* ui, const char* base_class, const char* class, u32 variant) {
+	const struct ui_style* base_ptr = table_get(ui->stylesheet->normal, base_class);
+
+	if (!base_ptr) {
+		error("Base class `%s' not found in stylesheet.", base_class);
+		return (struct ui_style) { 0 };
+	}
+
+	struct ui_style base = *base_ptr;
+	ui_build_style_variant(ui, base_class, &base, variant);
+
+	if (*class) {
+		const struct ui_class_list* list = get_class_list(ui, class);
+
+		for (usize i = 0; i < vector_count(list->classes); i++) {
+			const char* cur_class = list->classes[i];
+			const struct ui_style* class_ptr = table_get(ui->stylesheet->normal, cur_class);
+
+			if (!class_ptr) {
+				error("Class `%s' not found in stylesheet.", cur_class);
+			} else {
+				ui_build_style(&base, class_ptr);
+				ui_build_style_variant(ui, cur_class, &base, variant);
+			}
+		}
 	}
 
 	f32 scale = get_dpi_scale();
@@ -455,82 +697,74 @@ static bool ui_get_style_variant(struct ui* ui, struct ui_style* style, const ch
 	return false;
 }
 
-static void stylesheet_table_from_dtable(void* dst_vptr, struct dtable* src) {
+static void stylesheet_table_from_dtable(void* dst_vptr, const struct dtable_node* src) {
 	table(const char*, struct ui_style)* dst = dst_vptr;
 
-	for (usize i = 0; i < vector_count(src->children); i++) {
-		struct dtable* class = src->children + i;
+	for (u32 i = 0; i < src->child_count; i++) {
+		const struct dtable_node* class = src->children + i;
+
+		char class_key[64];
+		usize class_key_len = cr_min(class->key.len, sizeof class_key - 1);
+		memcpy(class_key, class->key.chars, class_key_len);
+		class_key[class_key_len] = '\0';
+
+		const char* class_name = intern_string(class_key);
 
 		struct ui_style s = { 0 };
-		struct ui_style* got = table_get(*dst, class->key.chars);
+		struct ui_style* got = table_get(*dst, class_name);
 		if (got) { s = *got; }
 
-		for (usize j = 0; j < vector_count(class->children); j++) {
-			struct dtable* child = class->children + j;
+		for (u32 j = 0; j < class->child_count; j++) {
+			const struct dtable_node* child = class->children + j;
 
-			switch (child->value.type) {
+			switch (child->type) {
 				case dtable_colour:
-					if (strcmp(child->key.chars, "text_colour") == 0) {
-						optional_set(s.text_colour, child->value.as.colour);
-					} else if (strcmp(child->key.chars, "background_colour") == 0) {
-						optional_set(s.background_colour, child->value.as.colour);
-					} else if (strcmp(child->key.chars, "selection_colour") == 0) {
-						optional_set(s.select_colour, child->value.as.colour);
-					} else if (strcmp(child->key.chars, "outline_colour") == 0) {
-						optional_set(s.outline_colour, child->value.as.colour);
+					if (dtable_slice_eq(child->key, "text_colour")) {
+						optional_set(s.text_colour, child->as.colour);
+					} else if (dtable_slice_eq(child->key, "background_colour")) {
+						optional_set(s.background_colour, child->as.colour);
+					} else if (dtable_slice_eq(child->key, "selection_colour")) {
+						optional_set(s.select_colour, child->as.colour);
+					} else if (dtable_slice_eq(child->key, "outline_colour")) {
+						optional_set(s.outline_colour, child->as.colour);
 					}
 					break;
 				case dtable_number: 
-					if (strcmp(child->key.chars, "radius") == 0) {
-						optional_set(s.radius, (f32)child->value.as.number);
-					} else if (strcmp(child->key.chars, "outline_thickness") == 0) {
-						optional_set(s.outline_thickness, (f32)child->value.as.number);
+					if (dtable_slice_eq(child->key, "radius")) {
+						optional_set(s.radius, (f32)child->as.number);
+					} else if (dtable_slice_eq(child->key, "outline_thickness")) {
+						optional_set(s.outline_thickness, (f32)child->as.number);
 					}
 					break;
 				case dtable_string:
-					if (strcmp(child->key.chars, "align") == 0) {
-						optional_set(s.align, strcmp(child->value.as.string, "left") == 0 ? ui_align_left :
-							strcmp(child->value.as.string, "centre") == 0 ? ui_align_centre :
+					if (dtable_slice_eq(child->key, "align")) {
+						optional_set(s.align, dtable_slice_eq(child->as.string, "left") ? ui_align_left :
+							dtable_slice_eq(child->as.string, "centre") ? ui_align_centre :
 							ui_align_right);
 					}
 					break;
 				case dtable_v2:
-					if (strcmp(child->key.chars, "max_size") == 0) {
-						optional_set(s.max_size, child->value.as.v2);
-					} else if (strcmp(child->key.chars, "min_size") == 0) {
-						optional_set(s.min_size, child->value.as.v2);
+					if (dtable_slice_eq(child->key, "max_size")) {
+						optional_set(s.max_size, child->as.v2);
+					} else if (dtable_slice_eq(child->key, "min_size")) {
+						optional_set(s.min_size, child->as.v2);
 					}
 					break;
 				case dtable_v4:
-					if (strcmp(child->key.chars, "padding") == 0) {	
-						optional_set(s.padding, child->value.as.v4);
+					if (dtable_slice_eq(child->key, "padding")) {	
+						optional_set(s.padding, child->as.v4);
 					}
 					break;
 			}
 		}
 
-		table_set(*dst, class->key.chars, s);
+		table_set(*dst, class_name, s);
 	}
 }
 
 static void stylesheet_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
 	struct ui_stylesheet* stylesheet = payload;
 
-	stylesheet->normal.hash     = table_hash_string;
-	stylesheet->normal.compare  = table_compare_string;
-	stylesheet->normal.free_key = table_free_string;
-	stylesheet->normal.copy_key = table_copy_string;
-
-	stylesheet->hovered.hash     = table_hash_string;
-	stylesheet->hovered.compare  = table_compare_string;
-	stylesheet->hovered.free_key = table_free_string;
-	stylesheet->hovered.copy_key = table_copy_string;
-
-	stylesheet->active.hash     = table_hash_string;
-	stylesheet->active.compare  = table_compare_string;
-	stylesheet->active.free_key = table_free_string;
-	stylesheet->active.copy_key = table_copy_string;
-
 	for (const char** i = table_first(default_stylesheet.normal); i; i = table_next(default_stylesheet.normal, *i)) {
 		table_set(stylesheet->normal, *i, *(struct ui_style*)table_get(default_stylesheet.normal, *i));
 	}
@@ -543,23 +777,25 @@ static void stylesheet_on_load(const char* filename, u8* raw, usize raw_size, vo
 		table_set(stylesheet->hovered, *i, *(struct ui_style*)table_get(default_stylesheet.hovered, *i));
 	}
 
-	struct dtable dt = { 0 };
-	parse_dtable(&dt, (const char*)raw);
+	struct dtable_doc doc;
+	if (!parse_dtable_doc(&doc, (const char*)raw)) {
+		return;
+	}
 
-	struct dtable tab = { 0 };
-	if (dtable_find_child(&dt, "normal", &tab)) {
-		stylesheet_table_from_dtable(&stylesheet->normal, &tab);
+	const struct dtable_node* tab;
+	if ((tab = dtable_node_find(&doc.root, "normal"))) {
+		stylesheet_table_from_dtable(&stylesheet->normal, tab);
 	}
 
-	if (dtable_find_child(&dt, "active", &tab)) {
-		stylesheet_table_from_dtable(&stylesheet->active, &tab);
+	if ((tab = dtable_node_find(&doc.root, "active"))) {
+		stylesheet_table_from_dtable(&stylesheet->active, tab);
 	}
 
-	if (dtable_find_child(&dt, "hovered", &tab)) {
-		stylesheet_table_from_dtable(&stylesheet->hovered, &tab);
+	if ((tab = dtable_node_find(&doc.root, "hovered"))) {
+		stylesheet_table_from_dtable(&stylesheet->hovered, tab);
 	}
 
-	deinit_dtable(&dt);
+	deinit_dtable_doc(&doc);
 }
 
 static void stylesheet_on_unload(void* payload, usize payload_size) {
@@ -575,28 +811,26 @@ void ui_init() {
 	memset(&default_stylesheet.active,  0, sizeof default_stylesheet.active);
 	memset(&default_stylesheet.hovered, 0, sizeof default_stylesheet.hovered);
 
-	default_stylesheet.normal.hash     = table_hash_string;
-	default_stylesheet.normal.compare  = table_compare_string;
-	default_stylesheet.normal.free_key = table_free_string;
-	default_stylesheet.normal.copy_key = table_copy_string;
-
-	default_stylesheet.active.hash     = table_hash_string;
-	default_stylesheet.active.compare  = table_compare_string;
-	default_stylesheet.active.free_key = table_free_string;
-	default_stylesheet.active.copy_key = table_copy_string;
-
-	default_stylesheet.hovered.hash     = table_hash_string;
-	default_stylesheet.hovered.compare  = table_compare_string;
-	default_stylesheet.hovered.free_key = table_free_string;
-	default_stylesheet.hovered.copy_key = table_copy_string;
-
-	table_set(default_stylesheet.normal, "label", ((struct ui_style) {
+	base_classes.label           = intern_string("label");
+	base_classes.button          = intern_string("button");
+	base_classes.input           = intern_string("input");
+	base_classes.container       = intern_string("container");
+	base_classes.knob            = intern_string("knob");
+	base_classes.picture         = intern_string("picture");
+	base_classes.tree_button     = intern_string("tree_button");
+	base_classes.tree_header     = intern_string("tree_header");
+	base_classes.tree_container  = intern_string("tree_container");
+	base_classes.picker          = intern_string("picker");
+	base_classes.combo           = intern_string("combo");
+	base_classes.combo_container = intern_string("combo_container");
+
+	table_set(default_stylesheet.normal, base_classes.label, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x111111, 0) },
 		.align             = { true, ui_align_left },
 	}));
 
-	table_set(default_stylesheet.normal, "button", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.button, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(3.0f, 3.0f, 3.0f, 3.0f) },
@@ -604,16 +838,16 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "button", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.button, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x252839, 255) },
 	}));
 
-	table_set(default_stylesheet.active, "button", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.button, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0x000000, 255) },
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "input", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.input, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(3.0f, 3.0f, 3.0f, 3.0f) },
@@ -622,16 +856,16 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "input", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.input, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x252839, 255) },
 	}));
 
-	table_set(default_stylesheet.active, "input", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.input, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0x000000, 255) },
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "container", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.container, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x111111, 255) },
 		.padding           = { true, make_v4f(5.0f, 5.0f, 5.0f, 5.0f) },
 		.spacing           = { true, 5.0f },
@@ -640,7 +874,7 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.normal, "knob", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.knob, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(5.0f, 5.0f, 5.0f, 5.0f) },
@@ -651,19 +885,19 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "knob", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.knob, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x252839, 255) },
 		.outline_thickness = { true, 1.0f },
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.active, "knob", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.knob, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0x000000, 255) },
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "picture", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.picture, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(3.0f, 3.0f, 3.0f, 3.0f) },
@@ -674,16 +908,16 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "picture", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.picture, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xd9d9ff, 255) },
 		.background_colour = { true, make_rgba(0x252839, 255) },
 	}));
 
-	table_set(default_stylesheet.active, "picture", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.picture, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "tree_button", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.tree_button, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(3.0f, 3.0f, 3.0f, 3.0f) },
@@ -691,16 +925,16 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "tree_button", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.tree_button, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x252839, 255) },
 	}));
 
-	table_set(default_stylesheet.active, "tree_button", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.tree_button, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0x000000, 255) },
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "tree_header", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.tree_header, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(3.0f, 3.0f, 3.0f, 3.0f) },
@@ -708,22 +942,22 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "tree_header", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.tree_header, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x252839, 255) },
 	}));
 
-	table_set(default_stylesheet.active, "tree_header", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.tree_header, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0x000000, 255) },
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "tree_container", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.tree_container, ((struct ui_style) {
 		.padding           = { true, make_v4f(10.0f, 0.0f, 0.0f, 0.0f) },
 		.spacing           = { true, 5.0f },
 		.radius            = { true, 0.0f }
 	}));
 
-	table_set(default_stylesheet.normal, "picker", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.picker, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x262626, 255) },
 		.max_size          = { true, make_v2f(150.0f, 150.0f) },
@@ -733,7 +967,7 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.normal, "combo", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.combo, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0xffffff, 255) },
 		.background_colour = { true, make_rgba(0x191b26, 255) },
 		.padding           = { true, make_v4f(3.0f, 3.0f, 3.0f, 3.0f) },
@@ -741,16 +975,16 @@ void ui_init() {
 		.outline_colour    = { true, make_rgba(0x000000, 255) }
 	}));
 
-	table_set(default_stylesheet.hovered, "combo", ((struct ui_style) {
+	table_set(default_stylesheet.hovered, base_classes.combo, ((struct ui_style) {
 		.background_colour = { true, make_rgba(0x252839, 255) },
 	}));
 
-	table_set(default_stylesheet.active, "combo", ((struct ui_style) {
+	table_set(default_stylesheet.active, base_classes.combo, ((struct ui_style) {
 		.text_colour       = { true, make_rgba(0x000000, 255) },
 		.background_colour = { true, make_rgba(0x8c91ac, 255) },
 	}));
 
-	table_set(default_stylesheet.normal, "combo_container", ((struct ui_style) {
+	table_set(default_stylesheet.normal, base_classes.combo_container, ((struct ui_style) {
 		.padding           = { true, make_v4f(5.0f, 10.0f, 5.0f, 5.0f) },
 		.background_colour = { true, make_rgba(0x0c0c0c, 255) },
 		.spacing           = { true, 5.0f },
@@ -806,7 +1040,14 @@ void free_ui(struct ui* ui) {
 		free_vector(m->cmd_views);
 	}
 
-	core_free(ui->wrap_buffer);
+	for (u64* i = table_first(ui->class_lists); i; i = table_next(ui->class_lists, *i)) {
+		struct ui_class_list* list = table_get(ui->class_lists, *i);
+
+		core_free(list->text);
+		free_vector(list->classes);
+	}
+
+	free_table(ui->class_lists);
 	core_free(ui->temp_str);
 	free_vector(ui->columns);
 	free_vector(ui->container_stack);
@@ -815,6 +1056,13 @@ void free_ui(struct ui* ui) {
 	free_table(ui->open_treenodes);
 	free_table(ui->number_input_trailing_fullstops);
 	free_table(ui->container_meta);
+
+	for (u64* i = table_first(ui->text_layouts); i; i = table_next(ui->text_layouts, *i)) {
+		core_free(*(struct ui_text_layout**)table_get(ui->text_layouts, *i));
+	}
+
+	free_table(ui->text_layouts);
+	free_vector(ui->to_delete);
 	free_ui_renderer(ui->renderer);
 	video.free_texture(ui->alpha_texture);
 	core_free(ui->cmd_buffer);
@@ -854,21 +1102,38 @@ void ui_begin(struct ui* ui) {
 	ui->treenode_id = 0;
 	ui->container_id = 0;
 
-	u64 to_delete[256];
-	usize to_delete_count = 0;
+	/* Entries can't be deleted while the table is walked, so the keys of
+	 * those that have run out of life are gathered first. */
+	vector_clear(ui->to_delete);
 	for (u64* i = table_first(ui->container_meta); i; i = table_next(ui->container_meta, *i)) {
 		struct ui_container_meta* m = table_get(ui->container_meta, *i);
 		m->visible = false;
 		m->life--;
 		if (m->life <= 0) {
-			to_delete[to_delete_count++] = *i;
+			vector_push(ui->to_delete, *i);
 		}
 	}
 
-	for (usize i = 0; i < to_delete_count; i++) {
-		struct ui_container_meta* m = table_get(ui->container_meta, to_delete[i]);
+	for (usize i = 0; i < vector_count(ui->to_delete); i++) {
+		struct ui_container_meta* m = table_get(ui->container_meta, ui->to_delete[i]);
 		free_vector(m->cmd_views);
-		table_delete(ui->container_meta, to_delete[i]);
+		table_delete(ui->container_meta, ui->to_delete[i]);
+	}
+
+	/* Layouts are freed once they've gone about a second without being
+	 * drawn. */
+	vector_clear(ui->to_delete);
+	for (u64* i = table_first(ui->text_layouts); i; i = table_next(ui->text_layouts, *i)) {
+		struct ui_text_layout* l = *(struct ui_text_layout**)table_get(ui->text_layouts, *i);
+		l->life--;
+		if (l->life <= 0) {
+			vector_push(ui->to_delete, *i);
+		}
+	}
+
+	for (usize i = 0; i < vector_count(ui->to_delete); i++) {
+		core_free(*(struct ui_text_layout**)table_get(ui->text_layouts, ui->to_delete[i]));
+		table_delete(ui->text_layouts, ui->to_delete[i]);
 	}
 
 	ui_begin_container(ui, make_v4f(0.0f, 0.0f, 1.0f, 1.0f), false);
@@ -982,7 +1247,7 @@ void ui_begin_container_ex(struct ui* ui, const char* class, v4f rect, bool scro
 		struct ui_container_meta* parent_meta = get_container_meta(ui, parent->id);
 		parent_meta->current_view->tail = ui->cmd_buffer_idx;
 
-		const struct ui_style style = ui_get_style(ui, "container", class, ui_style_variant_none);
+		const struct ui_style style = ui_get_style(ui, base_classes.container, class, ui_style_variant_none);
 		pad_top_bottom = parent->padding.y;
 		padding = v4f_scale(style.padding.value, get_dpi_scale());
 		spacing = style.spacing.value * get_dpi_scale();
@@ -1046,7 +1311,7 @@ void ui_begin_floating_container_ex(struct ui* ui, const char* class, v4f rect,
 		scroll = make_v2f(0.0f, 0.0f);
 	}
 
-	const struct ui_style style = ui_get_style(ui, "container", class, ui_style_variant_none);
+	const struct ui_style style = ui_get_style(ui, base_classes.container, class, ui_style_variant_none);
 
 	ui->current_z++;
 
@@ -1241,131 +1506,25 @@ void ui_columns(struct ui* ui, usize count, f32* columns) {
 	ui->current_item_height = 0.0f;
 }
 
-static i32 word_wrap_len(struct font* font, const char* string, i32 width) {
-	i32 i = 0;
-
-	i32 string_len = (i32)strlen(string);
-	i32 line_start = 0;
-
-	i32 len = 0;
-
-	while (i < string_len) {
-		for (i32 c = 1; c < width - 8; c += get_char_dimensions(font, string + i).x) {
-			if (i >= string_len) {
-				len++;
-				return len;
-			}
-
-			len++;
-
-			if (string[i] == '\n') {
-				line_start = i;
-				c = 1;
-			}
-
-			i++;
-		}
-
-		if (isspace(string[i])) {
-			i++;
-			len++;
-			line_start = i;
-		} else {
-			for (i32 c = i; c > 0; c--) {
-				if (isspace(string[c])) {
-					i = c + 1;
-					line_start = i;
-					break;
-				}
-
-				if (c <= line_start) {
-					i++;
-					len++;
-					break;
-				}
-			}
-		}
-	}
-
-	len++;
-
-	return len;
-}
-
-static char* word_wrap(struct font* font, char* buffer, const char* string, i32 width) {
-	i32 i = 0;
-
-	i32 string_len = (i32)strlen(string);
-	i32 line_start = 0;
-
-	while (i < string_len) {
-		for (i32 c = 1; c < width - 8; c += get_char_dimensions(font, string + i).x) {
-			if (i >= string_len) {
-				buffer[i] = '\0';
-				return buffer;
-			}
-
-			buffer[i] = string[i];
-
-			if (string[i] == '\n') {
-				line_start = i;
-				c = 1;
-			}
-
-			i++;
-		}
-
-		if (isspace(string[i])) {
-			buffer[i++] = '\n';
-			line_start = i;
-		} else {
-			for (i32 c = i; c > 0; c--) {
-				if (isspace(string[c])) {
-					buffer[c] = '\n';
-					i = c + 1;
-					line_start = i;
-					break;
-				}
-
-				if (c <= line_start) {
-					buffer[i++] = '\n';
-					break;
-				}
-			}
-		}
-	}
-
-	buffer[i] = '\0';
-
-	return buffer;
-}
-
 bool ui_text_ex(struct ui* ui, const char* class, const char* text, bool wrapped) {
 	const struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	struct ui_style style = ui_get_style(ui, "label", class, ui_style_variant_none);
+	struct ui_style style = ui_get_style(ui, base_classes.label, class, ui_style_variant_none);
 
-	/* TODO: Do this more cleanly. That is, take into account Unicode and don't
-	 * malloc every frame. I did this quickly on a short time budget. */
+	i32 wrap_width = 0;
 	if (wrapped) {
 		const v2f wrap_dim = v2f_add(make_v2f(ui->columns[ui->column] *
 				container->rect.z - (style.padding.value.x * 2.0f + style.padding.value.z) -
 				(container->padding.x + container->padding.z), get_font_height(ui->font)),
 			make_v2f(0.0f, style.padding.value.y + style.padding.value.w));
 
-		i32 wrap_count = word_wrap_len(ui->font, text, wrap_dim.x);
-		if (wrap_count > (i32)ui->wrap_buffer_size) {
-			ui->wrap_buffer = core_realloc(ui->wrap_buffer, wrap_count + 1);
-		}
-
-		strcpy(ui->wrap_buffer, text);
-
-		word_wrap(ui->font, ui->wrap_buffer, text, (i32)wrap_dim.x);
-
-		text = ui->wrap_buffer;
+		/* Widths this small wrap every character anyway. */
+		wrap_width = cr_max((i32)wrap_dim.x, 1);
 	}
 
-	const v2f text_dimensions = get_text_dimensions(ui->font, text);
+	const struct ui_text_layout* layout = get_text_layout(ui, text, wrap_width);
+
+	const v2f text_dimensions = layout->dimensions;
 	const v2f dimensions = make_v2f(text_dimensions.x + style.padding.value.x + style.padding.value.z,
 		text_dimensions.y + style.padding.value.y + style.padding.value.w);
 
@@ -1373,12 +1532,12 @@ bool ui_text_ex(struct ui* ui, const char* class, const char* text, bool wrapped
 		style.background_colour.value, style.radius.value);
 	struct ui_cmd_draw_rect* rect_cmd = ui_last_cmd(ui);
 
-	ui_draw_text(ui, v2f_add(rect_cmd->position, style.padding.value),
-		text_dimensions, text, style.text_colour.value);
+	ui_draw_text_layout(ui, v2f_add(rect_cmd->position, style.padding.value),
+		text_dimensions, layout, style.text_colour.value);
 	struct ui_cmd_draw_text* text_cmd = ui_last_cmd(ui);
 
 	bool hovered = container->interactable && mouse_over_rect(rect_cmd->position, dimensions);
-	if (ui_get_style_variant(ui, &style, "label", class, hovered, false)) {
+	if (ui_get_style_variant(ui, &style, base_classes.label, class, hovered, false)) {
 		ui->hovered = hash_string(text);
 
 		rect_cmd->position = get_ui_el_position(ui, &style, dimensions);
@@ -1416,9 +1575,9 @@ void ui_linebreak(struct ui* ui) {
 bool ui_knob_ex(struct ui* ui, const char* class, f32* val, f32 min, f32 max) {
 	const struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	const u64 id = elf_hash((const u8*)&val, sizeof val);
+	const u64 id = hash_bytes((const u8*)&val, sizeof val);
 
-	struct ui_style style = ui_get_style(ui, "knob", class, ui_style_variant_none);
+	struct ui_style style = ui_get_style(ui, base_classes.knob, class, ui_style_variant_none);
 	style.radius.value *= get_dpi_scale();
 
 	const f32 handle_radius = 5.0f * get_dpi_scale();
@@ -1460,7 +1619,7 @@ bool ui_knob_ex(struct ui* ui, const char* class, f32* val, f32 min, f32 max) {
 	bool changed = false;
 
 	if (ui->dragging == id) {
-		style = ui_get_style(ui, "knob", class, ui_style_variant_active);
+		style = ui_get_style(ui, base_classes.knob, class, ui_style_variant_active);
 		style.radius.value *= get_dpi_scale();
 
 		knob_cmd->radius   = style.radius.value;
@@ -1496,7 +1655,7 @@ bool ui_knob_ex(struct ui* ui, const char* class, f32* val, f32 min, f32 max) {
 		*val = clamp(*val, min, max);
 
 		changed = true;
-	} else if (ui_get_style_variant(ui, &style, "knob", class, hovered, false)) {
+	} else if (ui_get_style_variant(ui, &style, base_classes.knob, class, hovered, false)) {
 		style.radius.value *= get_dpi_scale();
 
 		knob_cmd->radius   = style.radius.value;
@@ -1540,7 +1699,7 @@ bool ui_knob_ex(struct ui* ui, const char* class, f32* val, f32 min, f32 max) {
 bool ui_picture_ex(struct ui* ui, const char* class, const struct texture* texture, v4i rect) {
 	const struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	struct ui_style style = ui_get_style(ui, "picture", class, ui_style_variant_none);
+	struct ui_style style = ui_get_style(ui, base_classes.picture, class, ui_style_variant_none);
 
 	v2i texture_size = video.get_texture_size(texture);
 	v2f dimensions = make_v2f(texture_size.x, texture_size.y);
@@ -1568,7 +1727,7 @@ bool ui_picture_ex(struct ui* ui, const char* class, const struct texture* textu
 	struct ui_cmd_texture* text_cmd = ui_last_cmd(ui);
 
 	bool hovered = container->interactable && mouse_over_rect(rect_cmd->position, rect_dimensions);
-	if (ui_get_style_variant(ui, &style, "picture", class, hovered, false)) {
+	if (ui_get_style_variant(ui, &style, base_classes.picture, class, hovered, false)) {
 		rect_cmd->position = get_ui_el_position(ui, &style, dimensions);
 		rect_cmd->radius   = style.radius.value;
 		text_cmd->position = v2f_add(rect_cmd->position, style.padding.value);
@@ -1609,12 +1768,12 @@ bool ui_alphanum_input_filter(char c) {
 
 bool ui_input_ex2(struct ui* ui, const char* class, char* buf, usize buf_size, ui_input_filter filter, u64 id, bool is_password) {
 	if (id == 0) {
-		id = elf_hash((const u8*)&buf, sizeof buf);
+		id = hash_bytes((const u8*)&buf, sizeof buf);
 	}
 
 	const struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	struct ui_style style = ui_get_style(ui, "input", class, ui_style_variant_none);
+	struct ui_style style = ui_get_style(ui, base_classes.input, class, ui_style_variant_none);
 
 	const v2f dimensions = v2f_add(make_v2f(ui->columns[ui->column] *
 		container->rect.z - (style.padding.value.x * 2.0f + style.padding.value.z) - (container->padding.x + container->padding.z), get_font_height(ui->font)),
@@ -1645,7 +1804,7 @@ bool ui_input_ex2(struct ui* ui, const char* class, char* buf, usize buf_size, u
 
 	bool active = ui->active == id;
 
-	if (ui_get_style_variant(ui, &style, "input", class, hovered, active)) {
+	if (ui_get_style_variant(ui, &style, base_classes.input, class, hovered, active)) {
 		rect_cmd->position = get_ui_el_position(ui, &style, dimensions);
 		rect_cmd->radius   = style.radius.value;
 
@@ -1870,7 +2029,7 @@ bool ui_input_ex2(struct ui* ui, const char* class, char* buf, usize buf_size, u
 bool ui_number_input_ex(struct ui* ui, const char* class, f64* target) {
 	char buf[64];
 
-	u64 id = elf_hash((const u8*)&target, sizeof target);
+	u64 id = hash_bytes((const u8*)&target, sizeof target);
 
 	bool* trailing_ptr = table_get(ui->number_input_trailing_fullstops, id);
 
@@ -1893,7 +2052,7 @@ bool ui_number_input_ex(struct ui* ui, const char* class, f64* target) {
 
 bool ui_selectable_tree_node_ex(struct ui* ui, const char* class, const char* text, bool leaf, bool* selected, u64 id) {
 	if (id == 0) {
-		id = ui->treenode_id++ + elf_hash((const u8*)&selected, sizeof selected);
+		id = ui->treenode_id++ + hash_bytes((const u8*)&selected, sizeof selected);
 	}
 
 	bool* open_ptr = table_get(ui->open_treenodes, id);
@@ -1906,9 +2065,10 @@ bool ui_selectable_tree_node_ex(struct ui* ui, const char* class, const char* te
 
 	struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	struct ui_style button_style = ui_get_style(ui, "tree_button", class, ui_style_variant_none);
+	struct ui_style button_style = ui_get_style(ui, base_classes.tree_button, class, ui_style_variant_none);
 
-	const v2f text_dimensions = get_text_dimensions(ui->font, text);
+	const struct ui_text_layout* layout = get_text_layout(ui, text, 0);
+	const v2f text_dimensions = layout->dimensions;
 
 	v2f header_pos;
 	v2f button_pos = make_v2f(0.0f, 0.0f);
@@ -1927,7 +2087,7 @@ bool ui_selectable_tree_node_ex(struct ui* ui, const char* class, const char* te
 		struct ui_cmd_draw_rect* rect_cmd = ui_last_cmd(ui);
 
 		button_hovered = container->interactable && mouse_over_rect(rect_cmd->position, button_dimensions);
-		if (ui_get_style_variant(ui, &button_style, "tree_button", class, button_hovered, false)) {
+		if (ui_get_style_variant(ui, &button_style, base_classes.tree_button, class, button_hovered, false)) {
 			rect_cmd->radius    = button_style.radius.value;
 
 			rect_cmd->colour = button_style.background_colour.value;
@@ -1947,7 +2107,7 @@ bool ui_selectable_tree_node_ex(struct ui* ui, const char* class, const char* te
 		header_pos = ui->cursor_pos;
 	}
 
-	struct ui_style background_style = ui_get_style(ui, "tree_header", class, ui_style_variant_none);
+	struct ui_style background_style = ui_get_style(ui, base_classes.tree_header, class, ui_style_variant_none);
 
 	const v2f background_dimensions = make_v2f(
 		container->rect.z - (header_pos.x - container->rect.x) - container->padding.z,
@@ -1957,8 +2117,8 @@ bool ui_selectable_tree_node_ex(struct ui* ui, const char* class, const char* te
 		background_dimensions, background_style.background_colour.value, background_style.radius.value);
 	struct ui_cmd_draw_rect* back_cmd = ui_last_cmd(ui);
 
-	ui_draw_text(ui, v2f_add(header_pos, background_style.padding.value),
-		text_dimensions, text, background_style.text_colour.value);
+	ui_draw_text_layout(ui, v2f_add(header_pos, background_style.padding.value),
+		text_dimensions, layout, background_style.text_colour.value);
 	struct ui_cmd_draw_text* text_cmd = ui_last_cmd(ui);
 	bool back_hovered = container->interactable && mouse_over_rect(back_cmd->position, back_cmd->dimensions);
 
@@ -1967,7 +2127,7 @@ bool ui_selectable_tree_node_ex(struct ui* ui, const char* class, const char* te
 	}
 
 	bool active = selected ? *selected : false;
-	if (ui_get_style_variant(ui, &background_style, "tree_header", class, back_hovered, active)) {
+	if (ui_get_style_variant(ui, &background_style, base_classes.tree_header, class, back_hovered, active)) {
 		back_cmd->radius = background_style.radius.value;
 		back_cmd->colour = background_style.background_colour.value;
 		text_cmd->colour = background_style.text_colour.value;
@@ -2016,12 +2176,12 @@ void ui_tree_pop(struct ui* ui) {
 
 bool ui_combo_ex(struct ui* ui, const char* class, i32* item, const char** items, usize item_count, u64 id) {
 	if (id == 0) {
-		id = elf_hash((const u8*)&item, sizeof item);
+		id = hash_bytes((const u8*)&item, sizeof item);
 	}
 
 	const struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	struct ui_style style = ui_get_style(ui, "combo", class, ui_style_variant_none);
+	struct ui_style style = ui_get_style(ui, base_classes.combo, class, ui_style_variant_none);
 
 	const v2f dimensions = v2f_add(make_v2f(ui->columns[ui->column] *
 		container->rect.z - (style.padding.value.x * 2.0f + style.padding.value.z) - (container->padding.x + container->padding.z), get_font_height(ui->font)),
@@ -2043,7 +2203,7 @@ bool ui_combo_ex(struct ui* ui, const char* class, i32* item, const char** items
 
 	bool active = ui->active == id;
 
-	if (ui_get_style_variant(ui, &style, "combo", class, hovered, active)) {
+	if (ui_get_style_variant(ui, &style, base_classes.combo, class, hovered, active)) {
 		rect_cmd->position = get_ui_el_position(ui, &style, dimensions);
 		rect_cmd->radius   = style.radius.value;
 
@@ -2060,9 +2220,9 @@ bool ui_combo_ex(struct ui* ui, const char* class, i32* item, const char** items
 
 	if (item && *item >= 0) {
 		const v2f text_pos = v2f_add(rect_cmd->position, style.padding.value);
-		const v2f text_dimensions = get_text_dimensions(ui->font, items[*item]);
+		const struct ui_text_layout* layout = get_text_layout(ui, items[*item], 0);
 	
-		ui_draw_text(ui, text_pos, text_dimensions, items[*item], style.text_colour.value);
+		ui_draw_text_layout(ui, text_pos, layout->dimensions, layout, style.text_colour.value);
 	}
 
 	bool changed = false;
@@ -2095,12 +2255,12 @@ bool ui_combo_ex(struct ui* ui, const char* class, i32* item, const char** items
 
 bool ui_colour_picker_ex(struct ui* ui, const char* class, v4f* colour, u64 id) {
 	if (id == 0) {
-		id = elf_hash((const u8*)&colour, sizeof colour);
+		id = hash_bytes((const u8*)&colour, sizeof colour);
 	}
 
 	const struct ui_container* container = vector_end(ui->container_stack) - 1;
 
-	struct ui_style style = ui_get_style(ui, "picker", class, ui_style_variant_none);
+	struct ui_style style = ui_get_style(ui, base_classes.picker, class, ui_style_variant_none);
 
 	f32 scale = get_dpi_scale();
 
@@ -2338,9 +2498,10 @@ void ui_draw(const struct ui* ui) {
 					case ui_cmd_draw_text: {
 						struct ui_cmd_draw_text* text = (struct ui_cmd_draw_text*)cmd;
 
-						ui_renderer_push_text(ui->renderer, &(struct ui_renderer_text) {
+						ui_renderer_push_glyphs(ui->renderer, &(struct ui_renderer_glyphs) {
 							.position = text->position,
-							.text     = (char*)(text + 1),
+							.glyphs   = text->layout->glyphs,
+							.count    = text->layout->count,
 							.colour   = text->colour,
 							.font     = text->font
 						});
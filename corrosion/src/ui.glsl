@@ -56,6 +56,7 @@ layout (location = 0) in VSOut {
 } fs_in;
 
 layout (binding = 1) uniform sampler2D atlas;
+layout (binding = 2) uniform sampler2D glyph_atlas;
 
 float rounded_box_sdf(vec2 pos, vec2 size, float r) {
 	return length(max(abs(pos) - size + r, 0.0)) - r;
@@ -82,7 +83,13 @@ void main() {
 
 	float a = 1.0 - smoothstep(0.0, softness * 2.0, max(-d1, d0));
 
-	if (fs_in.use_texture > 0.0f) {
+	if (fs_in.use_texture > 2.5f) {
+		float dist = texture(glyph_atlas, fs_in.uv).r;
+		float edge = max(fwidth(dist) * 0.75f, 0.0001f);
+		texture_colour = vec4(1.0, 1.0, 1.0, smoothstep(0.5f - edge, 0.5f + edge, dist));
+	} else if (fs_in.use_texture > 1.5f) {
+		texture_colour = vec4(1.0, 1.0, 1.0, texture(glyph_atlas, fs_in.uv).r);
+	} else if (fs_in.use_texture > 0.0f) {
 		texture_colour = texture(atlas, fs_in.uv);
 	}
 
@@ -735,6 +735,35 @@ static void validated_update_pipeline_uniform(struct pipeline* pipeline, const c
 	abort();
 }
 
+static void validated_pipeline_change_texture(struct pipeline* pipeline, const char* set, const char* descriptor, const struct texture* texture) {
+	bool ok = true;
+
+	check_is_init("pipeline_change_texture");
+	check_pipeline_valid("pipeline_change_texture");
+
+	if (!set) {
+		error("video.pipeline_change_texture: Descriptor set must be named.");
+		ok = false;
+	}
+
+	if (!descriptor) {
+		error("video.pipeline_change_texture: Descriptor must be named.");
+		ok = false;
+	}
+
+	if (!texture) {
+		error("video.pipeline_change_texture: texture must be a valid pointer.");
+		ok = false;
+	}
+
+	if (ok) {
+		get_api_proc(pipeline_change_texture)(pipeline, set, descriptor, texture);
+		return;
+	}
+	
+	abort();
+}
+
 static void validated_init_pipeline_uniform(struct pipeline* pipeline, const char* set, const char* descriptor, const void* data) {
 	bool ok = true;
 
@@ -901,6 +930,7 @@ static void find_procs(u32 api, bool enable_validation) {
 	video.bind_pipeline_descriptor_set = get_v_proc(bind_pipeline_descriptor_set);
 	video.update_pipeline_uniform      = get_v_proc(update_pipeline_uniform);
 	video.init_pipeline_uniform        = get_v_proc(init_pipeline_uniform);
+	video.pipeline_change_texture      = get_v_proc(pipeline_change_texture);
 	video.pipeline_push_buffer         = get_api_proc(pipeline_push_buffer);
 
 	video.new_storage           = get_api_proc(new_storage);
@@ -932,6 +962,7 @@ static void find_procs(u32 api, bool enable_validation) {
 	video.get_texture_size    = get_api_proc(get_texture_size);
 	video.get_texture_3d_size = get_api_proc(get_texture_3d_size);
 	video.texture_copy        = get_api_proc(texture_copy);
+	video.update_texture      = get_api_proc(update_texture);
 	video.texture_copy_3d     = get_api_proc(texture_copy_3d);
 	video.texture_barrier     = get_api_proc(texture_barrier);
 
@@ -9,11 +9,33 @@
 #include "gl33.h"
 #endif
 
+#include "bcn.h"
 #include "bir.h"
 #include "video_gl.h"
 #include "video_internal.h"
 #include "window_internal.h"
 
+/* Block compressed formats from extensions that the core headers lack. */
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83f1
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83f3
+#endif
+
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8dbb
+#endif
+
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8dbd
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8e8c
+#endif
+
 #ifdef debug
 #define check_gl(x) \
 	clear_gl_errors(); \
@@ -56,6 +78,43 @@ static void gl_log(u32 line, const char* file) {
 
 struct gl_video_context gctx;
 
+static bool has_gl_extension(const char* name) {
+	i32 count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (i32 i = 0; i < count; i++) {
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, (u32)i), name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* RGTC is core in desktop GL, but everything else comes from extensions,
+ * which WebGL names differently. */
+static void query_block_formats() {
+	gctx.block_formats = 0;
+
+	if (has_gl_extension("GL_EXT_texture_compression_s3tc") || has_gl_extension("GL_WEBGL_compressed_texture_s3tc")) {
+		gctx.block_formats |= (1 << texture_format_bc1) | (1 << texture_format_bc3);
+	}
+
+#ifdef __EMSCRIPTEN__
+	bool rgtc = has_gl_extension("GL_EXT_texture_compression_rgtc");
+#else
+	bool rgtc = true;
+#endif
+
+	if (rgtc) {
+		gctx.block_formats |= (1 << texture_format_bc4) | (1 << texture_format_bc5);
+	}
+
+	if (has_gl_extension("GL_ARB_texture_compression_bptc") || has_gl_extension("GL_EXT_texture_compression_bptc")) {
+		gctx.block_formats |= 1 << texture_format_bc7;
+	}
+}
+
 void video_gl_init(const struct video_config* config) {
 	memset(&gctx, 0, sizeof gctx);
 
@@ -74,6 +133,8 @@ void video_gl_init(const struct video_config* config) {
 	gctx.default_fb = (void*)-1;
 	gctx.default_clear = config->clear_colour;
 
+	query_block_formats();
+
 	if (config->enable_vsync) {
 		window_gl_set_swap_interval(1);
 	} else {
@@ -665,6 +726,25 @@ void video_gl_update_pipeline_uniform(struct pipeline* pipeline_, const char* se
 	check_gl(glBufferSubData(GL_UNIFORM_BUFFER, 0, desc->ub_size, data));
 }
 
+void video_gl_pipeline_change_texture(struct pipeline* pipeline_, const char* set, const char* descriptor, const struct texture* texture) {
+	struct video_gl_pipeline* pipeline = (struct video_gl_pipeline*)pipeline_;
+
+	struct video_gl_descriptor_set* desc_set = table_get(pipeline->descriptor_sets, hash_string(set));
+	if (!desc_set) {
+		error("%s: No such descriptor set.", set);
+		return;
+	}
+
+	struct video_gl_descriptor* desc = table_get(desc_set->descriptors, hash_string(descriptor));
+	if (!desc || desc->resource.type != pipeline_resource_texture) {
+		error("%s: No such texture on descriptor set `%s'.", descriptor, set);
+		return;
+	}
+
+	/* Textures are bound along with their descriptor set. */
+	desc->resource.texture = texture;
+}
+
 void video_gl_init_pipeline_uniform(struct pipeline* pipeline, const char* set, const char* descriptor, const void* data) {
 	video_gl_update_pipeline_uniform(pipeline, set, descriptor, data);
 }
@@ -890,6 +970,17 @@ static void init_texture(struct video_gl_texture* texture, const struct image* i
 	texture->flags = flags;
 	texture->size = image->size;
 
+	/* Block compressed images are decompressed if the driver can't take
+	 * them. */
+	struct image decompressed = { 0 };
+
+	if (bcn_is_block_format(format) && !(gctx.block_formats & (1 << format))) {
+		decompress_image(image, format, &decompressed);
+
+		image = &decompressed;
+		format = texture_format_rgba8i;
+	}
+
 	GLenum gl_format = GL_RGBA;
 	GLenum gl_type = GL_UNSIGNED_BYTE;
 	switch (format) {
@@ -941,6 +1032,21 @@ static void init_texture(struct video_gl_texture* texture, const struct image* i
 			gl_format = GL_RGBA;
 			gl_type = GL_FLOAT;
 			break;
+		case texture_format_bc1:
+			gl_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+			break;
+		case texture_format_bc3:
+			gl_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+		case texture_format_bc4:
+			gl_format = GL_COMPRESSED_RED_RGTC1;
+			break;
+		case texture_format_bc5:
+			gl_format = GL_COMPRESSED_RG_RGTC2;
+			break;
+		case texture_format_bc7:
+			gl_format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+			break;
 	}
 
 	texture->format = gl_format;
@@ -948,15 +1054,52 @@ static void init_texture(struct video_gl_texture* texture, const struct image* i
 
 	u32 filter = flags & texture_flags_filter_linear ? GL_LINEAR : GL_NEAREST;
 
+	u32 mip_count = flags & texture_flags_mipmaps ? cr_max(image->mip_count, 1) : 1;
+
+	u32 min_filter = filter;
+	if (mip_count > 1) {
+		min_filter = flags & texture_flags_filter_linear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_NEAREST;
+	}
+
 	check_gl(glGenTextures(1, &texture->id));
 	check_gl(glBindTexture(GL_TEXTURE_2D, texture->id));
-	check_gl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter));
+	check_gl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter));
 	check_gl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter));
 	check_gl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
 	check_gl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+	check_gl(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (i32)mip_count - 1));
+
+	/* The levels are stored one after the other. */
+	usize channels = gl_format == GL_RED ? 1 : gl_format == GL_RG ? 2 : gl_format == GL_RGB ? 3 : 4;
+	usize pixel_size = channels * (gl_type == GL_FLOAT ? 4 : gl_type == GL_HALF_FLOAT ? 2 : 1);
+
+	const u8* colours = image->colours;
+
+	for (u32 i = 0; i < mip_count; i++) {
+		v2i mip_size = get_mip_size(image->size, i);
+
+		if (bcn_is_block_format(format)) {
+			usize level_size = bcn_level_size(mip_size, format);
 
-	check_gl(glTexImage2D(GL_TEXTURE_2D, 0, gl_format, image->size.x, image->size.y, 0,
-		gl_format, gl_type, image->colours));
+			check_gl(glCompressedTexImage2D(GL_TEXTURE_2D, (i32)i, gl_format, mip_size.x, mip_size.y, 0,
+				(i32)level_size, colours));
+
+			if (colours) {
+				colours += level_size;
+			}
+
+			continue;
+		}
+
+		check_gl(glTexImage2D(GL_TEXTURE_2D, (i32)i, gl_format, mip_size.x, mip_size.y, 0,
+			gl_format, gl_type, colours));
+
+		if (colours) {
+			colours += (usize)mip_size.x * (usize)mip_size.y * pixel_size;
+		}
+	}
+
+	core_free(decompressed.colours);
 }
 
 static void deinit_texture(struct video_gl_texture* texture) {
@@ -1024,6 +1167,23 @@ void video_gl_texture_copy(struct texture* dst_, v2i dst_offset, const struct te
 	check_gl(glBindTexture(GL_TEXTURE_2D, old_texture));
 }
 
+void video_gl_update_texture(struct texture* texture_, v2i offset, v2i size, const void* data) {
+	struct video_gl_texture* texture = (struct video_gl_texture*)texture_;
+
+	i32 old_texture, old_alignment;
+	check_gl(glGetIntegerv(GL_TEXTURE_BINDING_2D, &old_texture));
+	check_gl(glGetIntegerv(GL_UNPACK_ALIGNMENT, &old_alignment));
+
+	/* Rows of single-channel texels needn't be a multiple of four bytes. */
+	check_gl(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
+	check_gl(glBindTexture(GL_TEXTURE_2D, texture->id));
+	check_gl(glTexSubImage2D(GL_TEXTURE_2D, 0, offset.x, offset.y, size.x, size.y, texture->format, texture->type, data));
+
+	check_gl(glPixelStorei(GL_UNPACK_ALIGNMENT, old_alignment));
+	check_gl(glBindTexture(GL_TEXTURE_2D, old_texture));
+}
+
 void video_gl_texture_copy_3d(struct texture* dst, v3i dst_offset, const struct texture* src, v3i src_offset, v3i dimensions) {
 	abort_with("3D textures are not supported in OpenGL.");
 }
@@ -1142,11 +1302,13 @@ static void shader_on_unload(void* payload, usize payload_size) {
 	deinit_shader(payload);
 }
 
+/* raw is the image from decode_texture_stream. */
 static void texture_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
-	struct image image;
-	init_image_from_raw(&image, raw, raw_size);
+	struct image* image = get_decoded_image(raw);
+
+	init_texture(payload, image, *(u32*)udata, image->block_format ? image->block_format : texture_format_rgba8i);
 
-	init_texture(payload, &image, *(u32*)udata, texture_format_rgba8i);
+	res_report_size(payload_size + get_image_size(image));
 }
 
 static void texture_on_unload(void* payload, usize payload_size) {
@@ -1171,6 +1333,8 @@ void video_gl_register_resources() {
 		.terminate_raw = false,
 		.alt_raw = bir_error_png,
 		.alt_raw_size = bir_error_png_size,
+		.cook_version = 3,
+		.on_decode_stream = decode_texture_stream,
 		.on_load = texture_on_load,
 		.on_unload = texture_on_unload
 	});
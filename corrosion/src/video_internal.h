@@ -156,6 +156,9 @@ struct vk_video_context {
 	bool want_recreate;
 	bool enable_vsync;
 
+	/* Whether the device samples block compressed formats. */
+	bool texture_compression_bc;
+
 	u32 current_frame;
 	u32 prev_frame;
 	u32 image_id;
@@ -177,6 +180,7 @@ struct video_vk_texture {
 	i32 depth; /* Only used if this is a 3D texture. */
 
 	u32 state;
+	u32 format;
 
 	bool is_depth;
 	bool is_3d;
@@ -264,7 +268,21 @@ struct video_vk_impl_descriptor_set {
 	VkDescriptorSetLayout layout;
 	VkDescriptorSet sets[max_frames_in_flight];
 
-	table(const char*, struct video_vk_impl_uniform_buffer*) uniforms;
+	table(const char*, struct video_vk_impl_uniform_buffer*) uniforms; /* Keyed by interned names. */
+
+	/* See video_vk_pipeline_change_texture. Sets that were swapped out in
+	 * the middle of a frame are retired until that frame comes round again,
+	 * then kept as spares for the next swap. The spares come out of pools
+	 * of their own, so that the pipeline's pool can stay exactly sized. */
+	vector(VkDescriptorSet) retired_sets[max_frames_in_flight];
+	vector(VkDescriptorSet) spare_sets;
+	vector(VkDescriptorPool) spare_pools;
+
+	/* Bit i of stale_frames is set if sets[i] is out of date with the
+	 * pipeline's textures, and of bound_frames if sets[i] has been bound
+	 * since frame i began. */
+	u32 stale_frames;
+	u32 bound_frames;
 };
 
 struct video_vk_pipeline {
@@ -278,7 +296,7 @@ struct video_vk_pipeline {
 	struct video_vk_impl_descriptor_set* desc_sets;
 	struct video_vk_impl_uniform_buffer* uniforms;
 
-	table(const char*, struct video_vk_impl_descriptor_set*) set_table;
+	table(const char*, struct video_vk_impl_descriptor_set*) set_table; /* Keyed by interned names. */
 
 	VkDescriptorPool descriptor_pool;
 
@@ -346,6 +364,9 @@ struct gl_video_context {
 	u32 draw_call_count;
 
 	v4f default_clear;
+
+	/* Bit n is set if texture format n can be uploaded as it is. */
+	u32 block_formats;
 };
 
 struct video_gl_descriptor {
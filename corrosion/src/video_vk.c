@@ -3,6 +3,7 @@
 #endif
 
 #include "core.h"
+#include "bcn.h"
 #include "bir.h"
 #include "res.h"
 #include "video_internal.h"
@@ -485,7 +486,7 @@ static void change_image_layout(VkImage image, VkFormat format, VkImageLayout sr
 	end_temp_command_buffer(command_buffer, vctx.command_pool, vctx.graphics_compute_queue);
 }
 
-static VkImageView new_image_view(VkImage image, VkFormat format, VkImageAspectFlags flags) {
+static VkImageView new_image_view(VkImage image, VkFormat format, VkImageAspectFlags flags, u32 mip_count) {
 	VkImageView view = VK_NULL_HANDLE;
 	if (vkCreateImageView(vctx.device, &(VkImageViewCreateInfo) {
 			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -494,7 +495,7 @@ static VkImageView new_image_view(VkImage image, VkFormat format, VkImageAspectF
 			.format = format,
 			.subresourceRange.aspectMask = flags,
 			.subresourceRange.baseMipLevel = 0,
-			.subresourceRange.levelCount = 1,
+			.subresourceRange.levelCount = mip_count,
 			.subresourceRange.baseArrayLayer = 0,
 			.subresourceRange.layerCount = 1
 		}, &vctx.ac, &view) != VK_SUCCESS) {
@@ -504,7 +505,7 @@ static VkImageView new_image_view(VkImage image, VkFormat format, VkImageAspectF
 	return view;
 }
 
-static void new_image(v2i size, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props,
+static void new_image(v2i size, u32 mip_count, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags props,
 	VkImage* image, struct video_vk_allocation* image_memory, VkImageLayout layout, bool is_depth) {
 
 	if (vkCreateImage(vctx.device, &(VkImageCreateInfo) {
@@ -515,7 +516,7 @@ static void new_image(v2i size, VkFormat format, VkImageTiling tiling, VkImageUs
 				.height = (u32)size.y,
 				.depth = 1
 			},
-			.mipLevels = 1,
+			.mipLevels = mip_count,
 			.arrayLayers = 1,
 			.format = format,
 			.tiling = tiling,
@@ -553,10 +554,10 @@ static void new_depth_resources(VkImage* image, VkImageView* view, struct video_
 
 	VkImageLayout layout = can_sample ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
 
-	new_image(size, depth_format, VK_IMAGE_TILING_OPTIMAL, usage,
+	new_image(size, 1, depth_format, VK_IMAGE_TILING_OPTIMAL, usage,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory, layout, true);
 
-	*view = new_image_view(*image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
+	*view = new_image_view(*image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 }
 
 static bool is_p2(VkDeviceSize size) {
@@ -773,6 +774,7 @@ static void* vk_reallocation_function(void* uptr, void* original, usize size, us
 static void init_swapchain(VkSwapchainKHR);
 static void deinit_swapchain();
 static void recreate();
+static void refresh_descriptor_sets();
 
 void video_vk_init(const struct video_config* config) {
 	memset(&vctx, 0, sizeof vctx);
@@ -846,6 +848,15 @@ no_validation:
 		abort_with("Failed to find a suitable graphics device.");
 	}
 
+	/* Block compressed textures are decompressed on the CPU without this. */
+	VkPhysicalDeviceFeatures supported_features;
+	vkGetPhysicalDeviceFeatures(vctx.pdevice, &supported_features);
+	vctx.texture_compression_bc = supported_features.textureCompressionBC;
+
+	if (!vctx.texture_compression_bc) {
+		warning("The graphics device doesn't support BC texture compression.");
+	}
+
 	vector(VkDeviceQueueCreateInfo) queue_infos = null;
 	vector(i32) unique_queue_families = null;
 
@@ -871,7 +882,7 @@ no_validation:
 			.pQueueCreateInfos = queue_infos,
 			.queueCreateInfoCount = (u32)vector_count(queue_infos),
 			.pEnabledFeatures = &(VkPhysicalDeviceFeatures) {
-				0
+				.textureCompressionBC = vctx.texture_compression_bc
 			},
 			.enabledExtensionCount = sizeof(device_extensions) / sizeof(*device_extensions),
 			.ppEnabledExtensionNames = device_extensions,
@@ -1084,6 +1095,8 @@ frame_begin:
 
 	vkResetFences(vctx.device, 1, &vctx.in_flight_fences[vctx.current_frame]);
 
+	refresh_descriptor_sets();
+
 	vkResetCommandBuffer(vctx.command_buffers[vctx.current_frame], 0);
 
 	if (vkBeginCommandBuffer(vctx.command_buffers[vctx.current_frame], &(VkCommandBufferBeginInfo) {
@@ -1222,7 +1235,7 @@ static void init_swapchain(VkSwapchainKHR old_swapchain) {
 
 	/* Create image views. */
 	for (u32 i = 0; i < vctx.swapchain_image_count; i++) {
-		vctx.swapchain_image_views[i] = new_image_view(vctx.swapchain_images[i], vctx.swapchain_format, VK_IMAGE_ASPECT_COLOR_BIT);
+		vctx.swapchain_image_views[i] = new_image_view(vctx.swapchain_images[i], vctx.swapchain_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	}
 }
 
@@ -1374,13 +1387,13 @@ static void init_vk_framebuffer(struct video_vk_framebuffer* fb,
 				usage |= VK_IMAGE_USAGE_STORAGE_BIT;
 			}
 
-			new_image(fb->size, attachment->format, VK_IMAGE_TILING_OPTIMAL,
+			new_image(fb->size, 1, attachment->format, VK_IMAGE_TILING_OPTIMAL,
 				usage,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				&attachment->texture->image, &attachment->texture->memory,
 				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
 			attachment->texture->view = new_image_view(attachment->texture->image,
-				attachment->format, VK_IMAGE_ASPECT_COLOR_BIT);
+				attachment->format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
 			attachment->texture->size = fb->size;
 
@@ -1805,17 +1818,98 @@ static void copy_buffer(VkBuffer dst, VkBuffer src, VkDeviceSize size, VkCommand
 	end_temp_command_buffer(command_buffer, pool, queue);
 }
 
-static void copy_buffer_to_image(VkBuffer buffer, VkImage image, v2i size, VkCommandPool pool, VkQueue queue) {
+/* For block compressed formats, pixel_size is the size of a 4x4 block. */
+struct texture_format_data {
+	VkFormat format;
+	usize pixel_size;
+};
+
+static struct texture_format_data get_texture_format_data(u32 format) {
+	switch (format) {
+		case texture_format_r8i:     return (struct texture_format_data) { VK_FORMAT_R8_UNORM,            1  };
+		case texture_format_r16f:    return (struct texture_format_data) { VK_FORMAT_R16_SFLOAT,          2  };
+		case texture_format_r32f:    return (struct texture_format_data) { VK_FORMAT_R32_SFLOAT,          4  };
+		case texture_format_rg8i:    return (struct texture_format_data) { VK_FORMAT_R8G8_UNORM,          2  };
+		case texture_format_rg16f:   return (struct texture_format_data) { VK_FORMAT_R16G16_SFLOAT,       4  };
+		case texture_format_rg32f:   return (struct texture_format_data) { VK_FORMAT_R32G32_SFLOAT,       8  };
+		case texture_format_rgb8i:   return (struct texture_format_data) { VK_FORMAT_R8G8B8_UNORM,        3  };
+		case texture_format_rgb16f:  return (struct texture_format_data) { VK_FORMAT_R16G16B16_SFLOAT,    6  };
+		case texture_format_rgb32f:  return (struct texture_format_data) { VK_FORMAT_R32G32B32_SFLOAT,    12 };
+		case texture_format_rgba8i:  return (struct texture_format_data) { VK_FORMAT_R8G8B8A8_UNORM,      4  };
+		case texture_format_rgba16f: return (struct texture_format_data) { VK_FORMAT_R16G16B16A16_SFLOAT, 8  };
+		case texture_format_rgba32f: return (struct texture_format_data) { VK_FORMAT_R32G32B32A32_SFLOAT, 16 };
+		case texture_format_bc1:     return (struct texture_format_data) { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 8  };
+		case texture_format_bc3:     return (struct texture_format_data) { VK_FORMAT_BC3_UNORM_BLOCK,      16 };
+		case texture_format_bc4:     return (struct texture_format_data) { VK_FORMAT_BC4_UNORM_BLOCK,      8  };
+		case texture_format_bc5:     return (struct texture_format_data) { VK_FORMAT_BC5_UNORM_BLOCK,      16 };
+		case texture_format_bc7:     return (struct texture_format_data) { VK_FORMAT_BC7_UNORM_BLOCK,      16 };
+	}
+
+	return (struct texture_format_data) { VK_FORMAT_R8G8B8A8_UNORM, 4 };
+}
+
+static VkDeviceSize get_texture_level_size(v2i size, u32 format) {
+	if (bcn_is_block_format(format)) {
+		return (VkDeviceSize)bcn_level_size(size, format);
+	}
+
+	return (VkDeviceSize)size.x * (VkDeviceSize)size.y * (VkDeviceSize)get_texture_format_data(format).pixel_size;
+}
+
+/* Copies every mip level, stored one after the other in the buffer, and
+ * makes the image ready for sampling, all in one submission. */
+static void copy_buffer_to_mips(VkBuffer buffer, VkImage image, v2i size, u32 mip_count, u32 format) {
 	VkCommandBuffer command_buffer = begin_temp_command_buffer(vctx.command_pool);
 
-	vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-		&(VkBufferImageCopy) {
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.subresourceRange.baseMipLevel = 0,
+		.subresourceRange.levelCount = mip_count,
+		.subresourceRange.baseArrayLayer = 0,
+		.subresourceRange.layerCount = 1
+	};
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, null, 0, null, 1, &barrier);
+
+	VkBufferImageCopy* copies = core_alloc(mip_count * sizeof *copies);
+	VkDeviceSize offset = 0;
+
+	for (u32 i = 0; i < mip_count; i++) {
+		v2i mip_size = get_mip_size(size, i);
+
+		copies[i] = (VkBufferImageCopy) {
+			.bufferOffset = offset,
 			.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.imageSubresource.mipLevel = i,
 			.imageSubresource.layerCount = 1,
-			.imageExtent = { (u32)size.x, (u32)size.y, 1 }
-		});
+			.imageExtent = { (u32)mip_size.x, (u32)mip_size.y, 1 }
+		};
 
-	end_temp_command_buffer(command_buffer, pool, queue);
+		offset += get_texture_level_size(mip_size, format);
+	}
+
+	vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_count, copies);
+
+	core_free(copies);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, null, 0, null, 1, &barrier);
+
+	end_temp_command_buffer(command_buffer, vctx.command_pool, vctx.graphics_compute_queue);
 }
 
 static VkDescriptorSetLayout* init_pipeline_descriptors(struct video_vk_pipeline* pipeline, const struct pipeline_descriptor_sets* descriptor_sets) {
@@ -1902,12 +1996,7 @@ static VkDescriptorSetLayout* init_pipeline_descriptors(struct video_vk_pipeline
 		const struct pipeline_descriptor_set* set = descriptor_sets->sets + i;
 		struct video_vk_impl_descriptor_set* v_set = pipeline->desc_sets + i;
 
-		table_set(pipeline->set_table, set->name, v_set);
-
-		v_set->uniforms.hash = table_hash_string;
-		v_set->uniforms.compare = table_compare_string;
-		v_set->uniforms.free_key = table_free_string;
-		v_set->uniforms.copy_key = table_copy_string;
+		table_set(pipeline->set_table, intern_string(set->name), v_set);
 
 		VkDescriptorSetLayoutBinding* layout_bindings = core_calloc(set->count, sizeof(VkDescriptorSetLayoutBinding));
 
@@ -1990,7 +2079,7 @@ static VkDescriptorSetLayout* init_pipeline_descriptors(struct video_vk_pipeline
 				pipeline->uniforms[uniform_idx].size = desc->resource.uniform.size;
 			}
 
-			table_set(v_set->uniforms, desc->name, pipeline->uniforms + uniform_idx);
+			table_set(v_set->uniforms, intern_string(desc->name), pipeline->uniforms + uniform_idx);
 
 			image_info_count = 0;
 			buffer_info_count = 0;
@@ -2082,10 +2171,6 @@ static void init_pipeline(struct video_vk_pipeline* pipeline, u32 flags, const s
 	pipeline->uniforms  = null;
 
 	memset(&pipeline->set_table, 0, sizeof(pipeline->set_table));
-	pipeline->set_table.hash = table_hash_string;
-	pipeline->set_table.compare = table_compare_string;
-	pipeline->set_table.free_key = table_free_string;
-	pipeline->set_table.copy_key = table_copy_string;
 
 	pipeline->flags = flags;
 
@@ -2303,10 +2388,6 @@ static void init_compute_pipeline(struct video_vk_pipeline* pipeline, u32 flags,
 	pipeline->uniforms  = null;
 
 	memset(&pipeline->set_table, 0, sizeof(pipeline->set_table));
-	pipeline->set_table.hash = table_hash_string;
-	pipeline->set_table.compare = table_compare_string;
-	pipeline->set_table.free_key = table_free_string;
-	pipeline->set_table.copy_key = table_copy_string;
 
 	pipeline->flags = flags;
 
@@ -2358,9 +2439,23 @@ static void deinit_pipeline(struct video_vk_pipeline* pipeline) {
 
 	if (pipeline->desc_sets) {
 		for (usize i = 0; i < pipeline->descriptor_set_count; i++) {
-			vkDestroyDescriptorSetLayout(vctx.device, pipeline->desc_sets[i].layout, &vctx.ac);
+			struct video_vk_impl_descriptor_set* desc_set = pipeline->desc_sets + i;
+
+			vkDestroyDescriptorSetLayout(vctx.device, desc_set->layout, &vctx.ac);
+
+			free_table(desc_set->uniforms);
 
-			free_table(pipeline->desc_sets[i].uniforms);
+			/* Destroying the pools frees the spare and retired sets too. */
+			for (usize j = 0; j < vector_count(desc_set->spare_pools); j++) {
+				vkDestroyDescriptorPool(vctx.device, desc_set->spare_pools[j], &vctx.ac);
+			}
+
+			for (usize j = 0; j < max_frames_in_flight; j++) {
+				free_vector(desc_set->retired_sets[j]);
+			}
+
+			free_vector(desc_set->spare_sets);
+			free_vector(desc_set->spare_pools);
 		}
 
 		core_free(pipeline->desc_sets);
@@ -2544,18 +2639,37 @@ void video_vk_recreate_pipeline(struct pipeline* pipeline_) {
 	}
 }
 
-static void impl_video_vk_update_pipeline_uniform(struct pipeline* pipeline_, const char* set, const char* descriptor, const void* data, i32 frame) {
-	struct video_vk_pipeline* pipeline = (struct video_vk_pipeline*)pipeline_;
-
+/* The set and uniform tables are keyed by interned names. Callers that pass
+ * the interned name itself, as the renderers do, are found by pointer
+ * without touching the string; Any other name has to be looked up in the
+ * string pool first. */
+static struct video_vk_impl_descriptor_set* find_descriptor_set(struct video_vk_pipeline* pipeline, const char* set) {
 	struct video_vk_impl_descriptor_set** set_ptr = table_get(pipeline->set_table, set);
+	if (!set_ptr) {
+		const char* set_name = lookup_interned_string(set);
+		set_ptr = set_name ? table_get(pipeline->set_table, set_name) : null;
+	}
+
 	if (!set_ptr) {
 		error("%s: No such descriptor set.", set);
-		return;
+		return null;
 	}
 
-	struct video_vk_impl_descriptor_set* desc_set = *set_ptr;
+	return *set_ptr;
+}
+
+static void impl_video_vk_update_pipeline_uniform(struct pipeline* pipeline_, const char* set, const char* descriptor, const void* data, i32 frame) {
+	struct video_vk_pipeline* pipeline = (struct video_vk_pipeline*)pipeline_;
+
+	struct video_vk_impl_descriptor_set* desc_set = find_descriptor_set(pipeline, set);
+	if (!desc_set) { return; }
 
 	struct video_vk_impl_uniform_buffer** uniform_ptr = table_get(desc_set->uniforms, descriptor);
+	if (!uniform_ptr) {
+		const char* descriptor_name = lookup_interned_string(descriptor);
+		uniform_ptr = descriptor_name ? table_get(desc_set->uniforms, descriptor_name) : null;
+	}
+
 	if (!uniform_ptr) {
 		error("%s: No such uniform buffer on descriptor set `%s'.", descriptor, set);
 		return;
@@ -2586,13 +2700,8 @@ void video_vk_pipeline_push_buffer(struct pipeline* pipeline_, usize offset, usi
 void video_vk_bind_pipeline_descriptor_set(struct pipeline* pipeline_, const char* set, usize target) {
 	struct video_vk_pipeline* pipeline = (struct video_vk_pipeline*)pipeline_;
 
-	struct video_vk_impl_descriptor_set** set_ptr = table_get(pipeline->set_table, set);
-	if (!set_ptr) {
-		error("%s: No such descriptor set.", set);
-		return;
-	}
-
-	struct video_vk_impl_descriptor_set* desc_set = *set_ptr;
+	struct video_vk_impl_descriptor_set* desc_set = find_descriptor_set(pipeline, set);
+	if (!desc_set) { return; }
 
 	VkPipelineBindPoint point = pipeline->flags & pipeline_flags_compute ?
 		VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -2600,6 +2709,215 @@ void video_vk_bind_pipeline_descriptor_set(struct pipeline* pipeline_, const cha
 	vkCmdBindDescriptorSets(pipeline->command_buffers[vctx.current_frame], point,
 		pipeline->layout, (u32)target, 1,
 		desc_set->sets + vctx.current_frame, 0, null);
+
+	desc_set->bound_frames |= 1u << vctx.current_frame;
+}
+
+/* Points every texture descriptor of a set at the pipeline's current
+ * texture for it. The set mustn't be in use by a frame in flight. */
+static void write_set_textures(const struct pipeline_descriptor_set* set, VkDescriptorSet dst) {
+	VkWriteDescriptorSet* writes = core_alloc(set->count * sizeof *writes);
+	VkDescriptorImageInfo* image_infos = core_alloc(set->count * sizeof *image_infos);
+	u32 write_count = 0;
+
+	for (usize i = 0; i < set->count; i++) {
+		const struct pipeline_descriptor* desc = set->descriptors + i;
+		if (desc->resource.type != pipeline_resource_texture) { continue; }
+
+		const struct video_vk_texture* texture = (const struct video_vk_texture*)desc->resource.texture;
+
+		image_infos[write_count] = (VkDescriptorImageInfo) {
+			.imageView = texture->view,
+			.sampler = texture->sampler,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+		};
+
+		writes[write_count] = (VkWriteDescriptorSet) {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = dst,
+			.dstBinding = desc->binding,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.pImageInfo = image_infos + write_count
+		};
+
+		write_count++;
+	}
+
+	vkUpdateDescriptorSets(vctx.device, write_count, writes, 0, null);
+
+	core_free(writes);
+	core_free(image_infos);
+}
+
+#define spare_descriptor_set_batch 8
+
+static void allocate_spare_descriptor_sets(struct video_vk_impl_descriptor_set* desc_set, const struct pipeline_descriptor_set* set) {
+	VkDescriptorPoolSize pool_sizes[4] = {
+		{ .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER },
+		{ .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+		{ .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE }
+	};
+
+	for (usize i = 0; i < set->count; i++) {
+		switch (set->descriptors[i].resource.type) {
+			case pipeline_resource_uniform_buffer:  pool_sizes[0].descriptorCount += spare_descriptor_set_batch; break;
+			case pipeline_resource_texture:         pool_sizes[1].descriptorCount += spare_descriptor_set_batch; break;
+			case pipeline_resource_storage:         pool_sizes[2].descriptorCount += spare_descriptor_set_batch; break;
+			case pipeline_resource_texture_storage: pool_sizes[3].descriptorCount += spare_descriptor_set_batch; break;
+			default: break;
+		}
+	}
+
+	/* Vulkan doesn't allow pool sizes of zero. */
+	u32 pool_size_count = 0;
+	for (usize i = 0; i < 4; i++) {
+		if (pool_sizes[i].descriptorCount > 0) {
+			pool_sizes[pool_size_count++] = pool_sizes[i];
+		}
+	}
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(vctx.device, &(VkDescriptorPoolCreateInfo) {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.poolSizeCount = pool_size_count,
+			.pPoolSizes = pool_sizes,
+			.maxSets = spare_descriptor_set_batch
+		}, &vctx.ac, &pool) != VK_SUCCESS) {
+		abort_with("Failed to create descriptor pool.");
+	}
+
+	vector_push(desc_set->spare_pools, pool);
+
+	VkDescriptorSetLayout layouts[spare_descriptor_set_batch];
+	VkDescriptorSet sets[spare_descriptor_set_batch];
+	for (usize i = 0; i < spare_descriptor_set_batch; i++) {
+		layouts[i] = desc_set->layout;
+	}
+
+	if (vkAllocateDescriptorSets(vctx.device, &(VkDescriptorSetAllocateInfo) {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = pool,
+			.descriptorSetCount = spare_descriptor_set_batch,
+			.pSetLayouts = layouts
+		}, sets) != VK_SUCCESS) {
+		abort_with("Failed to allocate descriptor sets.");
+	}
+
+	for (usize i = 0; i < spare_descriptor_set_batch; i++) {
+		vector_push(desc_set->spare_sets, sets[i]);
+	}
+}
+
+/* Swaps this frame's set for a spare that is a copy of it, since the set
+ * may already be recorded into the frame's command buffer. */
+static VkDescriptorSet swap_in_spare_descriptor_set(struct video_vk_impl_descriptor_set* desc_set, const struct pipeline_descriptor_set* set) {
+	if (vector_count(desc_set->spare_sets) == 0) {
+		allocate_spare_descriptor_sets(desc_set, set);
+	}
+
+	VkDescriptorSet old = desc_set->sets[vctx.current_frame];
+	VkDescriptorSet spare = *vector_pop(desc_set->spare_sets);
+
+	VkCopyDescriptorSet* copies = core_alloc(set->count * sizeof *copies);
+	for (usize i = 0; i < set->count; i++) {
+		copies[i] = (VkCopyDescriptorSet) {
+			.sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET,
+			.srcSet = old,
+			.srcBinding = set->descriptors[i].binding,
+			.dstSet = spare,
+			.dstBinding = set->descriptors[i].binding,
+			.descriptorCount = 1
+		};
+	}
+
+	vkUpdateDescriptorSets(vctx.device, 0, null, (u32)set->count, copies);
+
+	core_free(copies);
+
+	vector_push(desc_set->retired_sets[vctx.current_frame], old);
+	desc_set->sets[vctx.current_frame] = spare;
+	desc_set->bound_frames &= ~(1u << vctx.current_frame);
+
+	return spare;
+}
+
+/* Called once the current frame's fence has been waited on, at which point
+ * nothing that the GPU still has to do uses this frame's sets. */
+static void refresh_descriptor_sets() {
+	u32 frame_bit = 1u << vctx.current_frame;
+
+	for (struct video_vk_pipeline* pipeline = vctx.pipelines.head; pipeline; pipeline = pipeline->next) {
+		for (usize i = 0; i < pipeline->descriptor_set_count; i++) {
+			struct video_vk_impl_descriptor_set* desc_set = pipeline->desc_sets + i;
+
+			for (usize j = 0; j < vector_count(desc_set->retired_sets[vctx.current_frame]); j++) {
+				vector_push(desc_set->spare_sets, desc_set->retired_sets[vctx.current_frame][j]);
+			}
+
+			vector_clear(desc_set->retired_sets[vctx.current_frame]);
+
+			desc_set->bound_frames &= ~frame_bit;
+
+			if (desc_set->stale_frames & frame_bit) {
+				write_set_textures(pipeline->descriptor_sets + i, desc_set->sets[vctx.current_frame]);
+				desc_set->stale_frames &= ~frame_bit;
+			}
+		}
+	}
+}
+
+/* Changing a texture doesn't wait for the GPU or build anything new: Each
+ * frame has its own descriptor set, and the current frame's is written
+ * straight away, or swapped for a copy if it has already been bound. The
+ * sets of the other frames may be in flight, so they're marked stale and
+ * written when their frame begins. Outside of a frame, every set is left
+ * until its frame begins. */
+void video_vk_pipeline_change_texture(struct pipeline* pipeline_, const char* set, const char* descriptor, const struct texture* texture_) {
+	struct video_vk_pipeline* pipeline = (struct video_vk_pipeline*)pipeline_;
+
+	struct video_vk_impl_descriptor_set* desc_set = find_descriptor_set(pipeline, set);
+	if (!desc_set) { return; }
+
+	/* The pipeline keeps its own copy of the descriptors, from which the
+	 * sets are written, and rebuilt if the pipeline is ever re-created. */
+	const struct pipeline_descriptor_set* desc_set_info = pipeline->descriptor_sets + (desc_set - pipeline->desc_sets);
+
+	struct pipeline_descriptor* desc = null;
+	for (usize i = 0; i < desc_set_info->count; i++) {
+		struct pipeline_descriptor* d = (void*)(desc_set_info->descriptors + i);
+
+		if (strcmp(d->name, descriptor) == 0 && d->resource.type == pipeline_resource_texture) {
+			desc = d;
+			break;
+		}
+	}
+
+	if (!desc) {
+		error("%s: No such texture on descriptor set `%s'.", descriptor, set);
+		return;
+	}
+
+	desc->resource.texture = texture_;
+
+	u32 all_frames = (1u << max_frames_in_flight) - 1;
+
+	if (!vctx.in_frame) {
+		desc_set->stale_frames = all_frames;
+		return;
+	}
+
+	u32 frame_bit = 1u << vctx.current_frame;
+
+	VkDescriptorSet dst = desc_set->bound_frames & frame_bit ?
+		swap_in_spare_descriptor_set(desc_set, desc_set_info) :
+		desc_set->sets[vctx.current_frame];
+
+	write_set_textures(desc_set_info, dst);
+
+	desc_set->stale_frames = all_frames & ~frame_bit;
 }
 
 struct storage* video_vk_new_storage(u32 flags, usize size, void* initial_data) {
@@ -3157,39 +3475,30 @@ void video_vk_free_shader(struct shader* shader) {
 	core_free(shader);
 }
 
-struct texture_format_data {
-	VkFormat format;
-	usize pixel_size;
-};
+static void init_texture(struct video_vk_texture* texture, const struct image* image, u32 flags, u32 format) {
+	texture->size = image->size;
 
-static struct texture_format_data get_texture_format_data(u32 format) {
-	switch (format) {
-		case texture_format_r8i:     return (struct texture_format_data) { VK_FORMAT_R8_UNORM,            1  };
-		case texture_format_r16f:    return (struct texture_format_data) { VK_FORMAT_R16_SFLOAT,          2  };
-		case texture_format_r32f:    return (struct texture_format_data) { VK_FORMAT_R32_SFLOAT,          4  };
-		case texture_format_rg8i:    return (struct texture_format_data) { VK_FORMAT_R8G8_UNORM,          2  };
-		case texture_format_rg16f:   return (struct texture_format_data) { VK_FORMAT_R16G16_SFLOAT,       4  };
-		case texture_format_rg32f:   return (struct texture_format_data) { VK_FORMAT_R32G32_SFLOAT,       8  };
-		case texture_format_rgb8i:   return (struct texture_format_data) { VK_FORMAT_R8G8B8_UNORM,        3  };
-		case texture_format_rgb16f:  return (struct texture_format_data) { VK_FORMAT_R16G16B16_SFLOAT,    6  };
-		case texture_format_rgb32f:  return (struct texture_format_data) { VK_FORMAT_R32G32B32_SFLOAT,    12 };
-		case texture_format_rgba8i:  return (struct texture_format_data) { VK_FORMAT_R8G8B8A8_UNORM,      4  };
-		case texture_format_rgba16f: return (struct texture_format_data) { VK_FORMAT_R16G16B16A16_SFLOAT, 8  };
-		case texture_format_rgba32f: return (struct texture_format_data) { VK_FORMAT_R32G32B32A32_SFLOAT, 16 };
-	}
+	/* Block compressed images are decompressed if the device can't sample
+	 * them. */
+	struct image decompressed = { 0 };
 
-	return (struct texture_format_data) { VK_FORMAT_R8G8B8A8_UNORM, 4 };
-}
+	if (bcn_is_block_format(format) && !vctx.texture_compression_bc) {
+		decompress_image(image, format, &decompressed);
 
-static void init_texture(struct video_vk_texture* texture, const struct image* image, u32 flags, u32 format) {
-	texture->size = image->size;
+		image = &decompressed;
+		format = texture_format_rgba8i;
+	}
 
 	struct texture_format_data format_data = get_texture_format_data(format);
 
-	VkDeviceSize image_size =
-		(VkDeviceSize)image->size.x *
-		(VkDeviceSize)image->size.y *
-		(VkDeviceSize)format_data.pixel_size;
+	texture->format = format;
+
+	u32 mip_count = flags & texture_flags_mipmaps ? cr_max(image->mip_count, 1) : 1;
+
+	VkDeviceSize image_size = 0;
+	for (u32 i = 0; i < mip_count; i++) {
+		image_size += get_texture_level_size(get_mip_size(image->size, i), format);
+	}
 
 	VkBuffer stage;
 	struct video_vk_allocation stage_memory;
@@ -3212,20 +3521,20 @@ static void init_texture(struct video_vk_texture* texture, const struct image* i
 		usage |= VK_IMAGE_USAGE_STORAGE_BIT;
 	}
 
-	new_image(image->size, format_data.format, VK_IMAGE_TILING_OPTIMAL,
+	new_image(image->size, mip_count, format_data.format, VK_IMAGE_TILING_OPTIMAL,
 		usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		&texture->image, &texture->memory, VK_IMAGE_LAYOUT_UNDEFINED, false);
-	
-	change_image_layout(texture->image, format_data.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false);
-	copy_buffer_to_image(stage, texture->image, image->size, vctx.command_pool, vctx.graphics_compute_queue);
-	change_image_layout(texture->image, format_data.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+
+	copy_buffer_to_mips(stage, texture->image, image->size, mip_count, format);
 
 	texture->state = texture_state_shader_graphics_read;
 
 	vkDestroyBuffer(vctx.device, stage, &vctx.ac);
 	video_vk_free(&stage_memory);
 
-	texture->view = new_image_view(texture->image, format_data.format, VK_IMAGE_ASPECT_COLOR_BIT);
+	core_free(decompressed.colours);
+
+	texture->view = new_image_view(texture->image, format_data.format, VK_IMAGE_ASPECT_COLOR_BIT, mip_count);
 
 	VkSamplerAddressMode address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	if (flags & texture_flags_clamp) {
@@ -3244,7 +3553,8 @@ static void init_texture(struct video_vk_texture* texture, const struct image* i
 			.unnormalizedCoordinates = VK_FALSE,
 			.compareEnable = VK_FALSE,
 			.compareOp = VK_COMPARE_OP_ALWAYS,
-			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR
+			.mipmapMode = (flags & texture_flags_filter_linear) ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.maxLod = (f32)mip_count
 		}, &vctx.ac, &texture->sampler) != VK_SUCCESS) {
 		abort_with("Failed to create texture sampler.");
 	}
@@ -3480,6 +3790,58 @@ void video_vk_texture_copy_3d(struct texture* dst_, v3i dst_offset, const struct
 	end_temp_command_buffer(command_buffer, vctx.command_pool, vctx.graphics_compute_queue);
 }
 
+void video_vk_update_texture(struct texture* texture_, v2i offset, v2i size, const void* data) {
+	struct video_vk_texture* texture = (struct video_vk_texture*)texture_;
+
+	VkDeviceSize data_size = get_texture_level_size(size, texture->format);
+
+	VkBuffer stage;
+	struct video_vk_allocation stage_memory;
+
+	new_buffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&stage, &stage_memory);
+
+	memcpy(video_vk_map(&stage_memory), data, data_size);
+
+	VkCommandBuffer command_buffer = begin_temp_command_buffer(vctx.command_pool);
+
+	VkImageMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.image = texture->image,
+		.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+		.srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED
+	};
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, null, 0, null, 1, &barrier);
+
+	vkCmdCopyBufferToImage(command_buffer, stage, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+		&(VkBufferImageCopy) {
+			.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+			.imageOffset = { offset.x, offset.y, 0 },
+			.imageExtent = { (u32)size.x, (u32)size.y, 1 }
+	});
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
+		0, 0, null, 0, null, 1, &barrier);
+
+	end_temp_command_buffer(command_buffer, vctx.command_pool, vctx.graphics_compute_queue);
+
+	vkDestroyBuffer(vctx.device, stage, &vctx.ac);
+	video_vk_free(&stage_memory);
+}
+
 void video_vk_texture_barrier(struct texture* texture_, u32 state) {
 	struct video_vk_texture* texture = (struct video_vk_texture*)texture_;
 
@@ -3561,6 +3923,30 @@ void video_vk_texture_barrier(struct texture* texture_, u32 state) {
 	texture->state = state;
 }
 
+/* Pipelines are built from their shader's modules and their textures' views,
+ * so those that use a resource that was reloaded in place must be rebuilt.
+ * A resource that is loaded for the first time isn't used by any. */
+static void recreate_pipelines_using(const void* resource) {
+	for (struct video_vk_pipeline* pipeline = vctx.pipelines.head; pipeline; pipeline = pipeline->next) {
+		bool uses = pipeline->shader == resource;
+
+		for (usize i = 0; !uses && i < vector_count(pipeline->descriptor_sets); i++) {
+			const struct pipeline_descriptor_set* set = pipeline->descriptor_sets + i;
+
+			for (usize j = 0; !uses && j < set->count; j++) {
+				const struct pipeline_resource* r = &set->descriptors[j].resource;
+
+				uses = (r->type == pipeline_resource_texture || r->type == pipeline_resource_texture_storage) &&
+					(const void*)r->texture == resource;
+			}
+		}
+
+		if (uses) {
+			video_vk_recreate_pipeline((struct pipeline*)pipeline);
+		}
+	}
+}
+
 static void shader_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
 	struct shader_header* header = (struct shader_header*)raw;
 
@@ -3572,15 +3958,17 @@ static void shader_on_load(const char* filename, u8* raw, usize raw_size, void*
 	}
 
 	init_shader(payload, header, raw);
+
+	recreate_pipelines_using(payload);
 }
 
 static void shader_on_unload(void* payload, usize payload_size) {
 	deinit_shader(payload);
 }
 
+/* raw is the image from decode_texture_stream. */
 static void texture_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
-	struct image image;
-	init_image_from_raw(&image, raw, raw_size);
+	struct image* image = get_decoded_image(raw);
 
 	u32 flags;
 	if (udata) {
@@ -3589,9 +3977,11 @@ static void texture_on_load(const char* filename, u8* raw, usize raw_size, void*
 		flags = texture_flags_filter_none;
 	}
 
-	init_texture(payload, &image, flags, texture_format_rgba8i);
+	init_texture(payload, image, flags, image->block_format ? image->block_format : texture_format_rgba8i);
+
+	res_report_size(payload_size + get_image_size(image));
 
-	deinit_image(&image);
+	recreate_pipelines_using(payload);
 }
 
 static void texture_on_unload(void* payload, usize payload_size) {
@@ -3616,7 +4006,8 @@ void video_vk_register_resources() {
 		.terminate_raw = false,
 		.alt_raw = bir_error_png,
 		.alt_raw_size = bir_error_png_size,
-		.on_load = shader_on_load,
+		.cook_version = 3,
+		.on_decode_stream = decode_texture_stream,
 		.on_load = texture_on_load,
 		.on_unload = texture_on_unload
 	});
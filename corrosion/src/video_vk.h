@@ -33,6 +33,7 @@ void video_vk_begin_pipeline(const struct pipeline* pipeline);
 void video_vk_end_pipeline(const struct pipeline* pipeline);
 void video_vk_recreate_pipeline(struct pipeline* pipeline);
 void video_vk_update_pipeline_uniform(struct pipeline* pipeline, const char* set, const char* descriptor, const void* data);
+void video_vk_pipeline_change_texture(struct pipeline* pipeline, const char* set, const char* descriptor, const struct texture* texture);
 void video_vk_init_pipeline_uniform(struct pipeline* pipeline, const char* set, const char* descriptor, const void* data);
 void video_vk_pipeline_push_buffer(struct pipeline* pipeline, usize offset, usize size, const void* data);
 void video_vk_bind_pipeline_descriptor_set(struct pipeline* pipeline, const char* set, usize target);
@@ -68,6 +69,7 @@ void video_vk_free_texture(struct texture* texture);
 v2i  video_vk_get_texture_size(const struct texture* texture);
 v3i  video_vk_get_texture_3d_size(const struct texture* texture);
 void video_vk_texture_copy(struct texture* dst, v2i dst_offset, const struct texture* src, v2i src_offset, v2i dimensions);
+void video_vk_update_texture(struct texture* texture, v2i offset, v2i size, const void* data);
 void video_vk_texture_copy_3d(struct texture* dst, v3i dst_offset, const struct texture* src, v3i src_offset, v3i dimensions);
 void video_vk_texture_barrier(struct texture* texture, u32 state);
 
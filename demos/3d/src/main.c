@@ -40,7 +40,8 @@ struct app_config cr_config() {
 			.title = "3D Renderer",
 			.size = make_v2i(1920, 1080),
 			.resizable = true
-		}
+		},
+		.cook_dir = "cooked"
 	};
 }
 
@@ -60,6 +61,11 @@ void cr_init() {
 	app.world = new_world(app.renderer);
 	app.world->draw_debug = true;
 
+	/* Models and textures are read and decoded on the worker threads while
+	 * the scene is being set up, and waited on at the end. */
+	vector(struct resource) loading = null;
+	struct resource r;
+
 	for (usize i = 0; i < 100; i++) {
 		struct entity* obj = new_entity(app.world, eb_mesh | eb_spin);
 		obj->transform = m4f_translation(make_v3f(rand_flt() * 100.0f, rand_flt() * 100.0f, rand_flt() * 100.0f));
@@ -68,22 +74,28 @@ void cr_init() {
 		f32 v = rand_flt();
 
 		if (v > 0.6666f) {
-			obj->model = load_model("meshes/monkey.fbx", null);
+			obj->model = load_model_async("meshes/monkey.fbx", &r);
 		} else if (v > 0.3333f) {
-			obj->model = load_model("meshes/sphere.fbx", null);
+			obj->model = load_model_async("meshes/sphere.fbx", &r);
 		} else {
-			obj->model = load_model("meshes/torus.fbx", null);
+			obj->model = load_model_async("meshes/torus.fbx", &r);
 		}
 
+		vector_push(loading, r);
+
+		const u32 diffuse_flags = texture_flags_filter_linear | texture_flags_mipmaps | texture_flags_compress;
+
 		v = rand_flt();
 		if (v > 0.6666f) {
-			obj->material.diffuse_map = load_texture("textures/bricks_diffuse.png", texture_flags_filter_linear, null);
+			obj->material.diffuse_map = load_texture_async("textures/bricks_diffuse.png", diffuse_flags, &r);
 		} else if (v > 0.3333f) {
-			obj->material.diffuse_map = load_texture("textures/cobble_diffuse.png", texture_flags_filter_linear, null);
+			obj->material.diffuse_map = load_texture_async("textures/cobble_diffuse.png", diffuse_flags, &r);
 		} else {
-			obj->material.diffuse_map = load_texture("textures/wood_diffuse.png", texture_flags_filter_linear, null);
+			obj->material.diffuse_map = load_texture_async("textures/wood_diffuse.png", diffuse_flags, &r);
 		}
 
+		vector_push(loading, r);
+
 		obj->spin_speed = rand_flt() * 100.0f;
 		obj->material.diffuse = make_v3f(rand_flt() * 2.0f, rand_flt() * 2.0f, rand_flt() * 2.0f);
 	}
@@ -97,6 +109,12 @@ void cr_init() {
 		light->light.position = make_v3f(rand_flt() * 100.0f, rand_flt() * 100.0f, rand_flt() * 100.0f);
 	}
 
+	for (usize i = 0; i < vector_count(loading); i++) {
+		res_wait(&loading[i]);
+	}
+
+	free_vector(loading);
+
 	app.camera_active = false;
 	app.first_move = true;
 }
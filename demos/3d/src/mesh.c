@@ -19,18 +19,41 @@ static struct model_node process_node(ufbx_scene* scene, ufbx_node* node) {
 	return rnode;
 }
 
-static struct mesh process_mesh(ufbx_scene* scene, ufbx_mesh* mesh) {
-	struct mesh rmesh = { 0 };
-
-	rmesh.bound.min = make_v3f( INFINITY,  INFINITY,  INFINITY);
-	rmesh.bound.max = make_v3f(-INFINITY, -INFINITY, -INFINITY);
+/* A model is cooked into a single allocation without pointers, so that the
+ * resource manager can cache it on disk: A header, then the nodes, then
+ * every mesh, each followed by its instances, vertices and indices. Every
+ * part starts on a sixteen byte boundary. */
+struct cooked_model {
+	u32 node_count;
+	u32 mesh_count;
+};
+
+struct cooked_mesh {
+	struct aabb bound;
+	u32 instance_count;
+	u32 vertex_count;
+	u32 index_count;
+};
+
+#define cooked_align(s_) (((s_) + 15) & ~(usize)15)
+
+struct mesh_data {
+	struct cooked_mesh header;
+
+	vector(u32) instances;
+	vector(struct mesh_vertex) vertices;
+	vector(u32) indices;
+};
+
+static struct mesh_data process_mesh(ufbx_scene* scene, ufbx_mesh* mesh) {
+	struct mesh_data data = { 0 };
+
+	data.header.bound.min = make_v3f( INFINITY,  INFINITY,  INFINITY);
+	data.header.bound.max = make_v3f(-INFINITY, -INFINITY, -INFINITY);
 
 	vector(u32) tri_indices = null;
 	vector_allocate(tri_indices, mesh->max_face_triangles * 3);
 
-	vector(struct mesh_vertex) vertices = null;
-	vector(u32) indices = null;
-
 	for (usize i = 0; i < mesh->faces.count; i++) {
 		ufbx_face face = mesh->faces.data[i];
 		usize tri_count = ufbx_triangulate_face(tri_indices, mesh->max_face_triangles * 3, mesh, face);
@@ -44,12 +67,14 @@ static struct mesh process_mesh(ufbx_scene* scene, ufbx_mesh* mesh) {
 			ufbx_vec3 normal = ufbx_get_vertex_vec3(&mesh->vertex_normal, idx);
 			ufbx_vec2 uv = mesh->vertex_uv.exists ? ufbx_get_vertex_vec2(&mesh->vertex_uv, idx) : default_uv;
 
-			rmesh.bound.min.x = cr_min((f32)pos.x, rmesh.bound.min.x);
-			rmesh.bound.min.y = cr_min((f32)pos.y, rmesh.bound.min.y);
-			rmesh.bound.min.z = cr_min((f32)pos.z, rmesh.bound.min.z);
-			rmesh.bound.max.x = cr_max((f32)pos.x, rmesh.bound.max.x);
-			rmesh.bound.max.y = cr_max((f32)pos.y, rmesh.bound.max.y);
-			rmesh.bound.max.z = cr_max((f32)pos.z, rmesh.bound.max.z);
+			struct aabb* bound = &data.header.bound;
+
+			bound->min.x = cr_min((f32)pos.x, bound->min.x);
+			bound->min.y = cr_min((f32)pos.y, bound->min.y);
+			bound->min.z = cr_min((f32)pos.z, bound->min.z);
+			bound->max.x = cr_max((f32)pos.x, bound->max.x);
+			bound->max.y = cr_max((f32)pos.y, bound->max.y);
+			bound->max.z = cr_max((f32)pos.z, bound->max.z);
 
 			struct mesh_vertex v = {
 				.position = make_v3f(pos.x,    pos.y,    pos.z),
@@ -57,45 +82,48 @@ static struct mesh process_mesh(ufbx_scene* scene, ufbx_mesh* mesh) {
 				.uv       = make_v2f(uv.x, uv.y)
 			};
 
-			vector_push(vertices, v);
+			vector_push(data.vertices, v);
 
-			vector_push(indices, 0);
+			vector_push(data.indices, 0);
 		}
 	}
 
 	ufbx_vertex_stream streams[] = {
 		{
-			streams[0].data = vertices,
+			streams[0].data = data.vertices,
 			streams[0].vertex_size = sizeof(struct mesh_vertex),
 		}
 	};
 
 	ufbx_error r;
-	usize vertex_count = ufbx_generate_indices(streams, 1, indices, vector_count(indices), null, &r);
+	usize vertex_count = ufbx_generate_indices(streams, 1, data.indices, vector_count(data.indices), null, &r);
 	if (r.type != UFBX_ERROR_NONE) {
 		abort_with("Failed to generate mesh indices.");
 	}
 
-	vector_allocate(rmesh.instances, mesh->instances.count);
+	vector_allocate(data.instances, mesh->instances.count);
 	for (usize i = 0; i < mesh->instances.count; i++) {
-		vector_push(rmesh.instances, (usize)mesh->instances.data[i]->typed_id);
+		vector_push(data.instances, mesh->instances.data[i]->typed_id);
 	}
 
-	rmesh.vb = video.new_vertex_buffer(vertices, vertex_count * sizeof *vertices, vertex_buffer_flags_none);
-	rmesh.ib = video.new_index_buffer(indices, vector_count(indices), index_buffer_flags_u32);
-
-	rmesh.count = vector_count(indices);
+	data.header.instance_count = (u32)vector_count(data.instances);
+	data.header.vertex_count = (u32)vertex_count;
+	data.header.index_count = (u32)vector_count(data.indices);
 
-	free_vector(vertices);
-	free_vector(indices);
 	free_vector(tri_indices);
 
-	return rmesh;
+	return data;
 }
 
-void init_model_from_fbx(struct model* model, const u8* raw, usize raw_size) {
-	memset(model, 0, sizeof *model);
+static usize mesh_data_size(const struct cooked_mesh* header) {
+	return
+		cooked_align(sizeof *header) +
+		cooked_align(header->instance_count * sizeof(u32)) +
+		cooked_align(header->vertex_count * sizeof(struct mesh_vertex)) +
+		cooked_align(header->index_count * sizeof(u32));
+}
 
+static struct ufbx_scene* parse_fbx(const u8* raw, usize raw_size) {
 	ufbx_load_opts opts = {
 		.load_external_files = true,
 		.allow_null_material = true,
@@ -110,16 +138,134 @@ void init_model_from_fbx(struct model* model, const u8* raw, usize raw_size) {
 		.strict = true
 	};
 
-	ufbx_scene* scene = ufbx_load_memory(raw, raw_size, null, null);
+	return ufbx_load_memory(raw, raw_size, null, null);
+}
+
+static usize fbx_stream_read(void* user, void* data, usize size) {
+	return res_stream_read(user, data, size);
+}
+
+static bool fbx_stream_skip(void* user, usize size) {
+	return res_stream_skip(user, (i64)size);
+}
+
+static u8* cook_fbx_scene(ufbx_scene* scene, usize* cooked_size) {
+	if (!scene) {
+		*cooked_size = 0;
+		return null;
+	}
+
+	struct cooked_model header = {
+		.node_count = (u32)scene->nodes.count,
+		.mesh_count = (u32)scene->meshes.count
+	};
+
+	struct mesh_data* meshes = core_alloc(header.mesh_count * sizeof *meshes);
 
-	vector_allocate(model->nodes, scene->nodes.count);
-	for (usize i = 0; i < scene->nodes.count; i++) {
-		vector_push(model->nodes, process_node(scene, scene->nodes.data[i]));
+	usize size = cooked_align(sizeof header) + cooked_align(header.node_count * sizeof(struct model_node));
+
+	for (usize i = 0; i < header.mesh_count; i++) {
+		meshes[i] = process_mesh(scene, scene->meshes.data[i]);
+		size += mesh_data_size(&meshes[i].header);
 	}
 
-	vector_allocate(model->meshes, scene->meshes.count);
-	for (usize i = 0; i < scene->meshes.count; i++) {
-		vector_push(model->meshes, process_mesh(scene, scene->meshes.data[i]));
+	u8* cooked = core_calloc(1, size);
+	u8* cursor = cooked;
+
+	memcpy(cursor, &header, sizeof header);
+	cursor += cooked_align(sizeof header);
+
+	for (usize i = 0; i < header.node_count; i++) {
+		struct model_node node = process_node(scene, scene->nodes.data[i]);
+		memcpy(cursor + i * sizeof node, &node, sizeof node);
+	}
+
+	cursor += cooked_align(header.node_count * sizeof(struct model_node));
+
+	for (usize i = 0; i < header.mesh_count; i++) {
+		struct mesh_data* mesh = meshes + i;
+
+		memcpy(cursor, &mesh->header, sizeof mesh->header);
+		cursor += cooked_align(sizeof mesh->header);
+
+		memcpy(cursor, mesh->instances, mesh->header.instance_count * sizeof(u32));
+		cursor += cooked_align(mesh->header.instance_count * sizeof(u32));
+
+		memcpy(cursor, mesh->vertices, mesh->header.vertex_count * sizeof(struct mesh_vertex));
+		cursor += cooked_align(mesh->header.vertex_count * sizeof(struct mesh_vertex));
+
+		memcpy(cursor, mesh->indices, mesh->header.index_count * sizeof(u32));
+		cursor += cooked_align(mesh->header.index_count * sizeof(u32));
+
+		free_vector(mesh->instances);
+		free_vector(mesh->vertices);
+		free_vector(mesh->indices);
+	}
+
+	core_free(meshes);
+	ufbx_free_scene(scene);
+
+	*cooked_size = size;
+	return cooked;
+}
+
+u8* cook_fbx(const u8* raw, usize raw_size, usize* cooked_size) {
+	return cook_fbx_scene(parse_fbx(raw, raw_size), cooked_size);
+}
+
+u8* cook_fbx_stream(struct res_stream* stream, usize* cooked_size) {
+	const ufbx_stream fbx_stream = {
+		.read_fn = fbx_stream_read,
+		.skip_fn = fbx_stream_skip,
+		.user    = stream
+	};
+
+	return cook_fbx_scene(ufbx_load_stream(&fbx_stream, null, null), cooked_size);
+}
+
+void init_model_from_cooked(struct model* model, const u8* cooked) {
+	memset(model, 0, sizeof *model);
+
+	struct cooked_model header;
+	memcpy(&header, cooked, sizeof header);
+	cooked += cooked_align(sizeof header);
+
+	vector_allocate(model->nodes, header.node_count);
+	for (usize i = 0; i < header.node_count; i++) {
+		struct model_node node;
+		memcpy(&node, cooked + i * sizeof node, sizeof node);
+		vector_push(model->nodes, node);
+	}
+
+	cooked += cooked_align(header.node_count * sizeof(struct model_node));
+
+	vector_allocate(model->meshes, header.mesh_count);
+	for (usize i = 0; i < header.mesh_count; i++) {
+		struct cooked_mesh mesh_header;
+		memcpy(&mesh_header, cooked, sizeof mesh_header);
+
+		const u8* instances = cooked + cooked_align(sizeof mesh_header);
+		const u8* vertices  = instances + cooked_align(mesh_header.instance_count * sizeof(u32));
+		const u8* indices   = vertices + cooked_align(mesh_header.vertex_count * sizeof(struct mesh_vertex));
+
+		struct mesh mesh = {
+			.bound = mesh_header.bound,
+			.count = mesh_header.index_count
+		};
+
+		vector_allocate(mesh.instances, mesh_header.instance_count);
+		for (usize j = 0; j < mesh_header.instance_count; j++) {
+			u32 instance;
+			memcpy(&instance, instances + j * sizeof instance, sizeof instance);
+			vector_push(mesh.instances, instance);
+		}
+
+		mesh.vb = video.new_vertex_buffer(vertices, mesh_header.vertex_count * sizeof(struct mesh_vertex), vertex_buffer_flags_none);
+		mesh.ib = video.new_index_buffer(indices, mesh_header.index_count, index_buffer_flags_u32);
+
+		vector_push(model->meshes, mesh);
+
+		cooked += mesh_data_size(&mesh_header);
 	}
 
 	model->bound = (struct aabb) {
@@ -146,8 +292,19 @@ void init_model_from_fbx(struct model* model, const u8* raw, usize raw_size) {
 			model->mesh_count++;
 		}
 	}
+}
 
-	ufbx_free_scene(scene);
+void init_model_from_fbx(struct model* model, const u8* raw, usize raw_size) {
+	usize cooked_size;
+	u8* cooked = cook_fbx(raw, raw_size, &cooked_size);
+
+	if (cooked) {
+		init_model_from_cooked(model, cooked);
+	} else {
+		memset(model, 0, sizeof *model);
+	}
+
+	core_free(cooked);
 }
 
 void deinit_model(struct model* model) {
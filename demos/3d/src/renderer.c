@@ -3,8 +3,25 @@
 #define renderer_vert_buffer_bind_point 0
 #define renderer_inst_buffer_bind_point 1
 
+/* Descriptor names, interned once so that the calls made every frame find
+ * them by pointer instead of hashing the strings. */
+static struct {
+	const char* primary;
+	const char* vertex_config;
+	const char* fragment_config;
+	const char* lighting_buffer;
+	const char* diffuse_atlas;
+} names;
+
+static u8* mesh_on_decode(const char* filename, struct res_stream* stream, usize* decoded_size, void* udata) {
+	return cook_fbx_stream(stream, decoded_size);
+}
+
+/* raw holds the model from cook_fbx. */
 static void mesh_on_load(const char* filename, u8* raw, usize raw_size, void* payload, usize payload_size, void* udata) {
-	init_model_from_fbx(payload, raw, raw_size);
+	if (!raw) { return; }
+
+	init_model_from_cooked(payload, raw);
 }
 
 static void mesh_on_unload(void* payload, usize payload_size) {
@@ -16,6 +33,8 @@ void register_renderer_resources() {
 		.payload_size = sizeof(struct model),
 		.free_raw_on_load = true,
 		.terminate_raw = false,
+		.cook_version = 1,
+		.on_decode_stream = mesh_on_decode,
 		.on_load = mesh_on_load,
 		.on_unload = mesh_on_unload
 	});
@@ -32,6 +51,11 @@ struct model* load_model(const char* filename, struct resource* r) {
 	return r->payload;
 }
 
+struct model* load_model_async(const char* filename, struct resource* r) {
+	*r = res_load_async("model", filename, null);
+	return r->payload;
+}
+
 static void create_pipeline(struct renderer* renderer) {
 	const struct shader* shader = load_shader("shaders/lit.csh", null);
 
@@ -163,6 +187,12 @@ struct renderer* new_renderer(const struct framebuffer* framebuffer) {
 	struct renderer* renderer = core_calloc(1, sizeof *renderer);
 	renderer->target_fb = framebuffer;
 
+	names.primary         = intern_string("primary");
+	names.vertex_config   = intern_string("VertexConfig");
+	names.fragment_config = intern_string("FragmentConfig");
+	names.lighting_buffer = intern_string("LightingBuffer");
+	names.diffuse_atlas   = intern_string("diffuse_atlas");
+
 	renderer->scene_fb = video.new_framebuffer(framebuffer_flags_fit | framebuffer_flags_headless, get_window_size(), (struct framebuffer_attachment_desc[]) {
 		{
 			.name = "colour",
@@ -314,6 +344,7 @@ void renderer_begin(struct renderer* renderer) {
 	for (struct mesh** i = table_first(renderer->drawlist); i; i = table_next(renderer->drawlist, *i)) {
 		struct mesh_instance* instance = table_get(renderer->drawlist, *i);
 		instance->count = 0;
+		instance->frame_data = null;
 
 		instance->data.count = 0;
 	}
@@ -330,8 +361,16 @@ void renderer_end(struct renderer* renderer, struct camera* camera) {
 	renderer->fragment_config.camera_pos   = camera->position;
 	renderer->lighting_buffer.camera_pos = camera->position;
 
-	video.update_pipeline_uniform(renderer->pipeline, "primary", "VertexConfig",   &renderer->vertex_config);
-	video.update_pipeline_uniform(renderer->pipeline, "primary", "FragmentConfig", &renderer->fragment_config);
+	for (struct mesh** i = table_first(renderer->drawlist); i; i = table_next(renderer->drawlist, *i)) {
+		struct mesh_instance* instance = table_get(renderer->drawlist, *i);
+
+		if (instance->count > 0) {
+			vertex_vector_push(&instance->data, instance->frame_data, instance->count);
+		}
+	}
+
+	video.update_pipeline_uniform(renderer->pipeline, names.primary, names.vertex_config,   &renderer->vertex_config);
+	video.update_pipeline_uniform(renderer->pipeline, names.primary, names.fragment_config, &renderer->fragment_config);
 
 	video.begin_framebuffer(renderer->scene_fb);
 		video.begin_pipeline(renderer->pipeline);
@@ -342,7 +381,7 @@ void renderer_end(struct renderer* renderer, struct camera* camera) {
 				video.bind_vertex_buffer(mesh->vb,              renderer_vert_buffer_bind_point);
 				video.bind_vertex_buffer(instance->data.buffer, renderer_inst_buffer_bind_point);
 				video.bind_index_buffer(mesh->ib);
-				video.bind_pipeline_descriptor_set(renderer->pipeline, "primary", 0);
+				video.bind_pipeline_descriptor_set(renderer->pipeline, names.primary, 0);
 				video.draw_indexed(mesh->count, 0, instance->count);
 			}
 		video.end_pipeline(renderer->pipeline);
@@ -360,10 +399,10 @@ void renderer_push(struct renderer* renderer, struct mesh* mesh, struct material
 
 	v4i* diffuse_atlas_rect = table_get(renderer->diffuse_atlas->rects, material->diffuse_map);
 	if (!diffuse_atlas_rect) {
+		/* Growing the atlas keeps the rects where they were, so the
+		 * instances pushed so far stay valid. */
 		if (atlas_add_texture(renderer->diffuse_atlas, material->diffuse_map)) {
-			video.free_pipeline(renderer->pipeline);
-			create_pipeline(renderer);
-			return;
+			video.pipeline_change_texture(renderer->pipeline, names.primary, names.diffuse_atlas, renderer->diffuse_atlas->texture);
 		}
 
 		diffuse_atlas_rect = table_get(renderer->diffuse_atlas->rects, material->diffuse_map);
@@ -378,7 +417,7 @@ void renderer_push(struct renderer* renderer, struct mesh* mesh, struct material
 		.diffuse_rect = make_v4f(diffuse_atlas_rect->x, diffuse_atlas_rect->y, diffuse_atlas_rect->z, diffuse_atlas_rect->w)
 	};
 
-	vertex_vector_push(&instance->data, &data, 1);
+	arena_vector_push(get_frame_arena(), instance->frame_data, data);
 
 	instance->count++;
 }
@@ -399,11 +438,11 @@ void renderer_push_light(struct renderer* renderer, const struct light* light) {
 }
 
 void renderer_finalise(struct renderer* renderer) {
-	video.update_pipeline_uniform(renderer->lighting_pipeline, "primary", "LightingBuffer", &renderer->lighting_buffer);
+	video.update_pipeline_uniform(renderer->lighting_pipeline, names.primary, names.lighting_buffer, &renderer->lighting_buffer);
 
 	video.begin_pipeline(renderer->lighting_pipeline);
 		video.bind_vertex_buffer(renderer->tri_vb, 0);
-		video.bind_pipeline_descriptor_set(renderer->lighting_pipeline, "primary", 0);
+		video.bind_pipeline_descriptor_set(renderer->lighting_pipeline, names.primary, 0);
 		video.draw(3, 0, 1);
 	video.end_pipeline(renderer->lighting_pipeline);
 }
@@ -47,6 +47,15 @@ struct model {
 };
 
 void init_model_from_fbx(struct model* model, const u8* raw, usize raw_size);
+
+/* Parsing is split from building the model so that it can be done on a
+ * worker thread. cook_fbx flattens the scene into a buffer from core_alloc
+ * that holds no pointers, which the resource manager can cache on disk, and
+ * init_model_from_cooked uploads it. cook_fbx_stream parses the file as it
+ * reads it, instead of needing all of it in memory. */
+u8* cook_fbx(const u8* raw, usize raw_size, usize* cooked_size);
+u8* cook_fbx_stream(struct res_stream* stream, usize* cooked_size);
+void init_model_from_cooked(struct model* model, const u8* cooked);
 void deinit_model(struct model* model);
 
 struct mesh_vertex {
@@ -58,6 +67,10 @@ struct mesh_vertex {
 struct mesh_instance {
 	usize count;
 	struct vertex_vector data;
+
+	/* Instance data pushed this frame, uploaded in one go by renderer_end.
+	 * Allocated from the frame arena. */
+	vector(struct mesh_instance_data) frame_data;
 };
 
 struct material {
@@ -107,6 +120,7 @@ struct renderer {
 
 void register_renderer_resources();
 struct model* load_model(const char* filename, struct resource* r);
+struct model* load_model_async(const char* filename, struct resource* r);
 
 struct renderer* new_renderer(const struct framebuffer* framebuffer);
 void free_renderer(struct renderer* renderer);
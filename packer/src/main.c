@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <corrosion/core.h>
+#include <corrosion/job.h>
+#include <corrosion/res.h>
+#include <corrosion/timer.h>
+
+/* Usage: packer [-c none|lz4|lz4hc] [-p previous.pak] output.pak files and directories...
+ *
+ * Directories are added recursively. Entries are named after the paths as
+ * they are given. With -p, contents that are unchanged since the previous
+ * package are copied from it instead of being compressed again; It may be
+ * the output itself.
+ *
+ * The output is only replaced if the new package was written in full. The
+ * exit code is non-zero if anything went wrong, including inputs that had
+ * to be left out. */
+
+static vector(struct pak_write_file) files;
+static usize missing_count;
+
+static void add_path(const char* path, u32 compression) {
+	struct file_info info;
+	if (!get_file_info(path, &info)) {
+		error("`%s' doesn't exist.", path);
+		missing_count++;
+		return;
+	}
+
+	if (info.type != file_directory) {
+		vector_push(files, ((struct pak_write_file) {
+			.src         = copy_string(path),
+			.dst         = copy_string(path),
+			.compression = compression
+		}));
+
+		return;
+	}
+
+	struct dir_iter* it = new_dir_iter(path);
+	if (!it) {
+		error("Failed to read directory `%s'.", path);
+		missing_count++;
+		return;
+	}
+
+	/* The iterator's entry is only valid if the directory isn't empty. */
+	if (dir_iter_cur(it)->iter) {
+		do {
+			add_path(dir_iter_cur(it)->name, compression);
+		} while (dir_iter_next(it));
+	}
+
+	free_dir_iter(it);
+}
+
+static bool parse_compression(const char* name, u32* compression) {
+	if (strcmp(name, "none") == 0) {
+		*compression = pak_compression_none;
+	} else if (strcmp(name, "lz4") == 0) {
+		*compression = pak_compression_lz4;
+	} else if (strcmp(name, "lz4hc") == 0) {
+		*compression = pak_compression_lz4_hc;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+static f64 mib(u64 bytes) {
+	return (f64)bytes / (1024.0 * 1024.0);
+}
+
+i32 main(i32 argc, const char** argv) {
+	u32 compression = pak_compression_lz4;
+	const char* previous_path = null;
+
+	i32 arg = 1;
+
+	for (; arg < argc && argv[arg][0] == '-'; arg++) {
+		if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc) {
+			if (!parse_compression(argv[++arg], &compression)) {
+				error("Unknown compression method `%s'.", argv[arg]);
+				return 1;
+			}
+		} else if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+			previous_path = argv[++arg];
+		} else {
+			break;
+		}
+	}
+
+	if (argc - arg < 2) {
+		error("Usage: %s [-c none|lz4|lz4hc] [-p previous.pak] output.pak files...", argv[0]);
+		return 1;
+	}
+
+	alloc_init();
+	jobs_init(0);
+	init_timer();
+
+	const char* outname = argv[arg++];
+
+	for (; arg < argc; arg++) {
+		add_path(argv[arg], compression);
+	}
+
+	struct res_pak* previous = null;
+
+	if (previous_path) {
+		FILE* test = fopen(previous_path, "rb");
+
+		/* A missing previous package just means that everything is new. */
+		if (test) {
+			fclose(test);
+			previous = pak_open(previous_path, 0);
+		}
+	}
+
+	/* The package is written next to the output and moved into place at
+	 * the end, since the previous package may be the output itself. */
+	char* tempname = core_alloc(strlen(outname) + 5);
+	strcpy(tempname, outname);
+	strcat(tempname, ".tmp");
+
+	struct pak_write_stats stats;
+
+	u64 start = get_timer();
+	usize written = write_pak_v2(tempname, files, vector_count(files), previous, &stats);
+	f64 seconds = (f64)(get_timer() - start) / (f64)get_timer_frequency();
+
+	if (previous) {
+		pak_close(previous);
+	}
+
+	i32 result = 0;
+
+	/* The temporary file replaces the output in one step, so that whatever
+	 * happens, either the old package or the new one is in place. On
+	 * Windows, rename refuses to replace an existing file. */
+	bool moved = false;
+
+	if (written == 0) {
+		remove(tempname);
+		result = 1;
+	} else {
+#ifdef _WIN32
+		moved = MoveFileExA(tempname, outname, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		moved = rename(tempname, outname) == 0;
+#endif
+
+		if (!moved) {
+			error("Failed to move `%s' to `%s'.", tempname, outname);
+			remove(tempname);
+			result = 1;
+		}
+	}
+
+	usize skipped_count = missing_count + stats.skipped_count;
+
+	if (skipped_count > 0) {
+		error("%zu input%s could not be read and %s left out.", skipped_count,
+			skipped_count == 1 ? "" : "s", skipped_count == 1 ? "was" : "were");
+		result = 1;
+	}
+
+	if (!moved) {
+		info("`%s' was left as it was.", outname);
+	} else {
+		info("Packed %zu files into `%s'.", stats.file_count, outname);
+		info("  Input:        %10.2f MiB", mib(stats.input_bytes));
+		info("  Deduplicated: %10.2f MiB", mib(stats.deduplicated_bytes));
+		info("  Reused:       %10.2f MiB", mib(stats.reused_bytes));
+		info("  Output:       %10.2f MiB (%.1f%%)", mib(stats.output_bytes),
+			stats.input_bytes ? 100.0 * (f64)stats.output_bytes / (f64)stats.input_bytes : 0.0);
+		info("  Throughput:   %10.2f MiB/s in %.3f s", seconds > 0.0 ? mib(stats.input_bytes) / seconds : 0.0, seconds);
+	}
+
+	for (usize i = 0; i < vector_count(files); i++) {
+		core_free((char*)files[i].src);
+		core_free((char*)files[i].dst);
+	}
+
+	free_vector(files);
+	core_free(tempname);
+
+	jobs_deinit();
+	frame_arena_deinit();
+	leak_check();
+	alloc_deinit();
+
+	return result;
+}